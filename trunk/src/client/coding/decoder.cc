@@ -28,9 +28,38 @@ void* Decoder::thread_handler(void* param){
         /* get share objects */
         obj->inputbuffer_[index]->Extract(&temp);
 
+        /* exit indicator */
+        if(temp.secretSize == DECODE_EXIT) pthread_exit(NULL);
+
+        /* pass the abort indicator to collect thread */
+        if(temp.secretSize == DECODE_ABORT){
+            input.secretSize = DECODE_ABORT;
+            obj->outputbuffer_[index]->Insert(&input,sizeof(input));
+            continue;
+        }
+
         /* decode shares */
         input.secretSize = temp.secretSize;
-        obj->decodeObj_[index]->decoding((unsigned char*)temp.data, obj->kShareIDList_, temp.shareSize, temp.secretSize, (unsigned char*)input.data);
+        input.offset = temp.offset;
+        obj->decodeObj_[index]->decoding((unsigned char*)temp.data, temp.shareIDList, temp.shareSize, temp.secretSize, (unsigned char*)input.data);
+
+        /* trim the secret to the output range (for a range restore) */
+        if(input.offset < 0){
+            input.secretSize += input.offset;
+            if(input.secretSize < 0) input.secretSize = 0;
+            memmove(input.data, input.data + temp.secretSize - input.secretSize, input.secretSize);
+            input.offset = 0;
+        }
+        if(obj->fileSize_ >= 0 && input.offset + input.secretSize > obj->fileSize_){
+            input.secretSize = obj->fileSize_ - input.offset;
+            if(input.secretSize < 0) input.secretSize = 0;
+        }
+
+        /* in positional mode, write the secret directly without waiting for other threads */
+        if(obj->positional_){
+            obj->writeSecret(input.data, input.secretSize, input.offset);
+            continue;
+        }
 
         /* add secret into output buffer */
         obj->outputbuffer_[index]->Insert(&input,sizeof(input));
@@ -48,41 +77,69 @@ void* Decoder::collect(void* param){
     /* parse parameters */
     char* buf = (char*)malloc(FWRITE_BUFFER_SIZE);
     Decoder* obj = (Decoder*)param;
-    int count = 0;
+    int count;
     int i;
-    int out_index = 0;
+    int out_index;
 
-    /* main loop for get secrets */
+    /* main loop for files */
     while(true){
 
-        /* according to thread sequence */
-        for(i = 0; i < DECODE_NUM_THREADS; i++){
-            Secret_t temp;
+        /* wait for the total number of secrets of next file (in ordered mode) */
+        pthread_mutex_lock(&(obj->fileLock_));
+        while((obj->fileInProgress_ == 0 || obj->positional_) && obj->exit_ == 0){
+            pthread_cond_wait(&(obj->startCond_), &(obj->fileLock_));
+        }
+        int inProgress = obj->fileInProgress_ && !obj->positional_;
+        pthread_mutex_unlock(&(obj->fileLock_));
 
-            /* extract secret object */
-            obj->outputbuffer_[i]->Extract(&temp);
+        /* exit when no file left */
+        if(inProgress == 0) break;
 
-            /* if write buffer full then write to file */
-            if(out_index + temp.secretSize > FWRITE_BUFFER_SIZE){
-                fwrite(buf, out_index,1,obj->fw_);
-                out_index = 0;
-            }
+        count = 0;
+        out_index = 0;
 
-            /* copy secret to write buffer */
-            memcpy(buf+out_index, temp.data, temp.secretSize);
-            out_index += temp.secretSize;
+        /* get secrets according to thread sequence */
+        int aborted = 0;
+        while(count < obj->totalSecrets_ && !aborted){
+            for(i = 0; i < DECODE_NUM_THREADS && count < obj->totalSecrets_; i++){
+                Secret_t temp;
 
-            /* if this is the last secret, write to file and  exit the collect */
-            count++;
-            if(count == obj->totalSecrets_) {
-                if(out_index > 0){
-                    fwrite(buf, out_index, 1, obj->fw_);
+                /* extract secret object */
+                obj->outputbuffer_[i]->Extract(&temp);
+
+                /* the rest of file is not coming */
+                if(temp.secretSize == DECODE_ABORT){
+                    aborted = 1;
+                    break;
                 }
-                free(buf);
-                pthread_exit(NULL);
+
+                /* if write buffer full then write to file */
+                if(out_index + temp.secretSize > FWRITE_BUFFER_SIZE){
+                    if(fwrite(buf, out_index,1,obj->fw_) != 1) obj->writeError_ = 1;
+                    out_index = 0;
+                }
+
+                /* copy secret to write buffer */
+                memcpy(buf+out_index, temp.data, temp.secretSize);
+                out_index += temp.secretSize;
+                obj->writtenBytes_ += temp.secretSize;
+                count++;
             }
         }
+
+        /* this is the end of file, write the rest to file */
+        if(out_index > 0){
+            if(fwrite(buf, out_index, 1, obj->fw_) != 1) obj->writeError_ = 1;
+        }
+
+        /* tell the waiting side the file is done */
+        pthread_mutex_lock(&(obj->fileLock_));
+        obj->writtenSecrets_ = count;
+        obj->fileInProgress_ = 0;
+        pthread_cond_broadcast(&(obj->endCond_));
+        pthread_mutex_unlock(&(obj->fileLock_));
     }
+    free(buf);
     return NULL;
 }
 
@@ -118,6 +175,24 @@ Decoder::Decoder(int type, int n, int m, int r, int securetype){
         pthread_create(&tid_[i],0,&thread_handler,(void*)temp);
     }
 
+    /* initialize file signaling */
+    totalSecrets_ = 0;
+    fileInProgress_ = 0;
+    writtenSecrets_ = 0;
+    writtenBytes_ = 0;
+    writeError_ = 0;
+    fileSize_ = 0;
+    positional_ = 0;
+    writeFlags_ = 0;
+    outFd_ = -1;
+    baseOffset_ = 0;
+    directFd_ = -1;
+    exit_ = 0;
+    pthread_mutex_init(&extentLock_, NULL);
+    pthread_mutex_init(&fileLock_, NULL);
+    pthread_cond_init(&startCond_, NULL);
+    pthread_cond_init(&endCond_, NULL);
+
     /* create collect thread */
     pthread_create(&tid_[DECODE_NUM_THREADS],0,&collect,(void*)this);
 
@@ -125,17 +200,164 @@ Decoder::Decoder(int type, int n, int m, int r, int securetype){
 }
 
 /* 
- * test whether the decode thread returned
+ * wait until all secrets of the current file are written
  */
 int Decoder::indicateEnd(){
-    pthread_join(tid_[DECODE_NUM_THREADS], NULL);
+    pthread_mutex_lock(&fileLock_);
+    while(fileInProgress_ == 1){
+        pthread_cond_wait(&endCond_, &fileLock_);
+    }
+    pthread_mutex_unlock(&fileLock_);
+
+    if(positional_){
+        /* write out the extents not filled up (the tail of a file or an aborted file), their holes are left zero */
+        pthread_mutex_lock(&extentLock_);
+        map<long, directExtent_t*>::iterator it;
+        for(it = extents_.begin(); it != extents_.end(); it++){
+            directExtent_t* extent = it->second;
+            if(!pwriteAll(outFd_, extent->buffer, extent->end, baseOffset_ + it->first)) writeError_ = 1;
+            free(extent->buffer);
+            free(extent);
+        }
+        extents_.clear();
+        pthread_mutex_unlock(&extentLock_);
+
+        if(directFd_ != -1){
+            close(directFd_);
+            directFd_ = -1;
+        }
+
+        /* drop the preallocated space beyond what has been written */
+        if((writeFlags_ & DECODE_WRITE_FALLOCATE) && fileSize_ > 0 && writtenBytes_ != fileSize_){
+            if(ftruncate(outFd_, baseOffset_ + writtenBytes_) != 0){
+                fprintf(stderr, "Error: fail to truncate the output file %d\n", errno);
+            }
+        }
+
+        /* keep the file position after the written data */
+        fseek(fw_, baseOffset_ + writtenBytes_, SEEK_SET);
+    }
+    return !writeError_;
+}
+
+/*
+ * write a buffer at an offset of a descriptor completely
+ *
+ * @param fd - the descriptor
+ * @param data - the data buffer
+ * @param size - the data size
+ * @param offset - the offset in file
+ *
+ */
+int Decoder::pwriteAll(int fd, char* data, long size, long offset){
+    long total = 0;
+    while(total < size){
+        ssize_t ret = pwrite(fd, data+total, size-total, offset+total);
+        if(ret <= 0){
+            fprintf(stderr, "Error: fail to write the output file %d\n", errno);
+            return 0;
+        }
+        total += ret;
+    }
     return 1;
 }
 
+/*
+ * write a secret at its offset of the output (positional mode)
+ *
+ * @param data - the secret data
+ * @param size - the secret size
+ * @param offset - the offset of the secret in file
+ *
+ */
+void Decoder::writeSecret(char* data, int size, long offset){
+    int ok = 1;
+    if(directFd_ == -1){
+        ok = pwriteAll(outFd_, data, size, baseOffset_ + offset);
+    }else{
+        /* copy the secret into the aligned extents it covers */
+        int done = 0;
+        while(done < size){
+            long pos = offset + done;
+            long extentOffset = pos - pos%DIRECT_EXTENT_SIZE;
+            int piece = extentOffset + DIRECT_EXTENT_SIZE - pos;
+            if(piece > size - done) piece = size - done;
+
+            pthread_mutex_lock(&extentLock_);
+            map<long, directExtent_t*>::iterator it = extents_.find(extentOffset);
+            directExtent_t* extent;
+            if(it == extents_.end()){
+                extent = (directExtent_t*)malloc(sizeof(directExtent_t));
+                extent->filled = 0;
+                extent->end = 0;
+                extent->length = DIRECT_EXTENT_SIZE;
+                if(fileSize_ - extentOffset < DIRECT_EXTENT_SIZE) extent->length = fileSize_ - extentOffset;
+                if(posix_memalign((void**)&(extent->buffer), DIRECT_IO_ALIGN, DIRECT_EXTENT_SIZE) != 0){
+                    fprintf(stderr, "Error: fail to allocate aligned buffer\n");
+                    exit(1);
+                }
+                memset(extent->buffer, 0, DIRECT_EXTENT_SIZE);
+                extents_[extentOffset] = extent;
+            }else{
+                extent = it->second;
+            }
+            pthread_mutex_unlock(&extentLock_);
+
+            /* different secrets fill disjoint parts of an extent */
+            memcpy(extent->buffer + (pos - extentOffset), data + done, piece);
+
+            pthread_mutex_lock(&extentLock_);
+            extent->filled += piece;
+            if(pos - extentOffset + piece > extent->end) extent->end = pos - extentOffset + piece;
+            bool full = (extent->filled == extent->length);
+            if(full) extents_.erase(extentOffset);
+            pthread_mutex_unlock(&extentLock_);
+
+            /* the thread completing an extent writes it, a partial tail goes through the normal descriptor */
+            if(full){
+                if(extent->length % DIRECT_IO_ALIGN == 0){
+                    if(!pwriteAll(directFd_, extent->buffer, extent->length, baseOffset_ + extentOffset)) ok = 0;
+                }else{
+                    if(!pwriteAll(outFd_, extent->buffer, extent->length, baseOffset_ + extentOffset)) ok = 0;
+                }
+                free(extent->buffer);
+                free(extent);
+            }
+            done += piece;
+        }
+    }
+
+    /* count the written secret, the file is done when all are written */
+    pthread_mutex_lock(&fileLock_);
+    if(!ok) writeError_ = 1;
+    writtenSecrets_++;
+    writtenBytes_ += size;
+    if(writtenSecrets_ == totalSecrets_){
+        fileInProgress_ = 0;
+        pthread_cond_broadcast(&endCond_);
+    }
+    pthread_mutex_unlock(&fileLock_);
+}
+
 /*
  * decoder destructor
  */
 Decoder::~Decoder(){
+    /* stop collect thread */
+    pthread_mutex_lock(&fileLock_);
+    exit_ = 1;
+    pthread_cond_broadcast(&startCond_);
+    pthread_mutex_unlock(&fileLock_);
+    pthread_join(tid_[DECODE_NUM_THREADS], NULL);
+
+    /* stop decode threads */
+    ShareChunk_t exitItem;
+    exitItem.secretSize = DECODE_EXIT;
+    for (int i = 0; i < DECODE_NUM_THREADS; i++){
+        inputbuffer_[i]->Insert(&exitItem, sizeof(ShareChunk_t));
+        pthread_join(tid_[i], NULL);
+    }
+
     for (int i = 0; i < DECODE_NUM_THREADS; i++){
         delete(decodeObj_[i]);
         delete(cryptoObj_[i]);
@@ -145,6 +367,10 @@ Decoder::~Decoder(){
     free(inputbuffer_);
     free(outputbuffer_);
     free(cryptoObj_);
+    pthread_mutex_destroy(&extentLock_);
+    pthread_mutex_destroy(&fileLock_);
+    pthread_cond_destroy(&startCond_);
+    pthread_cond_destroy(&endCond_);
 }
 
 /*
@@ -165,18 +391,57 @@ int Decoder::add(ShareChunk_t* item, int index){
  * @param fp - the output file pointer
  */
 int Decoder::setFilePointer(FILE* fp){
+    struct stat st;
     fw_ = fp;
+
+    /* only a regular file supports writing out of order */
+    fflush(fw_);
+    outFd_ = fileno(fw_);
+    baseOffset_ = lseek(outFd_, 0, SEEK_CUR);
+    positional_ = (fstat(outFd_, &st) == 0 && S_ISREG(st.st_mode) && baseOffset_ != -1);
     return 1;
 }
 
+/*
+ * set the write options for positional mode
+ *
+ * @param flags - DECODE_WRITE_FALLOCATE and/or DECODE_WRITE_DIRECT
+ */
+int Decoder::setWriteOptions(int flags){
+    writeFlags_ = flags;
+    return 1;
+}
 
 /*
- * set the share list
+ * get the number of bytes written of the last file
+ */
+long Decoder::getWrittenSize(){
+    return writtenBytes_;
+}
+
+
+/*
+ * end current file early, after the secrets added so far
+ *
+ * @param numOfSecrets - the number of secrets added of the file
  *
- * @param list - the share ID list indicate the shares come from which clouds
  */
-int Decoder::setShareIDList(int* list){
-    kShareIDList_ = list;
+int Decoder::abortFile(int numOfSecrets){
+    /* in ordered mode, the indicator goes to the thread of the next secret so that collect thread meets it in sequence */
+    if(!positional_){
+        ShareChunk_t abortItem;
+        abortItem.secretSize = DECODE_ABORT;
+        add(&abortItem, numOfSecrets%DECODE_NUM_THREADS);
+        return 1;
+    }
+
+    pthread_mutex_lock(&fileLock_);
+    totalSecrets_ = numOfSecrets;
+    if(writtenSecrets_ >= totalSecrets_){
+        fileInProgress_ = 0;
+        pthread_cond_broadcast(&endCond_);
+    }
+    pthread_mutex_unlock(&fileLock_);
     return 1;
 }
 
@@ -184,10 +449,39 @@ int Decoder::setShareIDList(int* list){
  * pass the total secret number to decoder
  *
  * @param n - the total number of secrets in the file
+ * @param fileSize - the output size (of the file or its range), negative if unknown
  *
  */
-int Decoder::setTotal(int totalSecrets){
+int Decoder::setTotal(int totalSecrets, long fileSize){
+    fileSize_ = fileSize;
+    writtenSecrets_ = 0;
+    writtenBytes_ = 0;
+    writeError_ = 0;
+
+    if(positional_ && fileSize_ > 0){
+        /* reserve the whole file in one go to avoid fragmentation from out-of-order writes */
+        if(writeFlags_ & DECODE_WRITE_FALLOCATE){
+            if(fallocate(outFd_, 0, baseOffset_, fileSize_) != 0 && errno != EOPNOTSUPP){
+                fprintf(stderr, "Error: fail to preallocate the output file %d\n", errno);
+            }
+        }
+
+        /* O_DIRECT writes need an aligned start, fall back to normal writes otherwise */
+        if((writeFlags_ & DECODE_WRITE_DIRECT) && baseOffset_ % DIRECT_IO_ALIGN == 0){
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", outFd_);
+            directFd_ = open(path, O_WRONLY | O_DIRECT);
+            if(directFd_ == -1){
+                fprintf(stderr, "Error: fail to open the output file with O_DIRECT %d\n", errno);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&fileLock_);
     totalSecrets_ = totalSecrets;
+    fileInProgress_ = (totalSecrets > 0);
+    pthread_cond_broadcast(&startCond_);
+    pthread_mutex_unlock(&fileLock_);
     return 1;
 }
 
@@ -5,6 +5,12 @@
 #ifndef __DECODER_HH__
 #define __DECODER_HH__
 
+#include <map>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "CDCodec.hh"
 #include "BasicRingBuffer.hh"
 #include "CryptoPrimitive.hh"
@@ -24,6 +30,23 @@
 /* max write buffer size */
 #define FWRITE_BUFFER_SIZE (4*1024*1024)
 
+/* secret size indicating decode threads to exit */
+#define DECODE_EXIT (-1)
+
+/* secret size indicating the rest of a file is not coming (ordered mode) */
+#define DECODE_ABORT (-2)
+
+/* max number of shares used to decode a secret */
+#define MAX_DECODE_SHARES 16
+
+/* write options for positional restore */
+#define DECODE_WRITE_FALLOCATE 1
+#define DECODE_WRITE_DIRECT 2
+
+/* alignment and extent size of O_DIRECT writes */
+#define DIRECT_IO_ALIGN 4096
+#define DIRECT_EXTENT_SIZE (1024*1024)
+
 using namespace std;
 
 class Decoder{
@@ -38,6 +61,7 @@ class Decoder{
         typedef struct{
             char data[SECRET_SIZE];
             int secretSize;
+            long offset;
         }Secret_t;
 
         /* share metadata structure */
@@ -45,8 +69,18 @@ class Decoder{
             char data[SHARE_BUFFER_SIZE];
             int secretSize;
             int shareSize;
+            long offset;
+            int shareIDList[MAX_DECODE_SHARES];
         }ShareChunk_t;
 
+        /* aligned extent assembled from secrets for O_DIRECT writes */
+        typedef struct{
+            char* buffer;
+            int filled;
+            int length;
+            int end;      // end of the filled parts, for writing a partial extent
+        }directExtent_t;
+
         /* input share buffer */
         RingBuffer<ShareChunk_t>** inputbuffer_;
 
@@ -59,15 +93,50 @@ class Decoder{
         /* total number of secrets */
         int totalSecrets_;
 
+        /* indicator of a file being decoded (1) or finished (0) */
+        int fileInProgress_;
+
+        /* number of secrets and bytes written of current file */
+        int writtenSecrets_;
+        long writtenBytes_;
+
+        /* indicator of a failed write of current file */
+        int writeError_;
+
+        /* output size of current file or its range, secrets are trimmed to it (negative if unknown) */
+        long fileSize_;
+
+        /* positional mode: decode threads write secrets at their offsets, out of order */
+        int positional_;
+
+        /* write options for positional mode */
+        int writeFlags_;
+
+        /* output descriptor and its position when the file starts */
+        int outFd_;
+        long baseOffset_;
+
+        /* O_DIRECT descriptor of output, -1 if not used */
+        int directFd_;
+
+        /* extents being assembled for O_DIRECT writes, keyed by file offset */
+        map<long, directExtent_t*> extents_;
+        pthread_mutex_t extentLock_;
+
+        /* indicator for collect thread to exit */
+        int exit_;
+
+        /* lock and conditions for signaling start and end of a file */
+        pthread_mutex_t fileLock_;
+        pthread_cond_t startCond_;
+        pthread_cond_t endCond_;
+
         /* total number of clouds */
         int n_;
 
         /* output file pointer */
         FILE* fw_;
 
-        /* share ID list pointer */
-        int* kShareIDList_;
-
         /* crypto object array */
         CryptoPrimitive** cryptoObj_;
 
@@ -96,24 +165,59 @@ class Decoder{
 
         /*
          * set the total number of secrets we need to decode
+         * (this starts decoding a new file)
          *
          * @param total - the total number of secrets
+         * @param fileSize - the output size (of the file or its range), negative if unknown
          */
-        int setTotal(int totalSecrets);
+        int setTotal(int totalSecrets, long fileSize);
 
         /*
          * set the file output pointer
+         * (a regular file is written at secret offsets by decode threads,
+         * others such as pipes are written in order by collect thread)
          *
          * @param fp - the output file pointer
          */
         int setFilePointer(FILE* fp);
 
         /*
-         * set the k shareID list
+         * set the write options for positional mode
+         *
+         * @param flags - DECODE_WRITE_FALLOCATE and/or DECODE_WRITE_DIRECT
+         */
+        int setWriteOptions(int flags);
+
+        /*
+         * get the number of bytes written of the last file
+         */
+        long getWrittenSize();
+
+        /*
+         * write a secret at its offset of the output (positional mode)
          *
-         * @param list - the given kShareIDList
+         * @param data - the secret data
+         * @param size - the secret size
+         * @param offset - the offset of the secret in file
          */
-        int setShareIDList(int* list);
+        void writeSecret(char* data, int size, long offset);
+
+        /*
+         * write a buffer at an offset of a descriptor completely
+         *
+         * @param fd - the descriptor
+         * @param data - the data buffer
+         * @param size - the data size
+         * @param offset - the offset in file
+         */
+        static int pwriteAll(int fd, char* data, long size, long offset);
+
+        /*
+         * end current file early, after the secrets added so far
+         *
+         * @param numOfSecrets - the number of secrets added of the file
+         */
+        int abortFile(int numOfSecrets);
 
         /*
          * add a share into particular ringbuffer
@@ -124,9 +228,10 @@ class Decoder{
         int add(ShareChunk_t* item, int index);
 
         /*
-         * test if it's the end of decoding a file
-         *
+         * wait until the end of decoding a file
+         * (partially filled extents of O_DIRECT writes are written out)
          *
+         * @return 1 if the file is written, 0 on a write error
          */
         int indicateEnd();
 
@@ -35,6 +35,10 @@ void* Encoder::thread_handler(void* param){
         if(type == FILE_OBJECT){
             /* if it's file header */
             memcpy(&input.file_header, &temp.file_header, sizeof(fileHead_t));
+        }else if(type == ENCODE_EXIT){
+            /* if it's exit indicator, pass it to collect thread and exit */
+            obj->outputbuffer_[index]->Insert(&input,sizeof(input));
+            pthread_exit(NULL);
         }else{
 
             /* if it's share object */
@@ -73,6 +77,9 @@ void* Encoder::collect(void* param){
         /* get the object type */
         int type = temp.type;
 
+        /* exit indicator comes after all objects of the last file */
+        if(type == ENCODE_EXIT) pthread_exit(NULL);
+
         Uploader::Item_t input;
         if(type == FILE_OBJECT){
 
@@ -90,7 +97,7 @@ void* Encoder::collect(void* param){
             int tmp_s;
 
             //encode pathname into shares for privacy
-            obj->encodeObj_[0]->encoding(temp.file_header.data, temp.file_header.fullNameSize, tmp, &(tmp_s));
+            obj->nameEncodeObj_->encoding(temp.file_header.data, temp.file_header.fullNameSize, tmp, &(tmp_s));
             
             input.fileObj.file_header.fullNameSize = tmp_s;
 
@@ -179,6 +186,8 @@ Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* upload
     }
 
     uploadObj_ = uploaderObj;
+    nameCryptoObj_ = new CryptoPrimitive(securetype);
+    nameEncodeObj_ = new CDCodec(type,n,m,r, nameCryptoObj_);
 
     /* create collect thread */
     pthread_create(&tid_[NUM_THREADS],0,&collect,(void*)this);
@@ -189,6 +198,16 @@ Encoder::Encoder(int type, int n, int m, int r, int securetype, Uploader* upload
  *
  */
 Encoder::~Encoder(){
+    /* stop threads, starting from the next buffer so collect sees exit in order */
+    Secret_Item_t exitItem;
+    exitItem.type = ENCODE_EXIT;
+    for (int i = 0; i < NUM_THREADS; i++){
+        add(&exitItem);
+    }
+    for (int i = 0; i < NUM_THREADS+1; i++){
+        pthread_join(tid_[i], NULL);
+    }
+
     for (int i = 0; i < NUM_THREADS; i++){
         delete(cryptoObj_[i]);
         delete(encodeObj_[i]);
@@ -198,6 +217,8 @@ Encoder::~Encoder(){
     free(inputbuffer_);
     free(outputbuffer_);
     free(cryptoObj_);
+    delete(nameEncodeObj_);
+    delete(nameCryptoObj_);
 }
 
 /*
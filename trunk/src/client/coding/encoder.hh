@@ -24,6 +24,10 @@
 
 /* object type indicators */
 #define FILE_OBJECT 1
+#define ENCODE_EXIT 2
+
+/* file size in header of a streamed file, the final size is sent in trailer */
+#define FILE_SIZE_UNKNOWN (-1)
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
@@ -42,7 +46,7 @@ class Encoder{
         typedef struct{
             unsigned char data[SECRET_SIZE];
             int fullNameSize;
-            int fileSize;
+            long fileSize;
         }fileHead_t;
 
         /* secret metadata structure */
@@ -98,6 +102,12 @@ class Encoder{
         /* coding object array */
         CDCodec* encodeObj_[NUM_THREADS];
 
+        /* coding object for file names (used by collect thread only) */
+        CDCodec* nameEncodeObj_;
+
+        /* crypto object for file names */
+        CryptoPrimitive* nameCryptoObj_;
+
         /* uploader object */
         Uploader* uploadObj_;
 
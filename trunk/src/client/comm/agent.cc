@@ -0,0 +1,496 @@
+/*
+ * agent.cc
+ */
+
+#include "agent.hh"
+
+using namespace std;
+
+/*
+ * send a buffer completely
+ *
+ * @param sock - the socket
+ * @param buf - the buffer
+ * @param size - the size of buffer
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int sendAll(int sock, const char* buf, int size){
+    int sent = 0;
+    while (sent < size) {
+        int ret = send(sock, buf+sent, size-sent, MSG_NOSIGNAL);
+        if (ret <= 0) return 0;
+        sent += ret;
+    }
+    return 1;
+}
+
+/*
+ * receive a buffer completely
+ *
+ * @param sock - the socket
+ * @param buf - the buffer
+ * @param size - the size of buffer
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int recvAll(int sock, char* buf, int size){
+    int recvd = 0;
+    while (recvd < size) {
+        int ret = recv(sock, buf+recvd, size-recvd, 0);
+        if (ret <= 0) return 0;
+        recvd += ret;
+    }
+    return 1;
+}
+
+/*
+ * send a job request together with a file descriptor
+ *
+ * @param sock - the socket
+ * @param request - the job request
+ * @param fd - the file descriptor to pass, -1 for none
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int sendRequest(int sock, Agent::jobRequest_t* request, int fd){
+    if (fd == -1) return sendAll(sock, (char*)request, sizeof(Agent::jobRequest_t));
+
+    struct msghdr msg;
+    struct iovec iov;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = request;
+    iov.iov_len = sizeof(Agent::jobRequest_t);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    /* the descriptor goes with the first bytes of the request */
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    int ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if (ret <= 0) return 0;
+    return sendAll(sock, (char*)request+ret, sizeof(Agent::jobRequest_t)-ret);
+}
+
+/*
+ * receive a job request and the file descriptor passed with it
+ *
+ * @param sock - the socket
+ * @param request - the returned job request
+ * @param fd - the returned file descriptor, -1 for none
+ *
+ * @return 1 on success, 0 on failure
+ */
+static int recvRequest(int sock, Agent::jobRequest_t* request, int* fd){
+    struct msghdr msg;
+    struct iovec iov;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = request;
+    iov.iov_len = sizeof(Agent::jobRequest_t);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    *fd = -1;
+    int ret = recvmsg(sock, &msg, 0);
+    if (ret <= 0) return 0;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (!recvAll(sock, (char*)request+ret, sizeof(Agent::jobRequest_t)-ret)) {
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * worker thread handler
+ *
+ * @param param - agent object pointer
+ */
+void* Agent::thread_handler(void* param){
+    Agent* obj = (Agent*)param;
+
+    while(true){
+        pthread_mutex_lock(&(obj->lock_));
+        while(obj->runnable_.empty() && obj->pendingSocks_.empty()){
+            pthread_cond_wait(&(obj->jobCond_), &(obj->lock_));
+        }
+
+        /* receive new job requests first, so that a stalled submitter only holds one worker */
+        if(!obj->pendingSocks_.empty()){
+            int clientSock = obj->pendingSocks_.front();
+            obj->pendingSocks_.pop_front();
+            pthread_mutex_unlock(&(obj->lock_));
+
+            obj->receiveJob_(clientSock);
+            continue;
+        }
+
+        /* take the next session in round robin */
+        sessionEntry_t* entry = obj->runnable_.front();
+        obj->runnable_.pop_front();
+        entry->runnable = false;
+        entry->running = true;
+        job_t* job = entry->jobQueue.front();
+        entry->jobQueue.pop_front();
+        pthread_mutex_unlock(&(obj->lock_));
+
+        /* run one job, then give other sessions a turn */
+        obj->runJob_(entry, job);
+
+        pthread_mutex_lock(&(obj->lock_));
+        entry->running = false;
+        if(!entry->jobQueue.empty()){
+            entry->runnable = true;
+            obj->runnable_.push_back(entry);
+            pthread_cond_signal(&(obj->jobCond_));
+        }
+        pthread_mutex_unlock(&(obj->lock_));
+    }
+    return NULL;
+}
+
+/*
+ * idle session reaper thread handler
+ *
+ * @param param - agent object pointer
+ */
+void* Agent::reap_handler(void* param){
+    Agent* obj = (Agent*)param;
+
+    while(true){
+        sleep(AGENT_REAP_INTERVAL);
+
+        deque<Session*> evicted;
+        pthread_mutex_lock(&(obj->lock_));
+        obj->evictIdleSessions_(evicted);
+        pthread_mutex_unlock(&(obj->lock_));
+
+        /* close evicted sessions out of the lock */
+        for (size_t i = 0; i < evicted.size(); i++) {
+            delete evicted[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * run a job on its session
+ *
+ * @param entry - the session entry (owned by the calling worker while running)
+ * @param job - the job to run
+ */
+void Agent::runJob_(sessionEntry_t* entry, job_t* job){
+    Session* session = entry->session;
+    jobRequest_t* request = &(job->request);
+    jobReply_t reply;
+    memset(&reply, 0, sizeof(jobReply_t));
+
+    if (request->action == AGENT_BACKUP) {
+        FILE* fin = fopen(request->path, "r");
+        if (fin == NULL) {
+            fprintf(stderr, "Error: fail to open %s!\n", request->path);
+        } else {
+            fseek(fin,0,SEEK_END);
+            long size = ftell(fin);
+            fseek(fin,0,SEEK_SET);
+            reply.status = session->backup(request->name, request->nameSize, fin, size,
+                    &(reply.bw), &(reply.total), &(reply.unique), &(reply.zero));
+            fclose(fin);
+        }
+    } else if (request->action == AGENT_STREAM_BACKUP) {
+        FILE* fin = (job->streamFd == -1) ? NULL : fdopen(job->streamFd, "r");
+        if (fin == NULL) {
+            fprintf(stderr, "Error: no input stream for %s!\n", request->name);
+        } else {
+            reply.status = session->backup(request->name, request->nameSize, fin, FILE_SIZE_UNKNOWN,
+                    &(reply.bw), &(reply.total), &(reply.unique), &(reply.zero));
+            fclose(fin);
+            job->streamFd = -1;
+        }
+    } else if (request->action == AGENT_RESTORE) {
+        FILE* fw = fopen(request->path, "wb");
+        if (fw == NULL) {
+            fprintf(stderr, "Error: fail to open %s!\n", request->path);
+        } else {
+            reply.status = session->restore(request->name, request->nameSize, fw, &(reply.bw));
+            fclose(fw);
+        }
+    } else {
+        fprintf(stderr, "Error: unknown job action %d!\n", request->action);
+    }
+
+    sendAll(job->clientSock, (char*)&reply, sizeof(jobReply_t));
+    if (job->streamFd != -1) close(job->streamFd);
+    close(job->clientSock);
+    free(job);
+}
+
+/*
+ * find the session entry of a job, create it if needed
+ * (called with lock held)
+ *
+ * @param request - the job request
+ * @param evicted - returned idle sessions to be deleted by caller
+ */
+Agent::sessionEntry_t* Agent::findOrCreateSession_(jobRequest_t* request, deque<Session*>& evicted){
+    sessionKey_t key(request->userID, request->securetype);
+    map<sessionKey_t, sessionEntry_t*>::iterator it = sessions_.find(key);
+    if (it != sessions_.end()) return it->second;
+
+    /* close sessions idle for too long, and the least recently used one if still full */
+    evictIdleSessions_(evicted);
+    map<sessionKey_t, sessionEntry_t*>::iterator lru = sessions_.end();
+    for (it = sessions_.begin(); it != sessions_.end(); it++) {
+        sessionEntry_t* entry = it->second;
+        if (entry->running || !entry->jobQueue.empty()) continue;
+        if (lru == sessions_.end() || entry->session->getLastUsed() < lru->second->session->getLastUsed()) {
+            lru = it;
+        }
+    }
+    if (sessions_.size() >= AGENT_MAX_SESSIONS && lru != sessions_.end()) {
+        evicted.push_back(lru->second->session);
+        delete lru->second;
+        sessions_.erase(lru);
+    }
+
+    sessionEntry_t* entry = new sessionEntry_t;
+    entry->session = new Session(request->userID, request->securetype, confObj_);
+    entry->running = false;
+    entry->runnable = false;
+    sessions_[key] = entry;
+    return entry;
+}
+
+/*
+ * take out the sessions idle for too long
+ * (called with lock held)
+ *
+ * @param evicted - returned idle sessions to be deleted by caller
+ */
+void Agent::evictIdleSessions_(deque<Session*>& evicted){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    double now = (double)tv.tv_sec+(double)tv.tv_usec*1e-6;
+
+    map<sessionKey_t, sessionEntry_t*>::iterator it = sessions_.begin();
+    while (it != sessions_.end()) {
+        sessionEntry_t* entry = it->second;
+        if (!entry->running && entry->jobQueue.empty() &&
+                now - entry->session->getLastUsed() > AGENT_SESSION_IDLE_TIME) {
+            evicted.push_back(entry->session);
+            delete entry;
+            sessions_.erase(it++);
+            continue;
+        }
+        it++;
+    }
+}
+
+/*
+ * receive the job request of an accepted connection and queue it to its session
+ *
+ * @param clientSock - the connection
+ */
+void Agent::receiveJob_(int clientSock){
+    /* do not let a stalled submitter hold the worker for long */
+    struct timeval timeout;
+    timeout.tv_sec = AGENT_RECV_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(clientSock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    job_t* job = (job_t*)malloc(sizeof(job_t));
+    job->clientSock = clientSock;
+    if (!recvRequest(clientSock, &(job->request), &(job->streamFd))) {
+        fprintf(stderr, "Error: fail to receive job request\n");
+        close(clientSock);
+        free(job);
+        return;
+    }
+
+    /* make sure the names are terminated */
+    jobRequest_t* request = &(job->request);
+    request->path[PATH_MAX-1] = '\0';
+    if (request->nameSize <= 0 || request->nameSize > AGENT_NAME_SIZE) {
+        fprintf(stderr, "Error: invalid file name size in job request\n");
+        if (job->streamFd != -1) close(job->streamFd);
+        close(clientSock);
+        free(job);
+        return;
+    }
+    request->name[request->nameSize-1] = '\0';
+
+    /* the user ID must be one the agent serves */
+    if (!userIDs_.empty() && userIDs_.find(request->userID) == userIDs_.end()) {
+        fprintf(stderr, "Error: job request of user ID %d not served by the agent\n", request->userID);
+        if (job->streamFd != -1) close(job->streamFd);
+        close(clientSock);
+        free(job);
+        return;
+    }
+
+    /* queue the job to its session */
+    deque<Session*> evicted;
+    pthread_mutex_lock(&lock_);
+    sessionEntry_t* entry = findOrCreateSession_(request, evicted);
+    entry->jobQueue.push_back(job);
+    if (!entry->running && !entry->runnable) {
+        entry->runnable = true;
+        runnable_.push_back(entry);
+        pthread_cond_signal(&jobCond_);
+    }
+    pthread_mutex_unlock(&lock_);
+
+    /* close evicted sessions out of the lock */
+    for (size_t i = 0; i < evicted.size(); i++) {
+        delete evicted[i];
+    }
+}
+
+/*
+ * constructor: bind and listen on the agent socket
+ *
+ * @param socketPath - path of the Unix domain socket
+ * @param confObj - configuration object
+ * @param userIDs - user IDs served by the agent, any user ID if empty
+ */
+Agent::Agent(const char* socketPath, Configuration* confObj, const vector<int>& userIDs){
+    confObj_ = confObj;
+    userIDs_.insert(userIDs.begin(), userIDs.end());
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&jobCond_, NULL);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: agent socket path is too long!\n");
+        exit(1);
+    }
+    strcpy(addr.sun_path, socketPath);
+    strcpy(socketPath_, socketPath);
+
+    /* remove stale socket file of a previous agent */
+    unlink(socketPath_);
+
+    hostSock_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (hostSock_ == -1) {
+        fprintf(stderr, "Error: initializing socket %d\n", errno);
+        exit(1);
+    }
+    /* only the owner of the agent may connect to the socket */
+    mode_t mask = umask(0177);
+    if (bind(hostSock_, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error: binding to %s: %d\n", socketPath_, errno);
+        exit(1);
+    }
+    umask(mask);
+    if (chmod(socketPath_, S_IRUSR | S_IWUSR) == -1) {
+        fprintf(stderr, "Error: setting permissions of %s: %d\n", socketPath_, errno);
+        exit(1);
+    }
+    if (listen(hostSock_, 128) == -1) {
+        fprintf(stderr, "Error: listening %d\n", errno);
+        exit(1);
+    }
+
+    for (int i = 0; i < AGENT_NUM_WORKERS; i++) {
+        pthread_create(&tid_[i], 0, &thread_handler, (void*)this);
+    }
+    pthread_create(&reapTid_, 0, &reap_handler, (void*)this);
+}
+
+/*
+ * destructor
+ */
+Agent::~Agent(){
+    close(hostSock_);
+    unlink(socketPath_);
+    pthread_mutex_destroy(&lock_);
+    pthread_cond_destroy(&jobCond_);
+}
+
+/*
+ * main loop for accepting jobs
+ */
+void Agent::run(){
+    printf("agent listening on %s\n", socketPath_);
+
+    while(true){
+        int clientSock = accept(hostSock_, NULL, NULL);
+        if (clientSock == -1) {
+            fprintf(stderr, "Error: accepting connection %d\n", errno);
+            continue;
+        }
+
+        /* reject peers of other uids (the permissions of the socket may be changed) */
+        struct ucred cred;
+        socklen_t credLen = sizeof(cred);
+        if (getsockopt(clientSock, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1 || cred.uid != geteuid()) {
+            fprintf(stderr, "Error: rejecting connection of another user\n");
+            close(clientSock);
+            continue;
+        }
+
+        /* the job request is received by a worker */
+        pthread_mutex_lock(&lock_);
+        pendingSocks_.push_back(clientSock);
+        pthread_cond_signal(&jobCond_);
+        pthread_mutex_unlock(&lock_);
+    }
+}
+
+/*
+ * submit a job to a running agent and wait for the reply
+ *
+ * @param socketPath - path of the Unix domain socket
+ * @param request - the job request
+ * @param streamFd - the input stream passed to agent for AGENT_STREAM_BACKUP, -1 otherwise
+ * @param reply - the returned job reply
+ *
+ * @return 1 on success, 0 when the agent is not reachable
+ */
+int Agent::submit(const char* socketPath, jobRequest_t* request, int streamFd, jobReply_t* reply){
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: agent socket path is too long!\n");
+        return 0;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        fprintf(stderr, "Error: initializing socket %d\n", errno);
+        return 0;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error: connecting to agent %s: %d\n", socketPath, errno);
+        close(sock);
+        return 0;
+    }
+    if (!sendRequest(sock, request, streamFd) ||
+            !recvAll(sock, (char*)reply, sizeof(jobReply_t))) {
+        fprintf(stderr, "Error: agent connection lost\n");
+        close(sock);
+        return 0;
+    }
+    close(sock);
+    return 1;
+}
@@ -0,0 +1,215 @@
+/*
+ * agent.hh
+ */
+
+#ifndef __AGENT_HH__
+#define __AGENT_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <utility>
+
+#include "session.hh"
+#include "conf.hh"
+
+/* default agent socket path */
+#define AGENT_SOCKET_PATH "/tmp/cdstore-agent.sock"
+
+/* number of agent worker threads (jobs running at the same time) */
+#define AGENT_NUM_WORKERS 4
+
+/* max number of cached sessions, each one holds n+k server connections and its buffers */
+#define AGENT_MAX_SESSIONS 8
+
+/* time in seconds before an idle session is closed */
+#define AGENT_SESSION_IDLE_TIME 300
+
+/* interval in seconds of checking idle sessions */
+#define AGENT_REAP_INTERVAL 30
+
+/* timeout in seconds for receiving a job request */
+#define AGENT_RECV_TIMEOUT 5
+
+/* job actions */
+#define AGENT_BACKUP 0
+#define AGENT_RESTORE 1
+#define AGENT_STREAM_BACKUP 2
+
+/* max file name size in a job */
+#define AGENT_NAME_SIZE 256
+
+using namespace std;
+
+/*
+ * agent module
+ * long-running client that accepts backup and restore jobs on a Unix domain
+ * socket and runs them on cached per-user sessions
+ *
+ * the socket is only accessible to the owner of the agent, peers of other
+ * uids are rejected, and a job may only use the user IDs the agent serves
+ *
+ */
+class Agent{
+    public:
+        /* job request structure (sent by job submitter) */
+        typedef struct{
+            int action;
+            int userID;
+            int securetype;
+            int nameSize;
+            char name[AGENT_NAME_SIZE];
+            char path[PATH_MAX];
+        }jobRequest_t;
+
+        /* job reply structure (sent back to job submitter) */
+        typedef struct{
+            int status;
+            double bw;
+            long long total;
+            long long unique;
+            long zero;
+        }jobReply_t;
+
+    private:
+        /* queued job structure */
+        typedef struct{
+            jobRequest_t request;
+            int clientSock;
+            int streamFd;
+        }job_t;
+
+        /* cached session entry with its job queue */
+        typedef struct{
+            Session* session;
+            deque<job_t*> jobQueue;
+            bool running;
+            bool runnable;
+        }sessionEntry_t;
+
+        /* session key: userID and securetype */
+        typedef pair<int, int> sessionKey_t;
+
+        /* configuration object */
+        Configuration* confObj_;
+
+        /* path of the agent socket */
+        char socketPath_[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+        /* listening socket */
+        int hostSock_;
+
+        /* user IDs served by the agent, any user ID if empty */
+        set<int> userIDs_;
+
+        /* cached sessions */
+        map<sessionKey_t, sessionEntry_t*> sessions_;
+
+        /* sessions having queued jobs, served in round robin */
+        deque<sessionEntry_t*> runnable_;
+
+        /* accepted connections whose job requests are not received yet */
+        deque<int> pendingSocks_;
+
+        /* lock and condition for sessions and queues */
+        pthread_mutex_t lock_;
+        pthread_cond_t jobCond_;
+
+        /* worker thread id array */
+        pthread_t tid_[AGENT_NUM_WORKERS];
+
+        /* thread closing idle sessions */
+        pthread_t reapTid_;
+
+        /*
+         * find the session entry of a job, create it if needed
+         * (called with lock held)
+         *
+         * @param request - the job request
+         * @param evicted - returned idle sessions to be deleted by caller
+         */
+        sessionEntry_t* findOrCreateSession_(jobRequest_t* request, deque<Session*>& evicted);
+
+        /*
+         * take out the sessions idle for too long
+         * (called with lock held)
+         *
+         * @param evicted - returned idle sessions to be deleted by caller
+         */
+        void evictIdleSessions_(deque<Session*>& evicted);
+
+        /*
+         * receive the job request of an accepted connection and queue it to its session
+         *
+         * @param clientSock - the connection
+         */
+        void receiveJob_(int clientSock);
+
+        /*
+         * run a job on its session
+         *
+         * @param entry - the session entry (owned by the calling worker while running)
+         * @param job - the job to run
+         */
+        void runJob_(sessionEntry_t* entry, job_t* job);
+
+    public:
+        /*
+         * constructor: bind and listen on the agent socket
+         *
+         * @param socketPath - path of the Unix domain socket
+         * @param confObj - configuration object
+         * @param userIDs - user IDs served by the agent, any user ID if empty
+         */
+        Agent(const char* socketPath, Configuration* confObj, const vector<int>& userIDs);
+
+        /*
+         * destructor
+         */
+        ~Agent();
+
+        /*
+         * main loop for accepting jobs
+         */
+        void run();
+
+        /*
+         * worker thread handler
+         *
+         * @param param - agent object pointer
+         */
+        static void* thread_handler(void* param);
+
+        /*
+         * idle session reaper thread handler
+         *
+         * @param param - agent object pointer
+         */
+        static void* reap_handler(void* param);
+
+        /*
+         * submit a job to a running agent and wait for the reply
+         *
+         * @param socketPath - path of the Unix domain socket
+         * @param request - the job request
+         * @param streamFd - the input stream passed to agent for AGENT_STREAM_BACKUP, -1 otherwise
+         * @param reply - the returned job reply
+         *
+         * @return 1 on success, 0 when the agent is not reachable
+         */
+        static int submit(const char* socketPath, jobRequest_t* request, int streamFd, jobReply_t* reply);
+};
+
+#endif
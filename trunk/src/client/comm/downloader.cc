@@ -7,6 +7,15 @@
 
 using namespace std;
 
+/*
+ * get current time in seconds
+ */
+static double currentTime(){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec+(double)tv.tv_usec*1e-6;
+}
+
 /*
  * downloader thread handler
  * 
@@ -21,60 +30,145 @@ void* Downloader::thread_handler(void* param){
     Downloader* obj = temp->obj;
     free(temp);
 
-    /* get the download initiate signal */
-    init_t signal;
-    obj->signalBuffer_[cloudIndex]->Extract(&signal);
+    /* main loop for files */
+    while(true){
+
+        /* get the download initiate signal */
+        init_t signal;
+        obj->signalBuffer_[cloudIndex]->Extract(&signal);
+
+        /* exit indicator */
+        if(signal.type == DOWNLOAD_EXIT) break;
+
+        int ret = obj->downloadShares_(cloudIndex, &signal);
+
+        /* 
+         * a failed or cancelled connection is closed and reconnected for next file 
+         * (checked together with going idle, so that a cancellation never hits an idle connection)
+         */
+        pthread_mutex_lock(&(obj->arrivalLock_));
+        pthread_mutex_lock(&(obj->serverLock_));
+        int cancelled = (obj->cancelFileID_[cloudIndex] == signal.fileID);
+        if(ret != 0 && !cancelled){
+            fprintf(stderr, "Error: fail to download from server %d\n", cloudIndex);
+        }
+        if((ret != 0 || cancelled) && obj->socketArray_[cloudIndex] != NULL){
+            delete(obj->socketArray_[cloudIndex]);
+            obj->socketArray_[cloudIndex] = NULL;
+        }
+        pthread_mutex_unlock(&(obj->serverLock_));
+
+        /* the server is idle again */
+        obj->busy_[cloudIndex] = 0;
+        obj->arrivals_++;
+        pthread_cond_broadcast(&(obj->arrivalCond_));
+        pthread_mutex_unlock(&(obj->arrivalLock_));
+    }
+    return NULL;
+}
+
+/*
+ * wake up the waiting download procedure
+ */
+void Downloader::notifyArrival_(){
+    pthread_mutex_lock(&arrivalLock_);
+    arrivals_++;
+    pthread_cond_broadcast(&arrivalCond_);
+    pthread_mutex_unlock(&arrivalLock_);
+}
 
-    /* get filename & name size*/
-    char* filename = signal.filename;
-    int namesize = signal.namesize;
+/*
+ * download the shares of a file from a server
+ *
+ * @param cloudIndex - index of the server
+ * @param signal - the download signal
+ *
+ * @return 0 on success, -1 on failure or cancellation
+ */
+int Downloader::downloadShares_(int cloudIndex, init_t* signal){
+    char* container = downloadContainer_[cloudIndex];
     int retSize;
     int index = 0;
 
+    /* connect if the last connection was closed, unless the file is cancelled already */
+    pthread_mutex_lock(&serverLock_);
+    if(cancelFileID_[cloudIndex] == signal->fileID){
+        pthread_mutex_unlock(&serverLock_);
+        return -1;
+    }
+    if(socketArray_[cloudIndex] == NULL){
+        socketArray_[cloudIndex] = new Socket(serverIP_[cloudIndex], serverPort_[cloudIndex], userID_);
+    }
+    Socket* sock = socketArray_[cloudIndex];
+    pthread_mutex_unlock(&serverLock_);
+
     /* initiate download request */
-    obj->socketArray_[cloudIndex]->initDownload(filename, namesize);		
+    int ret;
+    if(signal->rangeOffset == 0 && signal->rangeLength == RANGE_TO_END){
+        ret = sock->initDownload(signal->filename, signal->namesize);
+    }else{
+        ret = sock->initRangeDownload(signal->filename, signal->namesize, signal->rangeOffset, signal->rangeLength);
+    }
+    if(ret != 0) return -1;
 
     /* start to download data into container */
-    obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex], &retSize);
+    double timer = currentTime();
+    if(sock->downloadChunk(container, &retSize) != 0 || retSize < (int)sizeof(shareFileHead_t)) return -1;
 
     /* get the header */
-    shareFileHead_t* header = (shareFileHead_t*)obj->downloadContainer_[cloudIndex];
+    shareFileHead_t* header = (shareFileHead_t*)container;
     index = sizeof(shareFileHead_t);
+    int numOfShares = header->numOfShares;
 
     /* parse the header object */
     Item_t headerObj;
     headerObj.type = 0;
+    headerObj.fileID = signal->fileID;
+    headerObj.shareIndex = -1;
     memcpy(&(headerObj.fileObj.file_header),header,sizeof(shareFileHead_t));
 
     /* add the header object into ringbuffer */
-    obj->ringBuffer_[cloudIndex]->Insert(&headerObj,sizeof(headerObj));
+    ringBuffer_[cloudIndex]->Insert(&headerObj,sizeof(headerObj));
+    notifyArrival_();
 
-    /* main loop to get data */
-    while(true){
+    /* loop to get data, end when all shares of the file are received */
+    for(int count = 0; count < numOfShares; count++){
 
         /* if the current comtainer has been proceed, download next container */
         if(index == retSize){
-            obj->socketArray_[cloudIndex]->downloadChunk(obj->downloadContainer_[cloudIndex],&retSize);
+            if(sock->downloadChunk(container, &retSize) != 0) return -1;
             index = 0;
+
+            /* update the throughput estimate with the time of this container */
+            double split = currentTime() - timer;
+            timer = currentTime();
+            if(split > 0){
+                throughput_[cloudIndex] = (1 - THROUGHPUT_SAMPLE_WEIGHT)*throughput_[cloudIndex] + 
+                    THROUGHPUT_SAMPLE_WEIGHT*retSize/split;
+            }
         }
 
         /* get the share object */
-        shareEntry_t* temp = (shareEntry_t*)(obj->downloadContainer_[cloudIndex]+index);
+        shareEntry_t* temp = (shareEntry_t*)(container+index);
         int shareSize = temp->shareSize;
         index += sizeof(shareEntry_t);
 
         /* parse the share object */
         Item_t output;
         output.type =1;
+        output.fileID = signal->fileID;
+        output.shareIndex = count;
         memcpy(&(output.shareObj.share_header), temp, sizeof(shareEntry_t));
-        memcpy(output.shareObj.data, obj->downloadContainer_[cloudIndex]+index, shareSize);
+        memcpy(output.shareObj.data, container+index, shareSize);
 
         index += shareSize;
 
         /* add the share object to ringbuffer */
-        obj->ringBuffer_[cloudIndex]->Insert(&output,sizeof(output));
+        ringBuffer_[cloudIndex]->Insert(&output,sizeof(output));
+        progress_[cloudIndex] = count + 1;
+        notifyArrival_();
     }
-    return NULL;
+    return 0;
 }
 
 /*
@@ -89,7 +183,10 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj){
     /* set private variables */
     total_ = total;
     subset_ = subset;
+    userID_ = userID;
     decodeObj_ = obj;
+    fileID_ = 0;
+    arrivals_ = 0;
 
     /* initialization*/
     ringBuffer_ = (RingBuffer<Item_t>**)malloc(sizeof(RingBuffer<Item_t>*)*total_);
@@ -98,6 +195,19 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj){
     downloadContainer_ = (char **)malloc(sizeof(char*)*total_);
     socketArray_ = (Socket**)malloc(sizeof(Socket*)*total_);
     headerArray_ = (fileShareMDHead_t **)malloc(sizeof(fileShareMDHead_t*)*total_);
+    tid_ = (pthread_t *)malloc(sizeof(pthread_t)*total_);
+    serverIP_ = (char **)malloc(sizeof(char*)*total_);
+    serverPort_ = (int *)malloc(sizeof(int)*total_);
+    busy_ = (volatile int *)malloc(sizeof(int)*total_);
+    progress_ = (volatile int *)malloc(sizeof(int)*total_);
+    cancelFileID_ = (volatile int *)malloc(sizeof(int)*total_);
+    throughput_ = (double *)malloc(sizeof(double)*total_);
+    order_ = (int *)malloc(sizeof(int)*total_);
+    scratch_ = (Item_t*)malloc(sizeof(Item_t));
+
+    pthread_mutex_init(&serverLock_, NULL);
+    pthread_mutex_init(&arrivalLock_, NULL);
+    pthread_cond_init(&arrivalCond_, NULL);
 
     /* open config file */
     FILE* fp = fopen("./config","rb");
@@ -107,26 +217,32 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj){
     /* initialization loop  */
     for(int i = 0; i < total_; i++){
         signalBuffer_[i] = new RingBuffer<init_t>(DOWNLOAD_RB_SIZE, true, 1);
-        ringBuffer_[i] = new RingBuffer<Item_t>(DOWNLOAD_RB_SIZE, true, 1);
+        /* shares are polled from all servers, so extraction does not block */
+        ringBuffer_[i] = new RingBuffer<Item_t>(DOWNLOAD_RB_SIZE, false, 1);
         downloadMetaBuffer_[i] = (char*)malloc(sizeof(char)*DOWNLOAD_BUFFER_SIZE);
         downloadContainer_[i] = (char*)malloc(sizeof(char)*DOWNLOAD_BUFFER_SIZE);
-
-        /* create threads */
-        param_t* param = (param_t*)malloc(sizeof(param_t));      // thread's parameter
-        param->cloudIndex = i;
-        param->obj = this;
-        pthread_create(&tid_[i],0,&thread_handler, (void*)param);
+        busy_[i] = 0;
+        progress_[i] = 0;
+        cancelFileID_[i] = -1;
+        throughput_[i] = 0;
+        order_[i] = i;
 
         /* get config parameters */
         int ret = fscanf(fp,"%s",line);
         if(ret == 0) printf("fail to load config file\n");
         char * token = strtok(line,ch);
-        char* ip = token;
+        serverIP_[i] = strdup(token);
         token = strtok(NULL, ch);
-        int port = atoi(token);
+        serverPort_[i] = atoi(token);
 
         /* create sockets */
-        socketArray_[i] = new Socket(ip ,port, userID);
+        socketArray_[i] = new Socket(serverIP_[i], serverPort_[i], userID);
+
+        /* create threads */
+        param_t* param = (param_t*)malloc(sizeof(param_t));      // thread's parameter
+        param->cloudIndex = i;
+        param->obj = this;
+        pthread_create(&tid_[i],0,&thread_handler, (void*)param);
     }
 
     fclose(fp);
@@ -140,19 +256,181 @@ Downloader::Downloader(int total, int subset, int userID, Decoder* obj){
  */
 Downloader::~Downloader(){
     int i;
+
+    /* stop all download threads (they are idle between files) */
+    init_t exitSignal;
+    exitSignal.type = DOWNLOAD_EXIT;
+    for(i = 0; i < total_; i++){
+        signalBuffer_[i]->Insert(&exitSignal, sizeof(init_t));
+        pthread_join(tid_[i], NULL);
+    }
+
     for(i = 0; i < total_; i++){
         delete(signalBuffer_[i]);
         delete(ringBuffer_[i]);
         free(downloadMetaBuffer_[i]);
         free(downloadContainer_[i]);
-        delete(socketArray_[i]);
+        if(socketArray_[i] != NULL) delete(socketArray_[i]);
+        free(serverIP_[i]);
     }
+    pthread_mutex_destroy(&serverLock_);
+    pthread_mutex_destroy(&arrivalLock_);
+    pthread_cond_destroy(&arrivalCond_);
+
     free(signalBuffer_);
     free(ringBuffer_);
     free(headerArray_);
     free(socketArray_);
     free(downloadContainer_);
     free(downloadMetaBuffer_);
+    free(tid_);
+    free(serverIP_);
+    free(serverPort_);
+    free((void*)busy_);
+    free((void*)progress_);
+    free((void*)cancelFileID_);
+    free(throughput_);
+    free(order_);
+    free(scratch_);
+}
+
+/*
+ * collect the first shares of a secret that arrive, drop stale shares of all servers
+ *
+ * @param shareIndex - index of the share in file (-1 for the file header)
+ * @param items - returned shares
+ * @param shareIDList - returned IDs of the shares
+ * @param needed - number of shares needed
+ *
+ * @return number of collected shares, less than needed if too many servers failed
+ */
+int Downloader::collectShares_(int shareIndex, Item_t* items, int* shareIDList, int needed){
+    int taken[MAX_NUMBER_OF_CLOUDS];
+    int chosen = 0;
+    int i;
+
+    memset(taken, 0, sizeof(taken));
+    while(true){
+        pthread_mutex_lock(&arrivalLock_);
+        long seen = arrivals_;
+        pthread_mutex_unlock(&arrivalLock_);
+
+        /* poll servers fastest first, the spare shares beyond needed are dropped */
+        int pending = 0;
+        for(i = 0; i < total_; i++){
+            int s = order_[i];
+
+            /* read before polling, so that a server that is idle now has inserted all its shares */
+            int busy = busy_[s];
+            while(!taken[s]){
+                Item_t* target = (chosen < needed) ? &items[chosen] : scratch_;
+                if(ringBuffer_[s]->Extract(target) != 0) break;
+
+                /* skip shares of a cancelled file or of secrets already restored */
+                if(target->fileID != fileID_ || target->shareIndex < shareIndex) continue;
+
+                /* shares of a server come in order, so this is the wanted one */
+                taken[s] = 1;
+                if(chosen < needed){
+                    shareIDList[chosen] = s;
+                    chosen++;
+                }
+            }
+            if(!taken[s] && busy) pending++;
+        }
+
+        /* done, or not enough servers left */
+        if(chosen == needed || chosen + pending < needed) return chosen;
+
+        /* wait for next arrival */
+        pthread_mutex_lock(&arrivalLock_);
+        while(arrivals_ == seen){
+            pthread_cond_wait(&arrivalCond_, &arrivalLock_);
+        }
+        pthread_mutex_unlock(&arrivalLock_);
+    }
+}
+
+/*
+ * cancel the download of current file from a server
+ *
+ * @param cloudIndex - index of the server
+ */
+void Downloader::cancelServer_(int cloudIndex){
+    pthread_mutex_lock(&arrivalLock_);
+    if(busy_[cloudIndex]){
+        pthread_mutex_lock(&serverLock_);
+        cancelFileID_[cloudIndex] = fileID_;
+        if(socketArray_[cloudIndex] != NULL) socketArray_[cloudIndex]->shutdownConnection();
+        pthread_mutex_unlock(&serverLock_);
+    }
+    pthread_mutex_unlock(&arrivalLock_);
+}
+
+/*
+ * sort servers by throughput and cancel the ones lagging too far behind
+ *
+ * @param shareIndex - index of the share being restored
+ */
+void Downloader::hedgeServers_(int shareIndex){
+    int i, j;
+
+    /* insertion sort, fastest first */
+    for(i = 1; i < total_; i++){
+        int s = order_[i];
+        for(j = i; j > 0 && throughput_[order_[j-1]] < throughput_[s]; j--){
+            order_[j] = order_[j-1];
+        }
+        order_[j] = s;
+    }
+
+    /* count the servers still sending the file */
+    int active = 0;
+    for(i = 0; i < total_; i++){
+        if(busy_[i] && cancelFileID_[i] != fileID_) active++;
+    }
+
+    /* cancel laggards while keeping enough servers, slowest first */
+    for(i = total_-1; i >= 0 && active > subset_; i--){
+        int s = order_[i];
+        if(busy_[s] && cancelFileID_[s] != fileID_ && shareIndex - progress_[s] > HEDGE_CANCEL_LAG){
+            cancelServer_(s);
+            active--;
+        }
+    }
+}
+
+/*
+ * cancel the servers still sending current file and wait until all are idle
+ */
+void Downloader::finishFile_(){
+    int i;
+
+    for(i = 0; i < total_; i++){
+        if(cancelFileID_[i] != fileID_) cancelServer_(i);
+    }
+
+    /* drop the remaining shares until all servers are idle */
+    while(true){
+        pthread_mutex_lock(&arrivalLock_);
+        long seen = arrivals_;
+        int idle = 1;
+        for(i = 0; i < total_; i++){
+            if(busy_[i]) idle = 0;
+        }
+        pthread_mutex_unlock(&arrivalLock_);
+
+        for(i = 0; i < total_; i++){
+            while(ringBuffer_[i]->Extract(scratch_) == 0);
+        }
+        if(idle) break;
+
+        pthread_mutex_lock(&arrivalLock_);
+        while(arrivals_ == seen){
+            pthread_cond_wait(&arrivalCond_, &arrivalLock_);
+        }
+        pthread_mutex_unlock(&arrivalLock_);
+    }
 }
 
 /*
@@ -160,15 +438,16 @@ Downloader::~Downloader(){
  *
  * @param filename - targeting filename
  * @param namesize - size of filename
- * @param numOfCloud - number of clouds that we download data
+ * @param rangeOffset - offset of the byte range to download
+ * @param rangeLength - length of the byte range to download, RANGE_TO_END for the rest of file
  *
+ * @return 0 on success, -1 when less than k servers can deliver the file
  */
-int Downloader::downloadFile(char* filename, int namesize, int numOfCloud){
+int Downloader::downloadFile(char* filename, int namesize, long rangeOffset, long rangeLength){
     int i;
 
-    /* temp share buffer for assemble the ring buffer data chunks*/
-    unsigned char *shareBuffer;
-    shareBuffer = (unsigned char*)malloc(sizeof(unsigned char)*RING_BUFFER_DATA_SIZE*MAX_NUMBER_OF_CLOUDS);
+    /* shares collected for a secret */
+    Item_t* items = (Item_t*)malloc(sizeof(Item_t)*subset_);
 
     unsigned char tmp[namesize*32];
     int tmp_s;
@@ -176,70 +455,83 @@ int Downloader::downloadFile(char* filename, int namesize, int numOfCloud){
     // encode the filepath into shares
     decodeObj_->decodeObj_[0]->encoding((unsigned char*)filename, namesize, tmp, &(tmp_s));
 
-    /* add init object for download */
+    /* add init object for download, all servers are asked for the file */
+    fileID_++;
     init_t input;
-    for (i = 0; i < numOfCloud; i++){
-        input.type = 1;
+    for (i = 0; i < total_; i++){
+        input.type = DOWNLOAD_START;
+        input.fileID = fileID_;
+        input.rangeOffset = rangeOffset;
+        input.rangeLength = rangeLength;
 
         //copy the corresponding share as file name
         input.filename = (char*)(tmp+i*tmp_s);
         input.namesize = tmp_s;
 
+        pthread_mutex_lock(&arrivalLock_);
+        busy_[i] = 1;
+        progress_[i] = 0;
+        pthread_mutex_unlock(&arrivalLock_);
         signalBuffer_[i]->Insert(&input, sizeof(init_t));
     }
 
-    /* get the header object from buffer */
-    Item_t headerObj;
-    for (i = 0; i < numOfCloud; i++){
-        ringBuffer_[i]->Extract(&headerObj);
+    /* get the header object from the first server that answers */
+    int shareIDList[MAX_NUMBER_OF_CLOUDS];
+    if(collectShares_(-1, items, shareIDList, 1) != 1){
+        fprintf(stderr, "Error: no server can deliver the file\n");
+        finishFile_();
+        free(items);
+        return -1;
     }
 
-    /* parse header object, tell decoder the total number of secret */
-    shareFileHead_t* header = &(headerObj.fileObj.file_header);
+    /* parse header object, tell decoder the total number of secret and the output size */
+    shareFileHead_t* header = &(items[0].fileObj.file_header);
     int numOfShares = header->numOfShares;
-    decodeObj_->setTotal(numOfShares);
+    long outputSize = header->fileSize;
+    if(rangeOffset != 0 || rangeLength != RANGE_TO_END){
+        /* the size of a file without trailer is unknown (negative) */
+        if(header->fileSize >= 0){
+            outputSize = header->fileSize - rangeOffset;
+            if(outputSize < 0) outputSize = 0;
+        }
+        if(rangeLength != RANGE_TO_END && (outputSize < 0 || outputSize > rangeLength)) outputSize = rangeLength;
+    }
+    decodeObj_->setTotal(numOfShares, outputSize);
 
-    /* proceed each secret */
+    /* proceed each secret, the offset (relative to the range) lets decoder write it out of order */
     int count = 0;
+    long offset = header->firstSecretOffset - rangeOffset;
     while(count < numOfShares){
-        int secretSize = 0;
-        int shareSize = 0;
-
-        /* extract share object from each cloud's ringbuffer */
-        for(i = 0; i < numOfCloud; i++){
-            Item_t output;
-            ringBuffer_[i]->Extract(&output);
-            shareEntry_t* temp = &(output.shareObj.share_header);
-            secretSize = temp->secretSize;
-            shareSize = temp->shareSize;
-
-            /* place the share at the right position */
-            memcpy(shareBuffer+i*shareSize,output.shareObj.data,shareSize);
+        if(count % HEDGE_REORDER_INTERVAL == 0) hedgeServers_(count);
+
+        /* take the first k shares of the secret that arrive */
+        if(collectShares_(count, items, shareIDList, subset_) != subset_){
+            fprintf(stderr, "Error: less than %d servers can deliver the file\n", subset_);
+            decodeObj_->abortFile(count);
+            finishFile_();
+            free(items);
+            return -1;
         }
 
-        /* add the share buffer to the decoder ringbuffer */
+        /* place the shares in order of collection, their IDs tell decoder where they come from */
         Decoder::ShareChunk_t package;
+        int secretSize = items[0].shareObj.share_header.secretSize;
+        int shareSize = items[0].shareObj.share_header.shareSize;
+        for(i = 0; i < subset_; i++){
+            memcpy(package.data+i*shareSize,items[i].shareObj.data,shareSize);
+            package.shareIDList[i] = shareIDList[i];
+        }
+
+        /* add the share package to the decoder ringbuffer */
         package.secretSize = secretSize;
         package.shareSize = shareSize;
-        memcpy(&(package.data), shareBuffer,numOfCloud*shareSize);
+        package.offset = offset;
         decodeObj_->add(&package, count%DECODE_NUM_THREADS);
 
+        offset += secretSize;
         count++;
     }
-    free(shareBuffer);
+    finishFile_();
+    free(items);
     return 0;
 }
-
-/*
- * test if it's the end of downloading a file
- *
- */
-int Downloader::indicateEnd(){
-    int i;
-    for(i = 0; i < DOWNLOAD_NUM_THREADS; i++){
-        /* trying to join all threads */
-        pthread_join(tid_[i],NULL);
-    }
-    return 1;
-}
-
@@ -20,6 +20,7 @@
 #include <openssl/evp.h>
 #include <cstring>
 #include <pthread.h>
+#include <sys/time.h>
 
 /* downloader ringbuffer size */
 #define DOWNLOAD_RB_SIZE 2048
@@ -38,8 +39,21 @@
 
 #define MAX_NUMBER_OF_CLOUDS 16
 
-/* number of download threads */
-#define DOWNLOAD_NUM_THREADS 3
+/* signal types for download threads */
+#define DOWNLOAD_START 1
+#define DOWNLOAD_EXIT 2
+
+/* length of a range that ends at the end of file */
+#define RANGE_TO_END (-1)
+
+/* a server lagging behind the restored secret by this many shares is cancelled */
+#define HEDGE_CANCEL_LAG 256
+
+/* number of secrets between reordering servers by throughput */
+#define HEDGE_REORDER_INTERVAL 64
+
+/* weight of the latest sample in the throughput estimate of a server */
+#define THROUGHPUT_SAMPLE_WEIGHT 0.2
 
 
 #include "BasicRingBuffer.hh"
@@ -51,7 +65,8 @@ using namespace std;
 
 /*
  * download module
- * handle share to its targeting cloud
+ * download shares from all clouds, and decode each secret from the first 
+ * k shares that arrive (laggards are cancelled and reconnected for next file)
  *
  */
 class Downloader{
@@ -65,6 +80,37 @@ class Downloader{
         //number of a subset of clouds
         int subset_;
 
+        /* server addresses for reconnecting cancelled connections */
+        char** serverIP_;
+        int* serverPort_;
+        int userID_;
+
+        /* ID of the file being downloaded */
+        int fileID_;
+
+        /* indicator of a server working on a file (1) or idle (0) */
+        volatile int* busy_;
+
+        /* number of shares received of the current file per server */
+        volatile int* progress_;
+
+        /* ID of the file cancelled per server */
+        volatile int* cancelFileID_;
+
+        /* estimated throughput (bytes per second) per server */
+        double* throughput_;
+
+        /* servers in the order of polling, fastest first */
+        int* order_;
+
+        /* lock for socket array and cancellation */
+        pthread_mutex_t serverLock_;
+
+        /* arrival counter with its lock and condition, updated whenever a server inserts a share or becomes idle */
+        long arrivals_;
+        pthread_mutex_t arrivalLock_;
+        pthread_cond_t arrivalCond_;
+
     public:
         /* file metadata header structure */
         typedef struct{
@@ -88,6 +134,7 @@ class Downloader{
         typedef struct{
             long fileSize;
             int numOfShares;
+            long firstSecretOffset;
         }shareFileHead_t;
 
         /* share detail struct for download */
@@ -112,6 +159,8 @@ class Downloader{
         /* union of objects for unifying ringbuffer objects */
         typedef struct{
             int type;
+            int fileID;
+            int shareIndex;
             union{
                 fileHeaderObj_t fileObj;
                 shareHeaderObj_t shareObj;
@@ -121,8 +170,11 @@ class Downloader{
         /* init object for initiating download */
         typedef struct{
             int type;
+            int fileID;
             char* filename;
             int namesize;
+            long rangeOffset;
+            long rangeLength;
         }init_t;
 
         /* thread parameter structure */
@@ -150,7 +202,7 @@ class Downloader{
         int shareMDEntrySize_;
 
         /* thread id array */
-        pthread_t tid_[DOWNLOAD_NUM_THREADS];
+        pthread_t* tid_;
 
         /* decoder object pointer */
         Decoder* decodeObj_;
@@ -161,6 +213,55 @@ class Downloader{
         /* download ringbuffer */
         RingBuffer<Item_t>** ringBuffer_;
 
+        /* scratch item for dropping shares */
+        Item_t* scratch_;
+
+        /*
+         * wake up the waiting download procedure
+         */
+        void notifyArrival_();
+
+        /*
+         * download the shares of a file from a server
+         *
+         * @param cloudIndex - index of the server
+         * @param signal - the download signal
+         *
+         * @return 0 on success, -1 on failure or cancellation
+         */
+        int downloadShares_(int cloudIndex, init_t* signal);
+
+        /*
+         * collect the first shares of a secret that arrive, drop stale shares of all servers
+         *
+         * @param shareIndex - index of the share in file (-1 for the file header)
+         * @param items - returned shares
+         * @param shareIDList - returned IDs of the shares
+         * @param needed - number of shares needed
+         *
+         * @return number of collected shares, less than needed if too many servers failed
+         */
+        int collectShares_(int shareIndex, Item_t* items, int* shareIDList, int needed);
+
+        /*
+         * cancel the download of current file from a server
+         *
+         * @param cloudIndex - index of the server
+         */
+        void cancelServer_(int cloudIndex);
+
+        /*
+         * sort servers by throughput and cancel the ones lagging too far behind
+         *
+         * @param shareIndex - index of the share being restored
+         */
+        void hedgeServers_(int shareIndex);
+
+        /*
+         * cancel the servers still sending current file and wait until all are idle
+         */
+        void finishFile_();
+
 
         /*
          * constructor
@@ -178,21 +279,16 @@ class Downloader{
          */
         ~Downloader();
 
-        /*
-         * test if it's the end of downloading a file
-         *
-         */
-        int indicateEnd();
-
         /*
          * main procedure for downloading a file
          *
          * @param filename - targeting filename
          * @param namesize - size of filename
-         * @param numOfCloud - number of clouds that we download data
+         * @param rangeOffset - offset of the byte range to download
+         * @param rangeLength - length of the byte range to download, RANGE_TO_END for the rest of file
          *
          */
-        int downloadFile(char* filename, int namesize, int numOfCloud);	
+        int downloadFile(char* filename, int namesize, long rangeOffset = 0, long rangeLength = RANGE_TO_END);	
 
         /*
          * downloader thread handler
@@ -0,0 +1,222 @@
+/*
+ * session.cc
+ */
+
+#include "session.hh"
+
+using namespace std;
+
+/*
+ * get current time in seconds
+ */
+static double currentTime(){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec+(double)tv.tv_usec*1e-6;
+}
+
+/*
+ * constructor
+ *
+ * @param userID - ID of the user
+ * @param securetype - encryption and hash type
+ * @param confObj - configuration object
+ */
+Session::Session(int userID, int securetype, Configuration* confObj){
+    userID_ = userID;
+    securetype_ = securetype;
+    confObj_ = confObj;
+
+    n_ = confObj_->getN();
+    m_ = confObj_->getM();
+    k_ = confObj_->getK();
+    r_ = confObj_->getR();
+
+    chunkerObj_ = NULL;
+    encoderObj_ = NULL;
+    uploaderObj_ = NULL;
+    decoderObj_ = NULL;
+    downloaderObj_ = NULL;
+    buffer_ = NULL;
+    chunkEndIndexList_ = NULL;
+
+    zeroSecret_ = (unsigned char*)malloc(sizeof(unsigned char)*confObj_->getSecretBufferSize());
+    memset(zeroSecret_, 0, confObj_->getSecretBufferSize());
+
+    lastUsed_ = currentTime();
+}
+
+/*
+ * destructor
+ */
+Session::~Session(){
+    /* encoder flushes into uploader, so delete it first */
+    if (encoderObj_ != NULL) delete encoderObj_;
+    if (uploaderObj_ != NULL) delete uploaderObj_;
+    if (chunkerObj_ != NULL) delete chunkerObj_;
+    if (downloaderObj_ != NULL) delete downloaderObj_;
+    if (decoderObj_ != NULL) delete decoderObj_;
+
+    free(buffer_);
+    free(chunkEndIndexList_);
+    free(zeroSecret_);
+}
+
+/*
+ * back up a file
+ * (the input is read until EOF, the last secret is held back until then so that 
+ * it can be marked as the end of the file)
+ *
+ * @param filename - full name of the file (as stored on servers)
+ * @param namesize - size of the file name (including '\0')
+ * @param fin - input file pointer (a regular file or a pipe)
+ * @param size - size of input file, FILE_SIZE_UNKNOWN for a stream
+ * @param bw - returned bandwidth in MB/s
+ * @param total - returned amount of data that input to uploader
+ * @param unique - returned amount of unique data transferred in network
+ * @param zero - returned amount of zero data
+ *
+ * @return 1 on success, 0 on failure
+ */
+int Session::backup(char* filename, int namesize, FILE* fin, long size,
+        double* bw, long long* total, long long* unique, long* zero){
+    if (size == 0) {
+        fprintf(stderr, "Error: cannot back up an empty file!\n");
+        return 0;
+    }
+    if (namesize > SECRET_SIZE) {
+        fprintf(stderr, "Error: file name is too long!\n");
+        return 0;
+    }
+
+    /* create the backup pipeline on first use */
+    if (uploaderObj_ == NULL) {
+        uploaderObj_ = new Uploader(n_,n_,userID_);
+        encoderObj_ = new Encoder(CAONT_RS_TYPE, n_, m_, r_, securetype_, uploaderObj_);
+        chunkerObj_ = new Chunker(VAR_SIZE_TYPE);
+        buffer_ = (unsigned char*)malloc(sizeof(unsigned char)*confObj_->getBufferSize());
+        chunkEndIndexList_ = (int*)malloc(sizeof(int)*confObj_->getListSize());
+    }
+
+    int bufferSize = confObj_->getBufferSize();
+    double timer, split, timer2, split2;
+    double total_t = 0;
+    timer2 = currentTime();
+
+    /* secret items, one of them holds the pending secret */
+    Encoder::Secret_Item_t input[2];
+    int pending = -1;
+
+    *zero = 0;
+    long readTotal = 0;
+    int totalChunks = 0;
+    int numOfChunks;
+    while (true){
+        timer = currentTime();
+        int ret = fread(buffer_,1,bufferSize,fin);
+        split = currentTime() - timer;
+        total_t += split;
+        if (ret <= 0) break;
+
+        /* add the file header before the first secret */
+        if (readTotal == 0) {
+            Encoder::Secret_Item_t header;
+            header.type = FILE_OBJECT;
+            memcpy(header.file_header.data, filename, namesize);
+            header.file_header.fullNameSize = namesize;
+            header.file_header.fileSize = size;
+            encoderObj_->add(&header);
+        }
+        chunkerObj_->chunking(buffer_,ret,chunkEndIndexList_,&numOfChunks);
+
+        int count = 0;
+        int preEnd = -1;
+        while(count < numOfChunks){
+            /* the previous pending secret is not the last one */
+            if (pending != -1) encoderObj_->add(&input[pending]);
+            pending = (pending + 1)%2;
+
+            input[pending].type = 0;
+            input[pending].secret.secretID = totalChunks;
+            input[pending].secret.secretSize = chunkEndIndexList_[count] - preEnd;
+            input[pending].secret.end = 0;
+            memcpy(input[pending].secret.data, buffer_+preEnd+1, input[pending].secret.secretSize);
+            if(memcmp(input[pending].secret.data, zeroSecret_, input[pending].secret.secretSize) == 0){
+                *zero += input[pending].secret.secretSize;
+            }
+
+            totalChunks++;
+            preEnd = chunkEndIndexList_[count];
+            count++;
+        }
+        readTotal+=ret;
+    }
+
+    /* nothing read, the header was not sent either */
+    if (pending == -1) {
+        fprintf(stderr, "Error: cannot back up an empty file!\n");
+        return 0;
+    }
+
+    /* the pending secret is the end of file */
+    input[pending].secret.end = 1;
+    encoderObj_->add(&input[pending]);
+
+    *total = 0;
+    *unique = 0;
+    int endStat = uploaderObj_->indicateEnd(total, unique);
+    split2 = currentTime() - timer2;
+
+    *bw = readTotal/1024/1024/(split2-total_t);
+    lastUsed_ = currentTime();
+
+    /* the file is finished with what has been read, but report the read error */
+    if (ferror(fin)) {
+        fprintf(stderr, "Error: fail to read the input file!\n");
+        return 0;
+    }
+
+    /* a server without the trailer has not finished the file */
+    if (!endStat) {
+        fprintf(stderr, "Error: fail to finish the file on every server!\n");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * restore a file
+ *
+ * @param filename - full name of the file (as stored on servers)
+ * @param namesize - size of the file name (including '\0')
+ * @param fw - output file pointer
+ * @param bw - returned bandwidth in MB/s
+ * @param rangeOffset - offset of the byte range to restore
+ * @param rangeLength - length of the byte range to restore, RANGE_TO_END for the rest of file
+ *
+ * @return 1 on success, 0 on failure
+ */
+int Session::restore(char* filename, int namesize, FILE* fw, double* bw, long rangeOffset, long rangeLength){
+    /* create the restore pipeline on first use */
+    if (downloaderObj_ == NULL) {
+        decoderObj_ = new Decoder(CAONT_RS_TYPE, n_, m_, r_, securetype_);
+        downloaderObj_ = new Downloader(n_,k_,userID_,decoderObj_);
+
+        int flags = 0;
+        if (confObj_->getRestoreFallocate()) flags |= DECODE_WRITE_FALLOCATE;
+        if (confObj_->getRestoreDirectIO()) flags |= DECODE_WRITE_DIRECT;
+        decoderObj_->setWriteOptions(flags);
+    }
+
+    double timer = currentTime();
+    decoderObj_->setFilePointer(fw);
+    int ret = downloaderObj_->downloadFile(filename, namesize, rangeOffset, rangeLength);
+    int written = decoderObj_->indicateEnd();
+    if (fflush(fw) != 0) written = 0;
+    double split = currentTime() - timer;
+    if (!written) fprintf(stderr, "Error: fail to write the restored file!\n");
+
+    *bw = decoderObj_->getWrittenSize()/1024/1024/split;
+    lastUsed_ = currentTime();
+    return (ret == 0) && written;
+}
@@ -0,0 +1,126 @@
+/*
+ * session.hh
+ */
+
+#ifndef __SESSION_HH__
+#define __SESSION_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "chunker.hh"
+#include "encoder.hh"
+#include "decoder.hh"
+#include "uploader.hh"
+#include "downloader.hh"
+#include "conf.hh"
+
+using namespace std;
+
+/*
+ * session module
+ * keep the pipeline objects (and their server connections) of one user,
+ * so that a sequence of backups and restores reuses them
+ *
+ */
+class Session{
+    private:
+        /* user ID of the session */
+        int userID_;
+
+        /* encryption and hash type */
+        int securetype_;
+
+        /* coding parameters */
+        int n_, m_, k_, r_;
+
+        /* configuration object */
+        Configuration* confObj_;
+
+        /* backup pipeline objects (created on first backup) */
+        Chunker* chunkerObj_;
+        Encoder* encoderObj_;
+        Uploader* uploaderObj_;
+
+        /* restore pipeline objects (created on first restore) */
+        Decoder* decoderObj_;
+        Downloader* downloaderObj_;
+
+        /* file read buffer */
+        unsigned char* buffer_;
+
+        /* chunk end index list */
+        int* chunkEndIndexList_;
+
+        /* zero secret for counting zero data */
+        unsigned char* zeroSecret_;
+
+        /* time of last finished job */
+        double lastUsed_;
+
+    public:
+        /*
+         * constructor
+         *
+         * @param userID - ID of the user
+         * @param securetype - encryption and hash type
+         * @param confObj - configuration object
+         */
+        Session(int userID, int securetype, Configuration* confObj);
+
+        /*
+         * destructor
+         */
+        ~Session();
+
+        /*
+         * back up a file
+         *
+         * @param filename - full name of the file (as stored on servers)
+         * @param namesize - size of the file name (including '\0')
+         * @param fin - input file pointer (a regular file or a pipe)
+         * @param size - size of input file, FILE_SIZE_UNKNOWN for a stream
+         * @param bw - returned bandwidth in MB/s
+         * @param total - returned amount of data that input to uploader
+         * @param unique - returned amount of unique data transferred in network
+         * @param zero - returned amount of zero data
+         *
+         * @return 1 on success, 0 on failure
+         */
+        int backup(char* filename, int namesize, FILE* fin, long size,
+                double* bw, long long* total, long long* unique, long* zero);
+
+        /*
+         * restore a file
+         *
+         * @param filename - full name of the file (as stored on servers)
+         * @param namesize - size of the file name (including '\0')
+         * @param fw - output file pointer
+         * @param bw - returned bandwidth in MB/s
+         * @param rangeOffset - offset of the byte range to restore
+         * @param rangeLength - length of the byte range to restore, RANGE_TO_END for the rest of file
+         *
+         * @return 1 on success, 0 on failure
+         */
+        int restore(char* filename, int namesize, FILE* fw, double* bw, 
+                long rangeOffset = 0, long rangeLength = RANGE_TO_END);
+
+        /*
+         * get the user ID of the session
+         */
+        inline int getUserID() { return userID_; }
+
+        /*
+         * get the security type of the session
+         */
+        inline int getSecureType() { return securetype_; }
+
+        /*
+         * get the time of last finished job
+         */
+        inline double getLastUsed() { return lastUsed_; }
+};
+
+#endif
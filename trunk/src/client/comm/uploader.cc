@@ -77,14 +77,18 @@ void* Uploader::thread_handler(void* param){
             obj->headerArray_[cloudIndex]->numOfComingSecrets += 1;
             obj->headerArray_[cloudIndex]->sizeOfComingSecrets += output.shareObj.share_header.secretSize;
 
-            /* IF this is the last share object, perform upload and exit thread */
+            /* IF this is the last share object, perform upload and wait for next file */
             if(output.type == SHARE_END){
                 obj->performUpload(cloudIndex);
-                delete hashobj;
-                pthread_exit(NULL);
+                obj->finishFile(cloudIndex, obj->sendTrailer(cloudIndex));
             }
+        }else if (output.type == UPLOAD_EXIT){
+            /* IF this is the exit indicator, exit thread */
+            delete hashobj;
+            pthread_exit(NULL);
         }
     }
+    return NULL;
 }
 
 /*
@@ -109,6 +113,13 @@ Uploader::Uploader(int total, int subset, int userID){
     socketArray_ = (Socket**)malloc(sizeof(Socket*)*total_);
     headerArray_ = (fileShareMDHead_t **)malloc(sizeof(fileShareMDHead_t*)*total_);
     shareSizeArray_ = (int **)malloc(sizeof(int *)*total_);
+    tid_ = (pthread_t *)malloc(sizeof(pthread_t)*total_);
+    accuData_ = (long long *)malloc(sizeof(long long)*total_);
+    accuUnique_ = (long long *)malloc(sizeof(long long)*total_);
+    numOfFinishedThreads_ = 0;
+    numOfFailedThreads_ = 0;
+    pthread_mutex_init(&endLock_, NULL);
+    pthread_cond_init(&endCond_, NULL);
 
 
     /* read server ip & port from config file */
@@ -125,11 +136,6 @@ Uploader::Uploader(int total, int subset, int userID){
         metaWP_[i] = 0;
         numOfShares_[i] = 0;
 
-        param_t* param = (param_t*)malloc(sizeof(param_t));      // thread's parameter
-        param->cloudIndex = i;
-        param->obj = this;
-        pthread_create(&tid_[i],0,&thread_handler, (void*)param);
-
         /* line by line read config file*/
         int ret = fscanf(fp,"%s",line);
         if (ret == 0) printf("fail to load config file\n");
@@ -142,6 +148,11 @@ Uploader::Uploader(int total, int subset, int userID){
         socketArray_[i] = new Socket(ip ,port, userID);
         accuData_[i] = 0;
         accuUnique_[i] = 0;
+
+        param_t* param = (param_t*)malloc(sizeof(param_t));      // thread's parameter
+        param->cloudIndex = i;
+        param->obj = this;
+        pthread_create(&tid_[i],0,&thread_handler, (void*)param);
     }
 
     fclose(fp);
@@ -155,6 +166,17 @@ Uploader::Uploader(int total, int subset, int userID){
  */
 Uploader::~Uploader(){
     int i;
+
+    /* stop all upload threads before releasing their buffers */
+    Item_t exitItem;
+    exitItem.type = UPLOAD_EXIT;
+    for(i = 0; i < total_; i++){
+        ringBuffer_[i]->Insert(&exitItem, sizeof(int));
+    }
+    for(i = 0; i < total_; i++){
+        pthread_join(tid_[i], NULL);
+    }
+
     for(i = 0; i < total_; i++){
         delete(ringBuffer_[i]);
         free(shareSizeArray_[i]);
@@ -171,6 +193,11 @@ Uploader::~Uploader(){
     free(containerWP_);
     free(uploadContainer_);
     free(uploadMetaBuffer_);
+    free(tid_);
+    free(accuData_);
+    free(accuUnique_);
+    pthread_mutex_destroy(&endLock_);
+    pthread_cond_destroy(&endCond_);
 }
 
 /*
@@ -260,20 +287,78 @@ int Uploader::add(Item_t* item, int size, int index){
     return 1;
 }
 
+/*
+ * send the file trailer, which commits the final size and count of a file
+ * (the server detects the file end by the trailer instead of the file size in header)
+ *
+ * @param cloudIndex - indicating targeting cloud
+ *
+ * @return 1 if the trailer is sent, 0 otherwise
+ *
+ */
+int Uploader::sendTrailer(int cloudIndex){
+    fileShareMDTrailer_t trailer;
+    trailer.fileSize = headerArray_[cloudIndex]->sizeOfPastSecrets + headerArray_[cloudIndex]->sizeOfComingSecrets;
+    trailer.numOfSecrets = headerArray_[cloudIndex]->numOfPastSecrets + headerArray_[cloudIndex]->numOfComingSecrets;
+
+    if (socketArray_[cloudIndex]->sendTrailer((char*)&trailer, sizeof(fileShareMDTrailer_t)) == -1){
+        fprintf(stderr, "Error: fail to send the file trailer to cloud %d!\n", cloudIndex);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * reset the buffers of a cloud after the last share of a file is uploaded
+ *
+ * @param cloudIndex - indicating targeting cloud
+ * @param finishStat - if the cloud has finished the file (its trailer is sent)
+ *
+ */
+int Uploader::finishFile(int cloudIndex, int finishStat){
+    /* reset all index (means buffers are empty) */
+    containerWP_[cloudIndex] = 0;
+    metaWP_[cloudIndex] = 0;
+    numOfShares_[cloudIndex] = 0;
+
+    /* tell the waiting side this cloud has finished */
+    pthread_mutex_lock(&endLock_);
+    numOfFinishedThreads_++;
+    if (!finishStat) numOfFailedThreads_++;
+    pthread_cond_broadcast(&endCond_);
+    pthread_mutex_unlock(&endLock_);
+    return 1;
+}
+
 /*
  * indicate the end of uploading a file
  * 
  * @return total - total amount of data that input to uploader
  * @return uniq - the amount of unique data that transferred in network
  *
+ * @return 1 if every cloud has finished the file, 0 otherwise
+ *
  */
 int Uploader::indicateEnd(long long* total, long long* uniq){
     int i;
-    for(i = 0; i < UPLOAD_NUM_THREADS; i++){
-        pthread_join(tid_[i],NULL);
+    int numOfFailedThreads;
+
+    /* wait until every cloud finishes the current file */
+    pthread_mutex_lock(&endLock_);
+    while(numOfFinishedThreads_ < total_){
+        pthread_cond_wait(&endCond_, &endLock_);
+    }
+    numOfFinishedThreads_ = 0;
+    numOfFailedThreads = numOfFailedThreads_;
+    numOfFailedThreads_ = 0;
+    pthread_mutex_unlock(&endLock_);
+
+    for(i = 0; i < total_; i++){
         *total+=accuData_[i];
         *uniq+=accuUnique_[i];
+        accuData_[i] = 0;
+        accuUnique_[i] = 0;
     }
-    return 1;
+    return numOfFailedThreads == 0;
 }
 
@@ -57,6 +57,7 @@
 #define FILE_HEADER (-9)
 #define SHARE_OBJECT (-8)
 #define SHARE_END (-27)
+#define UPLOAD_EXIT (-28)
 
 using namespace std;
 
@@ -95,6 +96,12 @@ class Uploader{
             int shareSize;
         } shareMDEntry_t;
 
+        /* file trailer structure, sent after the last share of a file */
+        typedef struct{
+            long fileSize;
+            int numOfSecrets;
+        }fileShareMDTrailer_t;
+
         /* file header object struct for ringbuffer */
         typedef struct{
             fileShareMDHead_t file_header;
@@ -153,13 +160,21 @@ class Uploader{
         int shareMDEntrySize_;
 
         /* thread id array */
-        pthread_t tid_[UPLOAD_NUM_THREADS];
+        pthread_t* tid_;
 
         /* record accumulated processed data */
-        long long accuData_[UPLOAD_NUM_THREADS];
+        long long* accuData_;
 
         /* record accumulated unique data */
-        long long accuUnique_[UPLOAD_NUM_THREADS];
+        long long* accuUnique_;
+
+        /* number of threads that have finished uploading the current file, and of those that failed to finish it */
+        int numOfFinishedThreads_;
+        int numOfFailedThreads_;
+
+        /* lock and condition for signaling the end of a file */
+        pthread_mutex_t endLock_;
+        pthread_cond_t endCond_;
 
         /* uploader ringbuffer array */
         RingBuffer<Item_t>** ringBuffer_;
@@ -191,13 +206,34 @@ class Uploader{
 
         /*
          * indicate the end of uploading a file
+         * (wait until all threads finish the current file, the threads are then
+         * ready for the next file)
          * 
          * @return total - total amount of data that input to uploader
          * @return uniq - the amount of unique data that transferred in network
          *
+         * @return 1 if every cloud has finished the file, 0 otherwise
+         *
          */
         int indicateEnd(long long *total, long long *uniq);
 
+        /*
+         * send the file trailer, which commits the final size and count of a file
+         *
+         * @param cloudIndex - indicating targeting cloud
+         *
+         * @return 1 if the trailer is sent, 0 otherwise
+         */
+        int sendTrailer(int cloudIndex);
+
+        /*
+         * reset the buffers of a cloud after the last share of a file is uploaded
+         *
+         * @param cloudIndex - indicating targeting cloud
+         * @param finishStat - if the cloud has finished the file (its trailer is sent)
+         */
+        int finishFile(int cloudIndex, int finishStat);
+
         /*
          * interface for adding object to ringbuffer
          *
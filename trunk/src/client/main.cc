@@ -5,13 +5,10 @@
 #include <stdlib.h>
 #include <iostream>
 #include <sys/time.h>
+#include <signal.h>
 
-#include "chunker.hh"
-#include "encoder.hh"
-#include "decoder.hh"
-#include "CDCodec.hh"
-#include "uploader.hh"
-#include "downloader.hh"
+#include "session.hh"
+#include "agent.hh"
 #include "CryptoPrimitive.hh"
 #include "conf.hh"
 
@@ -20,57 +17,125 @@
 
 using namespace std;
 
-Chunker* chunkerObj;
-Decoder* decoderObj;
-Encoder* encoderObj;
-Uploader* uploaderObj;
-CryptoPrimitive* cryptoObj;
-CDCodec* cdCodecObj;
-Downloader* downloaderObj;
+Session* sessionObj;
 Configuration* confObj;
 
-void timerStart(double *t){
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    *t = (double)tv.tv_sec+(double)tv.tv_usec*1e-6;
+void usage(char *s){
+    printf("usage: ./CLIENT [filename] [userID] [action] [secutiyType] ([agentSocket])\n       ./CLIENT [filename] [userID] -r [secutiyType] [offset] [length] ([output])\n       ./CLIENT -agent ([agentSocket]) ([userID] ...)\n- [filename]: full path of the file;\n- [userID]: use ID of current client;\n- [action]: [-u] upload; [-d] download; [-s] upload the stream from stdin as [filename]; [-r] download [length] bytes from [offset] into [output] (default ./decoded_copy, '-' for stdout, [length] -1 for the rest of file);\n- [securityType]: [HIGH] AES-256 & SHA-256; [LOW] AES-128 & SHA-1\n- [agentSocket]: submit the job to the agent listening on this socket;\n- [-agent]: run as agent serving jobs of the given user IDs (any user ID by default) on [agentSocket] (default %s), only for the same system user\n", AGENT_SOCKET_PATH);
+    exit(1);
 }
 
-double timerSplit(const double *t){
-    struct timeval tv;
-    double cur_t;
-    gettimeofday(&tv, NULL);
-    cur_t = (double)tv.tv_sec + (double)tv.tv_usec*1e-6;
-    return (cur_t - *t);
-}
+/*
+ * submit a job to the agent and print its result
+ *
+ * @param socketPath - path of agent socket
+ * @param action - job action
+ * @param filename - full name of the file
+ * @param namesize - size of the file name
+ * @param path - local file to read or write
+ * @param userID - ID of current client
+ * @param securetype - encryption and hash type
+ */
+int submitJob(char* socketPath, int action, char* filename, int namesize, char* path, int userID, int securetype){
+    Agent::jobRequest_t request;
+    Agent::jobReply_t reply;
+    memset(&request, 0, sizeof(request));
 
-void usage(char *s){
-    printf("usage: ./CLIENT [filename] [userID] [action] [secutiyType]\n- [filename]: full path of the file;\n- [userID]: use ID of current client;\n- [action]: [-u] upload; [-d] download;\n- [securityType]: [HIGH] AES-256 & SHA-256; [LOW] AES-128 & SHA-1\n");
-    exit(1);
+    if (namesize > AGENT_NAME_SIZE) {
+        fprintf(stderr, "Error: file name is too long!\n");
+        return 0;
+    }
+    request.action = action;
+    request.userID = userID;
+    request.securetype = securetype;
+    request.nameSize = namesize;
+    memcpy(request.name, filename, namesize);
+
+    /* the agent may run in another directory */
+    if (action == AGENT_STREAM_BACKUP) {
+        /* the stream is passed to the agent as a descriptor */
+        request.path[0] = '\0';
+    } else if (action == AGENT_BACKUP) {
+        if (realpath(path, request.path) == NULL) {
+            fprintf(stderr, "Error: fail to resolve %s!\n", path);
+            return 0;
+        }
+    } else {
+        /* a path cut short would restore into another file, so it fails instead */
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, PATH_MAX) == NULL || snprintf(request.path, PATH_MAX, "%s/%s", cwd, path) >= PATH_MAX) {
+            fprintf(stderr, "Error: fail to resolve %s!\n", path);
+            return 0;
+        }
+    }
+
+    if (!Agent::submit(socketPath, &request, action == AGENT_STREAM_BACKUP ? STDIN_FILENO : -1, &reply)) return 0;
+    if (reply.status == 0) {
+        fprintf(stderr, "Error: agent fails to run the job!\n");
+        return 0;
+    }
+
+    if (action != AGENT_RESTORE) {
+        printf("%lf\t%lld\t%lld\t%ld\n", reply.bw, reply.total, reply.unique, reply.zero);
+    } else {
+        printf("%lf\n", reply.bw);
+    }
+    return 1;
 }
 
 int main(int argc, char *argv[]){
-    /* argument test */
-    if (argc != 5) usage(NULL);
+    /* a cancelled server connection is reported as a send error instead */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* agent mode */
+    if (argc >= 2 && strcmp(argv[1], "-agent") == 0) {
+        vector<int> userIDs;
+        for (int i = 3; i < argc; i++) userIDs.push_back(atoi(argv[i]));
+
+        /* initialize openssl locks */
+        if (!CryptoPrimitive::opensslLockSetup()) {
+            printf("fail to set up OpenSSL locks\n");
+
+            return 0;
+        }
+        confObj = new Configuration();
+        Agent* agentObj = new Agent(argc >= 3 ? argv[2] : AGENT_SOCKET_PATH, confObj, userIDs);
+        agentObj->run();
+        return 0;
+    }
+
+    /* argument test (range download takes the range instead of agent socket) */
+    if (argc >= 4 && strncmp(argv[3], "-r", 2) == 0) {
+        if (argc != 7 && argc != 8) usage(NULL);
+    } else if (argc != 5 && argc != 6) {
+        usage(NULL);
+    }
 
     /* get options */
     int userID = atoi(argv[2]);
     char* opt = argv[3];
     char* securesetting = argv[4];
 
-    /* read file */
-    FILE * fin = fopen(argv[1],"r");
-
-    /* get file size */
-    fseek(fin,0,SEEK_END);
-    long size = ftell(fin);	
-    fseek(fin,0,SEEK_SET);
+    /* full file name process */
+    int namesize = strlen(argv[1]) + 1;
 
-    unsigned char * buffer;
-    int *chunkEndIndexList;
-    int numOfChunks;
-    int n, m, k, r, *kShareIDList;
+    /* parse secure parameters */
+    int securetype = LOW_SEC_PAIR_TYPE;
+    if(strncmp(securesetting,"HIGH", 4) == 0) securetype = HIGH_SEC_PAIR_TYPE;
 
-    int i;
+    /* submit the job to agent */
+    if (argc == 6 && strncmp(opt, "-r", 2) != 0) {
+        if (strncmp(opt,"-u",2) == 0 || strncmp(opt, "-a", 2) == 0){
+            if (!submitJob(argv[5], AGENT_BACKUP, argv[1], namesize, argv[1], userID, securetype)) return 1;
+        }
+        if (strncmp(opt,"-s",2) == 0){
+            if (!submitJob(argv[5], AGENT_STREAM_BACKUP, argv[1], namesize, NULL, userID, securetype)) return 1;
+        }
+        if (strncmp(opt,"-d",2) == 0 || strncmp(opt, "-a", 2) == 0){
+            if (!submitJob(argv[5], AGENT_RESTORE, argv[1], namesize, (char*)"decoded_copy", userID, securetype)) return 1;
+        }
+        return 0;
+    }
 
     /* initialize openssl locks */
     if (!CryptoPrimitive::opensslLockSetup()) {
@@ -80,139 +145,84 @@ int main(int argc, char *argv[]){
     }
 
     confObj = new Configuration();
-    /* fix parameters here */
-    /* TO DO: load from config file */
-    n = confObj->getN();
-    m = confObj->getM();
-    k = confObj->getK();
-    r = confObj->getR();
-
-    /* initialize buffers */
-    int bufferSize = confObj->getBufferSize();
-    int chunkEndIndexListSize = confObj->getListSize();
-    int secretBufferSize = confObj->getSecretBufferSize();
-    int shareBufferSize = confObj->getShareBufferSize();
-
-    unsigned char *secretBuffer, *shareBuffer;
-    unsigned char tmp[secretBufferSize];
-    memset(tmp,0,secretBufferSize);
-    long zero = 0;
-    buffer = (unsigned char*) malloc (sizeof(unsigned char)*bufferSize);
-    chunkEndIndexList = (int*)malloc(sizeof(int)*chunkEndIndexListSize);
-    secretBuffer = (unsigned char*)malloc(sizeof(unsigned char) * secretBufferSize);
-    shareBuffer = (unsigned char*)malloc(sizeof(unsigned char) * shareBufferSize);
-
-    /* initialize share ID list */
-    kShareIDList = (int*)malloc(sizeof(int)*k);
-    for (i = 0; i < k; i++) kShareIDList[i] = i;
-
-    /* full file name process */
-    int namesize = 0;
-    while(argv[1][namesize] != '\0'){
-        namesize++;
-    }
-    namesize++;
-
-    /* parse secure parameters */
-    int securetype = LOW_SEC_PAIR_TYPE;
-    if(strncmp(securesetting,"HIGH", 4) == 0) securetype = HIGH_SEC_PAIR_TYPE;
+    sessionObj = new Session(userID, securetype, confObj);
 
     if (strncmp(opt,"-u",2) == 0 || strncmp(opt, "-a", 2) == 0){
-        uploaderObj = new Uploader(n,n,userID);
-        encoderObj = new Encoder(CAONT_RS_TYPE, n, m, r, securetype, uploaderObj);
-        chunkerObj = new Chunker(VAR_SIZE_TYPE);
-        double timer,split,bw, timer2, split2;
-        double total_t = 0;
-        timerStart(&timer2);
-        //chunking
-        //
-        Encoder::Secret_Item_t header;
-        header.type = 1;
-        memcpy(header.file_header.data, argv[1], namesize);
-        header.file_header.fullNameSize = namesize;
-        header.file_header.fileSize = size;
-
-
-        // do encode
-        encoderObj->add(&header);
-        //uploaderObj->generateMDHead(0,size,(unsigned char*) argv[1],namesize,n,0,0,0,0);
-
-        long total = 0;
-        int totalChunks = 0;
-        while (total < size){
-            timerStart(&timer);
-            int ret = fread(buffer,1,bufferSize,fin);
-            split = timerSplit(&timer);
-            total_t += split;
-            chunkerObj->chunking(buffer,ret,chunkEndIndexList,&numOfChunks);
-
-            int count = 0;
-            int preEnd = -1;
-            while(count < numOfChunks){
-                Encoder::Secret_Item_t input;
-                input.type = 0;
-                input.secret.secretID = totalChunks;
-                input.secret.secretSize = chunkEndIndexList[count] - preEnd;
-                memcpy(input.secret.data, buffer+preEnd+1, input.secret.secretSize);
-                if(memcmp(input.secret.data, tmp, input.secret.secretSize) == 0){
-                    zero += input.secret.secretSize;
-                }
-
-                input.secret.end = 0;
-                if(total+ret == size && count+1 == numOfChunks) input.secret.end = 1;
-                encoderObj->add(&input);
-                totalChunks++;
-                preEnd = chunkEndIndexList[count];
-                count++;
-            }
-            total+=ret;
+        /* read file */
+        FILE * fin = fopen(argv[1],"r");
+        if (fin == NULL) {
+            fprintf(stderr, "Error: fail to open %s!\n", argv[1]);
+            return 1;
         }
-        long long tt = 0, unique = 0;
-        uploaderObj->indicateEnd(&tt, &unique);
-        split2 = timerSplit(&timer2);
 
-        bw = size/1024/1024/(split2-total_t);
+        /* get file size */
+        fseek(fin,0,SEEK_END);
+        long size = ftell(fin);	
+        fseek(fin,0,SEEK_SET);
+
+        double bw;
+        long long tt = 0, unique = 0;
+        long zero = 0;
+        if (!sessionObj->backup(argv[1], namesize, fin, size, &bw, &tt, &unique, &zero)) return 1;
         printf("%lf\t%lld\t%lld\t%ld\n",bw, tt, unique, zero);
-        delete uploaderObj;
-        delete chunkerObj;
-        delete encoderObj;
+        fclose(fin);
     }
 
-
+    if (strncmp(opt,"-s",2) == 0){
+        /* the size is unknown until the end of stream */
+        double bw;
+        long long tt = 0, unique = 0;
+        long zero = 0;
+        if (!sessionObj->backup(argv[1], namesize, stdin, FILE_SIZE_UNKNOWN, &bw, &tt, &unique, &zero)) return 1;
+        printf("%lf\t%lld\t%lld\t%ld\n",bw, tt, unique, zero);
+    }
 
     if (strncmp(opt,"-d",2) == 0 || strncmp(opt, "-a", 2) == 0){
-        //cdCodecObj = new CDCodec(CAONT_RS_TYPE, n, m, r, cryptoObj);
-        decoderObj = new Decoder(CAONT_RS_TYPE, n, m, r, securetype);
-        downloaderObj = new Downloader(k,k,userID,decoderObj);
-        double timer,split,bw;
+        double bw;
         FILE * fw = fopen("./decoded_copy","wb");
 
-        decoderObj->setFilePointer(fw);
-        decoderObj->setShareIDList(kShareIDList);
-
-        timerStart(&timer);
-        downloaderObj->downloadFile(argv[1], namesize, k);
-        decoderObj->indicateEnd();
-        split = timerSplit(&timer);
-        bw = size/1024/1024/split;
+        if (!sessionObj->restore(argv[1], namesize, fw, &bw)) {
+            fclose(fw);
+            return 1;
+        }
         printf("%lf\n",bw);
 
         fclose(fw);
-        delete downloaderObj;
-        delete decoderObj;
     }
 
+    if (strncmp(opt,"-r",2) == 0){
+        long rangeOffset = atol(argv[5]);
+        long rangeLength = atol(argv[6]);
+        if (rangeOffset < 0 || (rangeLength <= 0 && rangeLength != RANGE_TO_END)) usage(NULL);
+
+        /* '-' writes the range to stdout, other messages are moved to stderr to keep it clean */
+        FILE * fw;
+        if (argc == 7) {
+            fw = fopen("./decoded_copy","wb");
+        } else if (strcmp(argv[7], "-") == 0) {
+            fflush(stdout);
+            fw = fdopen(dup(STDOUT_FILENO), "wb");
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        } else {
+            fw = fopen(argv[7],"wb");
+        }
+        if (fw == NULL) {
+            fprintf(stderr, "Error: fail to open the output file!\n");
+            return 1;
+        }
 
-    free(buffer);
-    free(chunkEndIndexList);
-    free(secretBuffer);
-    free(shareBuffer);
-    free(kShareIDList);
-    CryptoPrimitive::opensslLockCleanup();
-
-    fclose(fin);
-    return 0;	
+        double bw;
+        if (!sessionObj->restore(argv[1], namesize, fw, &bw, rangeOffset, rangeLength)) {
+            fclose(fw);
+            return 1;
+        }
+        printf("%lf\n", bw);
 
+        fclose(fw);
+    }
 
+    delete sessionObj;
+    delete confObj;
+    CryptoPrimitive::opensslLockCleanup();
+    return 0;	
 }
-
@@ -39,6 +39,12 @@ class Configuration{
 
       /* chunk end list size */
       int chunkEndIndexListSize_;
+
+      /* preallocate restored files (1) or not (0) */
+      int restoreFallocate_;
+
+      /* write restored files with O_DIRECT (1) or not (0) */
+      int restoreDirectIO_;
   public:
       /* constructor */
       Configuration(){
@@ -50,6 +56,8 @@ class Configuration{
         shareBufferSize_ = 16*1024*n_;
         bufferSize_ = 128*1024*1024;
         chunkEndIndexListSize_ = 1024*1024;
+        restoreFallocate_ = 1;
+        restoreDirectIO_ = 0;
       }
 
       inline int getN() { return n_; }
@@ -68,6 +76,10 @@ class Configuration{
 
       inline int getListSize() { return chunkEndIndexListSize_; }
 
+      inline int getRestoreFallocate() { return restoreFallocate_; }
+
+      inline int getRestoreDirectIO() { return restoreDirectIO_; }
+
 };
 
 #endif
@@ -140,6 +140,31 @@ int Socket::sendData(char * raw, int rawSize){
     return 0;
 }
 
+/*
+ * file trailer send function
+ *
+ * @param raw - raw data buffer_
+ * @param rawSize - size of raw data
+ *
+ */
+int Socket::sendTrailer(char * raw, int rawSize){
+    int indicator = SEND_TRAILER;
+
+    int bytecount;
+    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    if ((bytecount = send(hostSock_, &rawSize, sizeof(int), 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    if (genericSend(raw, rawSize) != rawSize) return -1;
+    return 0;
+}
+
 /*
  * data download function
  *
@@ -156,6 +181,9 @@ int Socket::genericDownload(char * raw, int rawSize){
             fprintf(stderr, "Error sending data %d\n", errno);
             return -1;
         }
+
+        /* connection closed */
+        if (bytecount == 0) return -1;
         total+=bytecount;
     }
     return 0;
@@ -221,6 +249,44 @@ int Socket::initDownload(char* filename, int namesize){
     return 0;
 }
 
+/*
+ * initiate downloading a byte range of a file
+ *
+ * @param filename - the full name of the targeting file
+ * @param namesize - the size of the file path
+ * @param rangeOffset - the offset of the range
+ * @param rangeLength - the length of the range
+ *
+ */
+int Socket::initRangeDownload(char* filename, int namesize, long rangeOffset, long rangeLength){
+    int indicator = INIT_RANGE_DOWNLOAD;
+    long range[2] = {rangeOffset, rangeLength};
+    int size = sizeof(range) + namesize;
+
+    int bytecount;
+    if ((bytecount = send(hostSock_, &indicator, sizeof(int), 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    if ((bytecount = send(hostSock_, &size, sizeof(int), 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    if ((bytecount = send(hostSock_, range, sizeof(range), 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    if ((bytecount = send(hostSock_, filename, namesize, 0)) == -1){
+        fprintf(stderr, "Error sending data %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * download a chunk of data
  *
@@ -232,21 +298,21 @@ int Socket::initDownload(char* filename, int namesize){
 int Socket::downloadChunk(char * raw, int* retSize){
     int indicator;
 
-    int bytecount;
-    if ((bytecount = recv(hostSock_, &indicator, sizeof(int), 0)) == -1){
-        fprintf(stderr, "Error receiving data %d\n", errno);
-        return -1;
-    }
+    if (genericDownload((char*)&indicator, sizeof(int)) != 0) return -1;
 
     int size;
-    if ((bytecount = recv(hostSock_, &size, sizeof(int), 0)) == -1){
-        fprintf(stderr, "Error receiving data %d\n", errno);
-        return -1;
-    }
+    if (genericDownload((char*)&size, sizeof(int)) != 0) return -1;
     *retSize = ntohl(size);
 
-    genericDownload(raw, *retSize);
+    return genericDownload(raw, *retSize);
+}
 
+/*
+ * shut down the connection, a blocking receive returns with failure
+ *
+ */
+int Socket::shutdownConnection(){
+    shutdown(hostSock_, SHUT_RDWR);
     return 0;
 }
 
@@ -21,6 +21,8 @@
 #define SEND_META (-1)
 #define SEND_DATA (-2)
 #define GET_STAT (-3)
+#define SEND_TRAILER (-4)
+#define INIT_RANGE_DOWNLOAD (-6)
 #define INIT_DOWNLOAD (-7)
 
 using namespace std;
@@ -80,6 +82,15 @@ class Socket{
          */ 
         int sendData(char * raw, int rawSize); 
 
+        /*
+         * file trailer send function
+         *
+         * @param raw - raw data buffer_
+         * @param rawSize - size of raw data
+         *
+         */ 
+        int sendTrailer(char * raw, int rawSize); 
+
         /*
          * status recv function
          *
@@ -100,6 +111,17 @@ class Socket{
          */
         int initDownload(char * filename, int namesize);
 
+        /*
+         * initiate downloading a byte range of a file
+         *
+         * @param filename - the full name of the targeting file
+         * @param namesize - the size of the file path
+         * @param rangeOffset - the offset of the range
+         * @param rangeLength - the length of the range
+         *
+         */
+        int initRangeDownload(char * filename, int namesize, long rangeOffset, long rangeLength);
+
         /*
          * download a chunk of data
          *
@@ -118,6 +140,12 @@ class Socket{
          * @return raw
          */
         int genericDownload(char *raw, int rawSize);
+
+        /*
+         * shut down the connection, a blocking receive returns with failure
+         *
+         */
+        int shutdownConnection();
 };
 
 #endif
@@ -11,19 +11,92 @@ DedupCore* dedupObj_;
 
 using namespace std;
 
+/*
+ * buffer pool constructor
+ *
+ * @param blockSize - size of each buffer
+ * @param maxFree - max number of free buffers kept
+ *
+ */
+BufferPool::BufferPool(size_t blockSize, int maxFree){
+	blockSize_ = blockSize;
+	maxFree_ = maxFree;
+	pthread_mutex_init(&lock_, NULL);
+}
+
+/*
+ * buffer pool destructor
+ */
+BufferPool::~BufferPool(){
+	for (size_t i = 0; i < freeList_.size(); i++){
+		free(freeList_[i]);
+	}
+	pthread_mutex_destroy(&lock_);
+}
+
+/*
+ * get a buffer from pool
+ */
+char* BufferPool::get(){
+	char* block = NULL;
+
+	pthread_mutex_lock(&lock_);
+	if (!freeList_.empty()){
+		block = freeList_.back();
+		freeList_.pop_back();
+	}
+	pthread_mutex_unlock(&lock_);
+
+	if (block == NULL) block = (char*)malloc(blockSize_);
+	return block;
+}
+
+/*
+ * return a buffer to pool
+ *
+ * @param block - the buffer
+ */
+void BufferPool::put(char* block){
+	pthread_mutex_lock(&lock_);
+	if ((int)freeList_.size() < maxFree_){
+		freeList_.push_back(block);
+		block = NULL;
+	}
+	pthread_mutex_unlock(&lock_);
+
+	free(block);
+}
+
 /*
  * constructor: initialize host socket
  *
  * @param port - port number
  * @param dedupObj - dedup object passed in
+ * @param backlog - length of the queue of pending connections
  *
  */
-Server::Server(int port, DedupCore* dedupObj){
+Server::Server(int port, DedupCore* dedupObj, int backlog){
 	//dedup. object
 	dedupObj_ = dedupObj;
 
 	//server port
 	hostPort_ = port;
+	backlog_ = backlog;
+
+	//buffer pools and job queue
+	dataPool_ = new BufferPool(sizeof(char)*BUFFER_LEN, BUFFER_POOL_MAX_FREE);
+	metaPool_ = new BufferPool(sizeof(char)*META_LEN, BUFFER_POOL_MAX_FREE);
+	statusPool_ = new BufferPool(sizeof(bool)*BUFFER_LEN, BUFFER_POOL_MAX_FREE);
+	pthread_mutex_init(&jobLock_, NULL);
+	pthread_cond_init(&jobCond_, NULL);
+	pthread_cond_init(&restoreCond_, NULL);
+	stopStat_ = false;
+	numOfActiveWorkers_ = 0;
+
+	//pipe for stopping the reactor
+	if (pipe(wakeFd_) == -1){
+		fprintf(stderr, "Error creating pipe %d\n", errno);
+	}
 
 	//server socket initialization
 	hostSock_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -54,7 +127,7 @@ Server::Server(int port, DedupCore* dedupObj){
 	}
 
 	//start to listen
-	if(listen(hostSock_, 10) == -1){
+	if(listen(hostSock_, backlog_) == -1){
 		fprintf(stderr, "Error listening %d\n", errno);
 	}
 }
@@ -74,148 +147,480 @@ double timerSplit(const double *t){
 }
 
 /*
- * Thread function: each thread maintains a socket from a certain client
+ * (re)arm a connection in epoll for one event
  *
- * @param lp - input parameter structure
+ * @param conn - the connection
+ * @param op - EPOLL_CTL_ADD or EPOLL_CTL_MOD
  *
  */
-void* SocketHandler(void* lp){
-	//double timer,split,bw;
-	
-	//get socket from input param
-	int *clientSock = (int*)lp;
+void Server::armConnection_(connection_t* conn, int op){
+	struct epoll_event event;
+	event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+	event.data.ptr = conn;
 
-	//variable initialization
-	int bytecount;
-	char * buffer = (char*)malloc(sizeof(char)*BUFFER_LEN);
-	char * metaBuffer = (char *)malloc(sizeof(char)*META_LEN);
-	bool* statusList = (bool*)malloc(sizeof(bool)*BUFFER_LEN);
-	memset(statusList,0,sizeof(bool)*BUFFER_LEN);
-	int metaSize;
-	int user = 0;
-	int dataSize = 0;
-	//double first_total = 0;
-	//double second_total = 0;
-	
-
-	//get user ID
-	if ((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1){
-		fprintf(stderr, "Error recv userID %d\n",errno);
+	if (epoll_ctl(epollFd_, op, conn->sock, &event) == -1){
+		fprintf(stderr, "Error arming connection %d\n", errno);
 	}
-	user= ntohl(*(int*)buffer);
+}
 
-	memset(buffer, 0, BUFFER_LEN);
-	int numOfShare = 0;
+/*
+ * accept all pending connections
+ *
+ */
+void Server::acceptConnections_(){
+	int clientSock;
 
-	//initialize hash object
-	CryptoPrimitive* hashObj = new CryptoPrimitive(SHA256_TYPE);
-	
-	//main loop for recv data package
 	while(true){
+		addrSize_ = sizeof(sockaddr_in);
+		if ((clientSock = accept(hostSock_, (sockaddr*)&sadr_, &addrSize_)) == -1){
+			if (errno == EINTR || errno == ECONNABORTED) continue;
 
-		/*recv indicator first*/
-		if((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1){
-			fprintf(stderr, "Error receiving data %d\n", errno);
+			/* edge-triggered, so stop only when no connection is pending */
+			if (errno != EAGAIN && errno != EWOULDBLOCK){
+				fprintf(stderr, "Error accepting %d\n", errno);
+			}
+			break;
 		}
+		printf("Received connection from %s\n", inet_ntoa(sadr_.sin_addr));
+
+		/* 
+		 * the client socket stays blocking, reactor receives with MSG_DONTWAIT 
+		 * while workers send replies and restored shares with blocking calls 
+		 */
+		connection_t* conn = (connection_t*)malloc(sizeof(connection_t));
+		memset(conn, 0, sizeof(connection_t));
+		conn->sock = clientSock;
+		conn->state = CONN_RECV_USER;
+		pthread_mutex_init(&conn->lock, NULL);
+		armConnection_(conn, EPOLL_CTL_ADD);
+	}
+}
 
-		/*if client closes, break loop*/
-		if(bytecount == 0) break;
+/*
+ * receive data of a connection without blocking
+ *
+ * @param conn - the connection
+ *
+ * @return 1 if a message is complete, 0 if no more data now, -1 if closed
+ *
+ */
+int Server::receive_(connection_t* conn){
+	while(true){
+		char* target;
+		int size;
+
+		/* the user ID first, then the head and data of each message */
+		if (conn->state == CONN_RECV_USER){
+			target = (char*)conn->head;
+			size = sizeof(int);
+		}else if (conn->state == CONN_RECV_HEAD){
+			target = (char*)conn->head;
+			size = 2*sizeof(int);
+		}else{
+			target = conn->buffer;
+			size = conn->packageSize;
+		}
 
-		int indicator = *(int*)buffer;
+		if (conn->received < size){
+			int bytecount = recv(conn->sock, target+conn->received, size-conn->received, MSG_DONTWAIT);
 
-		/*recv following package size*/
-		if((bytecount = recv(*clientSock, buffer, sizeof(int), 0)) == -1){
-			fprintf(stderr, "Error receiving data %d\n", errno);
+			/*if client closes, close the connection*/
+			if (bytecount == 0) return -1;
+			if (bytecount == -1){
+				if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+				if (errno == EINTR) continue;
+				fprintf(stderr, "Error receiving data %d\n", errno);
+				return -1;
+			}
+			conn->received += bytecount;
+			continue;
 		}
 
-		int packageSize = *(int*)buffer;
-		int count = 0;
-		
-		/*recv following data*/
-		while (count < packageSize){
-			if((bytecount = recv(*clientSock, buffer+count, packageSize-count, 0)) == -1){
-				fprintf(stderr, "Error receiving data %d\n", errno);
+		/* the current part is complete */
+		conn->received = 0;
+		if (conn->state == CONN_RECV_USER){
+			conn->user = ntohl(conn->head[0]);
+			conn->state = CONN_RECV_HEAD;
+		}else if (conn->state == CONN_RECV_HEAD){
+			conn->indicator = conn->head[0];
+			conn->packageSize = conn->head[1];
+			if (conn->packageSize < 0 || conn->packageSize > BUFFER_LEN){
+				fprintf(stderr, "Error: invalid package size %d\n", conn->packageSize);
+				return -1;
 			}
-			count += bytecount;
+			conn->buffer = dataPool_->get();
+			conn->state = CONN_RECV_BODY;
+		}else{
+			return 1;
 		}
+	}
+}
+
+/*
+ * queue the message just received by a connection, and pass the connection to workers if none is 
+ * processing it
+ *
+ * @param conn - the connection
+ *
+ * @return true if receiving goes on, false if it pauses as the queue is full
+ *
+ */
+bool Server::queueMessage_(connection_t* conn){
+	bool receiveStat;
+
+	pthread_mutex_lock(&conn->lock);
+	message_t* message = &conn->messages[(conn->firstMessage + conn->numOfMessages) % CONN_MAX_QUEUED_MESSAGES];
+	message->indicator = conn->indicator;
+	message->packageSize = conn->packageSize;
+	message->buffer = conn->buffer;
+	conn->numOfMessages++;
+
+	/* the next message goes to a new buffer */
+	conn->buffer = NULL;
+	conn->state = CONN_RECV_HEAD;
+
+	if (!conn->busy){
+		conn->busy = true;
+		scheduleConnection_(conn);
+	}
 
-		/*while metadata recv.ed, perform first stage deduplication*/
-		if (indicator == META){
-			memcpy(metaBuffer, buffer, count);
-			metaSize = count;
+	/* the worker rearms the connection once it takes a message */
+	if (conn->numOfMessages == CONN_MAX_QUEUED_MESSAGES) conn->paused = true;
+	receiveStat = !conn->paused;
+	pthread_mutex_unlock(&conn->lock);
 
-			//timerStart(&timer);
-			dedupObj_->firstStageDedup(user,(unsigned char*)metaBuffer, count, statusList, numOfShare, dataSize);
-			//split = timerSplit(&timer);
-			//first_total+= split;
+	return receiveStat;
+}
 
-			int ind = STAT;
-			memcpy(buffer, &ind, sizeof(int));
+/*
+ * pass a connection to the workers of its first queued message (the caller holds the lock of the connection)
+ *
+ * @param conn - the connection
+ *
+ */
+void Server::scheduleConnection_(connection_t* conn){
+	int indicator = conn->messages[conn->firstMessage].indicator;
+
+	pthread_mutex_lock(&jobLock_);
+	if (indicator == DOWNLOAD || indicator == DOWNLOAD_RANGE){
+		restoreQueue_.push_back(conn);
+		pthread_cond_signal(&restoreCond_);
+	}else{
+		jobQueue_.push_back(conn);
+		pthread_cond_signal(&jobCond_);
+	}
+	pthread_mutex_unlock(&jobLock_);
+}
 
-			/*return the status list*/
-			int bytecount;
-			if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1){
-				fprintf(stderr, "Error sending data %d\n", errno);
-			}
+/*
+ * close a connection and return its buffers
+ *
+ * @param conn - the connection
+ *
+ */
+void Server::closeConnection_(connection_t* conn){
+	epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn->sock, NULL);
+	close(conn->sock);
 
-			memcpy(buffer,&numOfShare, sizeof(int));
-			if ((bytecount = send(*clientSock, buffer, sizeof(int), 0)) == -1){
-				fprintf(stderr, "Error sending data %d\n", errno);
-			}
+	for (int i = 0; i < conn->numOfMessages; i++){
+		dataPool_->put(conn->messages[(conn->firstMessage + i) % CONN_MAX_QUEUED_MESSAGES].buffer);
+	}
+	pthread_mutex_destroy(&conn->lock);
+	if (conn->buffer != NULL) dataPool_->put(conn->buffer);
+	if (conn->metaBuffer != NULL) metaPool_->put(conn->metaBuffer);
+	if (conn->statusList != NULL) statusPool_->put((char*)conn->statusList);
+	free(conn);
+}
 
-			if ((bytecount = send(*clientSock, statusList, sizeof(bool)*numOfShare, 0)) == -1){
-				fprintf(stderr, "Error sending data %d\n", errno);
-			}
+/*
+ * process a complete message of a connection
+ *
+ * @param conn - the connection
+ * @param message - the message
+ * @param hashObj - hash object of the calling worker
+ *
+ */
+void Server::processMessage_(connection_t* conn, message_t* message, CryptoPrimitive* hashObj){
+	char* buffer = message->buffer;
+	int count = message->packageSize;
+	int indicator = message->indicator;
+	int user = conn->user;
+	int numOfShare = 0;
+	int dataSize = 0;
+
+	/*while metadata recv.ed, perform first stage deduplication*/
+	if (indicator == META){
+		if (count > META_LEN){
+			fprintf(stderr, "Error: metadata of %d bytes is too large\n", count);
+			return;
+		}
+		if (conn->metaBuffer == NULL){
+			conn->metaBuffer = metaPool_->get();
+			conn->statusList = (bool*)statusPool_->get();
+			memset(conn->statusList, 0, sizeof(bool)*BUFFER_LEN);
 		}
-		
-		/*while data recv.ed, perform second stage deduplication*/
-		if(indicator == DATA){
-			//timerStart(&timer);
-			dedupObj_->secondStageDedup(user, (unsigned char*)metaBuffer, metaSize, statusList, (unsigned char*)buffer, hashObj);
-			//split = timerSplit(&timer);
-			//second_total+=split;
+		memcpy(conn->metaBuffer, buffer, count);
+		conn->metaSize = count;
+
+		dedupObj_->firstStageDedup(user,(unsigned char*)conn->metaBuffer, count, conn->statusList, numOfShare, dataSize);
+
+		/*return the status list*/
+		int reply[2];
+		reply[0] = STAT;
+		reply[1] = numOfShare;
+		int bytecount;
+		if ((bytecount = send(conn->sock, reply, sizeof(reply), 0)) == -1){
+			fprintf(stderr, "Error sending data %d\n", errno);
 		}
 
-		/*while download request recv.ed, perform restore*/
-		if(indicator == DOWNLOAD){
-			std::string fullFileName;
-			fullFileName.assign(buffer, count);
-			dedupObj_->restoreShareFile(user, fullFileName, 0, *clientSock, hashObj);
+		if ((bytecount = send(conn->sock, conn->statusList, sizeof(bool)*numOfShare, 0)) == -1){
+			fprintf(stderr, "Error sending data %d\n", errno);
+		}
+	}
 
+	/*while data recv.ed, perform second stage deduplication*/
+	if (indicator == DATA){
+		if (conn->metaBuffer == NULL){
+			fprintf(stderr, "Error: share data without metadata\n");
+			return;
 		}
+		dedupObj_->secondStageDedup(user, (unsigned char*)conn->metaBuffer, conn->metaSize, conn->statusList, (unsigned char*)buffer, hashObj);
 	}
 
-	//printf("%lf\t%lf\n",first_total, second_total);
+	/*while file trailer recv.ed, finish the file*/
+	if (indicator == TRAILER){
+		dedupObj_->finishFileWithTrailer(user, (unsigned char*)buffer, count);
+	}
+
+	/*while download request recv.ed, perform restore*/
+	if (indicator == DOWNLOAD){
+		std::string fullFileName;
+		fullFileName.assign(buffer, count);
+		dedupObj_->restoreShareFile(user, fullFileName, 0, conn->sock, hashObj);
+	}
+
+	/*while range download request recv.ed, restore the shares covering the range*/
+	if (indicator == DOWNLOAD_RANGE && count >= (int)sizeof(fileRangeRequest_t)){
+		fileRangeRequest_t* rangeRequest = (fileRangeRequest_t*)buffer;
+		std::string fullFileName;
+		fullFileName.assign(buffer + sizeof(fileRangeRequest_t), count - sizeof(fileRangeRequest_t));
+		dedupObj_->restoreShareFile(user, fullFileName, 0, conn->sock, hashObj, 
+				rangeRequest->rangeOffset, rangeRequest->rangeLength);
+	}
+}
+
+/*
+ * main loop of a worker thread: process the queued messages of a connection in order, 
+ * while the reactor goes on receiving the next ones
+ *
+ * @param restoreStat - if the worker runs restore requests (or dedup requests)
+ *
+ */
+void Server::serveConnections_(bool restoreStat){
+	std::deque<connection_t*>* queue = restoreStat ? &restoreQueue_ : &jobQueue_;
+	pthread_cond_t* cond = restoreStat ? &restoreCond_ : &jobCond_;
+
+	//initialize hash object
+	CryptoPrimitive* hashObj = new CryptoPrimitive(SHA256_TYPE);
+
+	while(true){
+		pthread_mutex_lock(&jobLock_);
+		/* once stopping, a worker leaves when no worker may pass it a connection any more */
+		while(queue->empty() && !(stopStat_ && numOfActiveWorkers_ == 0)){
+			pthread_cond_wait(cond, &jobLock_);
+		}
+		if (queue->empty()){
+			pthread_mutex_unlock(&jobLock_);
+			break;
+		}
+		connection_t* conn = queue->front();
+		queue->pop_front();
+		numOfActiveWorkers_++;
+		pthread_mutex_unlock(&jobLock_);
+
+		while(true){
+			message_t message;
+			bool resumeStat, closeStat;
+
+			pthread_mutex_lock(&conn->lock);
+			if (conn->numOfMessages == 0){
+				/* the connection goes back to the reactor, or is closed if the client has closed */
+				conn->busy = false;
+				closeStat = conn->closed;
+				pthread_mutex_unlock(&conn->lock);
+
+				if (closeStat) closeConnection_(conn);
+				break;
+			}
+
+			/* a message of the other kind is passed to the other workers, with the connection still busy */
+			message = conn->messages[conn->firstMessage];
+			if ((message.indicator == DOWNLOAD || message.indicator == DOWNLOAD_RANGE) != restoreStat){
+				scheduleConnection_(conn);
+				pthread_mutex_unlock(&conn->lock);
+				break;
+			}
+			conn->firstMessage = (conn->firstMessage + 1) % CONN_MAX_QUEUED_MESSAGES;
+			conn->numOfMessages--;
+			resumeStat = conn->paused;
+			conn->paused = false;
+			pthread_mutex_unlock(&conn->lock);
+
+			/* rearm a paused connection, data that arrived meanwhile is reported again */
+			if (resumeStat) armConnection_(conn, EPOLL_CTL_MOD);
+
+			processMessage_(conn, &message, hashObj);
+
+			/* the message buffer goes back to pool until next message */
+			dataPool_->put(message.buffer);
+		}
+
+		pthread_mutex_lock(&jobLock_);
+		numOfActiveWorkers_--;
+		if (stopStat_ && numOfActiveWorkers_ == 0){
+			pthread_cond_broadcast(&jobCond_);
+			pthread_cond_broadcast(&restoreCond_);
+		}
+		pthread_mutex_unlock(&jobLock_);
+	}
 
-	/*free objects*/
 	delete hashObj;
-	free(buffer);
-	free(statusList);
-	free(metaBuffer);
-	free(clientSock);
-	return 0;
+}
+
+/*
+ * worker thread handler
+ *
+ * @param param - server object pointer
+ *
+ */
+void* Server::workerHandler(void* param){
+	((Server*)param)->serveConnections_(false);
+	return NULL;
+}
+
+/*
+ * restore worker thread handler
+ *
+ * @param param - server object pointer
+ *
+ */
+void* Server::restoreWorkerHandler(void* param){
+	((Server*)param)->serveConnections_(true);
+	return NULL;
+}
+
+/*
+ * stop the server: no more connections are accepted and no more messages are received 
+ * (safe to call from another thread, or before runReceive starts)
+ *
+ */
+void Server::stop(){
+	char wake = 0;
+
+	if (write(wakeFd_[1], &wake, 1) == -1){
+		fprintf(stderr, "Error waking the reactor %d\n", errno);
+	}
 }
 
 /*
  * main procedure for receiving data
+ * (an edge-triggered reactor receives messages into a small per-connection queue 
+ * while one worker at a time processes the queued ones, so the messages of a 
+ * connection are processed in order, and a connection with a full queue is not 
+ * rearmed until a worker takes a message; once the server is stopped, it returns 
+ * after the workers have processed the queued messages)
  * 
  */
 void Server::runReceive(){
-	addrSize_ = sizeof(sockaddr_in);
+	//create worker threads
+	for (int i = 0; i < SERVER_NUM_WORKERS; i++){
+		pthread_create(&workerId_[i], 0, &workerHandler, (void*)this);
+	}
+	for (int i = 0; i < SERVER_NUM_RESTORE_WORKERS; i++){
+		pthread_create(&restoreWorkerId_[i], 0, &restoreWorkerHandler, (void*)this);
+	}
 
-	//create a thread whenever a client connects
-	while(true){
-		printf("waiting for a connection\n");
-		clientSock_ = (int*)malloc(sizeof(int));
-		if((*clientSock_ = accept(hostSock_, (sockaddr*)&sadr_, &addrSize_))!= -1){
-			printf("Received connection from %s\n", inet_ntoa(sadr_.sin_addr));
-			pthread_create(&threadId_, 0, &SocketHandler, (void*)clientSock_);
-			pthread_detach(threadId_);
+	//register the listening socket
+	epollFd_ = epoll_create(MAX_EPOLL_EVENTS);
+	if (epollFd_ == -1){
+		fprintf(stderr, "Error creating epoll %d\n", errno);
+		return;
+	}
+	fcntl(hostSock_, F_SETFL, fcntl(hostSock_, F_GETFL, 0) | O_NONBLOCK);
+
+	struct epoll_event event;
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = NULL;
+	if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, hostSock_, &event) == -1){
+		fprintf(stderr, "Error adding listening socket %d\n", errno);
+		return;
+	}
+
+	//register the wake-up pipe
+	event.events = EPOLLIN;
+	event.data.ptr = wakeFd_;
+	if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_[0], &event) == -1){
+		fprintf(stderr, "Error adding wake-up pipe %d\n", errno);
+		return;
+	}
+
+	printf("waiting for connections\n");
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	bool stopStat = false;
+	while(!stopStat){
+		int num = epoll_wait(epollFd_, events, MAX_EPOLL_EVENTS, -1);
+		if (num == -1){
+			if (errno != EINTR) fprintf(stderr, "Error waiting events %d\n", errno);
+			continue;
 		}
-		else{
-			fprintf(stderr, "Error accepting %d\n", errno);
+
+		for (int i = 0; i < num; i++){
+			/* stop, the events of the other connections are left unhandled */
+			if (events[i].data.ptr == wakeFd_){
+				stopStat = true;
+				break;
+			}
+
+			/* new connections */
+			if (events[i].data.ptr == NULL){
+				acceptConnections_();
+				continue;
+			}
+
+			/* receive and queue messages until no more data now, or the queue is full */
+			connection_t* conn = (connection_t*)events[i].data.ptr;
+			int ret;
+			while ((ret = receive_(conn)) == 1){
+				if (!queueMessage_(conn)) break;
+			}
+
+			if (ret == 0){
+				armConnection_(conn, EPOLL_CTL_MOD);
+			}else if (ret == -1){
+				/* a worker processing the queued messages closes the connection afterwards */
+				pthread_mutex_lock(&conn->lock);
+				bool busy = conn->busy;
+				if (busy) conn->closed = true;
+				pthread_mutex_unlock(&conn->lock);
+
+				if (!busy) closeConnection_(conn);
+			}
 		}
 	}
-}
 
+	/* stop accepting, and wait for the workers to process the queued messages */
+	close(hostSock_);
 
+	pthread_mutex_lock(&jobLock_);
+	stopStat_ = true;
+	pthread_cond_broadcast(&jobCond_);
+	pthread_cond_broadcast(&restoreCond_);
+	pthread_mutex_unlock(&jobLock_);
+
+	for (int i = 0; i < SERVER_NUM_WORKERS; i++){
+		pthread_join(workerId_[i], NULL);
+	}
+	for (int i = 0; i < SERVER_NUM_RESTORE_WORKERS; i++){
+		pthread_join(restoreWorkerId_[i], NULL);
+	}
+}
@@ -16,6 +16,9 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <vector>
+#include <deque>
 
 #include "DedupCore.hh"
 #include "BackendStorer.hh"
@@ -25,17 +28,132 @@
 #define META (-1)
 #define DATA (-2)
 #define STAT (-3)
+#define TRAILER (-4)
+#define DOWNLOAD_RANGE (-6)
 #define DOWNLOAD (-7)
 
+/* default length of the queue of pending connections */
+#define DEFAULT_LISTEN_BACKLOG 128
+
+/* number of worker threads running dedup requests */
+#define SERVER_NUM_WORKERS 16
+
+/* number of worker threads running restore requests (a restore holds its worker until it is sent, 
+ * so slow restores never hold up the dedup requests) */
+#define SERVER_NUM_RESTORE_WORKERS 4
+
+/* max number of events returned by one epoll wait */
+#define MAX_EPOLL_EVENTS 256
+
+/* number of free buffers kept by a buffer pool */
+#define BUFFER_POOL_MAX_FREE 16
+
+/* max number of complete messages of a connection waiting for a worker (receiving pauses beyond it) */
+#define CONN_MAX_QUEUED_MESSAGES 2
+
+/* receiving states of a connection */
+#define CONN_RECV_USER 0
+#define CONN_RECV_HEAD 1
+#define CONN_RECV_BODY 2
+
 
 using namespace std;
 
+/*
+ * pool of fixed-size buffers, freed buffers are kept for reuse
+ * instead of returning them to the system
+ */
+class BufferPool{
+private:
+
+	//size of each buffer
+	size_t blockSize_;
+
+	//max number of free buffers kept
+	int maxFree_;
+
+	//free buffers
+	std::vector<char*> freeList_;
+
+	//lock for free list
+	pthread_mutex_t lock_;
+
+public:
+	BufferPool(size_t blockSize, int maxFree);
+	~BufferPool();
+
+	/*
+	 * get a buffer from pool
+	 */
+	char* get();
+
+	/*
+	 * return a buffer to pool
+	 *
+	 * @param block - the buffer
+	 */
+	void put(char* block);
+};
+
 class Server{
 private:
 
+	/* complete message structure */
+	typedef struct{
+		//indicator and size of the message
+		int indicator;
+		int packageSize;
+
+		//message data buffer (from pool)
+		char* buffer;
+	}message_t;
+
+	/* connection state structure */
+	typedef struct{
+		//client socket
+		int sock;
+
+		//user ID
+		int user;
+
+		//receiving state and bytes received in this state
+		int state;
+		int received;
+
+		//message head (or user ID) being received
+		int head[2];
+
+		//indicator and size of current message
+		int indicator;
+		int packageSize;
+
+		//message data buffer (from pool while a message is in progress)
+		char* buffer;
+
+		//complete messages waiting for a worker (a ring), and the lock of the fields below
+		message_t messages[CONN_MAX_QUEUED_MESSAGES];
+		int firstMessage;
+		int numOfMessages;
+		pthread_mutex_t lock;
+
+		//if a worker is processing the messages, if receiving is paused as the queue is full, 
+		//and if the client has closed while a worker is processing
+		bool busy;
+		bool paused;
+		bool closed;
+
+		//metadata of last META message, kept for the following DATA message
+		char* metaBuffer;
+		int metaSize;
+		bool* statusList;
+	}connection_t;
+
 	//port number
 	int hostPort_;
 
+	//length of the queue of pending connections
+	int backlog_;
+
 	//server address struct
 	struct sockaddr_in myAddr_;
 	
@@ -46,19 +164,126 @@ private:
 	//socket size
 	socklen_t addrSize_;
 
-	//client socket
-	int* clientSock_;
-
 	//socket address
 	struct sockaddr_in sadr_;
 		
-	//thread ID
-	pthread_t threadId_;
+	//epoll descriptor
+	int epollFd_;
+
+	//pipe that wakes the reactor up to stop the server
+	int wakeFd_[2];
+
+	//worker thread IDs
+	pthread_t workerId_[SERVER_NUM_WORKERS];
+	pthread_t restoreWorkerId_[SERVER_NUM_RESTORE_WORKERS];
+
+	//connections having complete messages and no worker yet (for dedup and for restore requests), 
+	//and their lock and conditions
+	std::deque<connection_t*> jobQueue_;
+	std::deque<connection_t*> restoreQueue_;
+	pthread_mutex_t jobLock_;
+	pthread_cond_t jobCond_;
+	pthread_cond_t restoreCond_;
+
+	//if the server is stopping, and the number of workers processing a connection (guarded by jobLock_)
+	bool stopStat_;
+	int numOfActiveWorkers_;
+
+	//pools for message, metadata and status list buffers
+	BufferPool* dataPool_;
+	BufferPool* metaPool_;
+	BufferPool* statusPool_;
+
+	/*
+	 * accept all pending connections
+	 */
+	void acceptConnections_();
+
+	/*
+	 * (re)arm a connection in epoll for one event
+	 *
+	 * @param conn - the connection
+	 * @param op - EPOLL_CTL_ADD or EPOLL_CTL_MOD
+	 */
+	void armConnection_(connection_t* conn, int op);
+
+	/*
+	 * receive data of a connection without blocking
+	 *
+	 * @param conn - the connection
+	 *
+	 * @return 1 if a message is complete, 0 if no more data now, -1 if closed
+	 */
+	int receive_(connection_t* conn);
+
+	/*
+	 * queue the message just received by a connection, and pass the connection to workers if none is 
+	 * processing it
+	 *
+	 * @param conn - the connection
+	 *
+	 * @return true if receiving goes on, false if it pauses as the queue is full
+	 */
+	bool queueMessage_(connection_t* conn);
+
+	/*
+	 * pass a connection to the workers of its first queued message (the caller holds the lock of the connection)
+	 *
+	 * @param conn - the connection
+	 */
+	void scheduleConnection_(connection_t* conn);
+
+	/*
+	 * close a connection and return its buffers
+	 *
+	 * @param conn - the connection
+	 */
+	void closeConnection_(connection_t* conn);
+
+	/*
+	 * process a complete message of a connection
+	 *
+	 * @param conn - the connection
+	 * @param message - the message
+	 * @param hashObj - hash object of the calling worker
+	 */
+	void processMessage_(connection_t* conn, message_t* message, CryptoPrimitive* hashObj);
+
+	/*
+	 * main loop of a worker thread
+	 *
+	 * @param restoreStat - if the worker runs restore requests (or dedup requests)
+	 */
+	void serveConnections_(bool restoreStat);
 
 public:
-	Server(int port, DedupCore* dedupObj);
+	Server(int port, DedupCore* dedupObj, int backlog = DEFAULT_LISTEN_BACKLOG);
+
+	/*
+	 * main procedure for receiving data, returns once the server is stopped 
+	 * and the workers have processed the queued messages
+	 */
 	void runReceive();
-//	void* SocketHandler(void* lp);
+
+	/*
+	 * stop the server: no more connections are accepted and no more messages are received 
+	 * (safe to call from another thread, or before runReceive starts)
+	 */
+	void stop();
+
+	/*
+	 * worker thread handler
+	 *
+	 * @param param - server object pointer
+	 */
+	static void* workerHandler(void* param);
+
+	/*
+	 * restore worker thread handler
+	 *
+	 * @param param - server object pointer
+	 */
+	static void* restoreWorkerHandler(void* param);
 };
 
 #endif
@@ -0,0 +1,729 @@
+/*
+ * ContainerWriter.cc
+ */
+
+#include "ContainerWriter.hh"
+
+using namespace std;
+
+/*
+ * write a whole buffer into a file
+ *
+ * @param fd - the file descriptor
+ * @param buffer - the buffer
+ * @param bufferSize - the size of the buffer
+ * @param offset - the offset in the file
+ *
+ * @return - a boolean value that indicates if the write op succeeds
+ */
+static bool writeAll(int fd, const unsigned char *buffer, long bufferSize, long offset) {
+	long doneSize = 0;
+	long ret;
+
+	while (doneSize < bufferSize) {
+		ret = pwrite(fd, buffer + doneSize, bufferSize - doneSize, offset + doneSize);
+
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return 0;
+		}
+		doneSize += ret;
+	}
+
+	return 1;
+}
+
+/*
+ * constructor of ContainerWriter
+ *
+ * @param segmentDirName - the name of the directory that stores the segment files (formatted)
+ * @param deviceID - the device id of the directory (its position in the list of data directories)
+ * @param db - the key-value database that keeps the container locations
+ * @param containerStorerObj - the BackendStorer instance that manages the sealed segment files
+ * @param shareIndex - the share index
+ * @param commitHandler - the handler called with the keys of the share index entries once committed 
+ * (or once dropped, with commitStat unset)
+ * @param recipeHandler - the handler that stores a recipe node
+ * @param commitArg - the argument passed to the handlers
+ */
+ContainerWriter::ContainerWriter(const std::string &segmentDirName, int deviceID, leveldb::DB *db, 
+		BackendStorer *containerStorerObj, ShareIndex *shareIndex, 
+		void (*commitHandler)(void *arg, const std::vector<std::string> &keyList, bool commitStat), 
+		bool (*recipeHandler)(void *arg, const containerNode_t *recipeNode), void *commitArg) {
+	std::string valueString;
+
+	segmentDirName_ = segmentDirName;
+	deviceID_ = deviceID;
+	db_ = db;
+	containerStorerObj_ = containerStorerObj;
+	shareIndex_ = shareIndex;
+	commitHandler_ = commitHandler;
+	recipeHandler_ = recipeHandler;
+	commitArg_ = commitArg;
+
+	/*the tail key of device 0 is the one of a server with a single data directory*/
+	segmentTailKey_ = SEGMENT_TAIL_KEY;
+	if (deviceID_ > 0) {
+		std::ostringstream deviceIDStream;
+
+		deviceIDStream << deviceID_;
+		segmentTailKey_ += deviceIDStream.str();
+	}
+
+	/*continue the segment that was being appended (it is opened at the first write)*/
+	segmentFD_ = -1;
+	memset(&segmentTail_, 0, sizeof(segmentTail_t));
+	leveldb::Status getStat = db_->Get(leveldb::ReadOptions(), segmentTailKey_, &valueString);
+	if (getStat.ok()) {
+		if (valueString.size() != sizeof(segmentTail_t)) {
+			fprintf(stderr, "Error: the tail of the segments in the database is corrupted!\n");
+			exit(1);
+		}
+		memcpy(&segmentTail_, valueString.data(), sizeof(segmentTail_t));
+	}
+	else if (!getStat.IsNotFound()) {
+		fprintf(stderr, "Error: fail to read the tail of the segments from the database!\n");
+		fprintf(stderr, "Status: %s \n", getStat.ToString().c_str());
+		exit(1);
+	}
+
+	headContainerNode_ = NULL;
+	tailContainerNode_ = NULL;
+	numOfPendingContainers_ = 0;
+	stopStat_ = 0;
+	failStat_ = 0;
+
+	/*initialize the mutex lock writerLock_*/
+	if (pthread_mutex_init(&writerLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock writerLock_!\n");
+		exit(1);
+	}
+
+	/*initialize the condition writerCond_*/
+	if (pthread_cond_init(&writerCond_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the condition writerCond_!\n");
+		exit(1);
+	}
+
+	/*initialize the condition doneCond_*/
+	if (pthread_cond_init(&doneCond_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the condition doneCond_!\n");
+		exit(1);
+	}
+
+	/*start the writer thread*/
+	if (pthread_create(&writerThread_, NULL, writerHandler_, (void *) this) != 0) {
+		fprintf(stderr, "Error: fail to create the writer thread!\n");
+		exit(1);
+	}
+}
+
+/*
+ * destructor of ContainerWriter (the queued share containers are written first)
+ */
+ContainerWriter::~ContainerWriter() {
+	/*stop the writer thread once the queue is drained*/
+	pthread_mutex_lock(&writerLock_);
+	stopStat_ = 1;
+	pthread_cond_signal(&writerCond_);
+	pthread_mutex_unlock(&writerLock_);
+
+	pthread_join(writerThread_, NULL);
+
+	/*the segment is left preallocated, and is continued after a restart*/
+	if (segmentFD_ >= 0) {
+		close(segmentFD_);
+	}
+
+	/*clean up the mutex lock writerLock_*/
+	pthread_mutex_destroy(&writerLock_);
+	/*clean up the conditions writerCond_ and doneCond_*/
+	pthread_cond_destroy(&writerCond_);
+	pthread_cond_destroy(&doneCond_);
+}
+
+/*
+ * transform a segment id to the full name of the segment file
+ *
+ * @param segmentID - the segment id
+ * @param segmentName - the full segment name <return>
+ */
+void ContainerWriter::segmentID2Name_(const uint64_t &segmentID, std::string &segmentName) {
+	char shortName[SEGMENT_NAME_SIZE];
+
+	snprintf(shortName, SEGMENT_NAME_SIZE, SEGMENT_NAME_FORMAT, deviceID_, (unsigned long long) segmentID);
+	segmentName = segmentDirName_ + shortName;
+}
+
+/*
+ * open/create the segment of segmentTail_ for appending
+ *
+ * @return - a boolean value that indicates if the open op succeeds
+ */
+bool ContainerWriter::openSegment_() {
+	std::string segmentName;
+	int ret;
+
+	segmentID2Name_(segmentTail_.segmentID, segmentName);
+
+	segmentFD_ = open(segmentName.c_str(), O_WRONLY | O_CREAT, 0644);
+	if (segmentFD_ < 0) {
+		fprintf(stderr, "Error: fail to open/create the segment file '%s'!\n", segmentName.c_str());
+		return 0;
+	}
+
+	/*preallocate the whole segment, so that the appends do not extend the file one by one*/
+	ret = posix_fallocate(segmentFD_, 0, SEGMENT_SIZE);
+	if (ret != 0) {
+		fprintf(stderr, "Error: fail to preallocate the segment file '%s' (errno %d)!\n", segmentName.c_str(), ret);
+
+		close(segmentFD_);
+		segmentFD_ = -1;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * seal the segment being appended (cut its preallocated space), and start the next one
+ *
+ * @return - a boolean value that indicates if the seal op succeeds
+ */
+bool ContainerWriter::sealSegment_() {
+	std::string segmentName;
+
+	segmentID2Name_(segmentTail_.segmentID, segmentName);
+
+	if (ftruncate(segmentFD_, segmentTail_.segmentOffset) != 0 || fsync(segmentFD_) != 0) {
+		fprintf(stderr, "Error: fail to seal the segment file '%s'!\n", segmentName.c_str());
+		return 0;
+	}
+
+	close(segmentFD_);
+	segmentFD_ = -1;
+
+	if (containerStorerObj_ != NULL) {
+		containerStorerObj_->addNewFile(segmentName);
+	}
+
+	segmentTail_.segmentID++;
+	segmentTail_.segmentOffset = 0;
+
+	return openSegment_();
+}
+
+/*
+ * append a batch of share containers into the segments, and commit their locations and share index entries
+ *
+ * @param headNode - the first node of the batch
+ * @param numOfNodes - the number of nodes of the batch
+ *
+ * @return - a boolean value that indicates if the write op succeeds
+ */
+bool ContainerWriter::writeBatch_(containerNode_t *headNode, int numOfNodes) {
+	std::vector<std::string> shareKeyList, shareValueList;
+	leveldb::WriteBatch locationBatch;
+	leveldb::WriteOptions syncOptions;
+	containerLocation_t location;
+	char locationKey[CONTAINER_LOCATION_KEY_SIZE];
+	containerNode_t *currNode;
+	int i;
+
+	if (segmentFD_ < 0 && !openSegment_()) {
+		return 0;
+	}
+
+	/*1. append the share containers*/
+	currNode = headNode;
+	for (i = 0; i < numOfNodes; i++) {
+		if (segmentTail_.segmentOffset + currNode->shareContainerSize > SEGMENT_SIZE) {
+			if (!sealSegment_()) {
+				return 0;
+			}
+		}
+
+		if (!writeAll(segmentFD_, currNode->shareContainerBuffer, currNode->shareContainerSize,
+					segmentTail_.segmentOffset)) {
+			fprintf(stderr, "Error: fail to write the share container %llu into the segment %llu!\n",
+					(unsigned long long) currNode->shareContainerID, (unsigned long long) segmentTail_.segmentID);
+			return 0;
+		}
+
+		memset(&location, 0, sizeof(containerLocation_t));
+		location.segmentID = segmentTail_.segmentID;
+		location.segmentOffset = segmentTail_.segmentOffset;
+		location.shareContainerSize = currNode->shareContainerSize;
+		location.deviceID = deviceID_;
+
+		containerID2LocationKey(currNode->shareContainerID, locationKey);
+		locationBatch.Put(leveldb::Slice(locationKey, CONTAINER_LOCATION_KEY_SIZE),
+				leveldb::Slice((char *) &location, sizeof(containerLocation_t)));
+
+		segmentTail_.segmentOffset += currNode->shareContainerSize;
+
+		shareKeyList.insert(shareKeyList.end(), currNode->shareKeyList->begin(), currNode->shareKeyList->end());
+		shareValueList.insert(shareValueList.end(), currNode->shareValueList->begin(), currNode->shareValueList->end());
+
+		currNode = currNode->next;
+	}
+
+	/*2. make the whole batch durable with one fsync*/
+	if (fdatasync(segmentFD_) != 0) {
+		fprintf(stderr, "Error: fail to sync the segment %llu!\n", (unsigned long long) segmentTail_.segmentID);
+		return 0;
+	}
+
+	/*3. commit the locations only then, together with the new tail and the share index entries*/
+	bool shareBatchStat = shareIndex_->addToBatch(shareKeyList, shareValueList, locationBatch);
+	locationBatch.Put(segmentTailKey_, leveldb::Slice((char *) &segmentTail_, sizeof(segmentTail_t)));
+	syncOptions.sync = true;
+	leveldb::Status writeStat = db_->Write(syncOptions, &locationBatch);
+	if (!writeStat.ok()) {
+		fprintf(stderr, "Error: fail to commit the locations of the share containers!\n");
+		fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+		return 0;
+	}
+
+	/*an engine with its own store gets the entries after the locations, so that an entry never points to a lost container*/
+	if (!shareBatchStat && !shareKeyList.empty()) {
+		writeStat = shareIndex_->write(shareKeyList, shareValueList);
+		if (!writeStat.ok()) {
+			fprintf(stderr, "Error: fail to commit the share index entries of the share containers!\n");
+			fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+			return 0;
+		}
+	}
+
+	/*4. the entries can now be looked up in the share index*/
+	if (!shareKeyList.empty()) {
+		commitHandler_(commitArg_, shareKeyList, 1);
+	}
+
+	return 1;
+}
+
+/*
+ * the main procedure of the writer thread
+ *
+ * @param param - the ContainerWriter instance
+ */
+void *ContainerWriter::writerHandler_(void *param) {
+	ContainerWriter *obj = (ContainerWriter *) param;
+	containerNode_t *headNode, *lastNode, *currNode;
+	bool failStat, recipeStat;
+	int numOfNodes, i;
+
+	while (1) {
+		/*1. take the share containers at the head of the queue as a batch, or the recipe there alone 
+		  (they stay in the queue for the readers)*/
+		pthread_mutex_lock(&(obj->writerLock_));
+		while ((obj->numOfPendingContainers_ <= 0) && (!obj->stopStat_)) {
+			pthread_cond_wait(&(obj->writerCond_), &(obj->writerLock_));
+		}
+		if (obj->numOfPendingContainers_ <= 0) {
+			pthread_mutex_unlock(&(obj->writerLock_));
+			break;
+		}
+		headNode = obj->headContainerNode_;
+		numOfNodes = 1;
+		if (headNode->recipeFileName == NULL) {
+			currNode = headNode;
+			while ((numOfNodes < obj->numOfPendingContainers_) && (currNode->next->recipeFileName == NULL)) {
+				currNode = currNode->next;
+				numOfNodes++;
+			}
+		}
+		failStat = obj->failStat_;
+		pthread_mutex_unlock(&(obj->writerLock_));
+
+		/*2. store the recipe, whatever the share containers of this writer (it fails if one of its share 
+		  containers is dropped)*/
+		recipeStat = 1;
+		if (headNode->recipeFileName != NULL) {
+			if (!obj->recipeHandler_(obj->commitArg_, headNode)) {
+				fprintf(stderr, "Error: fail to store the recipes of the file '%s'!\n", headNode->recipeFileName->c_str());
+				recipeStat = 0;
+			}
+		}
+		/*or write the batch (after a failure, nothing more is written)*/
+		else if (!failStat && !obj->writeBatch_(headNode, numOfNodes)) {
+			fprintf(stderr, "Error: fail to write a batch of %d share containers!\n", numOfNodes);
+
+			pthread_mutex_lock(&(obj->writerLock_));
+			obj->failStat_ = 1;
+			pthread_mutex_unlock(&(obj->writerLock_));
+			failStat = 1;
+		}
+
+		/*the entries of the share containers not written are released uncommitted, so they are not found any more*/
+		if (failStat && (headNode->recipeFileName == NULL)) {
+			currNode = headNode;
+			for (i = 0; i < numOfNodes; i++) {
+				if (!currNode->shareKeyList->empty()) {
+					obj->commitHandler_(obj->commitArg_, *(currNode->shareKeyList), 0);
+				}
+				currNode = currNode->next;
+			}
+		}
+
+		/*3. remove the batch from the queue (keeping what is dropped), and wake up the waiting threads*/
+		pthread_mutex_lock(&(obj->writerLock_));
+		if (!recipeStat) {
+			obj->droppedRecipeFileSet_.insert(*(headNode->recipeFileName));
+		}
+		if (failStat && (headNode->recipeFileName == NULL)) {
+			currNode = headNode;
+			for (i = 0; i < numOfNodes; i++) {
+				obj->droppedContainerSet_.insert(currNode->shareContainerID);
+				currNode = currNode->next;
+			}
+		}
+		lastNode = headNode;
+		for (i = 1; i < numOfNodes; i++) {
+			lastNode = lastNode->next;
+		}
+		obj->headContainerNode_ = lastNode->next;
+		if (obj->headContainerNode_ == NULL) {
+			obj->tailContainerNode_ = NULL;
+		}
+		lastNode->next = NULL;
+		obj->numOfPendingContainers_ -= numOfNodes;
+		pthread_cond_broadcast(&(obj->doneCond_));
+		pthread_mutex_unlock(&(obj->writerLock_));
+
+		while (headNode != NULL) {
+			currNode = headNode;
+			headNode = headNode->next;
+
+			freeNode_(currNode);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * add a node to the tail of the queue, once there is room for it
+ *
+ * @param targetNode - the node
+ *
+ * @return - a boolean value that indicates if the node is added (a share container is not, once the 
+ * writer has failed)
+ */
+bool ContainerWriter::addNode_(containerNode_t *targetNode) {
+	pthread_mutex_lock(&writerLock_);
+	/*wait if the writer falls too far behind*/
+	while (!failStat_ && (numOfPendingContainers_ >= MAX_PENDING_CONTAINERS)) {
+		pthread_cond_wait(&doneCond_, &writerLock_);
+	}
+	/*a failed writer takes no more share containers (the recipes waiting for them then fail)*/
+	if (failStat_ && (targetNode->recipeFileName == NULL)) {
+		droppedContainerSet_.insert(targetNode->shareContainerID);
+		pthread_mutex_unlock(&writerLock_);
+
+		return 0;
+	}
+	/*add the node to the tail of the queue, and then signal the writer*/
+	if (tailContainerNode_ == NULL) {
+		headContainerNode_ = targetNode;
+		tailContainerNode_ = targetNode;
+	}
+	else {
+		tailContainerNode_->next = targetNode;
+		tailContainerNode_ = targetNode;
+	}
+	numOfPendingContainers_++;
+	pthread_cond_signal(&writerCond_);
+	pthread_mutex_unlock(&writerLock_);
+
+	return 1;
+}
+
+/*
+ * free a node
+ *
+ * @param targetNode - the node
+ */
+void ContainerWriter::freeNode_(containerNode_t *targetNode) {
+	free(targetNode->shareContainerBuffer);
+	delete targetNode->shareKeyList;
+	delete targetNode->shareValueList;
+	delete targetNode->recipeFileName;
+	delete targetNode->shareContainerIDList;
+	free(targetNode);
+}
+
+/*
+ * find a share container in the queue (with writerLock_ held)
+ *
+ * @param shareContainerID - the share container id
+ *
+ * @return - the node of the share container, or NULL if it is not in the queue
+ */
+containerNode_t *ContainerWriter::findContainerNode_(const uint64_t &shareContainerID) {
+	containerNode_t *currNode;
+
+	currNode = headContainerNode_;
+	while ((currNode != NULL) && 
+			((currNode->recipeFileName != NULL) || (currNode->shareContainerID != shareContainerID))) {
+		currNode = currNode->next;
+	}
+
+	return currNode;
+}
+
+/*
+ * hand off a share container to the writer (the data is copied, and the entries are taken over)
+ *
+ * @param shareContainerID - the share container id
+ * @param shareContainerBuffer - the data of the share container
+ * @param shareContainerSize - the size of the share container
+ * @param shareKeyList - the keys of the share index entries of the new shares (left empty)
+ * @param shareValueList - the values of the share index entries of the new shares (left empty)
+ *
+ * @return - a boolean value that indicates if the share container is handed off (otherwise, the writer 
+ * has failed, and the entries are released uncommitted)
+ */
+bool ContainerWriter::addContainer(const uint64_t &shareContainerID, const unsigned char *shareContainerBuffer,
+		const int &shareContainerSize, std::vector<std::string> &shareKeyList, 
+		std::vector<std::string> &shareValueList) {
+	containerNode_t *targetNode;
+
+	targetNode = (containerNode_t *) malloc(sizeof(containerNode_t));
+	targetNode->shareContainerID = shareContainerID;
+	targetNode->shareContainerBuffer = (unsigned char *) malloc(shareContainerSize);
+	memcpy(targetNode->shareContainerBuffer, shareContainerBuffer, shareContainerSize);
+	targetNode->shareContainerSize = shareContainerSize;
+	targetNode->shareKeyList = new std::vector<std::string>();
+	targetNode->shareKeyList->swap(shareKeyList);
+	targetNode->shareValueList = new std::vector<std::string>();
+	targetNode->shareValueList->swap(shareValueList);
+	targetNode->recipeFileName = NULL;
+	targetNode->recipeFileOffset = -1;
+	targetNode->finishStat = 0;
+	targetNode->shareContainerIDList = NULL;
+	targetNode->next = NULL;
+
+	/*the entries of a share container that a failed writer does not take are released uncommitted*/
+	if (!addNode_(targetNode)) {
+		if (!targetNode->shareKeyList->empty()) {
+			commitHandler_(commitArg_, *(targetNode->shareKeyList), 0);
+		}
+		freeNode_(targetNode);
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * hand off the data of a recipe file buffer to the writer (the data is copied), which stores it once 
+ * the share containers queued before it are written
+ *
+ * @param recipeFileName - the full name of the recipe file
+ * @param recipeFileOffset - the offset of the file recipe head that the entries are appended to 
+ * (-1 for a new recipe file)
+ * @param recipeFileBuffer - the data of the recipe file buffer
+ * @param recipeFileBufferSize - the size of the data
+ * @param finishStat - if the last file of the recipes is finished
+ * @param shareContainerIDList - the share containers of the entries (left empty)
+ */
+void ContainerWriter::addRecipe(const std::string &recipeFileName, const int &recipeFileOffset, 
+		const unsigned char *recipeFileBuffer, const int &recipeFileBufferSize, const bool &finishStat, 
+		std::vector<uint64_t> &shareContainerIDList) {
+	containerNode_t *targetNode;
+
+	targetNode = (containerNode_t *) malloc(sizeof(containerNode_t));
+	targetNode->shareContainerID = 0;
+	targetNode->shareContainerBuffer = (unsigned char *) malloc(recipeFileBufferSize);
+	memcpy(targetNode->shareContainerBuffer, recipeFileBuffer, recipeFileBufferSize);
+	targetNode->shareContainerSize = recipeFileBufferSize;
+	targetNode->shareKeyList = new std::vector<std::string>();
+	targetNode->shareValueList = new std::vector<std::string>();
+	targetNode->recipeFileName = new std::string(recipeFileName);
+	targetNode->recipeFileOffset = recipeFileOffset;
+	targetNode->finishStat = finishStat;
+	targetNode->shareContainerIDList = new std::vector<uint64_t>();
+	targetNode->shareContainerIDList->swap(shareContainerIDList);
+	targetNode->next = NULL;
+
+	addNode_(targetNode);
+}
+
+/*
+ * wait until a share container leaves the queue
+ *
+ * @param shareContainerID - the share container id
+ *
+ * @return - a boolean value that indicates if the share container is not dropped by the writer
+ */
+bool ContainerWriter::waitForContainer(const uint64_t &shareContainerID) {
+	bool dropStat;
+
+	pthread_mutex_lock(&writerLock_);
+	while (findContainerNode_(shareContainerID) != NULL) {
+		pthread_cond_wait(&doneCond_, &writerLock_);
+	}
+	dropStat = (droppedContainerSet_.find(shareContainerID) != droppedContainerSet_.end());
+	pthread_mutex_unlock(&writerLock_);
+
+	return !dropStat;
+}
+
+/*
+ * wait until the recipes of a recipe file leave the queue
+ *
+ * @param recipeFileName - the full name of the recipe file
+ *
+ * @return - a boolean value that indicates if no recipe of the file is dropped by the writer
+ */
+bool ContainerWriter::waitForRecipeFile(const std::string &recipeFileName) {
+	containerNode_t *currNode;
+	bool dropStat;
+
+	pthread_mutex_lock(&writerLock_);
+	while (1) {
+		currNode = headContainerNode_;
+		while ((currNode != NULL) && 
+				((currNode->recipeFileName == NULL) || (*(currNode->recipeFileName) != recipeFileName))) {
+			currNode = currNode->next;
+		}
+		if (currNode == NULL) {
+			break;
+		}
+		pthread_cond_wait(&doneCond_, &writerLock_);
+	}
+	dropStat = (droppedRecipeFileSet_.find(recipeFileName) != droppedRecipeFileSet_.end());
+	pthread_mutex_unlock(&writerLock_);
+
+	return !dropStat;
+}
+
+/*
+ * get the number of share containers waiting for the writer
+ *
+ * @return - the number of share containers in the queue
+ */
+int ContainerWriter::getNumOfPendingContainers() {
+	int numOfPendingContainers;
+
+	pthread_mutex_lock(&writerLock_);
+	numOfPendingContainers = numOfPendingContainers_;
+	pthread_mutex_unlock(&writerLock_);
+
+	return numOfPendingContainers;
+}
+
+/*
+ * read a part of a share container from the queue
+ *
+ * @param shareContainerID - the share container id
+ * @param offset - the offset of the part in the share container
+ * @param size - the size of the part
+ * @param buffer - the buffer for storing the part <return>
+ *
+ * @return - a boolean value that indicates if the share container is in the queue
+ */
+bool ContainerWriter::readPendingContainer(const uint64_t &shareContainerID, const int &offset, const int &size, 
+		unsigned char *buffer) {
+	containerNode_t *currNode;
+
+	pthread_mutex_lock(&writerLock_);
+
+	currNode = findContainerNode_(shareContainerID);
+
+	if (currNode != NULL) {
+		memcpy(buffer, currNode->shareContainerBuffer + offset, size);
+
+		pthread_mutex_unlock(&writerLock_);
+
+		return 1;
+	}
+	else {
+		pthread_mutex_unlock(&writerLock_);
+
+		return 0;
+	}
+}
+
+/*
+ * check if a share container is in the queue
+ *
+ * @param shareContainerID - the share container id
+ *
+ * @return - a boolean value that indicates if the share container is in the queue
+ */
+bool ContainerWriter::isPendingContainer(const uint64_t &shareContainerID) {
+	containerNode_t *currNode;
+
+	pthread_mutex_lock(&writerLock_);
+
+	currNode = findContainerNode_(shareContainerID);
+
+	pthread_mutex_unlock(&writerLock_);
+
+	return (currNode != NULL);
+}
+
+/*
+ * open the segment file that stores a share container for reading
+ *
+ * @param location - the location of the share container (on this device)
+ * @param fp - the file pointer of the segment file <return>
+ *
+ * @return - a boolean value that indicates if the open op succeeds
+ */
+bool ContainerWriter::openContainerFile(const containerLocation_t &location, FILE *&fp) {
+	std::string segmentName;
+
+	segmentID2Name_(location.segmentID, segmentName);
+	if (containerStorerObj_ != NULL) {
+		if (!containerStorerObj_->openOldFile(segmentName, fp)) {
+			fp = NULL;
+		}
+	}
+	else {
+		fp = fopen(segmentName.c_str(), "rb");
+	}
+
+	if (fp == NULL) {
+		fprintf(stderr, "Error: fail to open the segment file '%s'!\n", segmentName.c_str());
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * wait until all share containers and recipes handed off so far are durable
+ *
+ * @return - a boolean value that indicates if they are durable (otherwise, the writer has failed, 
+ * or a recipe is dropped)
+ */
+bool ContainerWriter::flush() {
+	bool failStat;
+
+	pthread_mutex_lock(&writerLock_);
+	while (numOfPendingContainers_ > 0) {
+		pthread_cond_wait(&doneCond_, &writerLock_);
+	}
+	failStat = failStat_ || !droppedRecipeFileSet_.empty();
+	pthread_mutex_unlock(&writerLock_);
+
+	return !failStat;
+}
+
+/*
+ * transform a share container id to the container location key
+ *
+ * @param shareContainerID - the share container id
+ * @param locationKey - the container location key <return>
+ */
+void ContainerWriter::containerID2LocationKey(const uint64_t &shareContainerID, char *locationKey) {
+	locationKey[0] = CONTAINER_LOCATION_KEY_PREFIX;
+	memcpy(locationKey + 1, &shareContainerID, sizeof(uint64_t));
+}
@@ -0,0 +1,344 @@
+/*
+ * ContainerWriter.hh
+ */
+
+#ifndef __CONTAINERWRITER_HH__
+#define __CONTAINERWRITER_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*for the use of LevelDB*/
+#include "leveldb/db.h"
+/*for the use of write batch*/
+#include "leveldb/write_batch.h"
+
+/*for the use of BackendStorer*/
+#include "BackendStorer.hh"
+
+/*for the use of ShareIndex*/
+#include "ShareIndex.hh"
+
+/*macro for the size of a segment file (preallocated when it is created, and cut to its used size when it is sealed)*/
+#define SEGMENT_SIZE (256<<20)
+
+/*macro for the max number of share containers waiting for the writer (an ingest thread waits beyond it)*/
+#define MAX_PENDING_CONTAINERS 32
+
+/*macros for the container location key ('6' + share container id)*/
+#define CONTAINER_LOCATION_KEY_PREFIX '6'
+#define CONTAINER_LOCATION_KEY_SIZE (1 + sizeof(uint64_t))
+
+/*macro for the key of the tail of the segment being appended (followed by the device id, except for device 0)*/
+#define SEGMENT_TAIL_KEY "SegmentTail"
+
+/*macros for the short name format of segment files (from the device id and the segment id), and the size of 
+  a buffer that fits the name of any ids*/
+#define SEGMENT_NAME_FORMAT "%03d%09llu.sg"
+#define SEGMENT_NAME_SIZE 40
+
+/*macro for the max number of devices (data directories) of the segment files*/
+#define MAX_NUM_OF_DEVICES 1000
+
+using namespace std;
+
+/*the location structure of a share container in the segment files*/
+typedef struct {
+	uint64_t segmentID;
+	long segmentOffset;
+	int shareContainerSize;
+	int deviceID;
+} containerLocation_t;
+
+/*the tail structure of the segment being appended*/
+typedef struct {
+	uint64_t segmentID;
+	long segmentOffset;
+} segmentTail_t;
+
+/*the node structure of a share container (or of the data of a recipe file buffer) waiting for the writer*/
+typedef struct containerNode {
+	uint64_t shareContainerID;
+	unsigned char *shareContainerBuffer;
+	int shareContainerSize;
+	/*the share index entries of the new shares in the share container*/
+	std::vector<std::string> *shareKeyList;
+	std::vector<std::string> *shareValueList;
+	/*for a recipe node (whose data is in shareContainerBuffer): the full name of the recipe file (NULL for 
+	  a share container), the offset of the file recipe head that the entries are appended to (-1 for a new 
+	  recipe file), if the last file of the recipes is finished, and the share containers of the entries*/
+	std::string *recipeFileName;
+	int recipeFileOffset;
+	bool finishStat;
+	std::vector<uint64_t> *shareContainerIDList;
+	struct containerNode *next;
+} containerNode_t;
+
+/*
+ * a background writer that appends share containers into the segment files of a device (data directory)
+ *
+ * note: the containers handed off by the ingest threads are written in batches, with one fsync of the
+ * segment for the whole batch (whatever the users of the containers), and the locations of the batch are
+ * committed into the database only after that, so a container is found in the database only when its data
+ * is durable; until then, the container is read from the queue; the share index entries of the new shares 
+ * in the containers are committed with the locations (or right after them, if the share index engine keeps 
+ * its own store), and the ingest threads are then told to release them; once a write fails, the writer 
+ * commits nothing more (the state of the segment is unknown), the entries of the containers not written are 
+ * released uncommitted, and the threads handing off or waiting for containers are told of the failure
+ *
+ * note: the writer also stores the recipe files handed off to it, in order, each one alone once the share 
+ * containers queued before it are written; the recipe handler waits for the share containers of the recipes 
+ * (in any writer) to be durable, and a recipe that is not stored is dropped, so the restores of its files fail
+ */
+class ContainerWriter {
+	private:
+		/*the name of the directory that stores the segment files, and its device id*/
+		std::string segmentDirName_;
+		int deviceID_;
+
+		/*the key of the tail of the segment being appended*/
+		std::string segmentTailKey_;
+
+		/*the key-value database that keeps the container locations*/
+		leveldb::DB *db_;
+
+		/*the BackendStorer instance that manages the sealed segment files*/
+		BackendStorer *containerStorerObj_;
+
+		/*the share index, and the handler called with the keys of the share index entries once committed 
+		  (or once dropped, with commitStat unset)*/
+		ShareIndex *shareIndex_;
+		void (*commitHandler_)(void *arg, const std::vector<std::string> &keyList, bool commitStat);
+		void *commitArg_;
+
+		/*the handler that stores a recipe node (with the same argument)*/
+		bool (*recipeHandler_)(void *arg, const containerNode_t *recipeNode);
+
+		/*the segment being appended*/
+		int segmentFD_;
+		segmentTail_t segmentTail_;
+
+		/*the queue of the share containers waiting for the writer (the head ones are being written)*/
+		containerNode_t *headContainerNode_;
+		containerNode_t *tailContainerNode_;
+		int numOfPendingContainers_;
+		bool stopStat_;
+		bool failStat_;
+		/*the share containers and recipe files dropped (only kept after a failure)*/
+		std::set<uint64_t> droppedContainerSet_;
+		std::set<std::string> droppedRecipeFileSet_;
+		pthread_mutex_t writerLock_;
+		pthread_cond_t writerCond_;
+		pthread_cond_t doneCond_;
+
+		/*the writer thread*/
+		pthread_t writerThread_;
+
+		/*
+		 * transform a segment id to the full name of the segment file
+		 *
+		 * @param segmentID - the segment id
+		 * @param segmentName - the full segment name <return>
+		 */
+		void segmentID2Name_(const uint64_t &segmentID, std::string &segmentName);
+
+		/*
+		 * open/create the segment of segmentTail_ for appending
+		 *
+		 * @return - a boolean value that indicates if the open op succeeds
+		 */
+		bool openSegment_();
+
+		/*
+		 * seal the segment being appended (cut its preallocated space), and start the next one
+		 *
+		 * @return - a boolean value that indicates if the seal op succeeds
+		 */
+		bool sealSegment_();
+
+		/*
+		 * append a batch of share containers into the segments, and commit their locations and share index entries
+		 *
+		 * @param headNode - the first node of the batch
+		 * @param numOfNodes - the number of nodes of the batch
+		 *
+		 * @return - a boolean value that indicates if the write op succeeds
+		 */
+		bool writeBatch_(containerNode_t *headNode, int numOfNodes);
+
+		/*
+		 * add a node to the tail of the queue, once there is room for it
+		 *
+		 * @param targetNode - the node
+		 *
+		 * @return - a boolean value that indicates if the node is added (a share container is not, once the 
+		 * writer has failed)
+		 */
+		bool addNode_(containerNode_t *targetNode);
+
+		/*
+		 * find a share container in the queue (with writerLock_ held)
+		 *
+		 * @param shareContainerID - the share container id
+		 *
+		 * @return - the node of the share container, or NULL if it is not in the queue
+		 */
+		containerNode_t *findContainerNode_(const uint64_t &shareContainerID);
+
+		/*
+		 * free a node
+		 *
+		 * @param targetNode - the node
+		 */
+		static void freeNode_(containerNode_t *targetNode);
+
+		/*
+		 * the main procedure of the writer thread
+		 *
+		 * @param param - the ContainerWriter instance
+		 */
+		static void *writerHandler_(void *param);
+
+	public:
+		/*
+		 * constructor of ContainerWriter
+		 *
+		 * @param segmentDirName - the name of the directory that stores the segment files (formatted)
+		 * @param deviceID - the device id of the directory (its position in the list of data directories)
+		 * @param db - the key-value database that keeps the container locations
+		 * @param containerStorerObj - the BackendStorer instance that manages the sealed segment files
+		 * @param shareIndex - the share index
+		 * @param commitHandler - the handler called with the keys of the share index entries once committed 
+		 * (or once dropped, with commitStat unset)
+		 * @param recipeHandler - the handler that stores a recipe node
+		 * @param commitArg - the argument passed to the handlers
+		 */
+		ContainerWriter(const std::string &segmentDirName, int deviceID, leveldb::DB *db, 
+				BackendStorer *containerStorerObj, ShareIndex *shareIndex, 
+				void (*commitHandler)(void *arg, const std::vector<std::string> &keyList, bool commitStat), 
+				bool (*recipeHandler)(void *arg, const containerNode_t *recipeNode), void *commitArg);
+
+		/*
+		 * destructor of ContainerWriter (the queued share containers are written first)
+		 */
+		~ContainerWriter();
+
+		/*
+		 * hand off a share container to the writer (the data is copied, and the entries are taken over)
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param shareContainerBuffer - the data of the share container
+		 * @param shareContainerSize - the size of the share container
+		 * @param shareKeyList - the keys of the share index entries of the new shares (left empty)
+		 * @param shareValueList - the values of the share index entries of the new shares (left empty)
+		 *
+		 * @return - a boolean value that indicates if the share container is handed off (otherwise, the writer 
+		 * has failed, and the entries are released uncommitted)
+		 */
+		bool addContainer(const uint64_t &shareContainerID, const unsigned char *shareContainerBuffer,
+				const int &shareContainerSize, std::vector<std::string> &shareKeyList, 
+				std::vector<std::string> &shareValueList);
+
+		/*
+		 * hand off the data of a recipe file buffer to the writer (the data is copied), which stores it once 
+		 * the share containers queued before it are written
+		 *
+		 * @param recipeFileName - the full name of the recipe file
+		 * @param recipeFileOffset - the offset of the file recipe head that the entries are appended to 
+		 * (-1 for a new recipe file)
+		 * @param recipeFileBuffer - the data of the recipe file buffer
+		 * @param recipeFileBufferSize - the size of the data
+		 * @param finishStat - if the last file of the recipes is finished
+		 * @param shareContainerIDList - the share containers of the entries (left empty)
+		 */
+		void addRecipe(const std::string &recipeFileName, const int &recipeFileOffset, 
+				const unsigned char *recipeFileBuffer, const int &recipeFileBufferSize, const bool &finishStat, 
+				std::vector<uint64_t> &shareContainerIDList);
+
+		/*
+		 * wait until a share container leaves the queue
+		 *
+		 * @param shareContainerID - the share container id
+		 *
+		 * @return - a boolean value that indicates if the share container is not dropped by the writer
+		 */
+		bool waitForContainer(const uint64_t &shareContainerID);
+
+		/*
+		 * wait until the recipes of a recipe file leave the queue
+		 *
+		 * @param recipeFileName - the full name of the recipe file
+		 *
+		 * @return - a boolean value that indicates if no recipe of the file is dropped by the writer
+		 */
+		bool waitForRecipeFile(const std::string &recipeFileName);
+
+		/*
+		 * get the number of share containers waiting for the writer
+		 *
+		 * @return - the number of share containers in the queue
+		 */
+		int getNumOfPendingContainers();
+
+		/*
+		 * read a part of a share container from the queue
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param offset - the offset of the part in the share container
+		 * @param size - the size of the part
+		 * @param buffer - the buffer for storing the part <return>
+		 *
+		 * @return - a boolean value that indicates if the share container is in the queue
+		 */
+		bool readPendingContainer(const uint64_t &shareContainerID, const int &offset, const int &size, 
+				unsigned char *buffer);
+
+		/*
+		 * check if a share container is in the queue
+		 *
+		 * @param shareContainerID - the share container id
+		 *
+		 * @return - a boolean value that indicates if the share container is in the queue
+		 */
+		bool isPendingContainer(const uint64_t &shareContainerID);
+
+		/*
+		 * open the segment file that stores a share container for reading
+		 *
+		 * @param location - the location of the share container (on this device)
+		 * @param fp - the file pointer of the segment file <return>
+		 *
+		 * @return - a boolean value that indicates if the open op succeeds
+		 */
+		bool openContainerFile(const containerLocation_t &location, FILE *&fp);
+
+		/*
+		 * wait until all share containers and recipes handed off so far are durable
+		 *
+		 * @return - a boolean value that indicates if they are durable (otherwise, the writer has failed, 
+		 * or a recipe is dropped)
+		 */
+		bool flush();
+
+		/*
+		 * transform a share container id to the container location key
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param locationKey - the container location key <return>
+		 */
+		static void containerID2LocationKey(const uint64_t &shareContainerID, char *locationKey);
+};
+
+#endif
@@ -0,0 +1,368 @@
+/*
+ * ConvertIndex.cc
+ *
+ * convert the index of a server to the current format (run in the dir of the server while it is stopped):
+ * the share index values of the old formats (with the user references appended, or with share container
+ * names) are converted into fixed-width values with share container ids, the user references are moved
+ * to user reference keys, and the share containers are renamed after their ids
+ *
+ * usage: ./CONVERTINDEX ([indexEngine])
+ *        [indexEngine] is the engine the server runs with, "leveldb" (default) or "fpstore"
+ */
+
+#include <dirent.h>
+
+#include "DedupCore.hh"
+
+using namespace std;
+
+/*macros for the dirs of a server (the same as main.cc)*/
+#define DB_DIR_NAME "meta/DedupDB/"
+#define SHARE_CONTAINER_DIR_NAME "meta/ShareContainers/"
+
+/*macro for the number of share index values converted in a batch*/
+#define CONVERSION_BATCH_SIZE 1024
+
+/*macro for the length of the share container names of the old formats (excluding ".sc")*/
+#define OLD_CONTAINER_NAME_LEN 12
+
+/*the state of the conversion*/
+typedef struct {
+	leveldb::DB *db;
+	ShareIndex *shareIndex;
+	std::vector<std::string> keyList;
+	long numOfConverted;
+	/*one more than the largest share container id in the share index*/
+	uint64_t shareContainerIDLimit;
+	bool failStat;
+} conversion_t;
+
+/*
+ * transform a share container name of the old formats to the share container id
+ * (the names were handed out in order as base-26 numbers, from "aaaaaaaaaaaa.sc")
+ *
+ * @param name - the name
+ * @param shareContainerID - the share container id <return>
+ *
+ * @return - a boolean value that indicates if the name is a share container name of the old formats
+ */
+static bool oldContainerName2ID(const char *name, uint64_t &shareContainerID) {
+	int i;
+
+	shareContainerID = 0;
+	for (i = 0; i < OLD_CONTAINER_NAME_LEN; i++) {
+		if ((name[i] < 'a') || (name[i] > 'z')) {
+			return 0;
+		}
+		shareContainerID = shareContainerID * 26 + (name[i] - 'a');
+	}
+
+	return (strcmp(name + OLD_CONTAINER_NAME_LEN, ".sc") == 0);
+}
+
+/*
+ * transform a share index key and a user id to a user reference index key (the same as DedupCore)
+ *
+ * @param shareKey - the share index key
+ * @param userID - the user id
+ * @param key - the resulting index key <return>
+ */
+static void userRefKey(const std::string &shareKey, const int &userID, char *key) {
+	memcpy(key, shareKey.data(), KEY_SIZE);
+	memcpy(key + KEY_SIZE, &userID, sizeof(int));
+	key[0] = '3';
+}
+
+/*
+ * convert the values of a batch of keys scanned from the share index (values of the current format
+ * are skipped, so that an interrupted conversion can be resumed)
+ *
+ * @param conversion - the conversion state
+ *
+ * @return - a boolean value that indicates if the convert op succeeds
+ */
+static bool convertBatch(conversion_t *conversion) {
+	std::vector<std::string> &keyList = conversion->keyList;
+	std::vector<std::string> valueList, newKeyList, newValueList;
+	std::vector<leveldb::Status> statList;
+	legacyShareIndexValueHead_t *pLegacyShareIndexValueHead;
+	legacyShareUserRefEntry_t *pLegacyShareUserRefEntry;
+	shareIndexValue_t shareIndexValue;
+	const char *shareContainerName;
+	leveldb::WriteBatch refBatch;
+	leveldb::WriteOptions writeOptions;
+	char refKey[USER_REF_KEY_SIZE];
+	int i, j;
+
+	conversion->shareIndex->multiGet(keyList, valueList, statList);
+	for (i = 0; i < (int) keyList.size(); i++) {
+		if (statList[i].ok() == false) {
+			fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(keyList[i]).ToString().c_str());
+			fprintf(stderr, "Status: %s \n", statList[i].ToString().c_str());
+
+			return 0;
+		}
+
+		memset(&shareIndexValue, 0, sizeof(shareIndexValue_t));
+
+		/*format version 3: only count its share container id*/
+		if (valueList[i].size() == sizeof(shareIndexValue_t)) {
+			memcpy(&shareIndexValue, valueList[i].data(), sizeof(shareIndexValue_t));
+			if (shareIndexValue.shareContainerID >= conversion->shareContainerIDLimit) {
+				conversion->shareContainerIDLimit = shareIndexValue.shareContainerID + 1;
+			}
+
+			continue;
+		}
+
+		/*format version 2: the location with a share container name*/
+		if (valueList[i].size() == sizeof(v2ShareIndexValue_t)) {
+			shareContainerName = ((v2ShareIndexValue_t *) valueList[i].data())->shareContainerName;
+			shareIndexValue.shareContainerOffset = ((v2ShareIndexValue_t *) valueList[i].data())->shareContainerOffset;
+			shareIndexValue.shareSize = ((v2ShareIndexValue_t *) valueList[i].data())->shareSize;
+		}
+		/*format version 1: the location with a share container name, followed by the user references*/
+		else {
+			pLegacyShareIndexValueHead = (legacyShareIndexValueHead_t *) valueList[i].data();
+			if ((valueList[i].size() < sizeof(legacyShareIndexValueHead_t)) || (valueList[i].size() !=
+						sizeof(legacyShareIndexValueHead_t) + pLegacyShareIndexValueHead->numOfUsers * sizeof(legacyShareUserRefEntry_t))) {
+				fprintf(stderr, "Error: the value of the key '%s' is invalid!\n", leveldb::Slice(keyList[i]).ToString().c_str());
+
+				return 0;
+			}
+
+			/*move the reference count of each user to its user reference key*/
+			for (j = 0; j < pLegacyShareIndexValueHead->numOfUsers; j++) {
+				pLegacyShareUserRefEntry = (legacyShareUserRefEntry_t *) (valueList[i].data() +
+						sizeof(legacyShareIndexValueHead_t)) + j;
+				userRefKey(keyList[i], pLegacyShareUserRefEntry->userID, refKey);
+				refBatch.Put(leveldb::Slice(refKey, USER_REF_KEY_SIZE),
+						leveldb::Slice((char *) &pLegacyShareUserRefEntry->refCnt, sizeof(int)));
+			}
+
+			shareContainerName = pLegacyShareIndexValueHead->shareContainerName;
+			shareIndexValue.shareContainerOffset = pLegacyShareIndexValueHead->shareContainerOffset;
+			shareIndexValue.shareSize = pLegacyShareIndexValueHead->shareSize;
+		}
+
+		if (!oldContainerName2ID(shareContainerName, shareIndexValue.shareContainerID)) {
+			fprintf(stderr, "Error: the value of the key '%s' has an invalid share container name!\n",
+					leveldb::Slice(keyList[i]).ToString().c_str());
+
+			return 0;
+		}
+		if (shareIndexValue.shareContainerID >= conversion->shareContainerIDLimit) {
+			conversion->shareContainerIDLimit = shareIndexValue.shareContainerID + 1;
+		}
+
+		newKeyList.push_back(keyList[i]);
+		newValueList.push_back(std::string((char *) &shareIndexValue, sizeof(shareIndexValue_t)));
+	}
+
+	if (newKeyList.empty()) {
+		return 1;
+	}
+
+	/*write the references before the values, so that the values are converted again if interrupted in between
+	  (the references are set rather than added)*/
+	leveldb::Status writeStat = conversion->db->Write(writeOptions, &refBatch);
+	if (writeStat.ok()) {
+		writeStat = conversion->shareIndex->write(newKeyList, newValueList);
+	}
+	if (writeStat.ok() == false) {
+		fprintf(stderr, "Error: fail to perform batched writes!\n");
+		fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+
+		return 0;
+	}
+	conversion->numOfConverted += newKeyList.size();
+
+	return 1;
+}
+
+/*
+ * collect a key scanned from the share index, and convert the collected keys once they fill a batch
+ *
+ * @param arg - the conversion state
+ * @param key - the key
+ */
+static void convertKey(void *arg, const std::string &key) {
+	conversion_t *conversion = (conversion_t *) arg;
+
+	if (conversion->failStat) {
+		return;
+	}
+
+	conversion->keyList.push_back(key);
+	if (conversion->keyList.size() == CONVERSION_BATCH_SIZE) {
+		conversion->failStat = !convertBatch(conversion);
+		conversion->keyList.clear();
+	}
+}
+
+/*
+ * rename the share containers of the old formats after their ids
+ *
+ * @param shareContainerIDLimit - one more than the largest share container id <return>
+ * @param numOfRenamed - the number of renamed share containers <return>
+ *
+ * @return - a boolean value that indicates if the rename op succeeds
+ */
+static bool renameContainers(uint64_t &shareContainerIDLimit, long &numOfRenamed) {
+	char newName[SHARE_CONTAINER_NAME_SIZE];
+	std::string oldFullName, newFullName;
+	uint64_t shareContainerID;
+	struct dirent *entry;
+	DIR *dir;
+
+	dir = opendir(SHARE_CONTAINER_DIR_NAME);
+	if (dir == NULL) {
+		fprintf(stderr, "Error: fail to open the dir '%s'!\n", SHARE_CONTAINER_DIR_NAME);
+
+		return 0;
+	}
+
+	numOfRenamed = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!oldContainerName2ID(entry->d_name, shareContainerID)) {
+			continue;
+		}
+		if (shareContainerID >= SHARE_CONTAINER_ID_MAX) {
+			fprintf(stderr, "Error: the id of the share container '%s' is too large!\n", entry->d_name);
+			closedir(dir);
+
+			return 0;
+		}
+
+		snprintf(newName, SHARE_CONTAINER_NAME_SIZE, SHARE_CONTAINER_NAME_FORMAT, (unsigned long long) shareContainerID);
+		oldFullName = std::string(SHARE_CONTAINER_DIR_NAME) + entry->d_name;
+		newFullName = std::string(SHARE_CONTAINER_DIR_NAME) + newName;
+		if (rename(oldFullName.c_str(), newFullName.c_str()) != 0) {
+			fprintf(stderr, "Error: fail to rename '%s' to '%s'!\n", oldFullName.c_str(), newFullName.c_str());
+			closedir(dir);
+
+			return 0;
+		}
+
+		if (shareContainerID >= shareContainerIDLimit) {
+			shareContainerIDLimit = shareContainerID + 1;
+		}
+		numOfRenamed++;
+	}
+
+	closedir(dir);
+
+	return 1;
+}
+
+int main(int argv, char** argc) {
+	leveldb::Options dbOptions;
+	UserRefMergeOperator userRefMergeOperator;
+	leveldb::ReadOptions readOptions;
+	leveldb::WriteOptions writeOptions;
+	conversion_t conversion;
+	std::string valueString, indexCacheFileName;
+	uint64_t shareContainerIDLimit;
+	long numOfRenamed;
+	int formatVersion;
+	bool fpstoreStat = (argv > 1) && (strcmp(argc[1], "fpstore") == 0);
+
+	/*open the database with the same options as DedupCore (the operands of the old format are resolved
+	  by the merge operator)*/
+	dbOptions.create_if_missing = false;
+	dbOptions.write_buffer_size = MEM_TABLE_SIZE;
+	dbOptions.block_cache = leveldb::NewLRUCache(BLOCK_CACHE_SIZE);
+	dbOptions.filter_policy = leveldb::NewBloomFilterPolicy(BLOOM_FILTER_KEY_BITS);
+	dbOptions.merge_operator = &userRefMergeOperator;
+	leveldb::Status openStat = leveldb::DB::Open(dbOptions, DB_DIR_NAME, &conversion.db);
+	if (openStat.ok() == false) {
+		fprintf(stderr, "Error: fail to open the database '%s'!\n", DB_DIR_NAME);
+		fprintf(stderr, "Status: %s \n", openStat.ToString().c_str());
+
+		exit(1);
+	}
+
+	leveldb::Status getStat = conversion.db->Get(readOptions, INDEX_FORMAT_KEY, &valueString);
+	if (getStat.ok() && (valueString.size() == sizeof(int)) &&
+			(*((int *) valueString.data()) == INDEX_FORMAT_VERSION)) {
+		fprintf(stderr, "The index already has the current format.\n");
+
+		delete conversion.db;
+		exit(0);
+	}
+
+	if (fpstoreStat) {
+		conversion.shareIndex = new FPStore(std::string(DB_DIR_NAME) + FPSTORE_DIR_NAME);
+		indexCacheFileName = std::string(DB_DIR_NAME) + FPSTORE_DIR_NAME + INDEX_CACHE_SNAPSHOT_NAME;
+	}
+	else {
+		conversion.shareIndex = new LevelDBShareIndex(conversion.db, '1');
+		indexCacheFileName = std::string(DB_DIR_NAME) + INDEX_CACHE_SNAPSHOT_NAME;
+	}
+
+	/*1. convert the share index values batch by batch*/
+	conversion.numOfConverted = 0;
+	conversion.shareContainerIDLimit = 0;
+	conversion.failStat = 0;
+
+	leveldb::Status scanStat = conversion.shareIndex->scanKeys(convertKey, &conversion);
+	if (scanStat.ok() && !conversion.failStat && !conversion.keyList.empty()) {
+		conversion.failStat = !convertBatch(&conversion);
+	}
+	if (!scanStat.ok()) {
+		fprintf(stderr, "Error: fail to scan the share index!\n");
+		fprintf(stderr, "Status: %s \n", scanStat.ToString().c_str());
+
+		exit(1);
+	}
+	if (conversion.failStat) {
+		exit(1);
+	}
+
+	/*2. rename the share containers*/
+	shareContainerIDLimit = conversion.shareContainerIDLimit;
+	if (!renameContainers(shareContainerIDLimit, numOfRenamed)) {
+		exit(1);
+	}
+
+	/*3. hand out new share container ids after all existing ones*/
+	getStat = conversion.db->Get(readOptions, SHARE_CONTAINER_ID_LIMIT_KEY, &valueString);
+	if (getStat.ok() && (valueString.size() == sizeof(uint64_t)) && 
+			(*((uint64_t *) valueString.data()) > shareContainerIDLimit)) {
+		memcpy(&shareContainerIDLimit, valueString.data(), sizeof(uint64_t));
+	}
+
+	leveldb::Status putStat = conversion.db->Put(writeOptions, SHARE_CONTAINER_ID_LIMIT_KEY,
+			leveldb::Slice((char *) &shareContainerIDLimit, sizeof(uint64_t)));
+
+	/*4. drop the index cache snapshot (with the values of the old formats), and record the format*/
+	unlink(indexCacheFileName.c_str());
+
+	formatVersion = INDEX_FORMAT_VERSION;
+	writeOptions.sync = true;
+	if (putStat.ok()) {
+		putStat = conversion.db->Put(writeOptions, INDEX_FORMAT_KEY, leveldb::Slice((char *) &formatVersion, sizeof(int)));
+	}
+	if (!putStat.ok()) {
+		fprintf(stderr, "Error: fail to record the index format in the database!\n");
+		fprintf(stderr, "Status: %s \n", putStat.ToString().c_str());
+
+		exit(1);
+	}
+
+	if (!conversion.shareIndex->checkpoint()) {
+		fprintf(stderr, "Error: fail to checkpoint the share index!\n");
+
+		exit(1);
+	}
+
+	delete conversion.shareIndex;
+	delete conversion.db;
+	delete dbOptions.block_cache;
+	delete dbOptions.filter_policy;
+
+	fprintf(stderr, "The index has been converted: %ld share index values, %ld share containers.\n",
+			conversion.numOfConverted, numOfRenamed);
+
+	return 0;
+}
@@ -6,6 +6,107 @@
 
 using namespace std;
 
+/*
+ * get the name of the user reference merge operator
+ *
+ * @return - the name
+ */
+const char *UserRefMergeOperator::Name() const {
+	return "CDStore.UserRefMergeOperator";
+}
+
+/*
+ * add the reference count of a merge operand to a user reference value (or to an older operand)
+ *
+ * @param key - the user reference key (or a share index key of the old format)
+ * @param existing_value - the value or the older operand, NULL if there is none
+ * @param value - the merge operand
+ * @param new_value - the combined value <return>
+ *
+ * @return - a boolean value that indicates if the merge op succeeds
+ */
+bool UserRefMergeOperator::Merge(const leveldb::Slice &key, const leveldb::Slice *existing_value, 
+		const leveldb::Slice &value, std::string *new_value) const {
+	int refCnt, existingRefCnt;
+
+	if (key[0] == '1') {
+		return mergeLegacyShareRefs_(existing_value, value, new_value);
+	}
+
+	if ((value.size() != sizeof(int)) || ((existing_value != NULL) && (existing_value->size() != sizeof(int)))) {
+		return 0;
+	}
+
+	memcpy(&refCnt, value.data(), sizeof(int));
+	if (existing_value != NULL) {
+		memcpy(&existingRefCnt, existing_value->data(), sizeof(int));
+		refCnt += existingRefCnt;
+	}
+	new_value->assign((char *) &refCnt, sizeof(int));
+
+	return 1;
+}
+
+/*
+ * add the user reference entries of a merge operand to a share index value of the old format
+ *
+ * @param existing_value - the value or the older operand, NULL if there is none
+ * @param value - the merge operand
+ * @param new_value - the combined value <return>
+ *
+ * @return - a boolean value that indicates if the merge op succeeds
+ */
+bool UserRefMergeOperator::mergeLegacyShareRefs_(const leveldb::Slice *existing_value, const leveldb::Slice &value, 
+		std::string *new_value) const {
+	const legacyShareIndexValueHead_t *pOperandHead;
+	const legacyShareUserRefEntry_t *pOperandEntry;
+	const legacyShareIndexValueHead_t *pExistingHead;
+	legacyShareIndexValueHead_t *pShareIndexValueHead;
+	legacyShareUserRefEntry_t *pShareUserRefEntry;
+	int i, j, numOfUsers;
+
+	/*check the sizes of the operand and the existing value*/
+	pOperandHead = (const legacyShareIndexValueHead_t *) value.data();
+	if ((value.size() < sizeof(legacyShareIndexValueHead_t)) || 
+			(value.size() != sizeof(legacyShareIndexValueHead_t) + pOperandHead->numOfUsers * sizeof(legacyShareUserRefEntry_t))) {
+		return 0;
+	}
+	if (existing_value == NULL) {
+		new_value->assign(value.data(), value.size());
+
+		return 1;
+	}
+	pExistingHead = (const legacyShareIndexValueHead_t *) existing_value->data();
+	if ((existing_value->size() < sizeof(legacyShareIndexValueHead_t)) || 
+			(existing_value->size() != sizeof(legacyShareIndexValueHead_t) + pExistingHead->numOfUsers * sizeof(legacyShareUserRefEntry_t))) {
+		return 0;
+	}
+
+	/*add the reference count of each user of the operand to the existing entry of the user, or append it*/
+	new_value->assign(existing_value->data(), existing_value->size());
+	for (i = 0; i < pOperandHead->numOfUsers; i++) {
+		pOperandEntry = (const legacyShareUserRefEntry_t *) (value.data() + sizeof(legacyShareIndexValueHead_t)) + i;
+		pShareIndexValueHead = (legacyShareIndexValueHead_t *) &(*new_value)[0];
+		numOfUsers = pShareIndexValueHead->numOfUsers;
+
+		for (j = 0; j < numOfUsers; j++) {
+			pShareUserRefEntry = (legacyShareUserRefEntry_t *) (&(*new_value)[0] + sizeof(legacyShareIndexValueHead_t)) + j;
+			if (pShareUserRefEntry->userID == pOperandEntry->userID) {
+				pShareUserRefEntry->refCnt += pOperandEntry->refCnt;
+				break;
+			}
+		}
+
+		if (j == numOfUsers) {
+			new_value->append((const char *) pOperandEntry, sizeof(legacyShareUserRefEntry_t));
+			pShareIndexValueHead = (legacyShareIndexValueHead_t *) &(*new_value)[0];
+			pShareIndexValueHead->numOfUsers++;
+		}
+	}
+
+	return 1;
+}
+
 /*
  * constructor of DedupCore
  *
@@ -15,10 +116,19 @@ using namespace std;
  * @param shareContainerDirName - the name of the directory that stores the share containers
  * @param recipeStorerObj - the BackendStorer instance that manages recipe files
  * @param containerStorerObj - the BackendStorer instance that manages share containers 
+ * @param indexCacheSize - the memory budget of the share index cache (in bytes)
+ * @param indexEngine - the engine of the share index (LEVELDB_INDEX_ENGINE or FPSTORE_INDEX_ENGINE)
+ * @param extraContainerDirNames - the names of further directories (e.g. on other disks) that store the 
+ * share containers with shareContainerDirName (not under dedupDirName; the list may only grow at a restart)
  */
 DedupCore::DedupCore(const std::string &dedupDirName, const std::string &dbDirName, 
 		const std::string &recipeFileDirName, const std::string &shareContainerDirName, 
-		BackendStorer *recipeStorerObj, BackendStorer *containerStorerObj) {
+		BackendStorer *recipeStorerObj, BackendStorer *containerStorerObj, long indexCacheSize, int indexEngine, 
+		const std::vector<std::string> &extraContainerDirNames) {
+	std::vector<std::string> containerDirNames;
+	double currTime;
+	int i;
+
 	dedupDirName_ = dedupDirName;
 	dbDirName_ = dbDirName;
 	recipeFileDirName_ = recipeFileDirName;
@@ -75,11 +185,28 @@ DedupCore::DedupCore(const std::string &dedupDirName, const std::string &dbDirNa
 		exit(1);	
 	}	
 
+	/*create the further share container dirs (the position of a dir in the list is its device id)*/
+	containerDirNames.push_back(shareContainerDirName_);
+	for (i = 0; i < (int) extraContainerDirNames.size(); i++) {
+		std::string containerDirName = extraContainerDirNames[i];
+
+		if (!formatDirName_(containerDirName) || !createDir_(containerDirName)) {
+			fprintf(stderr, "Error: fail to create the dir '%s'!\n", containerDirName.c_str());
+			exit(1);	
+		}
+		containerDirNames.push_back(containerDirName);
+	}
+	if (containerDirNames.size() > MAX_NUM_OF_DEVICES) {
+		fprintf(stderr, "Error: there are more than %d share container dirs!\n", MAX_NUM_OF_DEVICES);
+		exit(1);	
+	}
+
 	/*open/create the key-value database*/
 	dbOptions_.create_if_missing = true;
 	dbOptions_.write_buffer_size = MEM_TABLE_SIZE;
 	dbOptions_.block_cache = leveldb::NewLRUCache(BLOCK_CACHE_SIZE);
 	dbOptions_.filter_policy = leveldb::NewBloomFilterPolicy(BLOOM_FILTER_KEY_BITS);
+	dbOptions_.merge_operator = &userRefMergeOperator_;
 	leveldb::Status openStat = leveldb::DB::Open(dbOptions_, dbDirName_, &db_);
 	if (openStat.ok() == false) {
 		fprintf(stderr, "Error: fail to open/create the database '%s'!\n", dbDirName_.c_str());
@@ -87,45 +214,88 @@ DedupCore::DedupCore(const std::string &dedupDirName, const std::string &dbDirNa
 		exit(1);	
 	}	
 
+	/*open/create the share index (the inode and offset indices always stay in the database), 
+	  and keep the snapshot of the index cache with the engine that it mirrors*/
+	if (indexEngine == FPSTORE_INDEX_ENGINE) {
+		shareIndex_ = new FPStore(dbDirName_ + FPSTORE_DIR_NAME);
+		indexCacheFileName_ = dbDirName_ + FPSTORE_DIR_NAME + INDEX_CACHE_SNAPSHOT_NAME;
+	}
+	else {
+		shareIndex_ = new LevelDBShareIndex(db_, '1');
+		indexCacheFileName_ = dbDirName_ + INDEX_CACHE_SNAPSHOT_NAME;
+	}
+
 	fileShareMDHeadSize_ = sizeof(fileShareMDHead_t);
 	shareMDEntrySize_ = sizeof(shareMDEntry_t);
+	fileShareMDTrailerSize_ = sizeof(fileShareMDTrailer_t);
 
 	inodeIndexValueHeadSize_ = sizeof(inodeIndexValueHead_t);
 	inodeDirEntrySize_ = sizeof(inodeDirEntry_t);
 	inodeFileEntrySize_ = sizeof(inodeFileEntry_t);
 
-	shareIndexValueHeadSize_ = sizeof(shareIndexValueHead_t);
-	shareUserRefEntrySize_ = sizeof(shareUserRefEntry_t);
+	shareIndexValueSize_ = sizeof(shareIndexValue_t);
+
+	offsetIndexValueHeadSize_ = sizeof(offsetIndexValueHead_t);
+
+	/*check the format of the share index (an old one is converted offline by CONVERTINDEX)*/
+	if (!checkIndexFormat_()) {
+		fprintf(stderr, "Error: fail to check the format of the share index!\n");
+		exit(1);	
+	}
+
+	/*start a container writer for each share container dir*/
+	for (i = 0; i < (int) containerDirNames.size(); i++) {
+		containerWriters_.push_back(new ContainerWriter(containerDirNames[i], i, db_, containerStorerObj_, shareIndex_, 
+				releasePendingShares_, writeRecipeFile_, this));
+	}
+	nextContainerWriter_ = 0;
+
+	/*create the cache of the share container extents*/
+	extentCache_ = new ExtentCache();
+
+	/*load the share index cache*/
+	indexCache_ = new IndexCache(indexCacheSize);
+	if (!loadIndexCache_()) {
+		fprintf(stderr, "Error: fail to load the share index cache!\n");
+		exit(1);	
+	}
 
 	/*initialize the file recipe name fileRecipeName_*/
 	recipeFileNameValidLen_ = INTERNAL_FILE_NAME_SIZE - 4;
 	std::string recipeFileNameMain(recipeFileNameValidLen_, 'a');
-	std::string recipeFileNamePostfix(".rf"); /*an implicit null-terminator*/
+	std::string recipeFileNamePostfix(RECIPE_FILE_NAME_POSTFIX); /*an implicit null-terminator*/
 	globalRecipeFileName_ = recipeFileNameMain + recipeFileNamePostfix;
 
 	fileRecipeHeadSize_ = sizeof(fileRecipeHead_t);
 	fileRecipeEntrySize_ = sizeof(fileRecipeEntry_t);
+	legacyFileRecipeEntrySize_ = sizeof(legacyFileRecipeEntry_t);
 
-	/*initialize the share container name shareContainerName_*/
-	shareContainerNameValidLen_ = INTERNAL_FILE_NAME_SIZE - 4;
-	std::string shareContainerNameMain(shareContainerNameValidLen_, 'a');
-	std::string shareContainerNamePostfix(".sc"); /*an implicit null-terminator*/
-	globalShareContainerName_ = shareContainerNameMain + shareContainerNamePostfix;
+	/*initialize the share container id nextShareContainerID_ (after all ids handed out before)*/
+	if (!loadShareContainerIDLimit_()) {
+		fprintf(stderr, "Error: fail to load the limit of the share container ids!\n");
+		exit(1);	
+	}
+	nextShareContainerID_ = shareContainerIDLimit_;
 
-	/*initialize the head and tail nodes of the file recipe pool*/
-	headBufferNode_ = NULL;
-	tailBufferNode_ = NULL;
+	/*initialize the timing wheel of the buffer node pool*/
+	for (i = 0; i < NUM_BUFFER_WHEEL_SLOTS; i++) {
+		bufferWheel_[i] = NULL;
+	}
+	getCurrTime_(currTime);
+	bufferWheelTick_ = (long) (currTime / BUFFER_WHEEL_TICK_SECS);
 
 	perUserBufferNodeSize_ = sizeof(perUserBufferNode_t);
 
 	shareFileHeadSize_ = sizeof(shareFileHead_t);
 	shareEntrySize_ = sizeof(shareEntry_t);
 
-	/*initialize the mutex lock DBLock_*/
-	if (pthread_mutex_init(&DBLock_, NULL) != 0) {
-		fprintf(stderr, "Error: fail to initialize the mutex lock DBLock_!\n");
-		exit(1);	
-	}		
+	/*initialize the mutex locks indexLocks_*/
+	for (int i = 0; i < NUM_INDEX_LOCK_STRIPES; i++) {
+		if (pthread_mutex_init(&indexLocks_[i], NULL) != 0) {
+			fprintf(stderr, "Error: fail to initialize the mutex locks indexLocks_!\n");
+			exit(1);	
+		}		
+	}
 
 	/*initialize the mutex lock bufferLock_*/
 	if (pthread_mutex_init(&bufferLock_, NULL) != 0) {
@@ -133,23 +303,80 @@ DedupCore::DedupCore(const std::string &dedupDirName, const std::string &dbDirNa
 		exit(1);	
 	}		
 
+	/*initialize the mutex lock pendingShareLock_*/
+	if (pthread_mutex_init(&pendingShareLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock pendingShareLock_!\n");
+		exit(1);	
+	}		
+
+	/*start the flusher thread of the idle buffer nodes*/
+	flusherStopStat_ = 0;
+	if (pthread_cond_init(&flusherCond_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the condition variable flusherCond_!\n");
+		exit(1);	
+	}
+	if (pthread_cond_init(&bufferCond_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the condition variable bufferCond_!\n");
+		exit(1);	
+	}
+	if (pthread_create(&flusherThread_, NULL, flusherHandler_, (void *) this) != 0) {
+		fprintf(stderr, "Error: fail to create the flusher thread!\n");
+		exit(1);	
+	}
+
 	/*initialize the mutex lock globalRecipeFileNameLock_*/
 	if (pthread_mutex_init(&globalRecipeFileNameLock_, NULL) != 0) {
 		fprintf(stderr, "Error: fail to initialize the mutex lock globalRecipeFileNameLock_!\n");
 		exit(1);	
 	}		
 
-	/*initialize the mutex lock globalShareContainerNameLock_*/
-	if (pthread_mutex_init(&globalShareContainerNameLock_, NULL) != 0) {
-		fprintf(stderr, "Error: fail to initialize the mutex lock globalShareContainerNameLock_!\n");
+	/*initialize the mutex lock shareContainerIDLock_*/
+	if (pthread_mutex_init(&shareContainerIDLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock shareContainerIDLock_!\n");
+		exit(1);	
+	}	
+
+	/*initialize the mutex lock dirInodeCacheLock_*/
+	if (pthread_mutex_init(&dirInodeCacheLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock dirInodeCacheLock_!\n");
 		exit(1);	
 	}	
 
+	/*start the hashing threads of the second-stage deduplication*/
+	hashStopStat_ = 0;
+	if ((pthread_mutex_init(&hashLock_, NULL) != 0) || (pthread_cond_init(&hashCond_, NULL) != 0) || 
+			(pthread_cond_init(&hashDoneCond_, NULL) != 0)) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock hashLock_!\n");
+		exit(1);	
+	}
+	for (i = 0; i < NUM_HASH_THREADS; i++) {
+		if (pthread_create(&hashThreads_[i], NULL, hashHandler_, (void *) this) != 0) {
+			fprintf(stderr, "Error: fail to create the hashing threads!\n");
+			exit(1);	
+		}
+	}
+
+	/*start the prefetch threads of the restores*/
+	prefetchStopStat_ = 0;
+	if ((pthread_mutex_init(&prefetchLock_, NULL) != 0) || (pthread_cond_init(&prefetchCond_, NULL) != 0)) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock prefetchLock_!\n");
+		exit(1);	
+	}
+	for (i = 0; i < NUM_PREFETCH_THREADS; i++) {
+		if (pthread_create(&prefetchThreads_[i], NULL, prefetchHandler_, (void *) this) != 0) {
+			fprintf(stderr, "Error: fail to create the prefetch threads!\n");
+			exit(1);	
+		}
+	}
+
 	fprintf(stderr, "\nA DedupCore has been constructed! \n");		
 	fprintf(stderr, "Parameters: \n");		
 	fprintf(stderr, "      dbDirName_: %s \n", dbDirName_.c_str());		
+	fprintf(stderr, "      indexEngine: %s \n", (indexEngine == FPSTORE_INDEX_ENGINE) ? "fpstore" : "leveldb");
 	fprintf(stderr, "      recipeFileDirName_: %s \n", recipeFileDirName_.c_str());
-	fprintf(stderr, "      shareContainerDirName_: %s \n", shareContainerDirName_.c_str());
+	for (i = 0; i < (int) containerDirNames.size(); i++) {
+		fprintf(stderr, "      shareContainerDirName (device %d): %s \n", i, containerDirNames[i].c_str());
+	}
 	fprintf(stderr, "\n");	
 }
 
@@ -157,27 +384,79 @@ DedupCore::DedupCore(const std::string &dedupDirName, const std::string &dbDirNa
  * destructor of DedupCore 
  */
 DedupCore::~DedupCore() {
+	/*stop the prefetch threads (the waiting prefetches are dropped)*/
+	pthread_mutex_lock(&prefetchLock_);
+	prefetchStopStat_ = 1;
+	pthread_cond_broadcast(&prefetchCond_);
+	pthread_mutex_unlock(&prefetchLock_);
+	for (int i = 0; i < NUM_PREFETCH_THREADS; i++) {
+		pthread_join(prefetchThreads_[i], NULL);
+	}
+	pthread_mutex_destroy(&prefetchLock_);
+	pthread_cond_destroy(&prefetchCond_);
+
+	/*stop the hashing threads (no second-stage deduplication is running by now)*/
+	pthread_mutex_lock(&hashLock_);
+	hashStopStat_ = 1;
+	pthread_cond_broadcast(&hashCond_);
+	pthread_mutex_unlock(&hashLock_);
+	for (int i = 0; i < NUM_HASH_THREADS; i++) {
+		pthread_join(hashThreads_[i], NULL);
+	}
+	pthread_mutex_destroy(&hashLock_);
+	pthread_cond_destroy(&hashCond_);
+	pthread_cond_destroy(&hashDoneCond_);
+
+	/*stop the flusher thread (the buffer nodes left are flushed below)*/
+	pthread_mutex_lock(&bufferLock_);
+	flusherStopStat_ = 1;
+	pthread_cond_signal(&flusherCond_);
+	pthread_mutex_unlock(&bufferLock_);
+	pthread_join(flusherThread_, NULL);
+	pthread_cond_destroy(&flusherCond_);
+
+	/*clean up the buffer node pool (the buffers are flushed while the database is open)*/
+	if (!cleanupAllBufferNodes()) {
+		fprintf(stderr, "Warning: fail to clean up the buffer node pool!\n");
+	}
+
+	/*stop the container writers once the handed-off containers are written (all of them first, as the 
+	  recipes wait for the containers of any writer)*/
+	for (int i = 0; i < (int) containerWriters_.size(); i++) {
+		containerWriters_[i]->flush();
+	}
+	for (int i = 0; i < (int) containerWriters_.size(); i++) {
+		delete containerWriters_[i];
+	}
+
 	/*close the key-value database*/
+	delete extentCache_;
+	delete indexCache_;
+	delete shareIndex_;
 	delete db_;
 	delete dbOptions_.block_cache;
 	delete dbOptions_.filter_policy;
 
-	/*clean up the buffer node link*/
-	if (!cleanupAllBufferNodes()) {
-		fprintf(stderr, "Warning: fail to clean up the buffer node link!\n");
+	/*clean up the mutex locks indexLocks_*/	
+	for (int i = 0; i < NUM_INDEX_LOCK_STRIPES; i++) {
+		pthread_mutex_destroy(&indexLocks_[i]);
 	}
 
-	/*clean up the mutex lock DBLock_*/	
-	pthread_mutex_destroy(&DBLock_);
-
-	/*clean up the mutex lock bufferLock_*/	
+	/*clean up the mutex lock bufferLock_ and its condition bufferCond_*/	
 	pthread_mutex_destroy(&bufferLock_);
+	pthread_cond_destroy(&bufferCond_);
+
+	/*clean up the mutex lock pendingShareLock_*/	
+	pthread_mutex_destroy(&pendingShareLock_);
 
 	/*clean up the mutex lock globalRecipeFileNameLock_*/	
 	pthread_mutex_destroy(&globalRecipeFileNameLock_);
 
-	/*clean up the mutex lock globalShareContainerNameLock_*/	
-	pthread_mutex_destroy(&globalShareContainerNameLock_);
+	/*clean up the mutex lock shareContainerIDLock_*/	
+	pthread_mutex_destroy(&shareContainerIDLock_);
+
+	/*clean up the mutex lock dirInodeCacheLock_*/	
+	pthread_mutex_destroy(&dirInodeCacheLock_);
 
 	fprintf(stderr, "\nThe DedupCore has been destructed! \n");	
 	fprintf(stderr, "\n");
@@ -327,14 +606,14 @@ bool DedupCore::createDir_(const std::string &dirName) {
 			return 0;
 		}
 
-		if (!checkFilePermissions_(dirName)) {
-			/*if the dir does not grant read, write, and execute permissions*/
-			return 0;
-		}
-
 		prePos = currPos + 1;
 	}
 
+	if (!checkFilePermissions_(dirName)) {
+		/*if the dir does not grant read, write, and execute permissions*/
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -422,6 +701,113 @@ inline void DedupCore::shareFP2IndexKey_(char *shareFP, char *key) {
 	key[0] = '1'; 
 }
 
+/*
+ * transform a share's fingerprint and a user id to a user reference index key
+ *
+ * @param shareFP - the share's fingerprint to be transformed 
+ * @param userID - the user id 
+ * @param key - the resulting index key <return>
+ */
+inline void DedupCore::shareUserRef2IndexKey_(char *shareFP, const int &userID, char *key) {
+	/*set the key to be the share's fingerprint followed by the user id*/
+	memcpy(key + 1, shareFP, FP_SIZE);
+	memcpy(key + KEY_SIZE, &userID, sizeof(int));
+	/*add a prefix '3' for indicating user reference index*/
+	key[0] = '3'; 
+}
+
+/*
+ * transform the location of a file recipe to an offset index key
+ *
+ * @param recipeFileName - the name of the recipe file 
+ * @param recipeFileOffset - the offset of the file recipe head in the recipe file 
+ * @param key - the resulting index key <return>
+ */
+inline void DedupCore::recipeLocation2IndexKey_(char *recipeFileName, const int &recipeFileOffset, char *key) {
+	/*set the key to be the recipe file name and offset (padded with zeros)*/
+	memset(key, 0, KEY_SIZE);
+	strncpy(key + 1, recipeFileName, INTERNAL_FILE_NAME_SIZE);
+	memcpy(key + 1 + INTERNAL_FILE_NAME_SIZE, &recipeFileOffset, sizeof(int));
+	/*add a prefix '2' for indicating offset index*/
+	key[0] = '2';
+}
+
+/*
+ * transform a file inode's fingerprint and a version number to an inode version key
+ *
+ * @param inodeFP - the file inode's fingerprint
+ * @param version - the version number (counted from 0 for the first version)
+ * @param key - the resulting index key <return>
+ */
+inline void DedupCore::inodeVersion2IndexKey_(char *inodeFP, const int &version, char *key) {
+	/*set the key to be the inode's fingerprint followed by the version number*/
+	memcpy(key + 1, inodeFP, FP_SIZE);
+	memcpy(key + KEY_SIZE, &version, sizeof(int));
+	/*add a prefix '5' for indicating inode version index*/
+	key[0] = '5';
+}
+
+/*
+ * transform the inode fingerprints of a dir and its child to a dir child key
+ *
+ * @param dirFP - the dir inode's fingerprint
+ * @param childFP - the child inode's fingerprint
+ * @param key - the resulting index key <return>
+ */
+inline void DedupCore::dirChild2IndexKey_(char *dirFP, char *childFP, char *key) {
+	/*set the key to be the dir inode's fingerprint followed by the child inode's fingerprint*/
+	memcpy(key + 1, dirFP, FP_SIZE);
+	memcpy(key + 1 + FP_SIZE, childFP, FP_SIZE);
+	/*add a prefix '4' for indicating dir child index*/
+	key[0] = '4';
+}
+
+/*
+ * get the size of the file recipe entries in a recipe file
+ *
+ * @param recipeFileName - the name of the recipe file 
+ *
+ * @return - the size of fileRecipeEntry_t, or that of legacyFileRecipeEntry_t for an old recipe file
+ */
+inline int DedupCore::fileRecipeEntrySizeOf_(const char *recipeFileName) {
+	int nameLen = strlen(recipeFileName);
+	int postfixLen = strlen(LEGACY_RECIPE_FILE_NAME_POSTFIX);
+
+	if ((nameLen >= postfixLen) && 
+			(strcmp(recipeFileName + nameLen - postfixLen, LEGACY_RECIPE_FILE_NAME_POSTFIX) == 0)) {
+		return legacyFileRecipeEntrySize_;
+	}
+
+	return fileRecipeEntrySize_;
+}
+
+/*
+ * get the index of the lock stripe of an index key
+ *
+ * @param key - the index key 
+ *
+ * @return - the index of the lock stripe
+ */
+inline int DedupCore::indexStripe_(const char *key) {
+	unsigned int hash;
+
+	/*the bytes following the prefix are (part of) a fingerprint, so they are uniformly distributed*/
+	memcpy(&hash, key + 1, sizeof(unsigned int));
+
+	return hash & (NUM_INDEX_LOCK_STRIPES - 1);
+}
+
+/*
+ * get the lock stripe of an index key
+ *
+ * @param key - the index key 
+ *
+ * @return - the mutex lock guarding read-modify-write sequences on the key
+ */
+inline pthread_mutex_t *DedupCore::indexLock_(const char *key) {
+	return &indexLocks_[indexStripe_(key)];
+}
+
 /*
  * get the current time (in second)
  *
@@ -441,176 +827,56 @@ inline void DedupCore::getCurrTime_(double &time) {
  * @return - a boolean value that indicates if the flush op succeeds
  */
 bool DedupCore::flushBufferNodeIntoDisk_(perUserBufferNode_t *targetBufferNode) {
-	FILE *fp;
+	std::string recipeFileName;
+	int recipeFileOffset;
 
-	/*flush the content of recipeFileBuffer into the disk*/
+	/*hand off the content of recipeFileBuffer to the recipe writer*/
 	if (targetBufferNode->recipeFileBufferCurrLen > 0) {
 		/*if the last file recipe head is at the beginning of the buffer*/
 		if (targetBufferNode->lastRecipeHeadPos == 0) {
-			std::string recipeFileName;
-			int recipeFileOffset;
-
 			/*find the old recipe file info in the database*/
 			if (!findOldRecipeFile_(targetBufferNode, recipeFileName, recipeFileOffset)) {	
 				fprintf(stderr, "Error: fail to find the old recipe file info in the database!\n");
 				return 0;		
 			}
 
-			if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
-				fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
-				return 0;	
-			}
-
-			/*open a reciple file for appending recipes; if it does not exist, then create it*/
-			fp = fopen(recipeFileName.c_str(), "ab+");
-			if (fp == NULL) {
-				fprintf(stderr, "Error: fail to open/create the file '%s' for appending/writing recipes!\n", recipeFileName.c_str());
-				return 0;
-			}
-
-			long fileSize = getFileSize_(fp);			
-			/*if the file is a newly created one of size 0, directly write the data of the recipe file buffer into the file*/
-			if (fileSize == 0) {	
-				/*close and re-open the file in a proper mode*/
-				fclose(fp);
-				fp = fopen(recipeFileName.c_str(), "wb");		
-				if (fp == NULL) {
-					fprintf(stderr, "Error: fail to re-open the file '%s' for writing recipes!\n", recipeFileName.c_str());
-					return 0;
-				}
-
+			/*if the file starts in the buffer, store the data of the buffer into a new file; otherwise, append 
+			  it to the old one (note: this case is only possible when an incomplete file is received; otherwise, 
+			  in finishFileWithTrailer(), all recipes in the buffer will be appended to a previous recipe file)*/
+			if (recipeFileName == targetBufferNode->recipeFileName) {
 				if (recipeFileOffset != 0) {
 					fprintf(stderr, "Error: the inode info in the database does not match the recipe file '%s'!\n", 
 							recipeFileName.c_str());
-
-					fclose(fp);
-					return 0;	
-				}
-
-				if (fwrite(targetBufferNode->recipeFileBuffer, targetBufferNode->recipeFileBufferCurrLen, 1, fp) != 1){
-					fprintf(stderr, "Error: fail to write recipes into the file '%s'!\n", recipeFileName.c_str());
-
-					fclose(fp);
-					return 0;	
-				}
-			}
-			/*if the file is an old one, append the recipes in the buffer to the file (note: this case is only possible 
-			  when an incomplete file is received; otherwise, in the last step of secondStageDedup(), all recipes 
-			  in the buffer will be appended to a previous recipe file)*/
-			else {
-				/*close and re-open the file in a proper mode*/
-				fclose(fp);
-				fp = fopen(recipeFileName.c_str(), "rb+");		
-				if (fp == NULL) {
-					fprintf(stderr, "Error: fail to re-open the file '%s' for appending recipes!\n", recipeFileName.c_str());
-					return 0;	
-				}
-
-				fileRecipeHead_t InsFileRecipeHead;
-
-				/*read the file recipe head from the recipe file*/
-				fseek(fp, recipeFileOffset, SEEK_SET);
-				if (fread(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
-					fprintf(stderr, "Error: fail to read the file recipe head from the file '%s'!\n", recipeFileName.c_str());
-
-					fclose(fp);
-					return 0;	
-				}	
-
-				/*append file recipe entries to the recipe file*/
-				fseek(fp, recipeFileOffset + fileRecipeHeadSize_ + fileRecipeEntrySize_ * (InsFileRecipeHead.numOfShares), 
-						SEEK_SET);
-				if (fwrite(targetBufferNode->recipeFileBuffer + fileRecipeHeadSize_, 
-							targetBufferNode->recipeFileBufferCurrLen - fileRecipeHeadSize_, 1, fp) != 1){
-					fprintf(stderr, "Error: fail to append recipe entries to the file '%s'!\n", recipeFileName.c_str());
-
-					fclose(fp);
 					return 0;	
 				}
 
-				/*update the file recipe head into the recipe file*/
-				fileRecipeHead_t *pFileRecipeHead;
-				pFileRecipeHead = (fileRecipeHead_t *) (targetBufferNode->recipeFileBuffer);
-				InsFileRecipeHead.numOfShares += pFileRecipeHead->numOfShares;
-				fseek(fp, recipeFileOffset, SEEK_SET);
-				if (fwrite(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
-					fprintf(stderr, "Error: fail to update the file recipe head into the file '%s'!\n", recipeFileName.c_str());
-
-					fclose(fp);
-					return 0;
-				}
-			}
-
-			fclose(fp);
-
-			if (recipeStorerObj_ != NULL) {
-				recipeStorerObj_->addNewFile(recipeFileName);
+				recipeFileOffset = -1;
 			}
 		}
 		/*if the last file recipe head is not at the beginning of the buffer, store the data of the buffer into a new file*/
 		else {
-			std::string recipeFileName;
-
 			recipeFileName = targetBufferNode->recipeFileName;
+			recipeFileOffset = -1;
+		}
 
-			if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
-				fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
-				return 0;	
-			}
-
-			/*create a reciple file for writing recipes*/
-			fp = fopen(recipeFileName.c_str(), "wb");		
-			if (fp == NULL) {
-				fprintf(stderr, "Error: fail to open the file '%s' for writing recipes!\n", recipeFileName.c_str());
-				return 0;
-			}
-
-			/*write the data of the recipe file buffer into a recipe file*/
-			if (fwrite(targetBufferNode->recipeFileBuffer, targetBufferNode->recipeFileBufferCurrLen, 1, fp) != 1){
-				fprintf(stderr, "Error: fail to write recipes into the file '%s'!\n", recipeFileName.c_str());
-
-				fclose(fp);
-				return 0;	
-			}	
-
-			fclose(fp);	
+		if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
+			fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
+			return 0;	
+		}
 
-			if (recipeStorerObj_ != NULL) {
-				recipeStorerObj_->addNewFile(recipeFileName);
-			}
+		if (!handOffRecipeFile_(targetBufferNode, recipeFileName, recipeFileOffset, 1)) {
+			return 0;
 		}
 	}
 
-	/*2. flush the content of shareContainerBuffer into the disk*/
+	/*hand off the rest of shareContainerBuffer to a container writer*/
 	if (targetBufferNode->shareContainerBufferCurrLen > 0) {
-		std::string shareContainerName;
-
-		shareContainerName = targetBufferNode->shareContainerName;
-
-		if (!addPrefixDir_(shareContainerDirName_, shareContainerName)) {
-			fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", shareContainerDirName_.c_str(), shareContainerName.c_str());
-			return 0;		
-		}	
-
-		/*create a container file for writing shares*/
-		fp = fopen(shareContainerName.c_str(), "wb");		
-		if (fp == NULL) {
-			fprintf(stderr, "Error: fail to open the file '%s' for writing shares!\n", shareContainerName.c_str());
-			return 0;	
-		}	
-
-		/*write the data of the share container buffer into a container file*/
-		if (fwrite(targetBufferNode->shareContainerBuffer, targetBufferNode->shareContainerBufferCurrLen, 1, fp) != 1){
-			fprintf(stderr, "Error: fail to write shares into the file '%s'!\n", shareContainerName.c_str());
-
-			fclose(fp);
-			return 0;	
-		}	
-
-		fclose(fp);	
-
-		if (containerStorerObj_ != NULL) {
-			containerStorerObj_->addNewFile(shareContainerName);
+		if (!selectContainerWriter_()->addContainer(targetBufferNode->shareContainerID, 
+					targetBufferNode->shareContainerBuffer, targetBufferNode->shareContainerBufferCurrLen, 
+					*(targetBufferNode->shareKeyList), *(targetBufferNode->shareValueList))) {
+			fprintf(stderr, "Error: fail to hand off the share container %llu to a container writer!\n", 
+					(unsigned long long) targetBufferNode->shareContainerID);
+			return 0;
 		}
 	}
 
@@ -618,244 +884,373 @@ bool DedupCore::flushBufferNodeIntoDisk_(perUserBufferNode_t *targetBufferNode)
 }
 
 /*
- * find or create a buffer node for a user in the buffer node link
+ * find or create a buffer node for a user in the buffer node pool, and use it until it is released
  *
  * @param userID - the user id
  * @param targetBufferNode - the resulting buffer node <return>
+ *
+ * @return - a boolean value that indicates if the buffer node is found or created
  */
-void DedupCore::findOrCreateBufferNode_(const int &userID, perUserBufferNode_t *&targetBufferNode) {	
-	perUserBufferNode_t *currBufferNode, *preBufferNode;
-	double currTime, preTime;
-	bool goForward;
+bool DedupCore::findOrCreateBufferNode_(const int &userID, perUserBufferNode_t *&targetBufferNode) {	
+	boost::unordered_map<int, perUserBufferNode_t *>::iterator it;
+	perUserBufferNode_t *newBufferNode;
+	double currTime;
 
 	/*get the mutex lock bufferLock_*/
 	pthread_mutex_lock(&bufferLock_);
 
-	/*find the buffer node for this user*/
-	currBufferNode = headBufferNode_;
+	/*find the buffer node for this user (it stays in its slot of the timing wheel until the flusher checks it), 
+	  after the node being retired if any, as a new one is created once its data is on the disk*/
 	targetBufferNode = NULL;
-	preBufferNode =NULL;
-	while (currBufferNode != NULL) {
-		goForward = 1;
-
-		if (currBufferNode->userID == userID) {
-			getCurrTime_(currTime);			
-			currBufferNode->lastUseTime = currTime;			
-			targetBufferNode = currBufferNode;
-		}
-		else {
-			preTime = currBufferNode->lastUseTime;
-			getCurrTime_(currTime);
-
-			if (currTime - preTime  > MAX_BUFFER_WAIT_SECS) {
-				/* flush the buffer node into the disk*/
-				if (!flushBufferNodeIntoDisk_(currBufferNode)) {
-					fprintf(stderr, "Warning: fail to flush the buffer node for userID '%d' into the disk!\n", 
-							currBufferNode->userID);
-				}
+	it = bufferNodeMap_.find(userID);
+	while ((it != bufferNodeMap_.end()) && it->second->retireStat) {
+		pthread_cond_wait(&bufferCond_, &bufferLock_);
+		it = bufferNodeMap_.find(userID);
+	}
+	if (it != bufferNodeMap_.end()) {
+		getCurrTime_(currTime);			
+		it->second->lastUseTime = currTime;			
+		it->second->numOfUsers++;
+		targetBufferNode = it->second;
+	}
 
-				/*delete the buffer node from the link and then free it*/
-				if (currBufferNode == headBufferNode_) {
-					currBufferNode = currBufferNode->next;
-					free(headBufferNode_);
+	/*release the mutex lock bufferLock_*/
+	pthread_mutex_unlock(&bufferLock_);
 
-					if (headBufferNode_ == tailBufferNode_) {
-						/*the only buffer node is deleted*/
-						headBufferNode_ = NULL;
-						tailBufferNode_ = NULL;
-					}
-					else {
-						headBufferNode_ = currBufferNode;
-					}
+	/*if such a buffer node does not exist, then create one for this user*/
+	if (targetBufferNode == NULL) { 
+		/*create the buffer node*/
+		newBufferNode = (perUserBufferNode_t *) malloc(perUserBufferNodeSize_);
 
-					preBufferNode =NULL;					
-				}
-				else {
-					preBufferNode->next = currBufferNode->next;
-					free(currBufferNode);
-
-					if (currBufferNode == tailBufferNode_) {
-						currBufferNode = NULL;
-						tailBufferNode_ = preBufferNode;
-					}
-					else {
-						currBufferNode = preBufferNode->next;
-					}					
-				}
-
-				goForward = 0;				
-			}				
-		}
-
-		if (goForward == 1) {
-			preBufferNode = currBufferNode;
-			currBufferNode = currBufferNode->next;
-		}
-	}	
-
-	/*release the mutex lock bufferLock_*/
-	pthread_mutex_unlock(&bufferLock_);
-
-	/*if such a buffer node does not exist, then create one for this user*/
-	if (targetBufferNode == NULL) { 
-		/*create the buffer node*/
-		targetBufferNode = (perUserBufferNode_t *) malloc(perUserBufferNodeSize_);
-
-		targetBufferNode->userID = userID;
+		newBufferNode->userID = userID;
 
 		/*get the mutex lock globalRecipeFileNameLock_*/
 		pthread_mutex_lock(&globalRecipeFileNameLock_);
 
-		globalRecipeFileName_.copy(targetBufferNode->recipeFileName, INTERNAL_FILE_NAME_SIZE-1, 0);
-		targetBufferNode->recipeFileName[INTERNAL_FILE_NAME_SIZE-1] = '\0';
+		globalRecipeFileName_.copy(newBufferNode->recipeFileName, INTERNAL_FILE_NAME_SIZE-1, 0);
+		newBufferNode->recipeFileName[INTERNAL_FILE_NAME_SIZE-1] = '\0';
 		incrGlobalFileName_(globalRecipeFileName_, recipeFileNameValidLen_);		
 
 		/*release the mutex lock globalRecipeFileNameLock_*/
 		pthread_mutex_unlock(&globalRecipeFileNameLock_);
 
-		targetBufferNode->recipeFileBufferCurrLen = 0;
-		targetBufferNode->lastRecipeHeadPos = 0;
-
-		/*get the mutex lock globalShareContainerNameLock_*/
-		pthread_mutex_lock(&globalShareContainerNameLock_);
+		newBufferNode->recipeFileBufferCurrLen = 0;
+		newBufferNode->lastRecipeHeadPos = 0;
 
-		globalShareContainerName_.copy(targetBufferNode->shareContainerName, INTERNAL_FILE_NAME_SIZE - 1, 0);
-		targetBufferNode->shareContainerName[INTERNAL_FILE_NAME_SIZE - 1] = '\0';
-		incrGlobalFileName_(globalShareContainerName_, recipeFileNameValidLen_);		
+		/*no file is tracked by the offset index until a new file starts*/
+		newBufferNode->currRecipeFileName[0] = '\0';
+		newBufferNode->currFileNumOfShares = 0;
 
-		/*release the mutex lock globalShareContainerNameLock_*/
-		pthread_mutex_unlock(&globalShareContainerNameLock_);
+		if (!newShareContainerID_(newBufferNode->shareContainerID)) {
+			free(newBufferNode);
 
-		targetBufferNode->shareContainerBufferCurrLen = 0;
+			return 0;
+		}
 
-		getCurrTime_(currTime);
-		targetBufferNode->lastUseTime = currTime;
+		newBufferNode->shareContainerBufferCurrLen = 0;
+		newBufferNode->shareKeyList = new std::vector<std::string>();
+		newBufferNode->shareValueList = new std::vector<std::string>();
 
-		targetBufferNode->next = NULL;
+		newBufferNode->numOfUsers = 1;
+		newBufferNode->retireStat = 0;
+		pthread_mutex_init(&(newBufferNode->nodeLock), NULL);
 
 		/*get the mutex lock bufferLock_*/
 		pthread_mutex_lock(&bufferLock_);
 
-		/*link it in the end of the pool*/
-		if (headBufferNode_ == NULL) {
-			headBufferNode_ = targetBufferNode;
-			tailBufferNode_= targetBufferNode;
+		/*add it into the pool, unless another session of the user has added one meanwhile*/
+		it = bufferNodeMap_.find(userID);
+		while ((it != bufferNodeMap_.end()) && it->second->retireStat) {
+			pthread_cond_wait(&bufferCond_, &bufferLock_);
+			it = bufferNodeMap_.find(userID);
+		}
+
+		getCurrTime_(currTime);
+
+		if (it != bufferNodeMap_.end()) {
+			it->second->lastUseTime = currTime;
+			it->second->numOfUsers++;
+			targetBufferNode = it->second;
+
+			pthread_mutex_destroy(&(newBufferNode->nodeLock));
+			delete newBufferNode->shareKeyList;
+			delete newBufferNode->shareValueList;
+			free(newBufferNode);
 		}
 		else {
-			tailBufferNode_->next = targetBufferNode;
-			tailBufferNode_ = targetBufferNode;
+			newBufferNode->lastUseTime = currTime;
+
+			bufferNodeMap_[userID] = newBufferNode;
+			containerBufferNodeMap_[newBufferNode->shareContainerID] = newBufferNode;
+			linkBufferNode_(newBufferNode);
+
+			targetBufferNode = newBufferNode;
 		}
 
 		/*release the mutex lock bufferLock_*/
 		pthread_mutex_unlock(&bufferLock_);
 	}		
+
+	/*the sessions of the user fill the node in turn (it cannot be retired while it is used, so the lock outlives 
+	  the waiters)*/
+	pthread_mutex_lock(&(targetBufferNode->nodeLock));
+
+	return 1;
+}
+
+/*
+ * release a buffer node used by findOrCreateBufferNode_()
+ *
+ * @param targetBufferNode - the buffer node
+ */
+void DedupCore::releaseBufferNode_(perUserBufferNode_t *targetBufferNode) {
+	double currTime;
+
+	/*let the next session of the user fill the node*/
+	pthread_mutex_unlock(&(targetBufferNode->nodeLock));
+
+	pthread_mutex_lock(&bufferLock_);
+
+	/*the node may expire only from now on*/
+	getCurrTime_(currTime);
+	targetBufferNode->lastUseTime = currTime;
+
+	targetBufferNode->numOfUsers--;
+	if (targetBufferNode->numOfUsers == 0) {
+		pthread_cond_broadcast(&bufferCond_);
+	}
+
+	pthread_mutex_unlock(&bufferLock_);
+}
+
+/*
+ * link a buffer node into the slot of the timing wheel where it may expire (the caller holds bufferLock_)
+ *
+ * @param targetBufferNode - the buffer node
+ */
+void DedupCore::linkBufferNode_(perUserBufferNode_t *targetBufferNode) {
+	long expireTick;
+
+	/*the first tick after the node may be idle for MAX_BUFFER_WAIT_SECS (always after bufferWheelTick_)*/
+	expireTick = (long) ((targetBufferNode->lastUseTime + MAX_BUFFER_WAIT_SECS) / BUFFER_WHEEL_TICK_SECS) + 1;
+	if (expireTick <= bufferWheelTick_) {
+		expireTick = bufferWheelTick_ + 1;
+	}
+
+	targetBufferNode->wheelSlot = expireTick % NUM_BUFFER_WHEEL_SLOTS;
+	targetBufferNode->prev = NULL;
+	targetBufferNode->next = bufferWheel_[targetBufferNode->wheelSlot];
+	if (targetBufferNode->next != NULL) {
+		targetBufferNode->next->prev = targetBufferNode;
+	}
+	bufferWheel_[targetBufferNode->wheelSlot] = targetBufferNode;
+}
+
+/*
+ * unlink a buffer node from the timing wheel (the caller holds bufferLock_)
+ *
+ * @param targetBufferNode - the buffer node
+ */
+void DedupCore::unlinkBufferNode_(perUserBufferNode_t *targetBufferNode) {
+	if (targetBufferNode->prev != NULL) {
+		targetBufferNode->prev->next = targetBufferNode->next;
+	}
+	else {
+		bufferWheel_[targetBufferNode->wheelSlot] = targetBufferNode->next;
+	}
+
+	if (targetBufferNode->next != NULL) {
+		targetBufferNode->next->prev = targetBufferNode->prev;
+	}
+}
+
+/*
+ * flush a buffer node into the disk, and delete it from the buffer node pool (the caller holds bufferLock_, 
+ * which is released during the flush, and has unlinked the node from the timing wheel and set its retireStat)
+ *
+ * @param targetBufferNode - the buffer node
+ *
+ * @return - a boolean value that indicates if the flush op succeeds (the node is deleted anyway)
+ */
+bool DedupCore::retireBufferNode_(perUserBufferNode_t *targetBufferNode) {
+	bool flushStat;
+
+	/*the node is flushed before it leaves the pool, so that the restores always find its data (no thread uses it 
+	  once it is retired, so its lock is only taken for the flush)*/
+	pthread_mutex_unlock(&bufferLock_);
+	pthread_mutex_lock(&(targetBufferNode->nodeLock));
+	flushStat = flushBufferNodeIntoDisk_(targetBufferNode);
+	pthread_mutex_unlock(&(targetBufferNode->nodeLock));
+	pthread_mutex_lock(&bufferLock_);
+
+	bufferNodeMap_.erase(targetBufferNode->userID);
+	containerBufferNodeMap_.erase(targetBufferNode->shareContainerID);
+	pthread_mutex_destroy(&(targetBufferNode->nodeLock));
+	delete targetBufferNode->shareKeyList;
+	delete targetBufferNode->shareValueList;
+	free(targetBufferNode);
+
+	/*wake up the threads waiting for the node to leave*/
+	pthread_cond_broadcast(&bufferCond_);
+
+	return flushStat;
+}
+
+/*
+ * the main procedure of the flusher thread
+ *
+ * @param param - the DedupCore instance
+ */
+void *DedupCore::flusherHandler_(void *param) {
+	DedupCore *obj = (DedupCore *) param;
+	perUserBufferNode_t *currBufferNode, *nextBufferNode;
+	std::vector<perUserBufferNode_t *> retireList;
+	struct timespec wakeTime;
+	double currTime;
+	long currTick;
+	int slot, userID, i;
+
+	pthread_mutex_lock(&(obj->bufferLock_));
+
+	while (!obj->flusherStopStat_) {
+		/*wait until the next tick*/
+		wakeTime.tv_sec = (obj->bufferWheelTick_ + 1) * BUFFER_WHEEL_TICK_SECS;
+		wakeTime.tv_nsec = 0;
+		pthread_cond_timedwait(&(obj->flusherCond_), &(obj->bufferLock_), &wakeTime);
+		if (obj->flusherStopStat_) {
+			break;
+		}
+
+		/*check the slots of the ticks passed (at most a lap, if the clock jumps)*/
+		obj->getCurrTime_(currTime);
+		currTick = (long) (currTime / BUFFER_WHEEL_TICK_SECS);
+		if (currTick - obj->bufferWheelTick_ > NUM_BUFFER_WHEEL_SLOTS) {
+			obj->bufferWheelTick_ = currTick - NUM_BUFFER_WHEEL_SLOTS;
+		}
+
+		while (obj->bufferWheelTick_ < currTick) {
+			obj->bufferWheelTick_++;
+
+			slot = obj->bufferWheelTick_ % NUM_BUFFER_WHEEL_SLOTS;
+			currBufferNode = obj->bufferWheel_[slot];
+			obj->bufferWheel_[slot] = NULL;
+
+			/*pick out the idle nodes, and move on the nodes in use or used since they were linked*/
+			retireList.clear();
+			while (currBufferNode != NULL) {
+				nextBufferNode = currBufferNode->next;
+
+				if ((currBufferNode->numOfUsers == 0) && (currTime - currBufferNode->lastUseTime > MAX_BUFFER_WAIT_SECS)) {
+					currBufferNode->retireStat = 1;
+					retireList.push_back(currBufferNode);
+				}
+				else {
+					obj->linkBufferNode_(currBufferNode);
+				}
+
+				currBufferNode = nextBufferNode;
+			}
+
+			/*flush the idle nodes (bufferLock_ is released during each flush)*/
+			for (i = 0; i < (int) retireList.size(); i++) {
+				userID = retireList[i]->userID;
+				if (!obj->retireBufferNode_(retireList[i])) {
+					fprintf(stderr, "Warning: fail to flush the buffer node for userID '%d' into the disk!\n", userID);
+				}
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&(obj->bufferLock_));
+
+	return NULL;
 }
 
 /*
- * add a file's information into the inode index
+ * add a file's information into the inode index, through the batch of the namespace updates 
+ * (the caller holds the lock stripe of the file inode key until the batch is written)
  *
- * @param fullFileName - the full name of the file to be added 
+ * @param newFile - the new file to be added 
  * @param userID - the user id 
- * @param targetBufferNode - the corresponding buffer node 
+ * @param namespaceBatch - the batch of the inode and dir updates of a metadata buffer <return>
+ * @param newDirKeySet - the keys of the new dirs added to namespaceBatch <return>
+ * @param newFileInodeMap - the file inodes added to namespaceBatch <return>
  * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
  *
  * @return - a boolean value that indicates if the add op succeeds
  */
-bool DedupCore::addFileIntoInodeIndex_(const std::string &fullFileName, const int &userID, 
-		perUserBufferNode_t *targetBufferNode, CryptoPrimitive *cryptoObj) {
+bool DedupCore::addFileIntoInodeIndex_(const newFileEntry_t &newFile, const int &userID, 
+		leveldb::WriteBatch &namespaceBatch, boost::unordered_set<std::string> &newDirKeySet, 
+		boost::unordered_map<std::string, std::string> &newFileInodeMap, CryptoPrimitive *cryptoObj) {
+	boost::unordered_map<std::string, std::string>::iterator it;
 	leveldb::Status fileStat, dirStat;
 	std::string shortName, dirName;
 	size_t currPos;
 	char currFP[FP_SIZE], preFP[FP_SIZE];	
-	char key[KEY_SIZE], *value;
-	leveldb::Slice *fileKeySlice, *dirKeySlice, *valueSlice;
-	std::string valueString;
+	char key[KEY_SIZE], childKey[DIR_CHILD_KEY_SIZE], versionKey[INODE_VERSION_KEY_SIZE], *value;
+	std::string valueString, fileKey, dirKey;
 	int valueSize, valueOffset;
 	inodeIndexValueHead_t *pInodeIndexValueHead;
-	inodeFileEntry_t *pInodeFileEntry;
-	inodeDirEntry_t *pInodeDirEntry;
-	bool inPathFlag;
-	int i;
+	int numOfVersions, i;
 
 	/*fullFileName always has the format '/.../.../shortName'*/	
-	currPos = fullFileName.rfind('/');
+	currPos = newFile.fullFileName.rfind('/');
 	/*for the fullFileName, shortName does not end with '/'*/
-	shortName = fullFileName.substr(currPos + 1);
+	shortName = newFile.fullFileName.substr(currPos + 1);
 	/*dirName always ends with '/'*/
-	dirName = fullFileName.substr(0, currPos + 1); 
+	dirName = newFile.fullFileName.substr(0, currPos + 1); 
 
 	/*generate the key*/
-	fileName2InodeFP_(fullFileName, userID, currFP, cryptoObj);	
+	memcpy(currFP, newFile.inodeFP, FP_SIZE);
 	inodeFP2IndexKey_(currFP, key); 
-	fileKeySlice = new leveldb::Slice(key, KEY_SIZE);
-
-	/*get the mutex lock DBLock_*/
-	pthread_mutex_lock(&DBLock_);
-
-	/*enquire the key in the database*/	
-	fileStat = db_->Get(readOptions_, *fileKeySlice, &valueString);
+	fileKey.assign(key, KEY_SIZE);
+
+	/*enquire the key among the file inodes added to the batch (if the file is repeated in the metadata buffer), 
+	  and then in the database*/	
+	it = newFileInodeMap.find(fileKey);
+	if (it != newFileInodeMap.end()) {
+		fileStat = leveldb::Status::OK();
+		valueString = it->second;
+	}
+	else {
+		fileStat = db_->Get(readOptions_, fileKey, &valueString);
+	}
 
 	/*if such an inode for fullFileName exists*/
 	if (fileStat.ok()) {	
-		valueSize = valueString.size() + inodeFileEntrySize_;
-		value = (char *) malloc(valueSize);
-
-		/*copy the head from valueString to value*/		
+		/*read the inode head (note: numOfChildren records the number of versions in this case)*/
 		valueOffset = 0;	
-		memcpy(value + valueOffset, valueString.data() + valueOffset, inodeIndexValueHeadSize_);	
-		pInodeIndexValueHead = (inodeIndexValueHead_t *) (value + valueOffset);
+		pInodeIndexValueHead = (inodeIndexValueHead_t *) (valueString.data() + valueOffset);
 		valueOffset += inodeIndexValueHeadSize_;
-
-		/*copy the short name from valueString to value*/		
-		memcpy(value + valueOffset, valueString.data() + valueOffset, pInodeIndexValueHead->shortNameSize);	
-		valueOffset += pInodeIndexValueHead->shortNameSize;	
-
-		/*add a new entry that contains the recipe file information for the newest version of the file in the front*/
-		pInodeFileEntry = (inodeFileEntry_t *) (value + valueOffset);
-		strcpy(pInodeFileEntry->recipeFileName, targetBufferNode->recipeFileName);
-		pInodeFileEntry->recipeFileOffset = targetBufferNode->recipeFileBufferCurrLen;
-
-		/*update the inode head (note: numOfChildren records the number of versions in this case)*/
-		pInodeIndexValueHead->numOfChildren++;
-
-		/*copy all other entries for older versions of the file from valueString to value*/	
-		memcpy(value + valueOffset + inodeFileEntrySize_, valueString.data() + valueOffset, 
-				valueString.size() - valueOffset);		
-
-		/*clear the write batch batch_*/
-		batch_.Clear();		
-
-		/*update the key-value entry in a batch manner*/
-		batch_.Delete(*fileKeySlice);
-		valueSlice = new leveldb::Slice(value, valueSize);
-		batch_.Put(*fileKeySlice, *valueSlice);
-
-		/*execute all batched database update ops*/
-		leveldb::Status writeStat = db_->Write(writeOptions_, &batch_);
-		if (writeStat.ok() == false) {
-			fprintf(stderr, "Error: fail to perform batched writes!\n");
-			fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
-
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
-
-			return 0;
+		valueOffset += pInodeIndexValueHead->shortNameSize;
+		numOfVersions = pInodeIndexValueHead->numOfChildren;
+
+		/*move the entries of an old inode (the newest first) to their version keys, and keep only its head and name*/
+		if ((int) valueString.size() > valueOffset) {
+			for (i = 0; i < numOfVersions; i++) {
+				inodeVersion2IndexKey_(currFP, numOfVersions - 1 - i, versionKey);
+				namespaceBatch.Put(leveldb::Slice(versionKey, INODE_VERSION_KEY_SIZE), 
+						leveldb::Slice(valueString.data() + valueOffset + inodeFileEntrySize_ * i, inodeFileEntrySize_));
+			}
+			valueString.resize(valueOffset);
 		}
 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+		/*add a version key that contains the recipe file information for the newest version of the file*/
+		inodeVersion2IndexKey_(currFP, numOfVersions, versionKey);
+		namespaceBatch.Put(leveldb::Slice(versionKey, INODE_VERSION_KEY_SIZE), 
+				leveldb::Slice((char *) &(newFile.inodeFileEntry), inodeFileEntrySize_));
 
-		delete valueSlice;
-		free(value);
+		/*update the inode head*/
+		pInodeIndexValueHead = (inodeIndexValueHead_t *) &valueString[0];
+		pInodeIndexValueHead->numOfChildren++;
+		namespaceBatch.Put(fileKey, valueString);
+		newFileInodeMap[fileKey] = valueString;
 	}
 
 	/*if such an inode for fullFileName does not exist*/
 	if (fileStat.IsNotFound()) {	
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
-
-		/*1. first add a new key-value entry for fullFileName in the inode index*/
-		valueSize = inodeIndexValueHeadSize_ + (shortName.size() + 1) + inodeFileEntrySize_;
+		/*1. first add a new key-value entry for fullFileName in the inode index, with its first version*/
+		valueSize = inodeIndexValueHeadSize_ + (shortName.size() + 1);
 		value = (char *) malloc(valueSize);
 
 		/*generate the value*/
@@ -873,28 +1268,20 @@ bool DedupCore::addFileIntoInodeIndex_(const std::string &fullFileName, const in
 		strcpy(value + valueOffset, shortName.c_str());
 		valueOffset += pInodeIndexValueHead->shortNameSize;
 
-		/*- set the recipe file information*/
-		pInodeFileEntry = (inodeFileEntry_t *) (value + valueOffset);
-		strcpy(pInodeFileEntry->recipeFileName, targetBufferNode->recipeFileName);
-		pInodeFileEntry->recipeFileOffset = targetBufferNode->recipeFileBufferCurrLen;
-		valueOffset += inodeFileEntrySize_;
-
-		valueSlice = new leveldb::Slice(value, valueSize);
-
-		/*get the mutex lock DBLock_*/
-		pthread_mutex_lock(&DBLock_);
-
-		/*store the key-value entry into the inode index*/
-		db_->Put(writeOptions_, *fileKeySlice, *valueSlice);
+		/*- set the recipe file information of the first version*/
+		inodeVersion2IndexKey_(currFP, 0, versionKey);
 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+		/*add the key-value entries into the batch*/
+		namespaceBatch.Put(leveldb::Slice(versionKey, INODE_VERSION_KEY_SIZE), 
+				leveldb::Slice((char *) &(newFile.inodeFileEntry), inodeFileEntrySize_));
+		namespaceBatch.Put(fileKey, leveldb::Slice(value, valueSize));
+		newFileInodeMap[fileKey].assign(value, valueSize);
 
-		delete valueSlice;
 		free(value);
 
-		/*2. update the inode of each dir in the path of fullFileName from bottom to top (the root '/')*/
-
+		/*2. add fullFileName as a child of its dir, and add the missing dirs in the path from bottom to top 
+		  (the root '/'); the dirs above an existing dir also exist, as the new dirs of a metadata buffer are 
+		  written in one batch*/
 		while (!dirName.empty()) {
 			/*copy the previous fingerprint from currFP into preFP*/
 			memcpy(preFP, currFP, FP_SIZE);
@@ -902,169 +1289,68 @@ bool DedupCore::addFileIntoInodeIndex_(const std::string &fullFileName, const in
 			/*generate the key of dirName*/
 			fileName2InodeFP_(dirName, userID, currFP, cryptoObj);
 			inodeFP2IndexKey_(currFP, key); 	
-			dirKeySlice = new leveldb::Slice(key, KEY_SIZE);
+			dirKey.assign(key, KEY_SIZE);
+
+			/*add the child to dirName (a blind write, as adding a child twice changes nothing)*/
+			dirChild2IndexKey_(currFP, preFP, childKey);
+			namespaceBatch.Put(leveldb::Slice(childKey, DIR_CHILD_KEY_SIZE), leveldb::Slice());
 
-			/*get the mutex lock DBLock_*/
-			pthread_mutex_lock(&DBLock_);
+			/*stop at a dir that is to be added by the batch or is known to exist*/
+			if ((newDirKeySet.count(dirKey) > 0) || findDirInodeInCache_(dirKey)) {
+				break;
+			}
 
 			/*enquire the key in the database*/
-			dirStat = db_->Get(readOptions_, *dirKeySlice, &valueString);
+			dirStat = db_->Get(readOptions_, leveldb::Slice(key, KEY_SIZE), &valueString);
 
 			/*if such an inode for dirName exists*/
-			if (dirStat.ok()) {	 
-				/*read the inode head*/
-				valueOffset = 0;	
-				pInodeIndexValueHead = (inodeIndexValueHead_t *) (valueString.data() + valueOffset);
-				valueOffset += inodeIndexValueHeadSize_;
-
-				/*skip the name*/
-				valueOffset += pInodeIndexValueHead->shortNameSize;
-
-				/*check if dirName has a path to fullFileName*/
-				inPathFlag = 0;
-				for (i = 0; (i < pInodeIndexValueHead->numOfChildren) && (inPathFlag == 0); i++) {
-					pInodeDirEntry = (inodeDirEntry_t *) (valueString.data() + valueOffset);				
-					valueOffset += inodeDirEntrySize_;
-
-					if (memcmp(pInodeDirEntry->inodeFP, preFP, FP_SIZE) == 0) {
-						inPathFlag = 1;
-					}
-				}
-
-				/*if dirName does not have a path to fullFileName, add an entry for fullFileName*/
-				if (inPathFlag != 1) {
-					valueSize = valueString.size() + inodeDirEntrySize_;
-					value = (char *) malloc(valueSize);
-
-					/*copy the value from valueString to value*/
-					memcpy(value, valueString.data(), valueString.size());
-
-					/*add an entry for fullFileName*/
-					valueOffset = valueString.size();	
-					pInodeDirEntry = (inodeDirEntry_t *) (value + valueOffset);	
-					memcpy(pInodeDirEntry->inodeFP, preFP, FP_SIZE); 	
-
-					/*update the inode head*/
-					valueOffset = 0;				
-					pInodeIndexValueHead = (inodeIndexValueHead_t *) (value + valueOffset);
-					pInodeIndexValueHead->numOfChildren++;
-
-					/*clear the write batch batch_*/
-					batch_.Clear();
-
-					/*update the key-value entry in a batch manner*/
-					batch_.Delete(*dirKeySlice);
-					valueSlice = new leveldb::Slice(value, valueSize);
-					batch_.Put(*dirKeySlice, *valueSlice);
-
-					/*execute all batched database update ops*/
-					leveldb::Status writeStat = db_->Write(writeOptions_, &batch_);
-					if (writeStat.ok() == false) {
-						fprintf(stderr, "Error: fail to perform batched writes!\n");
-						fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+			if (dirStat.ok()) {
+				addDirInodeIntoCache_(dirKey);
 
-						/*release the mutex lock DBLock_*/
-						pthread_mutex_unlock(&DBLock_);
-
-						return 0;
-					}
-
-					/*release the mutex lock DBLock_*/
-					pthread_mutex_unlock(&DBLock_);
-
-					delete valueSlice;
-					free(value);
-				}
-				else {
-					/*do nothing*/
-
-					/*release the mutex lock DBLock_*/
-					pthread_mutex_unlock(&DBLock_);
-				}
+				break;
 			}
 
-			/*if such an inode for dirName does not exist*/
-			if (dirStat.IsNotFound()) {
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
-
-				if (dirName != "/") {
-					/*since dirName ends with '/', we actually search the second last '/'*/
-					currPos = dirName.rfind('/', dirName.size() - 2);
-					/*for the dirName, shortName also ends with '/'*/
-					shortName = dirName.substr(currPos + 1);					
-				}
-				else { /*we reach the root '/'*/
-					shortName = dirName;
-				}
-
-				valueSize = inodeIndexValueHeadSize_ + (shortName.size() + 1) + inodeDirEntrySize_;
-				value = (char *) malloc(valueSize);
-
-				/*(a) generate the value*/
-
-				/*- set the head*/
-				valueOffset = 0;
-				pInodeIndexValueHead = (inodeIndexValueHead_t *) (value + valueOffset);
-				pInodeIndexValueHead->userID = userID;
-				pInodeIndexValueHead->shortNameSize = shortName.size() + 1; /*size() do not consider the null-terminator*/
-				pInodeIndexValueHead->inodeType = DIR_TYPE;
-				pInodeIndexValueHead->numOfChildren = 1;
-				valueOffset += inodeIndexValueHeadSize_;		
-
-				/*- set the short name*/
-				strcpy(value + valueOffset, shortName.c_str());
-				valueOffset += pInodeIndexValueHead->shortNameSize;
-
-				/*- set an entry for fullFileName*/
-				pInodeDirEntry = (inodeDirEntry_t *) (value + valueOffset);	
-				memcpy(pInodeDirEntry->inodeFP, preFP, FP_SIZE); 
-				valueOffset += inodeDirEntrySize_;
+			if (!dirStat.IsNotFound()) {
+				fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", 
+						leveldb::Slice(dirKey).ToString().c_str());
+				fprintf(stderr, "Status: %s \n", dirStat.ToString().c_str());
 
-				valueSlice = new leveldb::Slice(value, valueSize);
-
-				/*get the mutex lock DBLock_*/
-				pthread_mutex_lock(&DBLock_);
-
-				/*(b) store the key-value entry into the inode index*/
-				db_->Put(writeOptions_, *dirKeySlice, *valueSlice);	
-
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
-
-				delete valueSlice;
-				free(value);		
+				return 0;
 			}
 
-			if (dirStat.IsCorruption()) { 
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
-
-				fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", 
-						dirKeySlice->ToString().c_str());
-
-				delete dirKeySlice;
-
-				return 0;
+			/*if such an inode for dirName does not exist, add it to the batch*/
+			if (dirName != "/") {
+				/*since dirName ends with '/', we actually search the second last '/'*/
+				currPos = dirName.rfind('/', dirName.size() - 2);
+				/*for the dirName, shortName also ends with '/'*/
+				shortName = dirName.substr(currPos + 1);					
+			}
+			else { /*we reach the root '/'*/
+				shortName = dirName;
 			}
 
-			if (dirStat.IsIOError()) {
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
+			valueSize = inodeIndexValueHeadSize_ + (shortName.size() + 1);
+			value = (char *) malloc(valueSize);
 
-				fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", 
-						dirKeySlice->ToString().c_str());				
+			/*- set the head*/
+			valueOffset = 0;
+			pInodeIndexValueHead = (inodeIndexValueHead_t *) (value + valueOffset);
+			pInodeIndexValueHead->userID = userID;
+			pInodeIndexValueHead->shortNameSize = shortName.size() + 1; /*size() do not consider the null-terminator*/
+			pInodeIndexValueHead->inodeType = DIR_TYPE;
+			pInodeIndexValueHead->numOfChildren = 0;
+			valueOffset += inodeIndexValueHeadSize_;		
 
-				delete dirKeySlice;
+			/*- set the short name*/
+			strcpy(value + valueOffset, shortName.c_str());
+			valueOffset += pInodeIndexValueHead->shortNameSize;
 
-				return 0;
-			}
+			namespaceBatch.Put(leveldb::Slice(key, KEY_SIZE), leveldb::Slice(value, valueSize));
+			newDirKeySet.insert(dirKey);
 
-			delete dirKeySlice;
+			free(value);
 
 			if (dirName != "/") {
-				/*since dirName ends with '/', we actually search the second last '/'*/
-				currPos = dirName.rfind('/', dirName.size() - 2);
 				/*shorten dirName by one level*/
 				dirName.resize(currPos + 1);				
 			}
@@ -1075,715 +1361,2151 @@ bool DedupCore::addFileIntoInodeIndex_(const std::string &fullFileName, const in
 	}
 
 	if (fileStat.IsCorruption()) { 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
-
-		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", fileKeySlice->ToString().c_str());
-
-		delete fileKeySlice;
+		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", leveldb::Slice(fileKey).ToString().c_str());
 
 		return 0;
 	}
 
 	if (fileStat.IsIOError()) {
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
-
-		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", fileKeySlice->ToString().c_str());
-
-		delete fileKeySlice;
+		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", leveldb::Slice(fileKey).ToString().c_str());
 
 		return 0;
 	}	
 
-	delete fileKeySlice;
-
 	return 1;
 }
 
 /*
- * update the index for a share based on intra-user deduplication
+ * add the inodes of the new files of a metadata buffer and their dir updates in one batch, under the 
+ * lock stripes of the file inode keys until the batch is written (so that a file inode is never written 
+ * without its dir child keys), then cache the new dirs
  *
- * @param shareFP - the fingerprint of the share 
+ * @param newFileList - the new files to be added (cleared once they are added) <return>
  * @param userID - the user id 
- * @param intraUserDupStat - a boolean value that indicates if the key is a duplicate <return>
+ * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
  *
- * @return - a boolean value that indicates if the update op succeeds
+ * @return - a boolean value that indicates if the add op succeeds
  */
-bool DedupCore::intraUserIndexUpdate_(char *shareFP, const int &userID, bool &intraUserDupStat) {
+bool DedupCore::addNewFilesIntoInodeIndex_(std::vector<newFileEntry_t> &newFileList, const int &userID, 
+		CryptoPrimitive *cryptoObj) {
+	leveldb::WriteBatch namespaceBatch;
+	boost::unordered_set<std::string> newDirKeySet;
+	boost::unordered_set<std::string>::iterator it;
+	boost::unordered_map<std::string, std::string> newFileInodeMap;
+	bool stripeList[NUM_INDEX_LOCK_STRIPES];
 	char key[KEY_SIZE];
-	char *value;
-	leveldb::Slice *keySlice, *valueSlice;
-	std::string valueString;
-	int valueSize, valueOffset;
-	shareIndexValueHead_t *pShareIndexValueHead;
-	shareUserRefEntry_t *pShareUserRefEntry;
-
-	shareFP2IndexKey_(shareFP, key);
-	keySlice = new leveldb::Slice(key, KEY_SIZE); 
+	int i;
 
-	/*get the mutex lock DBLock_*/
-	pthread_mutex_lock(&DBLock_);
+	if (newFileList.empty()) {
+		return 1;
+	}
 
-	leveldb::Status getStat = db_->Get(readOptions_, *keySlice, &valueString);
+	memset(stripeList, 0, sizeof(stripeList));
+	for (i = 0; i < (int) newFileList.size(); i++) {
+		inodeFP2IndexKey_(newFileList[i].inodeFP, key);
+		stripeList[indexStripe_(key)] = 1;
+	}
 
-	if (getStat.ok()) { 
-		valueOffset = 0;
-		pShareIndexValueHead = (shareIndexValueHead_t *) (valueString.data() + valueOffset);
-		valueOffset += shareIndexValueHeadSize_;
+	lockIndexStripes_(stripeList);
 
-		/*check if the user owns the share corresponding to the key*/
-		intraUserDupStat = 0;
-		for (int i = 0; (i < pShareIndexValueHead->numOfUsers) && (intraUserDupStat == 0); i++) {
-			pShareUserRefEntry = (shareUserRefEntry_t *) (valueString.data() + valueOffset);
-			valueOffset += shareUserRefEntrySize_;			
+	for (i = 0; i < (int) newFileList.size(); i++) {
+		if (!addFileIntoInodeIndex_(newFileList[i], userID, namespaceBatch, newDirKeySet, newFileInodeMap, cryptoObj)) {
+			fprintf(stderr, "Error: fail to add an inode for fullFileName '%s' with userID '%d' in the database!\n", 
+					newFileList[i].fullFileName.c_str(), userID);
+			unlockIndexStripes_(stripeList);
 
-			if (pShareUserRefEntry->userID == userID) {
-				intraUserDupStat = 1;
-			}
+			return 0;
 		}
+	}
 
-		/*if the user owns the key, then update the user reference count*/
-		if (intraUserDupStat == 1) {
-			/*take a step back for updating the user reference count later*/
-			valueOffset -= shareUserRefEntrySize_;
-
-			valueSize = valueString.size();
-			value = (char *) malloc(valueSize);
+	leveldb::Status writeStat = db_->Write(writeOptions_, &namespaceBatch);
 
-			/*copy the value from valueString to value*/
-			memcpy(value, valueString.data(), valueString.size());
+	unlockIndexStripes_(stripeList);
 
-			/*update the user reference count*/	
-			pShareUserRefEntry = (shareUserRefEntry_t *) (value + valueOffset);
-			pShareUserRefEntry->refCnt++;
+	if (writeStat.ok() == false) {
+		fprintf(stderr, "Error: fail to perform batched writes!\n");
+		fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
 
-			/*clear the write batch batch_*/
-			batch_.Clear();
+		return 0;
+	}
 
-			/*update the key-value entry in a batch manner*/
-			batch_.Delete(*keySlice);
-			valueSlice = new leveldb::Slice(value, valueSize);
-			batch_.Put(*keySlice, *valueSlice);	
+	for (it = newDirKeySet.begin(); it != newDirKeySet.end(); it++) {
+		addDirInodeIntoCache_(*it);
+	}
 
-			/*execute all batched database update ops*/
-			leveldb::Status writeStat = db_->Write(writeOptions_, &batch_);
-			if (writeStat.ok() == false) {
-				fprintf(stderr, "Error: fail to perform batched writes!\n");
-				fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+	newFileList.clear();
 
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
+	return 1;
+}
 
-				return 0;
-			}
+/*
+ * read the inode file entry of a version of a file
+ *
+ * @param inodeFP - the file inode's fingerprint
+ * @param versionNumber - the version number (0 for the newest version, -1 for the previous one, and so on)
+ * @param inodeFileEntry - the inode file entry (read only if such a version exists) <return>
+ * @param numOfVersions - the number of versions of the file <return>
+ *
+ * @return - the status of the read op
+ */
+leveldb::Status DedupCore::getInodeFileEntry_(char *inodeFP, const int &versionNumber, inodeFileEntry_t &inodeFileEntry, 
+		int &numOfVersions) {
+	char key[KEY_SIZE], versionKey[INODE_VERSION_KEY_SIZE];
+	std::string valueString;
+	int valueOffset;
+	inodeIndexValueHead_t *pInodeIndexValueHead;
 
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
+	/*read the inode head*/
+	inodeFP2IndexKey_(inodeFP, key);
+	leveldb::Status getStat = db_->Get(readOptions_, leveldb::Slice(key, KEY_SIZE), &valueString);
+	if (!getStat.ok()) {
+		return getStat;
+	}
 
-			delete valueSlice;
-			free(value);
-		}
-		else {
-			/*do nothing*/
+	valueOffset = 0;	
+	pInodeIndexValueHead = (inodeIndexValueHead_t *) (valueString.data() + valueOffset);
+	valueOffset += inodeIndexValueHeadSize_;
 
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
-		}
+	/*numOfChildren records the number of versions of a file*/
+	numOfVersions = pInodeIndexValueHead->numOfChildren;
+	if ((versionNumber > 0) || ((-versionNumber) >= numOfVersions)) {
+		return getStat;
 	}
 
-	if (getStat.IsNotFound()) {
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
-
-		intraUserDupStat = 0;
-	}	
+	/*skip the name*/
+	valueOffset += pInodeIndexValueHead->shortNameSize;
 
-	if (getStat.IsCorruption()) { 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+	/*an old inode keeps all its versions, the newest first*/
+	if ((int) valueString.size() > valueOffset) {
+		valueOffset += (inodeFileEntrySize_ * (-versionNumber));
+		memcpy(&inodeFileEntry, valueString.data() + valueOffset, inodeFileEntrySize_);
 
-		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+		return getStat;
+	}
 
-		delete keySlice;
+	/*otherwise, read the version key*/
+	inodeVersion2IndexKey_(inodeFP, numOfVersions - 1 + versionNumber, versionKey);
+	getStat = db_->Get(readOptions_, leveldb::Slice(versionKey, INODE_VERSION_KEY_SIZE), &valueString);
+	if (getStat.IsNotFound() || (getStat.ok() && (valueString.size() != (size_t) inodeFileEntrySize_))) {
+		/*the version key is written together with the head*/
+		return leveldb::Status::Corruption(leveldb::Slice());
+	}
+	if (getStat.ok()) {
+		memcpy(&inodeFileEntry, valueString.data(), inodeFileEntrySize_);
+	}
 
-		return 0;
-	}		
+	return getStat;
+}
 
-	if (getStat.IsIOError()) { 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+/*
+ * check if a dir inode is in the dir inode cache
+ *
+ * @param dirKey - the key of the dir inode
+ *
+ * @return - a boolean value that indicates if the dir inode is cached
+ */
+bool DedupCore::findDirInodeInCache_(const std::string &dirKey) {
+	bool cachedStat;
 
-		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+	pthread_mutex_lock(&dirInodeCacheLock_);
+	cachedStat = (dirInodeCache_.count(dirKey) > 0);
+	pthread_mutex_unlock(&dirInodeCacheLock_);
 
-		delete keySlice;
+	return cachedStat;
+}
 
-		return 0;
-	}	
+/*
+ * add an existing dir inode into the dir inode cache
+ *
+ * @param dirKey - the key of the dir inode
+ */
+void DedupCore::addDirInodeIntoCache_(const std::string &dirKey) {
+	pthread_mutex_lock(&dirInodeCacheLock_);
 
-	delete keySlice;
+	/*a dir inode is never removed, so the cache is simply emptied when full*/
+	if ((int) dirInodeCache_.size() >= DIR_INODE_CACHE_SIZE) {
+		dirInodeCache_.clear();
+	}
+	dirInodeCache_.insert(dirKey);
 
-	return 1;
+	pthread_mutex_unlock(&dirInodeCacheLock_);
 }
 
 /*
- * update the index for a share based on inter-user deduplication
+ * order share batch entries by fingerprint (then by position, so the first share of a fingerprint leads its group)
  *
- * @param shareFP - the fingerprint of the share 
- * @param userID - the user id 
- * @param shareSize - the size of the corresponding share 
- * @param targetBufferNode - the corresponding buffer node 
- * @param shareDataBuffer - the share data buffer
- * @param shareDataBufferOffset - the offset of the share data buffer
+ * @param a - a share batch entry
+ * @param b - another share batch entry
  *
- * @return - a boolean value that indicates if the update op succeeds
+ * @return - a boolean value that indicates if a goes before b
  */
-bool DedupCore::interUserIndexUpdate_(char *shareFP, const int &userID, const int &shareSize, 
-		perUserBufferNode_t *targetBufferNode, unsigned char *shareDataBuffer, const int &shareDataBufferOffset) {	
-	char key[KEY_SIZE];
-	char *value;
-	leveldb::Slice *keySlice, *valueSlice;
-	std::string valueString;
-	int valueSize, valueOffset;
-	shareIndexValueHead_t *pShareIndexValueHead;
-	shareUserRefEntry_t *pShareUserRefEntry;
-	std::string shareContainerName;
+static bool shareBatchEntryLess(const shareBatchEntry_t &a, const shareBatchEntry_t &b) {
+	int cmp = memcmp(a.shareFP, b.shareFP, FP_SIZE);
 
-	shareFP2IndexKey_(shareFP, key);
-	keySlice = new leveldb::Slice(key, KEY_SIZE);
+	if (cmp != 0) {
+		return cmp < 0;
+	}
+	return a.index < b.index;
+}
+
+/*
+ * lock the stripes marked in a list in ascending order (so that batches touching many stripes do not deadlock)
+ *
+ * @param stripeList - a list that marks the stripes to be locked
+ */
+void DedupCore::lockIndexStripes_(bool *stripeList) {
+	for (int i = 0; i < NUM_INDEX_LOCK_STRIPES; i++) {
+		if (stripeList[i]) {
+			pthread_mutex_lock(&indexLocks_[i]);
+		}
+	}
+}
+
+/*
+ * unlock the stripes marked in a list
+ *
+ * @param stripeList - a list that marks the stripes to be unlocked
+ */
+void DedupCore::unlockIndexStripes_(bool *stripeList) {
+	for (int i = NUM_INDEX_LOCK_STRIPES - 1; i >= 0; i--) {
+		if (stripeList[i]) {
+			pthread_mutex_unlock(&indexLocks_[i]);
+		}
+	}
+}
+
+/*
+ * load the index cache from its snapshot, or fill its filter with all share keys in the database
+ *
+ * @return - a boolean value that indicates if the load op succeeds
+ */
+bool DedupCore::loadIndexCache_() {
+	/*the snapshot is removed once loaded, so that it is never loaded again after the index changes*/
+	if (indexCache_->loadSnapshot(indexCacheFileName_)) {
+		unlink(indexCacheFileName_.c_str());
+		fprintf(stderr, "The index cache has been loaded from '%s'.\n", indexCacheFileName_.c_str());
 
-	/*get the mutex lock DBLock_*/
-	pthread_mutex_lock(&DBLock_);
+		return 1;
+	}
+	unlink(indexCacheFileName_.c_str());
 
-	leveldb::Status getStat = db_->Get(readOptions_, *keySlice, &valueString);
+	/*scan all share keys*/
+	leveldb::Status scanStat = shareIndex_->scanKeys(addCacheKey_, indexCache_);
+	if (!scanStat.ok()) {
+		fprintf(stderr, "Error: fail to scan the share index!\n");
+		fprintf(stderr, "Status: %s \n", scanStat.ToString().c_str());
 
-	if (getStat.ok()) { 		
-		valueOffset = 0;
-		pShareIndexValueHead = (shareIndexValueHead_t *) (valueString.data() + valueOffset);
-		valueOffset += shareIndexValueHeadSize_;
-
-		/*note: we here still check if the user owns the share, in consideration of the special case 
-		  where the received package of shares contain repeated shares. The underlying reason is 
-		  that in the first stage of deduplication, we do not check if there is any repeated share contained 
-		  in the coming package of shares*/
-
-		/*check if the user owns the share corresponding to the key*/
-		int ownerStat = 0;
-		for (int i = 0; (i < pShareIndexValueHead->numOfUsers) && (ownerStat == 0); i++) {
-			pShareUserRefEntry = (shareUserRefEntry_t *) (valueString.data() + valueOffset);
-			valueOffset += shareUserRefEntrySize_;			
-
-			if (pShareUserRefEntry->userID == userID) {
-				ownerStat = 1;
-			}
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * check that the share index has the current format, and record the format in a new database
+ *
+ * @return - a boolean value that indicates if the check op succeeds
+ */
+bool DedupCore::checkIndexFormat_() {
+	std::string valueString;
+	int formatVersion;
+	bool foundStat;
+
+	/*the database records its format once created or converted*/
+	leveldb::Status getStat = db_->Get(readOptions_, INDEX_FORMAT_KEY, &valueString);
+	if (getStat.ok()) {
+		memcpy(&formatVersion, valueString.data(), sizeof(int));
+		if ((valueString.size() != sizeof(int)) || (formatVersion != INDEX_FORMAT_VERSION)) {
+			fprintf(stderr, "Error: the index has an old format, please convert it with CONVERTINDEX first!\n");
+
+			return 0;
 		}
 
-		/*if the user owns the key, then update the user reference count*/
-		if (ownerStat == 1) { 
-			/*take a step back for updating the user reference count later*/
-			valueOffset -= shareUserRefEntrySize_;
+		return 1;
+	}
+	if (!getStat.IsNotFound()) {
+		fprintf(stderr, "Error: fail to look up the index format in the database!\n");
+		fprintf(stderr, "Status: %s \n", getStat.ToString().c_str());
+
+		return 0;
+	}
 
-			valueSize = valueString.size();
-			value = (char *) malloc(valueSize);
+	/*a share index without the format is either new or of the oldest format*/
+	foundStat = 0;
+	leveldb::Status scanStat = shareIndex_->scanKeys(findShareKey_, &foundStat);
+	if (!scanStat.ok()) {
+		fprintf(stderr, "Error: fail to scan the share index!\n");
+		fprintf(stderr, "Status: %s \n", scanStat.ToString().c_str());
 
-			/*copy the value from valueString to value*/
-			memcpy(value, valueString.data(), valueString.size());
+		return 0;
+	}
+	if (foundStat) {
+		fprintf(stderr, "Error: the index has an old format, please convert it with CONVERTINDEX first!\n");
 
-			/*update the user reference count*/	
-			pShareUserRefEntry = (shareUserRefEntry_t *) (value + valueOffset);
-			pShareUserRefEntry->refCnt++;
+		return 0;
+	}
 
-			/*clear the write batch batch_*/
-			batch_.Clear();
+	formatVersion = INDEX_FORMAT_VERSION;
+	leveldb::Status putStat = db_->Put(writeOptions_, INDEX_FORMAT_KEY, leveldb::Slice((char *) &formatVersion, sizeof(int)));
+	if (!putStat.ok()) {
+		fprintf(stderr, "Error: fail to record the index format in the database!\n");
+		fprintf(stderr, "Status: %s \n", putStat.ToString().c_str());
 
-			/*update the key-value entry in a batch manner*/
-			batch_.Delete(*keySlice);
-			valueSlice = new leveldb::Slice(value, valueSize);
-			batch_.Put(*keySlice, *valueSlice);
+		return 0;
+	}
 
-			/*execute all batched database update ops*/
-			leveldb::Status writeStat = db_->Write(writeOptions_, &batch_);
-			if (writeStat.ok() == false) {
-				fprintf(stderr, "Error: fail to perform batched writes!\n");
-				fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+	return 1;
+}
 
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
+/*
+ * find a key scanned from the share index (for telling if the index is empty)
+ *
+ * @param arg - the found status <return>
+ * @param key - the key
+ */
+void DedupCore::findShareKey_(void *arg, const std::string & /*key*/) {
+	*((bool *) arg) = 1;
+}
 
-				return 0;
-			}
+/*
+ * load the limit of the share container ids handed out from the database
+ *
+ * @return - a boolean value that indicates if the load op succeeds
+ */
+bool DedupCore::loadShareContainerIDLimit_() {
+	std::string valueString;
 
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
+	leveldb::Status getStat = db_->Get(readOptions_, SHARE_CONTAINER_ID_LIMIT_KEY, &valueString);
+	if (getStat.IsNotFound()) {
+		shareContainerIDLimit_ = 0;
 
-			delete valueSlice;
-			free(value);
+		return 1;
+	}
+	if (!getStat.ok() || (valueString.size() != sizeof(uint64_t))) {
+		fprintf(stderr, "Error: fail to look up the limit of the share container ids in the database!\n");
+		fprintf(stderr, "Status: %s \n", getStat.ToString().c_str());
+
+		return 0;
+	}
+	memcpy(&shareContainerIDLimit_, valueString.data(), sizeof(uint64_t));
+
+	return 1;
+}
+
+/*
+ * hand out a new share container id (raising the recorded limit in the database if necessary)
+ *
+ * @param shareContainerID - the share container id <return>
+ *
+ * @return - a boolean value that indicates if an id is handed out
+ */
+bool DedupCore::newShareContainerID_(uint64_t &shareContainerID) {
+	uint64_t newLimit;
+
+	/*get the mutex lock shareContainerIDLock_*/
+	pthread_mutex_lock(&shareContainerIDLock_);
+
+	/*a larger id would have a longer name than the others*/
+	if (nextShareContainerID_ >= SHARE_CONTAINER_ID_MAX) {
+		fprintf(stderr, "Error: all share container ids are handed out!\n");
+
+		pthread_mutex_unlock(&shareContainerIDLock_);
+		return 0;
+	}
+
+	/*reserve a range of ids at a time, so that the ids handed out are never handed out again after a restart*/
+	if (nextShareContainerID_ >= shareContainerIDLimit_) {
+		newLimit = nextShareContainerID_ + SHARE_CONTAINER_ID_RESERVE;
+
+		leveldb::Status putStat = db_->Put(writeOptions_, SHARE_CONTAINER_ID_LIMIT_KEY, 
+				leveldb::Slice((char *) &newLimit, sizeof(uint64_t)));
+		if (putStat.ok()) {
+			shareContainerIDLimit_ = newLimit;
 		}
-		/*if the user does not own the key, then append a reference entry for this user*/
 		else {
-			valueSize = valueString.size() + shareUserRefEntrySize_;
-			value = (char *) malloc(valueSize);
+			fprintf(stderr, "Warning: fail to record the limit of the share container ids in the database!\n");
+			fprintf(stderr, "Status: %s \n", putStat.ToString().c_str());
+		}
+	}
 
-			/*copy the value from valueString to value*/
-			memcpy(value, valueString.data(), valueString.size());
+	shareContainerID = nextShareContainerID_++;
 
-			/*append a reference entry for this user*/
-			valueOffset = valueString.size();
-			pShareUserRefEntry = (shareUserRefEntry_t *) (value + valueOffset);
-			pShareUserRefEntry->userID = userID;
-			pShareUserRefEntry->refCnt = 1;
+	/*release the mutex lock shareContainerIDLock_*/
+	pthread_mutex_unlock(&shareContainerIDLock_);
 
-			/*update the share index value head*/
-			valueOffset = 0;		
-			pShareIndexValueHead = (shareIndexValueHead_t *) (value + valueOffset);
-			pShareIndexValueHead->numOfUsers++;
+	return 1;
+}
+
+/*
+ * transform a share container id to the full name of the share container
+ *
+ * @param shareContainerID - the share container id
+ * @param shareContainerName - the full share container name <return>
+ */
+void DedupCore::shareContainerID2Name_(const uint64_t &shareContainerID, std::string &shareContainerName) {
+	char shortName[SHARE_CONTAINER_NAME_SIZE];
 
-			/*clear the write batch batch_*/
-			batch_.Clear();
+	snprintf(shortName, SHARE_CONTAINER_NAME_SIZE, SHARE_CONTAINER_NAME_FORMAT, (unsigned long long) shareContainerID);
+	shareContainerName = shareContainerDirName_ + shortName;
+}
 
-			/*update the key-value entry in a batch manner*/
-			batch_.Delete(*keySlice);
-			valueSlice = new leveldb::Slice(value, valueSize);
-			batch_.Put(*keySlice, *valueSlice);	
+/*
+ * add a key scanned from the share index into the filter of the index cache
+ *
+ * @param arg - the index cache
+ * @param key - the key
+ */
+void DedupCore::addCacheKey_(void *arg, const std::string &key) {
+	((IndexCache *) arg)->addKey(key);
+}
 
-			/*execute all batched database update ops*/
-			leveldb::Status writeStat = db_->Write(writeOptions_, &batch_);
-			if (writeStat.ok() == false) {
-				fprintf(stderr, "Error: fail to perform batched writes!\n");
-				fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+/*
+ * release the pending share index entries committed by a container writer (or dropped by a failed one, 
+ * so they stay uncommitted, and the shares are stored again when they come next time)
+ *
+ * @param arg - the DedupCore instance
+ * @param keyList - the keys of the entries
+ * @param commitStat - if the entries are committed
+ */
+void DedupCore::releasePendingShares_(void *arg, const std::vector<std::string> &keyList, bool /*commitStat*/) {
+	DedupCore *obj = (DedupCore *) arg;
 
-				/*release the mutex lock DBLock_*/
-				pthread_mutex_unlock(&DBLock_);
+	pthread_mutex_lock(&(obj->pendingShareLock_));
+	for (int i = 0; i < (int) keyList.size(); i++) {
+		obj->pendingShareMap_.erase(keyList[i]);
+	}
+	pthread_mutex_unlock(&(obj->pendingShareLock_));
+}
 
+/*
+ * store the recipes handed off to the recipe writer, once the share containers of their entries are durable
+ *
+ * @param arg - the DedupCore instance
+ * @param recipeNode - the node of the recipes
+ *
+ * @return - a boolean value that indicates if the store op succeeds
+ */
+bool DedupCore::writeRecipeFile_(void *arg, const containerNode_t *recipeNode) {
+	DedupCore *obj = (DedupCore *) arg;
+	const std::string &recipeFileName = *(recipeNode->recipeFileName);
+	const std::vector<uint64_t> &shareContainerIDList = *(recipeNode->shareContainerIDList);
+	FILE *fp;
+	int i, k;
+
+	/*1. wait for the share containers of the entries, in whichever writer they are*/
+	for (i = 0; i < (int) shareContainerIDList.size(); i++) {
+		for (k = 0; k < (int) obj->containerWriters_.size(); k++) {
+			if (!obj->containerWriters_[k]->waitForContainer(shareContainerIDList[i])) {
+				fprintf(stderr, "Error: the share container %llu of the recipes in '%s' is not written!\n", 
+						(unsigned long long) shareContainerIDList[i], recipeFileName.c_str());
 				return 0;
 			}
-
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
-
-			delete valueSlice;
-			free(value);	
 		}
 	}
 
-	if (getStat.IsNotFound()) {
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+	/*2. create a new recipe file, or append the entries to a file recipe in an old one*/
+	if (recipeNode->recipeFileOffset < 0) {
+		fp = fopen(recipeFileName.c_str(), "wb");
+		if (fp == NULL) {
+			fprintf(stderr, "Error: fail to open the file '%s' for writing recipes!\n", recipeFileName.c_str());
+			return 0;	
+		}	
 
-		/*1. if there is no enough space in the share container buffer, first store the data of the buffer into the disk*/
-		if (targetBufferNode->shareContainerBufferCurrLen + shareSize > CONTAINER_BUFFER_SIZE) {
-			if (!storeShareContainer_(targetBufferNode, shareContainerName)) {
-				fprintf(stderr, "Error: fail to store the data of the share container buffer into the disk!\n");
-				return 0;
-			}
+		if (fwrite(recipeNode->shareContainerBuffer, recipeNode->shareContainerSize, 1, fp) != 1){
+			fprintf(stderr, "Error: fail to write recipes into the file '%s'!\n", recipeFileName.c_str());
 
-			if (containerStorerObj_ != NULL) {
-				containerStorerObj_->addNewFile(shareContainerName);
-			}
+			fclose(fp);
+			return 0;	
+		}	
+	}
+	else {
+		fp = fopen(recipeFileName.c_str(), "rb+");		
+		if (fp == NULL) {
+			fprintf(stderr, "Error: fail to open the file '%s' for appending recipes!\n", recipeFileName.c_str());
+			return 0;	
+		}	
+
+		if (obj->getFileSize_(fp) == 0) {
+			fprintf(stderr, "Error: the previous recipe file '%s' does not exit (or is empty)!\n", recipeFileName.c_str());
+
+			fclose(fp);
+			return 0;	
 		}
 
-		/*2. add a new key-value entry for the share in the share index*/
+		if (!obj->appendRecipeEntries_(recipeNode->shareContainerBuffer, fp, recipeFileName, recipeNode->recipeFileOffset)) {
+			fclose(fp);
+			return 0;	
+		}	
+	}
 
-		valueSize = shareIndexValueHeadSize_ + shareUserRefEntrySize_;
-		value = (char *) malloc(valueSize);
+	/*3. make the recipes durable*/
+	if ((fflush(fp) != 0) || (fdatasync(fileno(fp)) != 0)) {
+		fprintf(stderr, "Error: fail to sync the file '%s'!\n", recipeFileName.c_str());
 
-		/*(a) generate the value*/
+		fclose(fp);
+		return 0;	
+	}
+	fclose(fp);
 
-		/*- set the head*/
-		valueOffset = 0;		
-		pShareIndexValueHead = (shareIndexValueHead_t *) (value + valueOffset);	
-		strcpy(pShareIndexValueHead->shareContainerName, targetBufferNode->shareContainerName);
-		pShareIndexValueHead->shareContainerOffset = targetBufferNode->shareContainerBufferCurrLen;
-		pShareIndexValueHead->shareSize = shareSize;
-		pShareIndexValueHead->numOfUsers = 1;
-		valueOffset += shareIndexValueHeadSize_;
+	if (recipeNode->finishStat && (obj->recipeStorerObj_ != NULL)) {
+		obj->recipeStorerObj_->addNewFile(recipeFileName);
+	}
 
-		/*- set the user ref entry*/
-		pShareUserRefEntry = (shareUserRefEntry_t *) (value + valueOffset);
-		pShareUserRefEntry->userID = userID;
-		pShareUserRefEntry->refCnt = 1;
-		valueOffset += shareUserRefEntrySize_;
+	return 1;
+}
 
-		valueSlice = new leveldb::Slice(value, valueSize);
+/*
+ * look up the share index values of a list of keys, through the pending entries and the index cache
+ * (a value is never changed once written, so every value read from the share index is cached; a pending 
+ * entry is released only after it is committed, so a key that leaves the pending entries is found in the index)
+ *
+ * @param keyList - the index keys
+ * @param valueList - the values of the keys <return>
+ * @param statList - the lookup status of the keys <return>
+ */
+void DedupCore::getShareBatch_(const std::vector<std::string> &keyList, std::vector<std::string> &valueList, 
+		std::vector<leveldb::Status> &statList) {
+	std::vector<std::string> missKeyList;
+	std::vector<std::string> missValueList;
+	std::vector<leveldb::Status> missStatList;
+	std::vector<int> missList;
+	boost::unordered_map<std::string, std::string>::iterator it;
+	int numOfKeys = keyList.size();
+	std::vector<bool> pendingList(numOfKeys, false);
+	int g, m;
+
+	valueList.resize(numOfKeys);
+	statList.assign(numOfKeys, leveldb::Status::OK());
+
+	/*answer the keys of the new shares whose share containers are not durable yet*/
+	pthread_mutex_lock(&pendingShareLock_);
+	if (!pendingShareMap_.empty()) {
+		for (g = 0; g < numOfKeys; g++) {
+			it = pendingShareMap_.find(keyList[g]);
+			if (it != pendingShareMap_.end()) {
+				valueList[g] = it->second;
+				pendingList[g] = true;
+			}
+		}
+	}
+	pthread_mutex_unlock(&pendingShareLock_);
 
-		/*get the mutex lock DBLock_*/
-		pthread_mutex_lock(&DBLock_);
+	/*answer definite misses and hot keys from the cache*/
+	for (g = 0; g < numOfKeys; g++) {
+		if (pendingList[g]) {
+			continue;
+		}
+		if (!indexCache_->mayContain(keyList[g])) {
+			statList[g] = leveldb::Status::NotFound(leveldb::Slice());
+		}
+		else if (!indexCache_->lookup(keyList[g], valueList[g])) {
+			missKeyList.push_back(keyList[g]);
+			missList.push_back(g);
+		}
+	}
 
-		/*(b) store the key-value entry into the share index*/
-		db_->Put(writeOptions_, *keySlice, *valueSlice);
+	if (missList.empty()) {
+		return;
+	}
 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+	/*look up the rest in the share index together*/
+	shareIndex_->multiGet(missKeyList, missValueList, missStatList);
+	for (m = 0; m < (int) missList.size(); m++) {
+		g = missList[m];
+		statList[g] = missStatList[m];
+		valueList[g].swap(missValueList[m]);
 
-		delete valueSlice;
-		free(value);
+		if (statList[g].ok()) {
+			indexCache_->update(keyList[g], valueList[g]);
+		}
+	}
+}
 
-		/*3. copy the share from shareDataBuffer into the buffer*/
-		memcpy(targetBufferNode->shareContainerBuffer + targetBufferNode->shareContainerBufferCurrLen, 
-				shareDataBuffer + shareDataBufferOffset, shareSize);
-		targetBufferNode->shareContainerBufferCurrLen += shareSize;
-	}	
+/*
+ * sort a batch of shares by fingerprint and group the shares with the same fingerprint
+ *
+ * @param shareList - the shares (sorted by fingerprint on return, with the first share of each group 
+ *                    recording the size of the group)
+ * @param keyList - the index key of each group <return>
+ */
+void DedupCore::groupShareBatch_(std::vector<shareBatchEntry_t> &shareList, std::vector<std::string> &keyList) {
+	char key[KEY_SIZE];
+	int numOfEntries = shareList.size();
+	int i, j;
 
-	if (getStat.IsCorruption()) { 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+	std::sort(shareList.begin(), shareList.end(), shareBatchEntryLess);
 
-		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+	keyList.clear();
+	for (i = 0; i < numOfEntries; i = j) {
+		for (j = i + 1; (j < numOfEntries) && (memcmp(shareList[i].shareFP, shareList[j].shareFP, FP_SIZE) == 0); j++);
+		shareList[i].numOfRefs = j - i;
 
-		delete keySlice;
+		shareFP2IndexKey_(shareList[i].shareFP, key);
+		keyList.push_back(std::string(key, KEY_SIZE));
+	}
+}
 
-		return 0;
-	}		
+/*
+ * look up the locations of a batch of existing shares
+ *
+ * @param shareList - the shares (sorted by fingerprint on return, with the first share of each group 
+ *                    recording the share index value)
+ *
+ * @return - a boolean value that indicates if all shares are found
+ */
+bool DedupCore::locateShareBatch_(std::vector<shareBatchEntry_t> &shareList) {
+	std::vector<std::string> keyList, valueList;
+	std::vector<leveldb::Status> statList;
+	int numOfEntries = shareList.size();
+	int i, g;
 
-	if (getStat.IsIOError()) { 
-		/*release the mutex lock DBLock_*/
-		pthread_mutex_unlock(&DBLock_);
+	if (numOfEntries == 0) {
+		return 1;
+	}
 
-		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+	groupShareBatch_(shareList, keyList);
+	getShareBatch_(keyList, valueList, statList);
 
-		delete keySlice;
+	for (i = 0, g = 0; i < numOfEntries; i += shareList[i].numOfRefs, g++) {
+		if ((!statList[g].ok()) || (valueList[g].size() != (size_t) shareIndexValueSize_)) {
+			fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(keyList[g]).ToString().c_str());
+			fprintf(stderr, "Status: %s \n", statList[g].ToString().c_str());
 
-		return 0;
-	}	
+			return 0;
+		}
 
-	delete keySlice;
+		memcpy(&shareList[i].shareIndexValue, valueList[g].data(), shareIndexValueSize_);
+	}
 
 	return 1;
 }
 
 /*
- * store the data of the recipe file buffer into a new recipe file
+ * update the index for a batch of shares based on intra-user deduplication
+ * (the user reference keys of the distinct fingerprints are looked up together, then the references 
+ * of the owned shares are added as merge operands in one write batch, without any lock)
  *
- * @param targetBufferNode - the corresponding buffer node 
- * @param recipeFileName - the recipe file name <return>
+ * @param shareList - the shares of a metadata buffer (sorted by fingerprint on return)
+ * @param userID - the user id 
+ * @param intraUserDupStatList - a list that records the intra-user duplicate status of each share <return>
  *
- * @return - a boolean value that indicates if the store op succeeds
+ * @return - a boolean value that indicates if the update op succeeds
  */
-bool DedupCore::storeNewRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName) {
-	recipeFileName = targetBufferNode->recipeFileName;	
+bool DedupCore::intraUserIndexUpdate_(std::vector<shareBatchEntry_t> &shareList, const int &userID, 
+		bool *intraUserDupStatList) {
+	std::vector<std::string> keyList, refKeyList, refValueList, ownKeyList, ownValueList;
+	std::vector<leveldb::Slice> refKeySliceList;
+	std::vector<leveldb::Status> refStatList, ownStatList;
+	std::vector<int> refList, ownList;
+	leveldb::WriteBatch batch;
+	char refKey[USER_REF_KEY_SIZE];
+	int numOfEntries = shareList.size();
+	int numOfOwned = 0;
+	int i, k, g, r;
+
+	/*1. look up the user reference keys of all distinct fingerprints that may exist together*/
+	groupShareBatch_(shareList, keyList);
+
+	for (i = 0, g = 0; i < numOfEntries; i += shareList[i].numOfRefs, g++) {
+		shareList[i].ownerStat = 0;
+
+		if (indexCache_->mayContain(keyList[g])) {
+			shareUserRef2IndexKey_(shareList[i].shareFP, userID, refKey);
+			refKeyList.push_back(std::string(refKey, USER_REF_KEY_SIZE));
+			refList.push_back(i);
+			ownKeyList.push_back(keyList[g]);
+		}
+	}
 
-	if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
-		fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
-		return 0;	
+	if (!refList.empty()) {
+		for (r = 0; r < (int) refKeyList.size(); r++) {
+			refKeySliceList.push_back(refKeyList[r]);
+		}
+		refStatList = db_->MultiGet(readOptions_, refKeySliceList, &refValueList);
+
+		for (r = 0; r < (int) refList.size(); r++) {
+			if (refStatList[r].ok()) {
+				ownKeyList[ownList.size()] = ownKeyList[r];
+				ownList.push_back(refList[r]);
+			}
+			else if (!refStatList[r].IsNotFound()) {
+				fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(refKeyList[r]).ToString().c_str());
+				fprintf(stderr, "Status: %s \n", refStatList[r].ToString().c_str());
+
+				return 0;
+			}
+		}
+		ownKeyList.resize(ownList.size());
 	}
 
-	/*create a reciple file for writing recipes*/
-	FILE *fp = fopen(recipeFileName.c_str(), "wb");		
-	if (fp == NULL) {
-		fprintf(stderr, "Error: fail to open the file '%s' for writing recipes!\n", recipeFileName.c_str());
-		return 0;	
-	}	
+	/*a referenced share is owned only if it still exists, as the references are written before the share 
+	  container becomes durable, and the share is not added to the share index if the container is lost*/
+	if (!ownList.empty()) {
+		getShareBatch_(ownKeyList, ownValueList, ownStatList);
 
-	/*write the data of the recipe file buffer into a recipe file*/
-	if (fwrite(targetBufferNode->recipeFileBuffer, targetBufferNode->recipeFileBufferCurrLen, 1, fp) != 1){
-		fprintf(stderr, "Error: fail to write recipes into the file '%s'!\n", recipeFileName.c_str());
+		for (r = 0; r < (int) ownList.size(); r++) {
+			if (ownStatList[r].ok()) {
+				shareList[ownList[r]].ownerStat = 1;
+			}
+			else if (!ownStatList[r].IsNotFound()) {
+				fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(ownKeyList[r]).ToString().c_str());
+				fprintf(stderr, "Status: %s \n", ownStatList[r].ToString().c_str());
 
-		fclose(fp);
-		return 0;	
-	}	
+				return 0;
+			}
+		}
+	}
 
-	/*renew the recipeFileName of the buffer*/
+	/*2. add the user references of the owned shares (a user never loses a share, so they are still owned)*/
+	for (i = 0; i < numOfEntries; i += shareList[i].numOfRefs) {
+		/*every share of the group has the same duplicate status*/
+		for (k = i; k < i + shareList[i].numOfRefs; k++) {
+			intraUserDupStatList[shareList[k].index] = shareList[i].ownerStat;
+		}
 
-	/*get the mutex lock globalRecipeFileNameLock_*/
-	pthread_mutex_lock(&globalRecipeFileNameLock_);
+		if (shareList[i].ownerStat) {
+			shareUserRef2IndexKey_(shareList[i].shareFP, userID, refKey);
+			batch.Merge(leveldb::Slice(refKey, USER_REF_KEY_SIZE), 
+					leveldb::Slice((char *) &shareList[i].numOfRefs, sizeof(int)));
+			numOfOwned++;
+		}
+	}
 
-	globalRecipeFileName_.copy(targetBufferNode->recipeFileName, INTERNAL_FILE_NAME_SIZE - 1, 0);
-	targetBufferNode->recipeFileName[INTERNAL_FILE_NAME_SIZE - 1] = '\0';
-	incrGlobalFileName_(globalRecipeFileName_, recipeFileNameValidLen_);		
+	if (numOfOwned == 0) {
+		return 1;
+	}
 
-	/*release the mutex lock globalRecipeFileNameLock_*/
-	pthread_mutex_unlock(&globalRecipeFileNameLock_);
+	/*reference count increments commute, so they are written blindly*/
+	leveldb::Status writeStat = db_->Write(writeOptions_, &batch);
+	if (writeStat.ok() == false) {
+		fprintf(stderr, "Error: fail to perform batched writes!\n");
+		fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
 
-	/*renew the two positions of the buffer*/
-	targetBufferNode->recipeFileBufferCurrLen = 0;
-	targetBufferNode->lastRecipeHeadPos = 0;
+		return 0;
+	}
 
-	fclose(fp);
 	return 1;
 }
 
 /*
- * find an old recipe file for appending the data of the recipe file buffer
+ * update the index for a batch of shares based on inter-user deduplication
+ * (the distinct fingerprints are first looked up together without any lock; only the lock stripes of the 
+ * missing ones are then held while they are looked up again and the values of the new shares are added 
+ * as pending entries, and the stripes are released whenever the share container buffer is full, so that the 
+ * buffer is handed off outside them; the user references are added as merge operands afterwards)
  *
+ * @param shareList - the non-duplicate shares of a metadata buffer (sorted by fingerprint on return, 
+ *                    with the first share of each group recording the share index value)
+ * @param userID - the user id 
  * @param targetBufferNode - the corresponding buffer node 
- * @param recipeFileName - the name of the found old recipe file <return>
- * @param recipeFileOffset - the offset of the found old recipe file <return>
+ * @param shareDataBuffer - the share data buffer
  *
- * @return - a boolean value that indicates if the find op succeeds
+ * @return - a boolean value that indicates if the update op succeeds
  */
-bool DedupCore::findOldRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName, 
-		int &recipeFileOffset) {
-	char key[KEY_SIZE];
-	leveldb::Slice *keySlice;
-	std::string valueString;
-	int valueOffset;
-	inodeIndexValueHead_t *pInodeIndexValueHead;
-	inodeFileEntry_t *pInodeFileEntry;
+bool DedupCore::interUserIndexUpdate_(std::vector<shareBatchEntry_t> &shareList, const int &userID, 
+		perUserBufferNode_t *targetBufferNode, unsigned char *shareDataBuffer) {
+	std::vector<std::string> keyList, valueList, missKeyList, newKeyList, newValueList;
+	std::vector<leveldb::Status> statList;
+	std::vector<int> missList;
+	shareIndexValue_t shareIndexValue;
+	leveldb::WriteBatch refBatch;
+	leveldb::Status writeStat;
+	char refKey[USER_REF_KEY_SIZE];
+	bool stripeList[NUM_INDEX_LOCK_STRIPES];
+	int numOfEntries = shareList.size();
+	int i, g, m, n;
+
+	if (numOfEntries == 0) {
+		return 1;
+	}
+
+	/*1. group the shares by fingerprint, and look up all distinct fingerprints together*/
+	groupShareBatch_(shareList, keyList);
+	getShareBatch_(keyList, valueList, statList);
+
+	for (i = 0, g = 0; i < numOfEntries; i += shareList[i].numOfRefs, g++) {
+		const leveldb::Status &getStat = statList[g];
+
+		/*note: the user may already own the share, as the received package of shares may contain repeated 
+		  shares or the share may be uploaded by another session of the user after the first stage; either way 
+		  the references are added to the user reference key*/
+		shareUserRef2IndexKey_(shareList[i].shareFP, userID, refKey);
+		refBatch.Merge(leveldb::Slice(refKey, USER_REF_KEY_SIZE), 
+				leveldb::Slice((char *) &shareList[i].numOfRefs, sizeof(int)));
+
+		if (getStat.IsNotFound()) {
+			missKeyList.push_back(keyList[g]);
+			missList.push_back(i);
+		}
+		else if ((!getStat.ok()) || (valueList[g].size() != (size_t) shareIndexValueSize_)) {
+			fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(keyList[g]).ToString().c_str());
+			fprintf(stderr, "Status: %s \n", getStat.ToString().c_str());
+
+			return 0;
+		}
+		else {
+			memcpy(&shareList[i].shareIndexValue, valueList[g].data(), shareIndexValueSize_);
+		}
+	}
+
+	/*2. add the missing shares under the lock stripes of their keys, from the first one not added yet*/
+	for (m = 0; m < (int) missList.size(); ) {
+		memset(stripeList, 0, sizeof(stripeList));
+		for (n = m; n < (int) missList.size(); n++) {
+			stripeList[indexStripe_(missKeyList[n].data())] = 1;
+		}
+
+		lockIndexStripes_(stripeList);
+
+		/*look up the rest again, as another user may have added some of them since the first lookup*/
+		std::vector<std::string> restKeyList(missKeyList.begin() + m, missKeyList.end());
+		getShareBatch_(restKeyList, valueList, statList);
+
+		newKeyList.clear();
+		newValueList.clear();
+		for (n = 0; m < (int) missList.size(); m++, n++) {
+			i = missList[m];
+
+			if (statList[n].ok() && (valueList[n].size() == (size_t) shareIndexValueSize_)) {
+				memcpy(&shareList[i].shareIndexValue, valueList[n].data(), shareIndexValueSize_);
+				continue;
+			}
+			if (!statList[n].IsNotFound()) {
+				fprintf(stderr, "Error: fail to look up the key '%s' in the database!\n", leveldb::Slice(restKeyList[n]).ToString().c_str());
+				fprintf(stderr, "Status: %s \n", statList[n].ToString().c_str());
+
+				unlockIndexStripes_(stripeList);
+
+				return 0;
+			}
+
+			/*if there is no enough space in the share container buffer, stop here to store the buffer first*/
+			if ((targetBufferNode->shareContainerBufferCurrLen > 0) && 
+					(targetBufferNode->shareContainerBufferCurrLen + shareList[i].shareSize > CONTAINER_BUFFER_SIZE)) {
+				break;
+			}
+
+			/*add a new key-value entry for the share, which is committed with the share container*/
+			memset(&shareIndexValue, 0, shareIndexValueSize_);
+			shareIndexValue.shareContainerID = targetBufferNode->shareContainerID;
+			shareIndexValue.shareContainerOffset = targetBufferNode->shareContainerBufferCurrLen;
+			shareIndexValue.shareSize = shareList[i].shareSize;
+
+			newKeyList.push_back(restKeyList[n]);
+			newValueList.push_back(std::string((char *) &shareIndexValue, shareIndexValueSize_));
+			shareList[i].shareIndexValue = shareIndexValue;
+
+			/*copy the share from shareDataBuffer into the buffer*/
+			memcpy(targetBufferNode->shareContainerBuffer + targetBufferNode->shareContainerBufferCurrLen, 
+					shareDataBuffer + shareList[i].shareDataBufferOffset, shareList[i].shareSize);
+			targetBufferNode->shareContainerBufferCurrLen += shareList[i].shareSize;
+		}
+
+		/*publish the new entries as pending ones (they go to the writer with the share container buffer), 
+		  and add the new keys into the filter of the index cache before they can be looked up*/
+		if (!newKeyList.empty()) {
+			pthread_mutex_lock(&pendingShareLock_);
+			for (n = 0; n < (int) newKeyList.size(); n++) {
+				pendingShareMap_[newKeyList[n]] = newValueList[n];
+			}
+			pthread_mutex_unlock(&pendingShareLock_);
+
+			for (n = 0; n < (int) newKeyList.size(); n++) {
+				indexCache_->addKey(newKeyList[n]);
+			}
+
+			targetBufferNode->shareKeyList->insert(targetBufferNode->shareKeyList->end(), 
+					newKeyList.begin(), newKeyList.end());
+			targetBufferNode->shareValueList->insert(targetBufferNode->shareValueList->end(), 
+					newValueList.begin(), newValueList.end());
+		}
+
+		unlockIndexStripes_(stripeList);
+
+		/*store the full share container buffer (the writer may make it wait) outside the stripes*/
+		if ((m < (int) missList.size()) && !storeShareContainer_(targetBufferNode)) {
+			fprintf(stderr, "Error: fail to store the data of the share container buffer into the disk!\n");
+			return 0;
+		}
+	}
+
+	/*3. the references are written after the shares, so that an owned share always exists*/
+	writeStat = db_->Write(writeOptions_, &refBatch);
+	if (writeStat.ok() == false) {
+		fprintf(stderr, "Error: fail to perform batched writes!\n");
+		fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * hand off the data of the recipe file buffer to the recipe writer, after the share containers of its entries
+ * (the recipe writer is the first container writer, so the recipes of a recipe file are stored in order; 
+ * a share in the share container buffer of another user, which may stay there for long, is copied into the 
+ * buffer of this user, which is then handed off if an entry is in it)
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ * @param recipeFileName - the full recipe file name
+ * @param recipeFileOffset - the offset of the file recipe head that the entries are appended to 
+ * (-1 for a new recipe file)
+ * @param finishStat - if the last file of the recipes is finished
+ *
+ * @return - a boolean value that indicates if the hand-off op succeeds
+ */
+bool DedupCore::handOffRecipeFile_(perUserBufferNode_t *targetBufferNode, const std::string &recipeFileName, 
+		const int &recipeFileOffset, const bool &finishStat) {
+	boost::unordered_map<uint64_t, perUserBufferNode_t *>::iterator it;
+	std::vector<uint64_t> shareContainerIDList;
+	fileRecipeHead_t *pFileRecipeHead;
+	shareIndexValue_t *pShareLocation;
+	int recipeFileBufferOffset, i;
+	bool copyStat;
+
+	/*1. collect the share containers of the entries*/
+	recipeFileBufferOffset = 0;
+	while (recipeFileBufferOffset < targetBufferNode->recipeFileBufferCurrLen) {
+		pFileRecipeHead = (fileRecipeHead_t *) (targetBufferNode->recipeFileBuffer + recipeFileBufferOffset);
+		recipeFileBufferOffset += fileRecipeHeadSize_;
+
+		for (i = 0; i < pFileRecipeHead->numOfShares; i++) {
+			pShareLocation = &(((fileRecipeEntry_t *) (targetBufferNode->recipeFileBuffer + 
+							recipeFileBufferOffset))->shareLocation);
+			recipeFileBufferOffset += fileRecipeEntrySize_;
+
+			/*copy a share in the share container buffer of another user, after storing the full buffer of this user*/
+			do {
+				copyStat = 1;
+
+				pthread_mutex_lock(&bufferLock_);
+				it = containerBufferNodeMap_.find(pShareLocation->shareContainerID);
+				if ((it != containerBufferNodeMap_.end()) && (it->second != targetBufferNode)) {
+					if (targetBufferNode->shareContainerBufferCurrLen + pShareLocation->shareSize <= CONTAINER_BUFFER_SIZE) {
+						memcpy(targetBufferNode->shareContainerBuffer + targetBufferNode->shareContainerBufferCurrLen, 
+								it->second->shareContainerBuffer + pShareLocation->shareContainerOffset, 
+								pShareLocation->shareSize);
+						pShareLocation->shareContainerID = targetBufferNode->shareContainerID;
+						pShareLocation->shareContainerOffset = targetBufferNode->shareContainerBufferCurrLen;
+						targetBufferNode->shareContainerBufferCurrLen += pShareLocation->shareSize;
+					}
+					else {
+						copyStat = 0;
+					}
+				}
+				pthread_mutex_unlock(&bufferLock_);
+
+				if (!copyStat && !storeShareContainer_(targetBufferNode)) {
+					fprintf(stderr, "Error: fail to store the data of the share container buffer into the disk!\n");
+					return 0;
+				}
+			} while (!copyStat);
+
+			shareContainerIDList.push_back(pShareLocation->shareContainerID);
+		}
+	}
+	std::sort(shareContainerIDList.begin(), shareContainerIDList.end());
+	shareContainerIDList.erase(std::unique(shareContainerIDList.begin(), shareContainerIDList.end()), 
+			shareContainerIDList.end());
+
+	/*2. hand off the share container buffer if an entry is in it*/
+	if (std::binary_search(shareContainerIDList.begin(), shareContainerIDList.end(), targetBufferNode->shareContainerID)) {
+		if (!storeShareContainer_(targetBufferNode)) {
+			fprintf(stderr, "Error: fail to store the data of the share container buffer into the disk!\n");
+			return 0;
+		}
+	}
+
+	/*3. hand off the recipes, which are stored once the share containers are durable*/
+	containerWriters_[0]->addRecipe(recipeFileName, recipeFileOffset, targetBufferNode->recipeFileBuffer, 
+			targetBufferNode->recipeFileBufferCurrLen, finishStat, shareContainerIDList);
+
+	return 1;
+}
+
+/*
+ * store the data of the recipe file buffer into a new recipe file
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ * @param finishStat - if the last file of the recipes is finished
+ *
+ * @return - a boolean value that indicates if the store op succeeds
+ */
+bool DedupCore::storeNewRecipeFile_(perUserBufferNode_t *targetBufferNode, const bool &finishStat) {
+	std::string recipeFileName;
+
+	recipeFileName = targetBufferNode->recipeFileName;	
+
+	if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
+		fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
+		return 0;	
+	}
+
+	/*hand off the data of the recipe file buffer for a new recipe file*/
+	if (!handOffRecipeFile_(targetBufferNode, recipeFileName, -1, finishStat)) {
+		return 0;	
+	}	
+
+	/*renew the recipeFileName of the buffer*/
+
+	/*get the mutex lock globalRecipeFileNameLock_*/
+	pthread_mutex_lock(&globalRecipeFileNameLock_);
+
+	globalRecipeFileName_.copy(targetBufferNode->recipeFileName, INTERNAL_FILE_NAME_SIZE - 1, 0);
+	targetBufferNode->recipeFileName[INTERNAL_FILE_NAME_SIZE - 1] = '\0';
+	incrGlobalFileName_(globalRecipeFileName_, recipeFileNameValidLen_);		
+
+	/*release the mutex lock globalRecipeFileNameLock_*/
+	pthread_mutex_unlock(&globalRecipeFileNameLock_);
+
+	/*renew the two positions of the buffer*/
+	targetBufferNode->recipeFileBufferCurrLen = 0;
+	targetBufferNode->lastRecipeHeadPos = 0;
+
+	return 1;
+}
+
+/*
+ * find an old recipe file for appending the data of the recipe file buffer
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ * @param recipeFileName - the name of the found old recipe file <return>
+ * @param recipeFileOffset - the offset of the found old recipe file <return>
+ *
+ * @return - a boolean value that indicates if the find op succeeds
+ */
+bool DedupCore::findOldRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName, 
+		int &recipeFileOffset) {
+	char key[KEY_SIZE];
+	leveldb::Slice *keySlice;
+	inodeFileEntry_t inodeFileEntry;
+	int numOfVersions;
+
+	/*generate the key*/
+	inodeFP2IndexKey_(targetBufferNode->lastInodeFP, key);
+
+	/*enquire the key in the database*/
+	keySlice = new leveldb::Slice(key, KEY_SIZE);
+
+	/*read the inode file entry of the newest version*/
+	leveldb::Status getStat = getInodeFileEntry_(targetBufferNode->lastInodeFP, 0, inodeFileEntry, numOfVersions);
+
+	/*if such an inode exists*/
+	if (getStat.ok()) {
+		/*get the recipe file info*/
+		recipeFileName.assign(inodeFileEntry.recipeFileName);
+		recipeFileOffset = inodeFileEntry.recipeFileOffset;		
+	}
+
+	/*if such an inode does not exist*/
+	if (getStat.IsNotFound()) {	
+		fprintf(stderr, "Error: cannot find an inode for the key '%s' in the database!\n", keySlice->ToString().c_str());		
+
+		delete keySlice;
+
+		return 0;		
+	}
+
+	if (getStat.IsCorruption()) { 
+		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+
+		delete keySlice;
+
+		return 0;
+	}
+
+	if (getStat.IsIOError()) {
+		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+
+		delete keySlice;
+
+		return 0;
+	}
+
+	delete keySlice;
+
+	return 1;
+}
+
+/*
+ * append the data of the recipe file buffer to an old recipe file
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ * @param finishStat - if the file is finished
+ *
+ * @return - a boolean value that indicates if the append op succeeds
+ */
+bool DedupCore::appendOldRecipeFile_(perUserBufferNode_t *targetBufferNode, const bool &finishStat) {
+	std::string recipeFileName;
+	int recipeFileOffset;
+
+	/*find the old recipe file info in the database*/
+	if (!findOldRecipeFile_(targetBufferNode, recipeFileName, recipeFileOffset)) {	
+		fprintf(stderr, "Error: fail to find the old recipe file info in the database!\n");
+		return 0;		
+	}	
+
+	if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
+		fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
+		return 0;	
+	}
+
+	/*hand off the data of the recipe file buffer for appending it to the old recipe file*/
+	if (!handOffRecipeFile_(targetBufferNode, recipeFileName, recipeFileOffset, finishStat)) {
+		return 0;	
+	}	
+
+	/*renew the two positions of the buffer*/
+	targetBufferNode->recipeFileBufferCurrLen = 0;
+	targetBufferNode->lastRecipeHeadPos = 0;
+
+	return 1;
+}
+
+/*
+ * append the file recipe entries of a recipe file buffer to the recipe of the file in an open recipe file, 
+ * and update its file recipe head there
+ *
+ * @param recipeFileBuffer - the data of the recipe file buffer (the head of the file, and its entries)
+ * @param fp - the recipe file
+ * @param recipeFileName - the full recipe file name
+ * @param recipeFileOffset - the offset of the file recipe head in the recipe file
+ *
+ * @return - a boolean value that indicates if the append op succeeds
+ */
+bool DedupCore::appendRecipeEntries_(const unsigned char *recipeFileBuffer, FILE *fp, const std::string &recipeFileName, 
+		const int &recipeFileOffset) {
+	const fileRecipeHead_t *pFileRecipeHead;
+	fileRecipeHead_t InsFileRecipeHead;
+	int recipeEntrySize, i;
+
+	/*read the file recipe head from the recipe file*/
+	fseek(fp, recipeFileOffset, SEEK_SET);
+	if (fread(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
+		fprintf(stderr, "Error: fail to read the file recipe head from the file '%s'!\n", recipeFileName.c_str());
+		return 0;	
+	}	
+
+	/*append file recipe entries to the recipe file, in the entry format of the file (the entries of an old 
+	  recipe file do not carry the share locations, so only that prefix of each entry is written)*/
+	pFileRecipeHead = (const fileRecipeHead_t *) recipeFileBuffer;
+	recipeEntrySize = fileRecipeEntrySizeOf_(recipeFileName.c_str());
+	fseek(fp, recipeFileOffset + fileRecipeHeadSize_ + recipeEntrySize * (InsFileRecipeHead.numOfShares), SEEK_SET);
+	if (recipeEntrySize == fileRecipeEntrySize_) {
+		if (fwrite(recipeFileBuffer + fileRecipeHeadSize_, 
+					fileRecipeEntrySize_ * pFileRecipeHead->numOfShares, 1, fp) != 1){
+			fprintf(stderr, "Error: fail to append recipe entries to the file '%s'!\n", recipeFileName.c_str());
+			return 0;	
+		}	
+	}
+	else {
+		for (i = 0; i < pFileRecipeHead->numOfShares; i++) {
+			if (fwrite(recipeFileBuffer + fileRecipeHeadSize_ + fileRecipeEntrySize_ * i, 
+						recipeEntrySize, 1, fp) != 1){
+				fprintf(stderr, "Error: fail to append recipe entries to the file '%s'!\n", recipeFileName.c_str());
+				return 0;	
+			}	
+		}
+	}
+
+	/*update the file recipe head into the recipe file (the buffered head carries the latest file size)*/
+	InsFileRecipeHead.numOfShares += pFileRecipeHead->numOfShares;
+	InsFileRecipeHead.fileSize = pFileRecipeHead->fileSize;
+	fseek(fp, recipeFileOffset, SEEK_SET);
+	if (fwrite(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
+		fprintf(stderr, "Error: fail to update the file recipe head into the file '%s'!\n", recipeFileName.c_str());
+		return 0;	
+	}	
+
+	return 1;
+}
+
+/*
+ * hand off the data of the share container buffer to the container writer, and renew the buffer
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ *
+ * @return - a boolean value that indicates if the store op succeeds
+ */
+bool DedupCore::storeShareContainer_(perUserBufferNode_t *targetBufferNode) {
+	uint64_t newShareContainerID;
+	bool handoffStat;
+
+	/*get the id of the next container first, as the buffer is not handed off without one 
+	  (the new id may be recorded in the database, so it is got before the lock)*/
+	if (!newShareContainerID_(newShareContainerID)) {
+		return 0;
+	}
+
+	/*the container is in the queue of a writer before it leaves the buffer, so readers always find it 
+	  (a failed writer drops it, and its new shares, so the buffer is renewed either way)*/
+	handoffStat = selectContainerWriter_()->addContainer(targetBufferNode->shareContainerID, 
+			targetBufferNode->shareContainerBuffer, targetBufferNode->shareContainerBufferCurrLen, 
+			*(targetBufferNode->shareKeyList), *(targetBufferNode->shareValueList));
+	if (!handoffStat) {
+		fprintf(stderr, "Error: fail to hand off the share container %llu to a container writer!\n", 
+				(unsigned long long) targetBufferNode->shareContainerID);
+	}
+
+	/*renew the share container buffer*/
+	pthread_mutex_lock(&bufferLock_);
+	containerBufferNodeMap_.erase(targetBufferNode->shareContainerID);
+	targetBufferNode->shareContainerID = newShareContainerID;
+	targetBufferNode->shareContainerBufferCurrLen = 0;
+	containerBufferNodeMap_[newShareContainerID] = targetBufferNode;
+	pthread_mutex_unlock(&bufferLock_);
+
+	return handoffStat;
+}
+
+/*
+ * add a file recipe entry to the offset index of the file being received
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ * @param secretSize - the secret size of the entry
+ */
+void DedupCore::addOffsetCheckpoint_(perUserBufferNode_t *targetBufferNode, const int &secretSize) {
+	int i;
+
+	/*record the total size of the previous secrets at every interval*/
+	if (targetBufferNode->currFileNumOfShares % targetBufferNode->offsetIndexInterval == 0) {
+		/*if the checkpoints are full, double the interval by keeping every other checkpoint*/
+		if (targetBufferNode->numOfOffsetCheckpoints == MAX_OFFSET_CHECKPOINTS) {
+			for (i = 0; i < MAX_OFFSET_CHECKPOINTS / 2; i++) {
+				targetBufferNode->offsetCheckpoints[i] = targetBufferNode->offsetCheckpoints[2 * i];
+			}
+			targetBufferNode->numOfOffsetCheckpoints = MAX_OFFSET_CHECKPOINTS / 2;
+			targetBufferNode->offsetIndexInterval *= 2;
+		}
+
+		if (targetBufferNode->currFileNumOfShares % targetBufferNode->offsetIndexInterval == 0) {
+			targetBufferNode->offsetCheckpoints[targetBufferNode->numOfOffsetCheckpoints] = targetBufferNode->currFileSize;
+			targetBufferNode->numOfOffsetCheckpoints++;
+		}
+	}
+
+	targetBufferNode->currFileNumOfShares++;
+	targetBufferNode->currFileSize += secretSize;
+}
+
+/*
+ * store the offset index of the file being received into the database
+ *
+ * @param targetBufferNode - the corresponding buffer node 
+ *
+ * @return - a boolean value that indicates if the store op succeeds
+ */
+bool DedupCore::storeOffsetIndex_(perUserBufferNode_t *targetBufferNode) {
+	char key[KEY_SIZE], *value;
+	int valueSize;
+	offsetIndexValueHead_t *pOffsetIndexValueHead;
+
+	/*generate the key*/
+	recipeLocation2IndexKey_(targetBufferNode->currRecipeFileName, targetBufferNode->currRecipeFileOffset, key);
+	leveldb::Slice keySlice(key, KEY_SIZE);
+
+	/*generate the value*/
+	valueSize = offsetIndexValueHeadSize_ + sizeof(long) * targetBufferNode->numOfOffsetCheckpoints;
+	value = (char *) malloc(valueSize);
+	pOffsetIndexValueHead = (offsetIndexValueHead_t *) value;
+	pOffsetIndexValueHead->interval = targetBufferNode->offsetIndexInterval;
+	pOffsetIndexValueHead->numOfCheckpoints = targetBufferNode->numOfOffsetCheckpoints;
+	memcpy(value + offsetIndexValueHeadSize_, targetBufferNode->offsetCheckpoints, 
+			sizeof(long) * targetBufferNode->numOfOffsetCheckpoints);
+	leveldb::Slice valueSlice(value, valueSize);
+
+	/*store the key-value entry into the offset index*/
+	leveldb::Status putStat = db_->Put(writeOptions_, keySlice, valueSlice);
+
+	free(value);
+
+	if (putStat.ok() == false) {
+		fprintf(stderr, "Error: fail to store the offset index for the recipe file '%s'!\n", 
+				targetBufferNode->currRecipeFileName);
+		fprintf(stderr, "Status: %s \n", putStat.ToString().c_str());
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * locate the file recipe entries that cover a byte range of a file
+ *
+ * @param pInodeFileEntry - the inode file entry of the file 
+ * @param recipeFilePointer - the opened recipe file, or NULL if the recipe file is in recipeFileBuffer
+ * @param recipeFileBuffer - the buffer that stores the recipe file
+ * @param recipeEntrySize - the size of the file recipe entries in the recipe file
+ * @param numOfShares - the total number of shares of the file
+ * @param rangeOffset - the offset of the range
+ * @param rangeLength - the length of the range, or RANGE_TO_END
+ * @param startEntry - the index of the first covering entry <return>
+ * @param numOfRangeShares - the number of covering entries <return>
+ * @param firstSecretOffset - the file offset of the first covering secret <return>
+ *
+ * @return - a boolean value that indicates if the locate op succeeds
+ */
+bool DedupCore::locateRange_(inodeFileEntry_t *pInodeFileEntry, FILE *recipeFilePointer, unsigned char *recipeFileBuffer, 
+		const int &recipeEntrySize, const int &numOfShares, const long &rangeOffset, const long &rangeLength, 
+		int &startEntry, int &numOfRangeShares, long &firstSecretOffset) {
+	char key[KEY_SIZE];
+	std::string valueString;
+	offsetIndexValueHead_t *pOffsetIndexValueHead;
+	long *checkpoints;
+	long currOffset, rangeEnd;
+	unsigned char *recipeEntries;
+	fileRecipeEntry_t *pFileRecipeEntry;
+	long recipeEntryPos;
+	int low, high, mid;
+	int i, j, numOfReadEntries;
+
+	startEntry = 0;
+	currOffset = 0;
+
+	/*1. find the last checkpoint before rangeOffset in the offset index*/
+	recipeLocation2IndexKey_(pInodeFileEntry->recipeFileName, pInodeFileEntry->recipeFileOffset, key);
+	leveldb::Slice keySlice(key, KEY_SIZE);
+
+	leveldb::Status getStat = db_->Get(readOptions_, keySlice, &valueString);
+
+	if (getStat.ok()) {
+		pOffsetIndexValueHead = (offsetIndexValueHead_t *) valueString.data();
+		checkpoints = (long *) (valueString.data() + offsetIndexValueHeadSize_);
+
+		/*binary search the checkpoints, which are in ascending order*/
+		low = 0;
+		high = pOffsetIndexValueHead->numOfCheckpoints - 1;
+		while (low < high) {
+			mid = (low + high + 1) / 2;
+			if (checkpoints[mid] <= rangeOffset) {
+				low = mid;
+			}
+			else {
+				high = mid - 1;
+			}
+		}
+
+		if (pOffsetIndexValueHead->numOfCheckpoints > 0) {
+			startEntry = low * pOffsetIndexValueHead->interval;
+			currOffset = checkpoints[low];
+		}
+	}
+	/*without the offset index (e.g., an incomplete file), scan the recipe from the beginning*/
+	else if (!getStat.IsNotFound()) {
+		fprintf(stderr, "Error: fail to read the offset index for the recipe file '%s'!\n", 
+				pInodeFileEntry->recipeFileName);
+		fprintf(stderr, "Status: %s \n", getStat.ToString().c_str());
+
+		return 0;
+	}
+
+	/*2. walk the file recipe entries from the checkpoint to the end of the range*/
+	if (rangeLength == RANGE_TO_END) {
+		rangeEnd = LONG_MAX;
+	}
+	else {
+		rangeEnd = rangeOffset + rangeLength;
+	}
+
+	numOfRangeShares = 0;
+	firstSecretOffset = currOffset;
+	recipeEntryPos = pInodeFileEntry->recipeFileOffset + fileRecipeHeadSize_ + (long) recipeEntrySize * startEntry;
+	recipeEntries = (unsigned char *) malloc(recipeEntrySize * RANGE_SCAN_ENTRIES);
+	if (recipeFilePointer != NULL) {
+		fseek(recipeFilePointer, recipeEntryPos, SEEK_SET);
+	}
+
+	i = startEntry;
+	while ((i < numOfShares) && (currOffset < rangeEnd)) {
+		/*read the next batch of file recipe entries*/
+		numOfReadEntries = numOfShares - i;
+		if (numOfReadEntries > RANGE_SCAN_ENTRIES) {
+			numOfReadEntries = RANGE_SCAN_ENTRIES;
+		}
+
+		if (recipeFilePointer != NULL) {
+			if (fread(recipeEntries, recipeEntrySize, numOfReadEntries, recipeFilePointer) != (size_t) numOfReadEntries) {
+				fprintf(stderr, "Error: fail to read the recipe file '%s'!\n", pInodeFileEntry->recipeFileName);
+
+				free(recipeEntries);
+				return 0;
+			}
+		}
+		else {
+			memcpy(recipeEntries, recipeFileBuffer + recipeEntryPos, recipeEntrySize * numOfReadEntries);
+			recipeEntryPos += recipeEntrySize * numOfReadEntries;
+		}
+
+		/*skip the secrets before the range and count the ones in the range*/
+		for (j = 0; (j < numOfReadEntries) && (currOffset < rangeEnd); j++) {
+			pFileRecipeEntry = (fileRecipeEntry_t *) (recipeEntries + recipeEntrySize * j);
+
+			if (currOffset + pFileRecipeEntry->secretSize <= rangeOffset) {
+				startEntry++;
+				firstSecretOffset = currOffset + pFileRecipeEntry->secretSize;
+			}
+			else {
+				numOfRangeShares++;
+			}
+			currOffset += pFileRecipeEntry->secretSize;
+		}
+
+		i += numOfReadEntries;
+	}
+
+	free(recipeEntries);
+
+	return 1;
+}
+
+/*
+ * read the recipe file from the buffer node pool
+ *
+ * @param userID - the user id
+ * @param recipeFileName - the name of the recipe file
+ * @param recipeFileBuffer - the buffer for storing the recipe file <return>
+ *
+ * @return - a boolean value that indicates if the read op succeeds
+ */
+bool DedupCore::readRecipeFileFromBuffer_(const int &userID, char *recipeFileName, 
+		unsigned char *recipeFileBuffer) {	
+	boost::unordered_map<int, perUserBufferNode_t *>::iterator it;
+	perUserBufferNode_t *targetBufferNode;
+	bool readStat;
+
+	/*get the mutex lock bufferLock_*/
+	pthread_mutex_lock(&bufferLock_);
+
+	/*find the buffer node for this user, after the node being retired if any (its recipe file is then handed off)*/
+	it = bufferNodeMap_.find(userID);
+	while ((it != bufferNodeMap_.end()) && it->second->retireStat) {
+		pthread_cond_wait(&bufferCond_, &bufferLock_);
+		it = bufferNodeMap_.find(userID);
+	}
+	targetBufferNode = (it != bufferNodeMap_.end()) ? it->second : NULL;
+
+	/*if find the buffer node, then check if the recipe file is stored in the buffer*/
+	if ((targetBufferNode == NULL) || (strcmp(targetBufferNode->recipeFileName, recipeFileName) != 0)) {
+		/*release the mutex lock bufferLock_*/
+		pthread_mutex_unlock(&bufferLock_);
+
+		return 0;
+	}
+
+	/*use the node, and read it between the sessions filling it*/
+	targetBufferNode->numOfUsers++;
+
+	/*release the mutex lock bufferLock_*/
+	pthread_mutex_unlock(&bufferLock_);
+
+	pthread_mutex_lock(&(targetBufferNode->nodeLock));
+
+	/*the recipe file may have been handed off meanwhile*/
+	readStat = (strcmp(targetBufferNode->recipeFileName, recipeFileName) == 0);
+	if (readStat) {
+		/*get the data of the recipe file buffer*/
+		memcpy(recipeFileBuffer, targetBufferNode->recipeFileBuffer, 
+				targetBufferNode->recipeFileBufferCurrLen);
+	}
+
+	pthread_mutex_unlock(&(targetBufferNode->nodeLock));
+
+	/*get the mutex lock bufferLock_*/
+	pthread_mutex_lock(&bufferLock_);
+
+	/*a read does not keep the node from expiring*/
+	targetBufferNode->numOfUsers--;
+	if (targetBufferNode->numOfUsers == 0) {
+		pthread_cond_broadcast(&bufferCond_);
+	}
+
+	/*release the mutex lock bufferLock_*/
+	pthread_mutex_unlock(&bufferLock_);
+
+	return readStat;
+}
+
+/*
+ * read a part of a share container from the buffer node pool
+ *
+ * @param shareContainerID - the id of the share container
+ * @param offset - the offset of the part in the share container
+ * @param size - the size of the part
+ * @param buffer - the buffer for storing the part <return>
+ *
+ * @return - a boolean value that indicates if the share container is in the buffer node pool
+ */
+bool DedupCore::readShareContainerFromBuffer_(const uint64_t &shareContainerID, const int &offset, const int &size, 
+		unsigned char *buffer) {	
+	boost::unordered_map<uint64_t, perUserBufferNode_t *>::iterator it;
+
+	pthread_mutex_lock(&bufferLock_);
+
+	/*find the buffer node that contains the share container*/
+	it = containerBufferNodeMap_.find(shareContainerID);
+
+	/*if find the buffer node, then get the part of the share container buffer*/
+	if(it != containerBufferNodeMap_.end()) {
+		memcpy(buffer, it->second->shareContainerBuffer + offset, size);
+
+		pthread_mutex_unlock(&bufferLock_);
+
+		return 1;
+	}
+	else {
+		pthread_mutex_unlock(&bufferLock_);
+
+		return 0;
+	}
+}
+
+/*
+ * select the container writer of a new share container (the least queued one, in turn among equals)
+ *
+ * @return - the container writer
+ */
+ContainerWriter *DedupCore::selectContainerWriter_() {
+	int numOfWriters = containerWriters_.size();
+	int i, startPos, targetPos, numOfPendingContainers, minNumOfPendingContainers;
+
+	startPos = __sync_fetch_and_add(&nextContainerWriter_, 1) % numOfWriters;
+	if (startPos < 0) {
+		startPos += numOfWriters;
+	}
+
+	targetPos = startPos;
+	minNumOfPendingContainers = containerWriters_[startPos]->getNumOfPendingContainers();
+	for (i = 1; (i < numOfWriters) && (minNumOfPendingContainers > 0); i++) {
+		numOfPendingContainers = containerWriters_[(startPos + i) % numOfWriters]->getNumOfPendingContainers();
+		if (numOfPendingContainers < minNumOfPendingContainers) {
+			targetPos = (startPos + i) % numOfWriters;
+			minNumOfPendingContainers = numOfPendingContainers;
+		}
+	}
+
+	return containerWriters_[targetPos];
+}
+
+/*
+ * read a part of a share container from the queues of the container writers
+ *
+ * @param shareContainerID - the id of the share container
+ * @param offset - the offset of the part in the share container
+ * @param size - the size of the part
+ * @param buffer - the buffer for storing the part <return>
+ *
+ * @return - a boolean value that indicates if the share container is in a queue
+ */
+bool DedupCore::readShareContainerFromWriters_(const uint64_t &shareContainerID, const int &offset, const int &size, 
+		unsigned char *buffer) {
+	for (int i = 0; i < (int) containerWriters_.size(); i++) {
+		if (containerWriters_[i]->readPendingContainer(shareContainerID, offset, size, buffer)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * open the file of a share container on disk (a segment file, or the own file of an old share container)
+ *
+ * @param shareContainerID - the id of the share container
+ * @param source - the share container being read, which is replaced if it is another one <return>
+ *
+ * @return - a boolean value that indicates if the open op succeeds
+ */
+bool DedupCore::openShareContainer_(const uint64_t &shareContainerID, containerSource_t *source) {
+	containerLocation_t location;
+	char locationKey[CONTAINER_LOCATION_KEY_SIZE];
+	std::string valueString, fullShareContainerName;
+
+	if ((source->containerFilePointer != NULL) && (source->shareContainerID == shareContainerID)) {
+		return 1;
+	}
+
+	closeShareContainer_(source);
+
+	/*look up the location of the share container in the segment files*/
+	ContainerWriter::containerID2LocationKey(shareContainerID, locationKey);
+	leveldb::Status getStat = db_->Get(readOptions_, leveldb::Slice(locationKey, CONTAINER_LOCATION_KEY_SIZE), 
+			&valueString);
+
+	/*if it is there, then open the segment file on its device*/
+	if (getStat.ok()) {
+		if (valueString.size() != sizeof(containerLocation_t)) {
+			fprintf(stderr, "Error: invalid location of the share container %llu!\n", 
+					(unsigned long long) shareContainerID);
+			return 0;
+		}
+		memcpy(&location, valueString.data(), sizeof(containerLocation_t));
+
+		if ((location.deviceID < 0) || (location.deviceID >= (int) containerWriters_.size())) {
+			fprintf(stderr, "Error: the share container dir of device %d is not given!\n", location.deviceID);
+			return 0;
+		}
+
+		if (!containerWriters_[location.deviceID]->openContainerFile(location, source->containerFilePointer)) {
+			source->containerFilePointer = NULL;
+			return 0;
+		}
+		source->containerFileOffset = location.segmentOffset;
+		source->shareContainerSize = location.shareContainerSize;
+	}
+	/*or open its own file if it is stored by an earlier version*/
+	else if (getStat.IsNotFound()) {
+		shareContainerID2Name_(shareContainerID, fullShareContainerName);
+
+		if (containerStorerObj_ != NULL) {
+			if (!containerStorerObj_->openOldFile(fullShareContainerName, source->containerFilePointer)) {
+				source->containerFilePointer = NULL;
+			}
+		}
+		else {
+			source->containerFilePointer = fopen(fullShareContainerName.c_str(), "rb");
+		}
+
+		if (source->containerFilePointer == NULL) {
+			fprintf(stderr, "Error: fail to open the share container file '%s'!\n", fullShareContainerName.c_str());
+			return 0;
+		}
+		source->containerFileOffset = 0;
+		source->shareContainerSize = -1;
+	}
+	else {
+		fprintf(stderr, "Error: fail to get the location of the share container %llu!\n", 
+				(unsigned long long) shareContainerID);
+		return 0;
+	}
+
+	source->shareContainerID = shareContainerID;
+
+	return 1;
+}
+
+/*
+ * close the file of the share container being read
+ *
+ * @param source - the share container being read
+ */
+void DedupCore::closeShareContainer_(containerSource_t *source) {
+	if (source->containerFilePointer != NULL) {
+		fclose(source->containerFilePointer);
+		source->containerFilePointer = NULL;
+	}
+}
+
+/*
+ * verify the fingerprints of a run of non-duplicate shares
+ *
+ * @param shareList - the non-duplicate shares
+ * @param shareDataBuffer - the buffer of the share data
+ * @param startPos - the position of the first share of the run in shareList
+ * @param endPos - the position after the last share of the run
+ * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprints
+ *
+ * @return - the position of the first share whose fingerprint is inconsistent, or -1 if there is none
+ */
+int DedupCore::verifyShareRun_(std::vector<shareBatchEntry_t> &shareList, unsigned char *shareDataBuffer, 
+		const int &startPos, const int &endPos, CryptoPrimitive *cryptoObj) {
+	char shareFP[FP_SIZE];
+
+	for (int i = startPos; i < endPos; i++) {
+		cryptoObj->generateHash(shareDataBuffer + shareList[i].shareDataBufferOffset, shareList[i].shareSize, 
+				(unsigned char *) shareFP);
+		if (memcmp(shareList[i].shareFP, shareFP, FP_SIZE) != 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * verify the fingerprints of the non-duplicate shares of a batch (the runs of shares are hashed by 
+ * the hashing threads, and the first run by the calling thread)
+ *
+ * @param shareList - the non-duplicate shares
+ * @param shareDataBuffer - the buffer of the share data
+ * @param cryptoObj - the CryptoPrimitive instance of the calling thread
+ *
+ * @return - the position of the first share whose fingerprint is inconsistent found, or -1 if there is none
+ */
+int DedupCore::verifyShareBatch_(std::vector<shareBatchEntry_t> &shareList, unsigned char *shareDataBuffer, 
+		CryptoPrimitive *cryptoObj) {
+	int numOfPendingTasks = 0, inconsistentPos = -1, firstRunPos;
+	int numOfShares = shareList.size();
+	hashTask_t task;
+
+	/*hand off the runs after the first one to the hashing threads*/
+	if (numOfShares > HASH_TASK_SHARES) {
+		task.shareList = &shareList;
+		task.shareDataBuffer = shareDataBuffer;
+		task.numOfPendingTasks = &numOfPendingTasks;
+		task.inconsistentPos = &inconsistentPos;
+
+		pthread_mutex_lock(&hashLock_);
+		for (task.startPos = HASH_TASK_SHARES; task.startPos < numOfShares; task.startPos += HASH_TASK_SHARES) {
+			task.endPos = std::min(task.startPos + HASH_TASK_SHARES, numOfShares);
+			hashTaskList_.push_back(task);
+			numOfPendingTasks++;
+		}
+		pthread_cond_broadcast(&hashCond_);
+		pthread_mutex_unlock(&hashLock_);
+	}
 
-	/*generate the key*/
-	inodeFP2IndexKey_(targetBufferNode->lastInodeFP, key);
+	/*verify the first run meanwhile*/
+	firstRunPos = verifyShareRun_(shareList, shareDataBuffer, 0, std::min(HASH_TASK_SHARES, numOfShares), cryptoObj);
 
-	/*enquire the key in the database*/
-	keySlice = new leveldb::Slice(key, KEY_SIZE);
+	/*wait for the other runs*/
+	pthread_mutex_lock(&hashLock_);
+	while (numOfPendingTasks > 0) {
+		pthread_cond_wait(&hashDoneCond_, &hashLock_);
+	}
+	pthread_mutex_unlock(&hashLock_);
 
-	/*get the mutex lock DBLock_*/
-	pthread_mutex_lock(&DBLock_);
+	return (firstRunPos >= 0) ? firstRunPos : inconsistentPos;
+}
 
-	leveldb::Status getStat = db_->Get(readOptions_, *keySlice, &valueString);
+/*
+ * the main procedure of a hashing thread
+ *
+ * @param param - the DedupCore instance
+ */
+void *DedupCore::hashHandler_(void *param) {
+	DedupCore *obj = (DedupCore *) param;
+	CryptoPrimitive *cryptoObj = new CryptoPrimitive(SHA256_TYPE);
+	hashTask_t task;
+	int inconsistentPos;
+
+	while (true) {
+		pthread_mutex_lock(&(obj->hashLock_));
+		while (obj->hashTaskList_.empty() && !obj->hashStopStat_) {
+			pthread_cond_wait(&(obj->hashCond_), &(obj->hashLock_));
+		}
+		if (obj->hashTaskList_.empty()) {
+			pthread_mutex_unlock(&(obj->hashLock_));
+			break;
+		}
+		task = obj->hashTaskList_.front();
+		obj->hashTaskList_.pop_front();
+		pthread_mutex_unlock(&(obj->hashLock_));
 
-	/*release the mutex lock DBLock_*/
-	pthread_mutex_unlock(&DBLock_);
+		inconsistentPos = verifyShareRun_(*(task.shareList), task.shareDataBuffer, task.startPos, task.endPos, cryptoObj);
 
-	/*if such an inode exists*/
-	if (getStat.ok()) {
-		/*read the inode head*/
-		valueOffset = 0;	
-		pInodeIndexValueHead = (inodeIndexValueHead_t *) (valueString.data() + valueOffset);
-		valueOffset += inodeIndexValueHeadSize_;
+		pthread_mutex_lock(&(obj->hashLock_));
+		if ((inconsistentPos >= 0) && ((*(task.inconsistentPos) < 0) || (inconsistentPos < *(task.inconsistentPos)))) {
+			*(task.inconsistentPos) = inconsistentPos;
+		}
+		(*(task.numOfPendingTasks))--;
+		if (*(task.numOfPendingTasks) == 0) {
+			pthread_cond_broadcast(&(obj->hashDoneCond_));
+		}
+		pthread_mutex_unlock(&(obj->hashLock_));
+	}
 
-		/*skip the name*/
-		valueOffset += pInodeIndexValueHead->shortNameSize;
+	delete cryptoObj;
 
-		/*read the inode file entry*/
-		pInodeFileEntry = (inodeFileEntry_t *) (valueString.data() + valueOffset);
-		valueOffset += inodeFileEntrySize_;
+	return NULL;
+}
 
-		/*get the recipe file info*/
-		recipeFileName.assign(pInodeFileEntry->recipeFileName);
-		recipeFileOffset = pInodeFileEntry->recipeFileOffset;		
-	}
+/*
+ * check if a share container is not durable yet (i.e. in the buffer node pool or a writer queue)
+ *
+ * @param shareContainerID - the id of the share container
+ *
+ * @return - a boolean value that indicates if the share container is not durable yet
+ */
+bool DedupCore::shareContainerIsPending_(const uint64_t &shareContainerID) {
+	bool bufferStat;
 
-	/*if such an inode does not exist*/
-	if (getStat.IsNotFound()) {	
-		fprintf(stderr, "Error: cannot find an inode for the key '%s' in the database!\n", keySlice->ToString().c_str());		
+	/*a share container leaves the buffer node pool only once it is queued*/
+	pthread_mutex_lock(&bufferLock_);
+	bufferStat = (containerBufferNodeMap_.find(shareContainerID) != containerBufferNodeMap_.end());
+	pthread_mutex_unlock(&bufferLock_);
 
-		delete keySlice;
+	if (bufferStat) {
+		return 1;
+	}
 
-		return 0;		
+	for (int i = 0; i < (int) containerWriters_.size(); i++) {
+		if (containerWriters_[i]->isPendingContainer(shareContainerID)) {
+			return 1;
+		}
 	}
 
-	if (getStat.IsCorruption()) { 
-		fprintf(stderr, "Error: a corruption error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
+	return 0;
+}
 
-		delete keySlice;
+/*
+ * read an extent of a share container on disk into the extent buffer of the source, and cache it
+ *
+ * @param shareContainerID - the id of the share container
+ * @param extentID - the extent id
+ * @param source - the share container on disk being read
+ * @param readSize - the size of the extent <return>
+ *
+ * @return - a boolean value that indicates if the read op succeeds
+ */
+bool DedupCore::readExtent_(const uint64_t &shareContainerID, const long &extentID, containerSource_t *source, 
+		int &readSize) {
+	int extentSize;
 
+	if (!openShareContainer_(shareContainerID, source)) {
 		return 0;
 	}
 
-	if (getStat.IsIOError()) {
-		fprintf(stderr, "Error: an I/O error occurs for the key '%s' in the database!\n", keySlice->ToString().c_str());
-
-		delete keySlice;
+	/*the last extent of a share container is cut at its end*/
+	extentSize = EXTENT_SIZE;
+	if ((source->shareContainerSize >= 0) && (source->shareContainerSize - extentID * EXTENT_SIZE < extentSize)) {
+		extentSize = source->shareContainerSize - extentID * EXTENT_SIZE;
+	}
 
+	if ((extentSize <= 0) || 
+			(fseek(source->containerFilePointer, source->containerFileOffset + extentID * EXTENT_SIZE, SEEK_SET) != 0)) {
+		readSize = 0;
+	}
+	else {
+		readSize = fread(source->extentBuffer, 1, extentSize, source->containerFilePointer);
+	}
+	if (readSize <= 0) {
+		fprintf(stderr, "Error: fail to read the extent %ld of the share container %llu!\n", extentID, 
+				(unsigned long long) shareContainerID);
 		return 0;
 	}
 
-	delete keySlice;
+	extentCache_->insert(shareContainerID, extentID, source->extentBuffer, readSize);
 
 	return 1;
 }
 
 /*
- * append the data of the recipe file buffer to an old recipe file
+ * read the data of a share (from the extent cache, the buffer node pool, the container writers, or 
+ * the extents of its share container on disk, which are then cached)
  *
- * @param targetBufferNode - the corresponding buffer node 
- * @param recipeFileName - the recipe file name <return>
+ * @param pShareIndexValue - the location of the share
+ * @param source - the share container on disk being read by the restore
+ * @param shareBuffer - the buffer for storing the share data <return>
  *
- * @return - a boolean value that indicates if the append op succeeds
+ * @return - a boolean value that indicates if the read op succeeds
  */
-bool DedupCore::appendOldRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName) {
-	int recipeFileOffset;
-	fileRecipeHead_t *pFileRecipeHead;
-	fileRecipeHead_t InsFileRecipeHead;
+bool DedupCore::readShare_(const shareIndexValue_t *pShareIndexValue, containerSource_t *source, 
+		unsigned char *shareBuffer) {
+	const uint64_t &shareContainerID = pShareIndexValue->shareContainerID;
+	long extentID, firstExtentID, lastExtentID;
+	int partOffset, partSize, copiedSize, readSize;
+
+	firstExtentID = pShareIndexValue->shareContainerOffset / EXTENT_SIZE;
+	lastExtentID = (pShareIndexValue->shareContainerOffset + pShareIndexValue->shareSize - 1) / EXTENT_SIZE;
+
+	copiedSize = 0;
+	for (extentID = firstExtentID; extentID <= lastExtentID; extentID++) {
+		partOffset = (extentID == firstExtentID) ? (pShareIndexValue->shareContainerOffset % EXTENT_SIZE) : 0;
+		partSize = EXTENT_SIZE - partOffset;
+		if (partSize > pShareIndexValue->shareSize - copiedSize) {
+			partSize = pShareIndexValue->shareSize - copiedSize;
+		}
 
-	/*find the old recipe file info in the database*/
-	if (!findOldRecipeFile_(targetBufferNode, recipeFileName, recipeFileOffset)) {	
-		fprintf(stderr, "Error: fail to find the old recipe file info in the database!\n");
-		return 0;		
-	}	
+		/*1. read the part from the extent cache*/
+		if (extentCache_->read(shareContainerID, extentID, partOffset, partSize, shareBuffer + copiedSize)) {
+			copiedSize += partSize;
 
-	if (!addPrefixDir_(recipeFileDirName_, recipeFileName)) {
-		fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", recipeFileDirName_.c_str(), recipeFileName.c_str());
-		return 0;	
-	}
+			continue;
+		}
 
-	/*open the recipe file for appending recipes*/
-	FILE *fp = fopen(recipeFileName.c_str(), "rb+");		
-	if (fp == NULL) {
-		fprintf(stderr, "Error: fail to open the file '%s' for appending recipes!\n", recipeFileName.c_str());
-		return 0;	
-	}	
+		/*2. a share container that is not durable yet is never cached, and it is read from the buffer node 
+		  pool or the queues of the container writers (it leaves the buffer only once it is queued, and its 
+		  queue only once its location is committed)*/
+		if (copiedSize == 0) {
+			if (readShareContainerFromBuffer_(shareContainerID, pShareIndexValue->shareContainerOffset, 
+						pShareIndexValue->shareSize, shareBuffer) || 
+					readShareContainerFromWriters_(shareContainerID, pShareIndexValue->shareContainerOffset, 
+						pShareIndexValue->shareSize, shareBuffer)) {
+				return 1;
+			}
+		}
 
-	long fileSize = getFileSize_(fp);
-	if (fileSize == 0) {
-		fprintf(stderr, "Error: the previous recipe file '%s' does not exit (or is empty)!\n", recipeFileName.c_str());
+		/*3. read the extent from the share container on disk (which caches it)*/
+		if (!readExtent_(shareContainerID, extentID, source, readSize)) {
+			return 0;
+		}
+		if (readSize < partOffset + partSize) {
+			fprintf(stderr, "Error: the extent %ld of the share container %llu is incomplete!\n", extentID, 
+					(unsigned long long) shareContainerID);
+			return 0;
+		}
 
-		fclose(fp);
-		return 0;	
+		memcpy(shareBuffer + copiedSize, source->extentBuffer + partOffset, partSize);
+		copiedSize += partSize;
 	}
 
-	/*read the file recipe head from the recipe file*/
-	fseek(fp, recipeFileOffset, SEEK_SET);
-	if (fread(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
-		fprintf(stderr, "Error: fail to read the file recipe head from the file '%s'!\n", recipeFileName.c_str());
-
-		fclose(fp);
-		return 0;	
-	}	
+	return 1;
+}
 
-	/*append file recipe entries to the recipe file*/
-	fseek(fp, recipeFileOffset + fileRecipeHeadSize_ + fileRecipeEntrySize_ * (InsFileRecipeHead.numOfShares), SEEK_SET);
-	if (fwrite(targetBufferNode->recipeFileBuffer + fileRecipeHeadSize_, 
-				targetBufferNode->recipeFileBufferCurrLen - fileRecipeHeadSize_, 1, fp) != 1){
-		fprintf(stderr, "Error: fail to append recipe entries to the file '%s'!\n", recipeFileName.c_str());
+/*
+ * prepare to send a share from the file of its share container (only a large share that is durable 
+ * and not cached is sent so)
+ *
+ * @param pShareIndexValue - the location of the share
+ * @param source - the share container on disk being read by the restore
+ * @param zeroCopyShare - the share to send from the file <return>
+ *
+ * @return - a boolean value that indicates if the share is sent from the file
+ */
+bool DedupCore::prepareZeroCopyShare_(const shareIndexValue_t *pShareIndexValue, containerSource_t *source, 
+		zeroCopyShare_t &zeroCopyShare) {
+	const uint64_t &shareContainerID = pShareIndexValue->shareContainerID;
 
-		fclose(fp);
-		return 0;	
-	}	
+	if (pShareIndexValue->shareSize < ZERO_COPY_MIN_SHARE_SIZE) {
+		return 0;
+	}
 
-	/*update the file recipe head into the recipe file*/
-	pFileRecipeHead = (fileRecipeHead_t *) (targetBufferNode->recipeFileBuffer);
-	InsFileRecipeHead.numOfShares += pFileRecipeHead->numOfShares;
-	fseek(fp, recipeFileOffset, SEEK_SET);
-	if (fwrite(&InsFileRecipeHead, fileRecipeHeadSize_, 1, fp) != 1){
-		fprintf(stderr, "Error: fail to update the file recipe head into the file '%s'!\n", recipeFileName.c_str());
+	/*a share whose extents are cached is copied from memory, and a share container that is not durable 
+	  has no file yet*/
+	if ((extentCache_->contains(shareContainerID, pShareIndexValue->shareContainerOffset / EXTENT_SIZE) && 
+				extentCache_->contains(shareContainerID, 
+					(pShareIndexValue->shareContainerOffset + pShareIndexValue->shareSize - 1) / EXTENT_SIZE)) || 
+			shareContainerIsPending_(shareContainerID)) {
+		return 0;
+	}
 
-		fclose(fp);
-		return 0;	
-	}	
+	/*if the file cannot be opened, the share is read by readShare_, which reports the error*/
+	if (!openShareContainer_(shareContainerID, source)) {
+		return 0;
+	}
+	if ((source->shareContainerSize >= 0) && 
+			(pShareIndexValue->shareContainerOffset + pShareIndexValue->shareSize > source->shareContainerSize)) {
+		return 0;
+	}
 
-	/*renew the two positions of the buffer*/
-	targetBufferNode->recipeFileBufferCurrLen = 0;
-	targetBufferNode->lastRecipeHeadPos = 0;
+	zeroCopyShare.fileFD = dup(fileno(source->containerFilePointer));
+	if (zeroCopyShare.fileFD < 0) {
+		return 0;
+	}
+	zeroCopyShare.fileOffset = source->containerFileOffset + pShareIndexValue->shareContainerOffset;
+	zeroCopyShare.shareSize = pShareIndexValue->shareSize;
 
-	fclose(fp);
 	return 1;
 }
 
 /*
- * store the data of the share container buffer into a container
- *
- * @param targetBufferNode - the corresponding buffer node 
- * @param shareContainerName - the share container name <return>
+ * close the files of the shares to send from the files
  *
- * @return - a boolean value that indicates if the store op succeeds
+ * @param zeroCopyList - the shares to send from the files <return>
  */
-bool DedupCore::storeShareContainer_(perUserBufferNode_t *targetBufferNode, std::string &shareContainerName) {
-	shareContainerName = targetBufferNode->shareContainerName;
-
-	if (!addPrefixDir_(shareContainerDirName_, shareContainerName)) {
-		fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", shareContainerDirName_.c_str(), shareContainerName.c_str());
-		return 0;	
-	}	
-
-	/*create a container file for writing shares*/
-	FILE *fp = fopen(shareContainerName.c_str(), "wb");		
-	if (fp == NULL) {
-		fprintf(stderr, "Error: fail to open the file '%s' for writing shares!\n", shareContainerName.c_str());
-		return 0;	
-	}	
+void DedupCore::closeZeroCopyShares_(std::vector<zeroCopyShare_t> &zeroCopyList) {
+	for (int i = 0; i < (int) zeroCopyList.size(); i++) {
+		close(zeroCopyList[i].fileFD);
+	}
+	zeroCopyList.clear();
+}
 
-	/*write the data of the share container buffer into a container file*/
-	if (fwrite(targetBufferNode->shareContainerBuffer, targetBufferNode->shareContainerBufferCurrLen, 1, fp) != 1){
-		fprintf(stderr, "Error: fail to write shares into the file '%s'!\n", shareContainerName.c_str());
+/*
+ * send the share file buffer, with the shares to send from the files at their positions 
+ * (the files are closed afterwards)
+ *
+ * @param socketFD - the socket
+ * @param shareFileBuffer - the share file buffer, which starts with the space of the message head
+ * @param shareFileBufferOffset - the size of the data in the share file buffer
+ * @param zeroCopyList - the shares to send from the files, in order of their positions <return>
+ *
+ * @return - a boolean value that indicates if the send op succeeds
+ */
+bool DedupCore::sendShareFileBuffer_(int socketFD, unsigned char *shareFileBuffer, const int &shareFileBufferOffset, 
+		std::vector<zeroCopyShare_t> &zeroCopyList) {
+	int sentMsgHeadSize = sizeof(uint32_t) * 2;
+	uint32_t indicator, sentDataSize;
+	long dataSize, bufferPos, sendSize;
+	ssize_t sentSize = 0;
+	off_t fileOffset;
+	int i;
 
-		fclose(fp);
-		return 0;	
-	}	
+	/*add the message head, which counts the shares to send from the files*/
+	dataSize = shareFileBufferOffset - sentMsgHeadSize;
+	for (i = 0; i < (int) zeroCopyList.size(); i++) {
+		dataSize += zeroCopyList[i].shareSize;
+	}
+	indicator = htonl(-5);
+	sentDataSize = htonl(dataSize);
+	memcpy(shareFileBuffer, &indicator, sizeof(uint32_t));
+	memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
+
+	/*send the buffer up to each share to send from a file, and then the share by sendfile*/
+	bufferPos = 0;
+	for (i = 0; i <= (int) zeroCopyList.size(); i++) {
+		sendSize = ((i < (int) zeroCopyList.size()) ? zeroCopyList[i].bufferOffset : shareFileBufferOffset) - bufferPos;
+		while (sendSize > 0) {
+			sentSize = send(socketFD, shareFileBuffer + bufferPos, sendSize, 
+					(i < (int) zeroCopyList.size()) ? MSG_MORE : 0);
+			if (sentSize <= 0) {
+				if ((sentSize < 0) && (errno == EINTR)) {
+					continue;
+				}
+				break;
+			}
+			bufferPos += sentSize;
+			sendSize -= sentSize;
+		}
 
-	/*renew the share container buffer*/
+		if ((sendSize == 0) && (i < (int) zeroCopyList.size())) {
+			fileOffset = zeroCopyList[i].fileOffset;
+			sendSize = zeroCopyList[i].shareSize;
+			while (sendSize > 0) {
+				sentSize = sendfile(socketFD, zeroCopyList[i].fileFD, &fileOffset, sendSize);
+				if (sentSize <= 0) {
+					if ((sentSize < 0) && (errno == EINTR)) {
+						continue;
+					}
+					break;
+				}
+				sendSize -= sentSize;
+			}
+		}
 
-	/*get the mutex lock globalShareContainerNameLock_*/
-	pthread_mutex_lock(&globalShareContainerNameLock_);
+		if (sendSize > 0) {
+			fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %ld bytes) \
+					through the socket %d --- return %ld!\n", dataSize + sentMsgHeadSize, socketFD, sentSize);
 
-	globalShareContainerName_.copy(targetBufferNode->shareContainerName, INTERNAL_FILE_NAME_SIZE-1, 0);
-	targetBufferNode->shareContainerName[INTERNAL_FILE_NAME_SIZE - 1] = '\0';
-	incrGlobalFileName_(globalShareContainerName_, shareContainerNameValidLen_);
+			closeZeroCopyShares_(zeroCopyList);
 
-	/*release the mutex lock globalShareContainerNameLock_*/
-	pthread_mutex_unlock(&globalShareContainerNameLock_);
+			return 0;
+		}
+	}
 
-	targetBufferNode->shareContainerBufferCurrLen = 0;
+	closeZeroCopyShares_(zeroCopyList);
 
-	fclose(fp);
 	return 1;
 }
 
 /*
- * read the recipe file from the buffer node link
- *
- * @param userID - the user id
- * @param recipeFileName - the name of the recipe file
- * @param recipeFileBuffer - the buffer for storing the recipe file <return>
+ * hand off the extents needed by a run of file recipe entries to the prefetch threads, grouped by 
+ * share container (the cached extents and the share containers that are not durable are skipped)
  *
- * @return - a boolean value that indicates if the read op succeeds
+ * @param recipeEntryBuffer - the buffer of the file recipe entries
+ * @param recipeEntrySize - the size of a file recipe entry (the old ones carry no share location)
+ * @param numOfEntries - the number of the file recipe entries
  */
-bool DedupCore::readRecipeFileFromBuffer_(const int &userID, char *recipeFileName, 
-		unsigned char *recipeFileBuffer) {	
-	perUserBufferNode_t *targetBufferNode;
-
-	/*get the mutex lock bufferLock_*/
-	pthread_mutex_lock(&bufferLock_);
+void DedupCore::prefetchShares_(unsigned char *recipeEntryBuffer, const int &recipeEntrySize, const int &numOfEntries) {
+	std::vector<std::pair<uint64_t, long> > extentList;
+	std::vector<std::string> keyList, valueList;
+	std::vector<leveldb::Status> statList;
+	fileRecipeEntry_t *pFileRecipeEntry;
+	const shareIndexValue_t *pShareIndexValue;
+	prefetchTask_t task;
+	char key[KEY_SIZE];
+	long extentID;
+	int i, j;
 
-	/*find the buffer node for this user*/
-	targetBufferNode = headBufferNode_;
-	while ((targetBufferNode != NULL) && (targetBufferNode->userID != userID)) {
-		targetBufferNode = targetBufferNode->next;
+	/*the share locations of old file recipe entries are looked up in the share index together*/
+	if (recipeEntrySize != fileRecipeEntrySize_) {
+		for (i = 0; i < numOfEntries; i++) {
+			pFileRecipeEntry = (fileRecipeEntry_t *) (recipeEntryBuffer + (long) recipeEntrySize * i);
+			shareFP2IndexKey_(pFileRecipeEntry->shareFP, key);
+			keyList.push_back(std::string(key, KEY_SIZE));
+		}
+		shareIndex_->multiGet(keyList, valueList, statList);
 	}
 
-	/*if find the buffer node, then check if the recipe file is stored in the buffer*/
-	if((targetBufferNode != NULL) && (strcmp(targetBufferNode->recipeFileName, recipeFileName) == 0)) {
-		/*get the data of the recipe file buffer*/
-		memcpy(recipeFileBuffer, targetBufferNode->recipeFileBuffer, 
-				targetBufferNode->recipeFileBufferCurrLen);
-
-		/*release the mutex lock bufferLock_*/
-		pthread_mutex_unlock(&bufferLock_);
+	/*list the extents covering the shares*/
+	for (i = 0; i < numOfEntries; i++) {
+		if (recipeEntrySize == fileRecipeEntrySize_) {
+			pFileRecipeEntry = (fileRecipeEntry_t *) (recipeEntryBuffer + (long) recipeEntrySize * i);
+			pShareIndexValue = &(pFileRecipeEntry->shareLocation);
+		}
+		else if (statList[i].ok() && (valueList[i].size() >= sizeof(shareIndexValue_t))) {
+			pShareIndexValue = (const shareIndexValue_t *) valueList[i].data();
+		}
+		else {
+			continue;
+		}
 
-		return 1;
+		/*a large share is sent from the file, and its extents are not cached*/
+		if ((pShareIndexValue->shareSize <= 0) || (pShareIndexValue->shareSize >= ZERO_COPY_MIN_SHARE_SIZE)) {
+			continue;
+		}
+		for (extentID = pShareIndexValue->shareContainerOffset / EXTENT_SIZE; 
+				extentID <= (pShareIndexValue->shareContainerOffset + pShareIndexValue->shareSize - 1) / EXTENT_SIZE; 
+				extentID++) {
+			extentList.push_back(std::make_pair(pShareIndexValue->shareContainerID, extentID));
+		}
 	}
-	else {
-		/*release the mutex lock bufferLock_*/
-		pthread_mutex_unlock(&bufferLock_);
+	std::sort(extentList.begin(), extentList.end());
+	extentList.erase(std::unique(extentList.begin(), extentList.end()), extentList.end());
+
+	/*group the uncached extents by share container, and queue a prefetch task for each share container*/
+	for (i = 0; i < (int) extentList.size(); i = j) {
+		task.shareContainerID = extentList[i].first;
+		task.extentIDList.clear();
+		for (j = i; (j < (int) extentList.size()) && (extentList[j].first == task.shareContainerID); j++) {
+			if (!extentCache_->contains(task.shareContainerID, extentList[j].second)) {
+				task.extentIDList.push_back(extentList[j].second);
+			}
+		}
 
-		return 0;
+		if (task.extentIDList.empty() || shareContainerIsPending_(task.shareContainerID)) {
+			continue;
+		}
+
+		pthread_mutex_lock(&prefetchLock_);
+		if ((int) prefetchTaskList_.size() < MAX_PENDING_PREFETCHES) {
+			prefetchTaskList_.push_back(task);
+			pthread_cond_signal(&prefetchCond_);
+		}
+		pthread_mutex_unlock(&prefetchLock_);
 	}
 }
 
 /*
- * read the share container from the buffer node link
- *
- * @param shareContainerName - the name of the share container
- * @param shareContainerBuffer - the buffer for storing the share container <return>
+ * the main procedure of a prefetch thread
  *
- * @return - a boolean value that indicates if the read op succeeds
+ * @param param - the DedupCore instance
  */
-bool DedupCore::readShareContainerFromBuffer_(char *shareContainerName, 
-		unsigned char *shareContainerBuffer) {	
-	perUserBufferNode_t *targetBufferNode;
-
-	pthread_mutex_lock(&bufferLock_);
-
-	/*find the buffer node that contains the share container*/
-	targetBufferNode = headBufferNode_;
-	while ((targetBufferNode != NULL) && (strcmp(targetBufferNode->shareContainerName, shareContainerName) != 0)) {
-		targetBufferNode = targetBufferNode->next;
+void *DedupCore::prefetchHandler_(void *param) {
+	DedupCore *obj = (DedupCore *) param;
+	containerSource_t *source;
+	prefetchTask_t task;
+	int readSize;
+
+	source = (containerSource_t *) malloc(sizeof(containerSource_t));
+	source->containerFilePointer = NULL;
+
+	while (true) {
+		pthread_mutex_lock(&(obj->prefetchLock_));
+		while (obj->prefetchTaskList_.empty() && !obj->prefetchStopStat_) {
+			/*do not keep a share container file open while idle*/
+			if (source->containerFilePointer != NULL) {
+				pthread_mutex_unlock(&(obj->prefetchLock_));
+				obj->closeShareContainer_(source);
+				pthread_mutex_lock(&(obj->prefetchLock_));
+				continue;
+			}
+			pthread_cond_wait(&(obj->prefetchCond_), &(obj->prefetchLock_));
+		}
+		if (obj->prefetchStopStat_) {
+			pthread_mutex_unlock(&(obj->prefetchLock_));
+			break;
+		}
+		task = obj->prefetchTaskList_.front();
+		obj->prefetchTaskList_.pop_front();
+		pthread_mutex_unlock(&(obj->prefetchLock_));
+
+		/*read the extents in order (the restore reads an extent itself if its prefetch fails)*/
+		for (int i = 0; i < (int) task.extentIDList.size(); i++) {
+			if (obj->extentCache_->contains(task.shareContainerID, task.extentIDList[i])) {
+				continue;
+			}
+			if (!obj->readExtent_(task.shareContainerID, task.extentIDList[i], source, readSize)) {
+				break;
+			}
+		}
 	}
 
-	/*if find the buffer node, then get the data of the share container buffer*/
-	if(targetBufferNode != NULL) {
-		memcpy(shareContainerBuffer, targetBufferNode->shareContainerBuffer, 
-				targetBufferNode->shareContainerBufferCurrLen);
-
-		pthread_mutex_unlock(&bufferLock_);
-
-		return 1;
-	}
-	else {
-		pthread_mutex_unlock(&bufferLock_);
+	obj->closeShareContainer_(source);
+	free(source);
 
-		return 0;
-	}
+	return NULL;
 }
 
 /*
@@ -1802,12 +3524,15 @@ bool DedupCore::firstStageDedup(const int &userID, unsigned char *shareMDBuffer,
 		bool *intraUserDupStatList, int &numOfShares, int &sentShareDataSize) {
 	fileShareMDHead_t *pFileShareMDHead;
 	shareMDEntry_t *pShareMDEntry;
+	std::vector<shareBatchEntry_t> shareList;
+	shareBatchEntry_t shareEntry;
 	int shareMDBufferOffset = 0;	
 	int i;
 
 	numOfShares = 0;
 	sentShareDataSize = 0;
 
+	/*collect the shares of the whole metadata buffer*/
 	while (shareMDBufferOffset < shareMDSize) {
 		/*read the file share metadata head*/
 		pFileShareMDHead = (fileShareMDHead_t *) (shareMDBuffer + shareMDBufferOffset);
@@ -1816,26 +3541,33 @@ bool DedupCore::firstStageDedup(const int &userID, unsigned char *shareMDBuffer,
 		/*skip the file name*/
 		shareMDBufferOffset += pFileShareMDHead->fullNameSize;
 
-		/*check each of the subsequent shares*/
 		for (i = 0; i < pFileShareMDHead->numOfComingSecrets; i++) {
 			/*read the share metadata entry*/
 			pShareMDEntry = (shareMDEntry_t *) (shareMDBuffer + shareMDBufferOffset);
 			shareMDBufferOffset += shareMDEntrySize_;
 
-			/*check the intra-user duplicate status*/
-			if (!intraUserIndexUpdate_(pShareMDEntry->shareFP, userID, intraUserDupStatList[numOfShares])) {
-				fprintf(stderr, "Error: fail to update the share index for intra-user duplication in the database!\n");
-
-				return 0;
-			}
-			if (intraUserDupStatList[numOfShares] == 0) {
-				sentShareDataSize += pShareMDEntry->shareSize;
-			}
+			shareEntry.shareFP = pShareMDEntry->shareFP;
+			shareEntry.index = numOfShares;
+			shareEntry.shareSize = pShareMDEntry->shareSize;
+			shareList.push_back(shareEntry);
 
 			numOfShares++;					
 		}		
 	}
 
+	/*check the intra-user duplicate status of all shares in one pass*/
+	if (!intraUserIndexUpdate_(shareList, userID, intraUserDupStatList)) {
+		fprintf(stderr, "Error: fail to update the share index for intra-user duplication in the database!\n");
+
+		return 0;
+	}
+
+	for (i = 0; i < numOfShares; i++) {
+		if (intraUserDupStatList[shareList[i].index] == 0) {
+			sentShareDataSize += shareList[i].shareSize;
+		}
+	}
+
 	return 1;
 }
 
@@ -1860,22 +3592,102 @@ bool DedupCore::secondStageDedup(const int &userID, unsigned char *shareMDBuffer
 	fileRecipeHead_t *pFileRecipeHead;
 	fileRecipeEntry_t *pFileRecipeEntry;
 	std::string fullFileName;
-	char shareFP[FP_SIZE];
+	int inconsistentPos;
 	int shareMDBufferOffset = 0, shareDataBufferOffset = 0;	
 	int recipeFileBufferAddedLen;
-	std::string recipeFileName;
+	std::vector<shareBatchEntry_t> shareList, dupShareList;
+	std::vector<shareIndexValue_t> shareLocationList;
+	std::vector<newFileEntry_t> newFileList;
+	newFileEntry_t newFile;
+	shareBatchEntry_t shareEntry;
 	int numOfShares = 0;
-	int i;
+	int i, k;
+
+	if (cryptoObj == NULL) {		
+		fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");					
+		return 0;	
+	}
+
+	/*verify and collect the non-duplicate shares of the whole metadata buffer before changing anything*/
+	while (shareMDBufferOffset < shareMDSize) {
+		/*read the file share metadata head, and skip the file name*/
+		pFileShareMDHead = (fileShareMDHead_t *) (shareMDBuffer + shareMDBufferOffset);
+		shareMDBufferOffset += fileShareMDHeadSize_ + pFileShareMDHead->fullNameSize;		
+
+		for (i = 0; i < pFileShareMDHead->numOfComingSecrets; i++) {
+			/*read the share metadata entry*/
+			pShareMDEntry = (shareMDEntry_t *) (shareMDBuffer + shareMDBufferOffset);
+			shareMDBufferOffset += shareMDEntrySize_;
+
+			/*if the share is not a duplicate in intra-user deduplication, further perform inter-user deduplication on it*/
+			if (intraUserDupStatList[numOfShares] != 1) {
+				shareEntry.shareFP = pShareMDEntry->shareFP;
+				shareEntry.index = numOfShares;
+				shareEntry.shareSize = pShareMDEntry->shareSize;
+				shareEntry.shareDataBufferOffset = shareDataBufferOffset;
+				shareList.push_back(shareEntry);
+
+				shareDataBufferOffset += pShareMDEntry->shareSize;
+			}
+			/*otherwise, the share already exists and only its location is needed*/
+			else {
+				shareEntry.shareFP = pShareMDEntry->shareFP;
+				shareEntry.index = numOfShares;
+				dupShareList.push_back(shareEntry);
+			}
+
+			numOfShares++;
+		}
+	}
 
-	if (cryptoObj == NULL) {		
-		fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");					
-		return 0;	
+	/*generate the hash fingerprints of the non-duplicate shares in parallel, and check if the generated ones 
+	  are consistent with the received ones*/
+	inconsistentPos = verifyShareBatch_(shareList, shareDataBuffer, cryptoObj);
+	if (inconsistentPos >= 0) {
+		fprintf(stderr, "Error: the %d-th share and its fingerprint sent by userID '%d' are inconsistent!\n", 
+				shareList[inconsistentPos].index, userID);
+
+		return 0;
 	}
 
 	/*find the corresponding buffer node for the user*/
 	targetBufferNode = NULL;
-	findOrCreateBufferNode_(userID, targetBufferNode);	
+	if (!findOrCreateBufferNode_(userID, targetBufferNode)) {
+		fprintf(stderr, "Error: fail to find or create the buffer node of userID '%d'!\n", userID);
+
+		return 0;
+	}
+
+	/*update the share index for all non-duplicate shares in one pass*/
+	if (!interUserIndexUpdate_(shareList, userID, targetBufferNode, shareDataBuffer)) {
+		fprintf(stderr, "Error: fail to update the share index for inter-user duplication in the database!\n");
+		releaseBufferNode_(targetBufferNode);
+
+		return 0;
+	}
+
+	/*collect the location of every share for its file recipe entry*/
+	if (!locateShareBatch_(dupShareList)) {
+		fprintf(stderr, "Error: fail to locate the duplicate shares in the database!\n");
+		releaseBufferNode_(targetBufferNode);
+
+		return 0;
+	}
+
+	shareLocationList.resize(numOfShares);
+	for (i = 0; i < (int) shareList.size(); i += shareList[i].numOfRefs) {
+		for (k = i; k < i + shareList[i].numOfRefs; k++) {
+			shareLocationList[shareList[k].index] = shareList[i].shareIndexValue;
+		}
+	}
+	for (i = 0; i < (int) dupShareList.size(); i += dupShareList[i].numOfRefs) {
+		for (k = i; k < i + dupShareList[i].numOfRefs; k++) {
+			shareLocationList[dupShareList[k].index] = dupShareList[i].shareIndexValue;
+		}
+	}
 
+	numOfShares = 0;
+	shareMDBufferOffset = 0;
 	while (shareMDBufferOffset < shareMDSize) {
 		/*1. read the file share metadata head and file name*/
 
@@ -1889,6 +3701,7 @@ bool DedupCore::secondStageDedup(const int &userID, unsigned char *shareMDBuffer
 		/*format fullFileName before using it*/
 		if (!formatFullFileName_(fullFileName)) {
 			fprintf(stderr, "Error: encounter an invalid fullFileName!\n");
+			releaseBufferNode_(targetBufferNode);
 
 			return 0;
 		}	
@@ -1923,39 +3736,48 @@ bool DedupCore::secondStageDedup(const int &userID, unsigned char *shareMDBuffer
 			  (b) the first recipe entry has been stored in a previous recipe file*/
 			if ((targetBufferNode->lastRecipeHeadPos == 0) && 
 					(pFileShareMDHead->numOfPastSecrets > pFileRecipeHead->numOfShares)) {
-				/*since pFileShareMDHead->numOfPastSecrets > 0, the coming shares are for the same fullFileName*/
-				if (!appendOldRecipeFile_(targetBufferNode, recipeFileName)) {
+				/*since pFileShareMDHead->numOfPastSecrets > 0, the coming shares are for the same fullFileName, 
+				  whose inode (if it is a new file of this metadata buffer) is added first for finding its recipe file*/
+				if (!addNewFilesIntoInodeIndex_(newFileList, userID, cryptoObj)) {
+					releaseBufferNode_(targetBufferNode);
+
+					return 0;
+				}
+
+				if (!appendOldRecipeFile_(targetBufferNode, 0)) {
 					fprintf(stderr, "Error: fail to append the data of the recipe file buffer to a previous recipe file!\n");
+					releaseBufferNode_(targetBufferNode);
 
 					return 0;
 				}
 			}
+			/*(if a new file starts, then the previous file has been finished)*/
 			else {
-				if (!storeNewRecipeFile_(targetBufferNode, recipeFileName)) {
+				if (!storeNewRecipeFile_(targetBufferNode, pFileShareMDHead->numOfPastSecrets == 0)) {
 					fprintf(stderr, "Error: fail to store the data of the recipe file buffer into a new recipe file!\n");
+					releaseBufferNode_(targetBufferNode);
 
 					return 0;
 				}
 			}
-
-			/*if a new file starts, then the previous file has been finished*/
-			if (pFileShareMDHead->numOfPastSecrets == 0) {
-				if (recipeStorerObj_ != NULL) {
-					recipeStorerObj_->addNewFile(recipeFileName);
-				}
-			}
 		}
 
 		/*3. store the file recipe head, or update a previous one in the recipe file buffer*/
 
 		/*if this is a new file*/
 		if (pFileShareMDHead->numOfPastSecrets == 0) { 				
-			if (!addFileIntoInodeIndex_(fullFileName, userID, targetBufferNode, cryptoObj)) {
-				fprintf(stderr, "Error: fail to add an inode for fullFileName '%s' with userID '%d' in the database!\n", 
-						fullFileName.c_str(), userID);
-
-				return 0;
-			}			
+			/*keep the recipe file information of the file for its inode*/
+			newFile.fullFileName = fullFileName;
+			strcpy(newFile.inodeFileEntry.recipeFileName, targetBufferNode->recipeFileName);
+			newFile.inodeFileEntry.recipeFileOffset = targetBufferNode->recipeFileBufferCurrLen;
+
+			/*start the offset index of the file at the location of its file recipe*/
+			memcpy(targetBufferNode->currRecipeFileName, targetBufferNode->recipeFileName, INTERNAL_FILE_NAME_SIZE);
+			targetBufferNode->currRecipeFileOffset = targetBufferNode->recipeFileBufferCurrLen;
+			targetBufferNode->currFileNumOfShares = 0;
+			targetBufferNode->currFileSize = 0;
+			targetBufferNode->offsetIndexInterval = MIN_OFFSET_INDEX_INTERVAL;
+			targetBufferNode->numOfOffsetCheckpoints = 0;
 
 			/*put the file recipe head into recipeFileBuffer*/
 			pFileRecipeHead = (fileRecipeHead_t *) (targetBufferNode->recipeFileBuffer + 
@@ -1968,6 +3790,9 @@ bool DedupCore::secondStageDedup(const int &userID, unsigned char *shareMDBuffer
 			targetBufferNode->lastRecipeHeadPos = targetBufferNode->recipeFileBufferCurrLen;	
 			targetBufferNode->recipeFileBufferCurrLen += fileRecipeHeadSize_;			
 			fileName2InodeFP_(fullFileName, userID, targetBufferNode->lastInodeFP, cryptoObj);				
+
+			memcpy(newFile.inodeFP, targetBufferNode->lastInodeFP, FP_SIZE);
+			newFileList.push_back(newFile);
 		}
 		/*if this is the remain of a previous file*/
 		else {
@@ -2002,94 +3827,130 @@ bool DedupCore::secondStageDedup(const int &userID, unsigned char *shareMDBuffer
 			pShareMDEntry = (shareMDEntry_t *) (shareMDBuffer + shareMDBufferOffset);
 			shareMDBufferOffset += shareMDEntrySize_;
 
-			/*if the share is not a duplicate in intra-user deduplication, further perform inter-user deduplication on it*/
-			if (intraUserDupStatList[numOfShares] != 1) {
-				/*generate a hash fingerprint from the share and check if the generated one is consistent with the received one*/
-				cryptoObj->generateHash(shareDataBuffer + shareDataBufferOffset, pShareMDEntry->shareSize, 
-						(unsigned char *) shareFP);
-				if (memcmp(pShareMDEntry->shareFP, shareFP, FP_SIZE) != 0) {
-					fprintf(stderr, "Error: the %d-th share and its fingerprint sent by userID '%d' are inconsistent!\n", i, userID);
-
-					return 0;
-				}
-
-				if (!interUserIndexUpdate_(shareFP, userID, pShareMDEntry->shareSize, targetBufferNode, shareDataBuffer, 
-							shareDataBufferOffset)) {
-					fprintf(stderr, "Error: fail to update the share index for inter-user duplication in the database!\n");
-
-					return 0;
-				}
-
-				shareDataBufferOffset += pShareMDEntry->shareSize;
-			}
-
 			/*put the file recipe entry into recipeFileBuffer*/
 			pFileRecipeEntry = (fileRecipeEntry_t *) (targetBufferNode->recipeFileBuffer + 
 					targetBufferNode->recipeFileBufferCurrLen);
 			memcpy(pFileRecipeEntry->shareFP, pShareMDEntry->shareFP, FP_SIZE);
 			pFileRecipeEntry->secretID = pShareMDEntry->secretID;
 			pFileRecipeEntry->secretSize = pShareMDEntry->secretSize;
+			pFileRecipeEntry->shareLocation = shareLocationList[numOfShares];
+			numOfShares++;
 
 			/*update the info of targetBufferNode*/
 			targetBufferNode->recipeFileBufferCurrLen += fileRecipeEntrySize_;
-
-			numOfShares++;					
+			addOffsetCheckpoint_(targetBufferNode, pShareMDEntry->secretSize);
 		}
+	}
 
-		/*5. if a partial file ends here, append its recipe entries to a previous recipe file*/
+	/*add the inodes of all new files of the metadata buffer*/
+	if (!addNewFilesIntoInodeIndex_(newFileList, userID, cryptoObj)) {
+		releaseBufferNode_(targetBufferNode);
 
-		/*if the file ends here*/
-		if (pFileShareMDHead->sizeOfPastSecrets + pFileShareMDHead->sizeOfComingSecrets == 
-				pFileShareMDHead->fileSize) {
-			/*if (a) the file recipe head is at the beginning of the buffer and 
-			  (b) the first recipe entry has been stored in a previous recipe file*/
-			if ((targetBufferNode->lastRecipeHeadPos == 0) && 
-					(pFileShareMDHead->numOfPastSecrets > pFileRecipeHead->numOfShares)) {
-				if (!appendOldRecipeFile_(targetBufferNode, recipeFileName)) {
-					fprintf(stderr, "Error: fail to append the data of the recipe file buffer to a previous recipe file!\n");
+		return 0;
+	}
 
-					return 0;
-				}
+	releaseBufferNode_(targetBufferNode);
 
-				if (recipeStorerObj_ != NULL) {
-					recipeStorerObj_->addNewFile(recipeFileName);
-				}
-			}
-			else {
-				/*do nothing*/
-			}
+	return 1;
+}
+
+/*
+ * finish a file with its trailer, which commits the final file size and 
+ * appends the remain of a partial file to a previous recipe file
+ *
+ * @param userID - the user id 
+ * @param trailerBuffer - the buffer that stores the file share metadata trailer
+ * @param trailerSize - the size of the trailer buffer
+ *
+ * @return - a boolean value that indicates if the finish op succeeds
+ */
+bool DedupCore::finishFileWithTrailer(const int &userID, unsigned char *trailerBuffer, const int &trailerSize) {
+	perUserBufferNode_t *targetBufferNode;
+	fileShareMDTrailer_t *pFileShareMDTrailer;
+	fileRecipeHead_t *pFileRecipeHead;
+
+	if (trailerSize != fileShareMDTrailerSize_) {
+		fprintf(stderr, "Error: receive a file trailer of invalid size %d from userID '%d'!\n", trailerSize, userID);
+		return 0;
+	}
+	pFileShareMDTrailer = (fileShareMDTrailer_t *) trailerBuffer;
+
+	/*find the corresponding buffer node for the user*/
+	targetBufferNode = NULL;
+	if (!findOrCreateBufferNode_(userID, targetBufferNode)) {
+		fprintf(stderr, "Error: fail to find or create the buffer node of userID '%d'!\n", userID);
+
+		return 0;
+	}
+
+	/*the last shares of the file must be in the recipe file buffer*/
+	if (targetBufferNode->recipeFileBufferCurrLen == 0) {
+		fprintf(stderr, "Error: no file recipe in the buffer of userID '%d' for the file trailer!\n", userID);
+		releaseBufferNode_(targetBufferNode);
+
+		return 0;
+	}
+
+	/*commit the final file size into the file recipe head*/
+	pFileRecipeHead = (fileRecipeHead_t *) (targetBufferNode->recipeFileBuffer + targetBufferNode->lastRecipeHeadPos);
+	pFileRecipeHead->fileSize = pFileShareMDTrailer->fileSize;
+
+	/*store the offset index if all recipe entries of the file have been tracked 
+	  (otherwise, a range restore of the file scans its recipe from the beginning)*/
+	if ((targetBufferNode->currRecipeFileName[0] != '\0') && 
+			(targetBufferNode->currFileNumOfShares == pFileShareMDTrailer->numOfSecrets)) {
+		if (!storeOffsetIndex_(targetBufferNode)) {
+			fprintf(stderr, "Warning: fail to store the offset index for userID '%d'!\n", userID);
 		}
+	}
+	targetBufferNode->currRecipeFileName[0] = '\0';
 
+	/*if (a) the file recipe head is at the beginning of the buffer and 
+	  (b) the first recipe entry has been stored in a previous recipe file*/
+	if ((targetBufferNode->lastRecipeHeadPos == 0) && 
+			(pFileShareMDTrailer->numOfSecrets > pFileRecipeHead->numOfShares)) {
+		if (!appendOldRecipeFile_(targetBufferNode, 1)) {
+			fprintf(stderr, "Error: fail to append the data of the recipe file buffer to a previous recipe file!\n");
+			releaseBufferNode_(targetBufferNode);
+
+			return 0;
+		}
 	}
 
+	releaseBufferNode_(targetBufferNode);
+
 	return 1;
 }
 
 /*
- * clean up the buffer node for a user in the buffer node link
+ * clean up the buffer node for a user in the buffer node pool
  *
  * @param userID - the user id
  *
  * @return - a boolean value that indicates if the clean-up op succeeds
  */
 bool DedupCore::cleanupUserBufferNode(const int &userID) {	
-	perUserBufferNode_t *targetBufferNode, *preBufferNode;
+	boost::unordered_map<int, perUserBufferNode_t *>::iterator it;
+	perUserBufferNode_t *targetBufferNode;
 
 	/*get the mutex lock bufferLock_*/
 	pthread_mutex_lock(&bufferLock_);
 
-	/*find the buffer node for this user*/
-	targetBufferNode = headBufferNode_;
-	preBufferNode =NULL;
-	while ((targetBufferNode != NULL) && (targetBufferNode->userID != userID)) {
-		preBufferNode = targetBufferNode;
-		targetBufferNode = targetBufferNode->next;
+	/*find the buffer node for this user, once no thread uses it (or after it is retired by the flusher)*/
+	it = bufferNodeMap_.find(userID);
+	while ((it != bufferNodeMap_.end()) && (it->second->retireStat || (it->second->numOfUsers > 0))) {
+		pthread_cond_wait(&bufferCond_, &bufferLock_);
+		it = bufferNodeMap_.find(userID);
 	}
 
-	if (targetBufferNode != NULL) {
-		/* flush the buffer node into the disk*/
-		if (!flushBufferNodeIntoDisk_(targetBufferNode)) {
-			fprintf(stderr, "Error: fail to flush the buffer node for userID '%d' into the disk!\n", targetBufferNode->userID);
+	if (it != bufferNodeMap_.end()) {
+		targetBufferNode = it->second;
+
+		/*delete the buffer node from the pool after flushing it into the disk*/
+		unlinkBufferNode_(targetBufferNode);
+		targetBufferNode->retireStat = 1;
+		if (!retireBufferNode_(targetBufferNode)) {
+			fprintf(stderr, "Error: fail to flush the buffer node for userID '%d' into the disk!\n", userID);
 
 			/*release the mutex lock bufferLock_*/
 			pthread_mutex_unlock(&bufferLock_);
@@ -2097,32 +3958,13 @@ bool DedupCore::cleanupUserBufferNode(const int &userID) {
 			return 0;
 		}
 
-		/*delete the buffer node from the link and then free it*/
-		if (targetBufferNode == headBufferNode_) {
-			headBufferNode_ = targetBufferNode->next;
-			free(targetBufferNode);
-
-			if (headBufferNode_ == tailBufferNode_) {
-				/*the only buffer node is deleted*/
-				tailBufferNode_ = NULL;
-			}		
-		}
-		else {
-			if (targetBufferNode == tailBufferNode_) {
-				tailBufferNode_ = preBufferNode;
-			}
-
-			preBufferNode->next = targetBufferNode->next;
-			free(targetBufferNode);
-		}
-
 		/*release the mutex lock bufferLock_*/
 		pthread_mutex_unlock(&bufferLock_);
 
 		return 1;
 	}
 	else {
-		fprintf(stderr, "Error: cannot find the buffer node for userID '%d'!\n", targetBufferNode->userID);
+		fprintf(stderr, "Error: cannot find the buffer node for userID '%d'!\n", userID);
 
 		/*release the mutex lock bufferLock_*/
 		pthread_mutex_unlock(&bufferLock_);
@@ -2132,35 +3974,42 @@ bool DedupCore::cleanupUserBufferNode(const int &userID) {
 }
 
 /*
- * clean up the buffer nodes for all users in the buffer node link
+ * clean up the buffer nodes for all users in the buffer node pool
  *
  * @return - a boolean value that indicates if the clean-up op succeeds
  */
 bool DedupCore::cleanupAllBufferNodes() {	
-	perUserBufferNode_t *currBufferNode, *nextBufferNode;
+	perUserBufferNode_t *targetBufferNode;
+	bool cleanupStat = 1;
+	int userID;
 
-	/*free the file recipe pool*/
-	if (headBufferNode_ != NULL) {
-		/*get the mutex lock bufferLock_*/
-		pthread_mutex_lock(&bufferLock_);
+	/*get the mutex lock bufferLock_*/
+	pthread_mutex_lock(&bufferLock_);
 
-		currBufferNode = headBufferNode_;
-		while (currBufferNode != NULL){			
-			/* flush the buffer node into the disk*/
-			if (!flushBufferNodeIntoDisk_(currBufferNode)) {
-				fprintf(stderr, "Error: fail to flush the buffer node for userID '%d' into the disk!\n", 
-						currBufferNode->userID);
+	/*flush and free the buffer nodes one by one, once no thread uses them (or after they are retired by the flusher)*/
+	while (!bufferNodeMap_.empty()) {
+		targetBufferNode = bufferNodeMap_.begin()->second;
+		userID = targetBufferNode->userID;
 
-				return 0;
-			}
+		if (targetBufferNode->retireStat || (targetBufferNode->numOfUsers > 0)) {
+			pthread_cond_wait(&bufferCond_, &bufferLock_);
+			continue;
+		}
 
-			nextBufferNode = currBufferNode->next;
-			free(currBufferNode);			
-			currBufferNode = nextBufferNode;
-		}	
+		unlinkBufferNode_(targetBufferNode);
+		targetBufferNode->retireStat = 1;
+		if (!retireBufferNode_(targetBufferNode)) {
+			fprintf(stderr, "Error: fail to flush the buffer node for userID '%d' into the disk!\n", userID);
 
-		/*release the mutex lock bufferLock_*/
-		pthread_mutex_unlock(&bufferLock_);
+			cleanupStat = 0;
+		}
+	}	
+
+	/*release the mutex lock bufferLock_*/
+	pthread_mutex_unlock(&bufferLock_);
+
+	if (!cleanupStat) {
+		return 0;
 	}
 
 	/*ensure that all container files are committed to disk*/
@@ -2170,44 +4019,84 @@ bool DedupCore::cleanupAllBufferNodes() {
 }
 
 /*
- * restore a share file for a user and send it through the socket
+ * wait for the container writer, and save the index cache for the next start of the server
+ * (the share index is frozen from then on, so that the snapshot stays complete until the server exits)
+ *
+ * @return - a boolean value that indicates if the save op succeeds
+ */
+bool DedupCore::saveIndexCache() {
+	bool stripeList[NUM_INDEX_LOCK_STRIPES];
+
+	/*wait for the share containers handed off to the container writers (a failed writer leaves 
+	  its index entries uncommitted, so the snapshot would not match the share index)*/
+	for (int i = 0; i < (int) containerWriters_.size(); i++) {
+		if (!containerWriters_[i]->flush()) {
+			fprintf(stderr, "Error: fail to write the share containers of device %d!\n", i);
+
+			return 0;
+		}
+	}
+
+	/*wait for the ongoing share index updates, and block the coming ones*/
+	memset(stripeList, 1, sizeof(stripeList));
+	lockIndexStripes_(stripeList);
+
+	if (!shareIndex_->checkpoint()) {
+		fprintf(stderr, "Error: fail to checkpoint the share index!\n");
+
+		return 0;
+	}
+
+	indexCache_->printStat();
+	extentCache_->printStat();
+	if (!indexCache_->saveSnapshot(indexCacheFileName_)) {
+		fprintf(stderr, "Error: fail to save the index cache into '%s'!\n", indexCacheFileName_.c_str());
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * restore a share file (or the shares covering a byte range of it) for a user and send it through the socket
  *
  * @param userID - the user id
  * @param fullFileName - the full name of the original file 
  * @param versionNumber - the version number (<=0) of the original file 
  * @param socketFD - the file descriptor of the sending socket
  * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
+ * @param rangeOffset - the offset of the range to restore
+ * @param rangeLength - the length of the range to restore, or RANGE_TO_END
  *
  * @return - a boolean value that indicates if the restore op succeeds
  */
 bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileName, const int &versionNumber, 
-		int socketFD, CryptoPrimitive *cryptoObj) {
+		int socketFD, CryptoPrimitive *cryptoObj, const long &rangeOffset, const long &rangeLength) {
 	leveldb::Status inodeStat, shareStat;
 	std::string formatedFullFileName;
 	char FP[FP_SIZE];		
 	char key[KEY_SIZE];
 	leveldb::Slice *inodeKeySlice, *shareKeySlice;
 	std::string valueString;
-	int valueOffset;
 	bool recipeFileIsInBuffer;
 	unsigned char *recipeFileBuffer, *shareFileBuffer;
 	int recipeFileBufferOffset, recipeFileBufferTailLen, shareFileBufferOffset;
-	shareContainerCacheNode_t *shareContainerCache;
-	int *shareContainerCacheIndex, numOfCachedShareContainers;
-	FILE *recipeFilePointer, *containerFilePointer;
-	std::string fullRecipeFileName, fullShareContainerName;
-	int numOfShares;
-	inodeIndexValueHead_t *pInodeIndexValueHead;
-	inodeFileEntry_t *pInodeFileEntry;
-	shareIndexValueHead_t *pShareIndexValueHead;
+	containerSource_t *containerSource;
+	std::vector<zeroCopyShare_t> zeroCopyList;
+	zeroCopyShare_t zeroCopyShare;
+	int zeroCopySize;
+	FILE *recipeFilePointer;
+	std::string fullRecipeFileName;
+	int numOfShares, startEntry, recipeEntrySize, numOfVersions;
+	int nextPrefetchEntry, numOfPrefetchEntries;
+	inodeFileEntry_t inodeFileEntry, *pInodeFileEntry;
+	shareIndexValue_t *pShareIndexValue;
 	fileRecipeHead_t *pFileRecipeHead;
 	fileRecipeEntry_t *pFileRecipeEntry;
 	shareFileHead_t *pShareFileHead;
 	shareEntry_t *pShareEntry;	
-	ssize_t sentSize;	
-	uint32_t indicator;
-	uint32_t sentDataSize;
-	int i, j, k;
+	int i;
 
 	if (cryptoObj == NULL) {		
 		fprintf(stderr, "Error: no CryptoPrimitive instance for calculating hash fingerprint!\n");					
@@ -2227,14 +4116,18 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 	inodeFP2IndexKey_(FP, key);
 	inodeKeySlice = new leveldb::Slice(key, KEY_SIZE);
 
-	/*get the mutex lock DBLock_*/
-	pthread_mutex_lock(&DBLock_);
+	/*read the inode file entry of the version in the database*/
+	inodeStat = getInodeFileEntry_(FP, versionNumber, inodeFileEntry, numOfVersions);
+	pInodeFileEntry = &inodeFileEntry;
 
-	/*enquire the key in the database*/
-	inodeStat = db_->Get(readOptions_, *inodeKeySlice, &valueString);
+	/*check the validity of the version number*/
+	if (inodeStat.ok() && ((versionNumber > 0) || ((-versionNumber) >= numOfVersions))) {
+		fprintf(stderr, "Error: no such an old version exists for the version number %d!\n", versionNumber);
+
+		delete inodeKeySlice;
 
-	/*release the mutex lock DBLock_*/
-	pthread_mutex_unlock(&DBLock_);
+		return 0;	
+	}
 
 	/*if such an inode for fullFileName exists*/
 	if (inodeStat.ok()) {	
@@ -2245,36 +4138,11 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 		/*allocate some caches and buffers for accelerating file restoring speed*/
 		recipeFileBuffer = (unsigned char *) malloc(sizeof(unsigned char) * RECIPE_BUFFER_SIZE);
 		shareFileBuffer = (unsigned char *) malloc(sentShareFileBufferSize);
-		shareContainerCache = (shareContainerCacheNode_t *) malloc(sizeof(shareContainerCacheNode_t) * NUM_OF_CACHED_CONTAINERS);
-		shareContainerCacheIndex = (int *) malloc(sizeof(int) * NUM_OF_CACHED_CONTAINERS); 
-		numOfCachedShareContainers = 0;
-
-		/*read the inode head*/
-		valueOffset = 0;	
-		pInodeIndexValueHead = (inodeIndexValueHead_t *) (valueString.data() + valueOffset);
-		valueOffset += inodeIndexValueHeadSize_;
-
-		/*check the validity of the version number*/
-		if ((-versionNumber) >= pInodeIndexValueHead->numOfChildren) {
-			fprintf(stderr, "Error: no such an old version exists for the version number %d!\n", versionNumber);
-
-			free(recipeFileBuffer);
-			free(shareFileBuffer);
-			free(shareContainerCache);
-			free(shareContainerCacheIndex); 
-
-			delete inodeKeySlice;
-
-			return 0;	
-		}	
-
-		/*skip the name*/
-		valueOffset += pInodeIndexValueHead->shortNameSize;
+		containerSource = (containerSource_t *) malloc(sizeof(containerSource_t));
+		containerSource->containerFilePointer = NULL;
 
-		/*read the inode file entry*/		
-		valueOffset += (inodeFileEntrySize_ * (-versionNumber));
-		pInodeFileEntry = (inodeFileEntry_t *) (valueString.data() + valueOffset);
-		valueOffset += inodeFileEntrySize_;
+		/*the entries of an old recipe file do not carry the share locations, which are then looked up in the share index*/
+		recipeEntrySize = fileRecipeEntrySizeOf_(pInodeFileEntry->recipeFileName);
 
 		/*first read recipe file from the buffer; if it is not in the buffer, then read it from the disk*/
 		if (!(recipeFileIsInBuffer = readRecipeFileFromBuffer_(userID, pInodeFileEntry->recipeFileName, recipeFileBuffer))) {
@@ -2286,8 +4154,24 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
+
+				delete inodeKeySlice;
+
+				return 0;	
+			}
+
+			/*the recipes handed off to the recipe writer are read once they are stored*/
+			if (!containerWriters_[0]->waitForRecipeFile(fullRecipeFileName)) {
+				fprintf(stderr, "Error: the recipes in the file '%s' are not stored!\n", fullRecipeFileName.c_str());
+
+				free(recipeFileBuffer);
+				free(shareFileBuffer);
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 
@@ -2306,8 +4190,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 
@@ -2323,8 +4208,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 
@@ -2342,20 +4228,73 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 		pShareFileHead = (shareFileHead_t *) (shareFileBuffer + shareFileBufferOffset);
 		pShareFileHead->fileSize = pFileRecipeHead->fileSize;
 		pShareFileHead->numOfShares = pFileRecipeHead->numOfShares;
+		pShareFileHead->firstSecretOffset = 0;
 		shareFileBufferOffset += shareFileHeadSize_;
+		zeroCopySize = 0;
+
+		/*for a range restore, only send the shares covering the range*/
+		if ((rangeOffset != 0) || (rangeLength != RANGE_TO_END)) {
+			if (!locateRange_(pInodeFileEntry, recipeFileIsInBuffer ? NULL : recipeFilePointer, recipeFileBuffer, 
+						recipeEntrySize, pFileRecipeHead->numOfShares, rangeOffset, rangeLength, 
+						startEntry, pShareFileHead->numOfShares, pShareFileHead->firstSecretOffset)) {
+				fprintf(stderr, "Error: fail to locate the range of the file '%s'!\n", formatedFullFileName.c_str());
+
+				if (!recipeFileIsInBuffer) {
+					fclose(recipeFilePointer);
+				}
+
+				free(recipeFileBuffer);
+				free(shareFileBuffer);
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
+
+				delete inodeKeySlice;
+
+				return 0;	
+			}
+
+			/*move to the first covering file recipe entry*/
+			long recipeEntryPos = recipeFileBufferOffset + (long) recipeEntrySize * startEntry;
+			if (recipeFileIsInBuffer) {
+				recipeFileBufferOffset = recipeEntryPos;
+			}
+			else if (pShareFileHead->numOfShares > 0) {
+				fseek(recipeFilePointer, recipeEntryPos, SEEK_SET);
+				if (fread(recipeFileBuffer, 1, RECIPE_BUFFER_SIZE, recipeFilePointer) == 0){
+					fprintf(stderr, "Error: fail to read the recipe file '%s'!\n", fullRecipeFileName.c_str());
+
+					fclose(recipeFilePointer);
+
+					free(recipeFileBuffer);
+					free(shareFileBuffer);
+					closeShareContainer_(containerSource);
+					closeZeroCopyShares_(zeroCopyList);
+					free(containerSource);
+
+					delete inodeKeySlice;
+
+					return 0;	
+				}
+
+				recipeFileBufferOffset = 0;
+			}
+		}
 
 		/*restore each share*/
 		numOfShares = pShareFileHead->numOfShares;
+		nextPrefetchEntry = 0;
 		for (i = 0; i < numOfShares; i++) {
 			/*check if recipeFileBuffer holds a complete file recipe entry*/
-			if (recipeFileBufferOffset + fileRecipeEntrySize_ > RECIPE_BUFFER_SIZE) {
+			if (recipeFileBufferOffset + recipeEntrySize > RECIPE_BUFFER_SIZE) {
 				if (recipeFileIsInBuffer) {
 					fprintf(stderr, "Error: encounter incomplete file recipe in buffer!\n");
 
 					free(recipeFileBuffer);
 					free(shareFileBuffer);
-					free(shareContainerCache);
-					free(shareContainerCacheIndex); 
+					closeShareContainer_(containerSource);
+					closeZeroCopyShares_(zeroCopyList);
+					free(containerSource);
 
 					delete inodeKeySlice;
 
@@ -2374,8 +4313,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 						free(recipeFileBuffer);
 						free(shareFileBuffer);
-						free(shareContainerCache);
-						free(shareContainerCacheIndex); 
+						closeShareContainer_(containerSource);
+						closeZeroCopyShares_(zeroCopyList);
+						free(containerSource);
 
 						delete inodeKeySlice;
 
@@ -2387,170 +4327,59 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 				}
 			}
 
+			/*read ahead the next file recipe entries in recipeFileBuffer once half of the ones read ahead 
+			  are restored, and prefetch their shares while the current ones are restored and sent*/
+			if (i + RESTORE_PREFETCH_ENTRIES / 2 >= nextPrefetchEntry) {
+				if (nextPrefetchEntry < i) {
+					nextPrefetchEntry = i;
+				}
+				numOfPrefetchEntries = (RECIPE_BUFFER_SIZE - recipeFileBufferOffset) / recipeEntrySize - 
+					(nextPrefetchEntry - i);
+				numOfPrefetchEntries = std::min(numOfPrefetchEntries, 
+						std::min(RESTORE_PREFETCH_ENTRIES, numOfShares - nextPrefetchEntry));
+				if (numOfPrefetchEntries > 0) {
+					prefetchShares_(recipeFileBuffer + recipeFileBufferOffset + 
+							(long) recipeEntrySize * (nextPrefetchEntry - i), recipeEntrySize, numOfPrefetchEntries);
+					nextPrefetchEntry += numOfPrefetchEntries;
+				}
+			}
+
 			/*read the file recipe entry*/
 			pFileRecipeEntry = (fileRecipeEntry_t *) (recipeFileBuffer + recipeFileBufferOffset);
-			recipeFileBufferOffset += fileRecipeEntrySize_;	
+			recipeFileBufferOffset += recipeEntrySize;	
 
 			/*generate the key for the corresponding share*/
 			shareFP2IndexKey_(pFileRecipeEntry->shareFP, key);
 			shareKeySlice = new leveldb::Slice(key, KEY_SIZE);
 
-			/*get the mutex lock DBLock_*/
-			pthread_mutex_lock(&DBLock_);	
-
-			/*enquire the key in the database*/
-			shareStat = db_->Get(readOptions_, *shareKeySlice, &valueString);
-
-			/*release the mutex lock DBLock_*/
-			pthread_mutex_unlock(&DBLock_);
+			/*read the share location from the file recipe entry*/
+			if (recipeEntrySize == fileRecipeEntrySize_) {
+				shareStat = leveldb::Status::OK();
+				pShareIndexValue = &(pFileRecipeEntry->shareLocation);
+			}
+			/*or enquire the key in the share index*/
+			else {
+				shareStat = shareIndex_->get(std::string(key, KEY_SIZE), valueString);
+				pShareIndexValue = (shareIndexValue_t *) valueString.data();
+			}
 
 			/*if such a share exists*/
 			if (shareStat.ok()) {
-				/*read the head of the share index value*/				
-				valueOffset = 0;
-				pShareIndexValueHead = (shareIndexValueHead_t *) (valueString.data() + valueOffset);
-				valueOffset += shareIndexValueHeadSize_;
-
-				/*check if the share container has been cached in shareContainerCache*/
-				j = 0;
-				while ((j < numOfCachedShareContainers) && (strcmp(pShareIndexValueHead->shareContainerName, 
-								shareContainerCache[shareContainerCacheIndex[j]].shareContainerName) != 0)) {
-					j++;
-				}
-
-				/*if the share container is cached in shareContainerCache*/
-				if (j < numOfCachedShareContainers) {
-					/*move the found share container to the beginning of the cache*/
-					if (j > 0) {
-						int tmp = shareContainerCacheIndex[j];
-						for (k = j; k > 0; k--) {
-							shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-						}
-						shareContainerCacheIndex[0] = tmp;
-					}
-				}
-				/*if the share container is not cached in shareContainerCache*/
-				else {
-					/*move the evicted share container to the beginning of the cache*/
-					if (numOfCachedShareContainers < NUM_OF_CACHED_CONTAINERS) {
-						/*in this case, the evicted one is a new cache entry*/
-						for (k = numOfCachedShareContainers; k > 0; k--) {
-							shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-						}
-						shareContainerCacheIndex[0] = numOfCachedShareContainers;
-						numOfCachedShareContainers++;
-					}
-					else {
-						/*in this case, the evicted one is the last cache entry*/
-						int tmp = shareContainerCacheIndex[NUM_OF_CACHED_CONTAINERS - 1];
-						for (k = NUM_OF_CACHED_CONTAINERS - 1; k > 0; k--) {
-							shareContainerCacheIndex[k] = shareContainerCacheIndex[k - 1];
-						}
-						shareContainerCacheIndex[0] = tmp;
-					}
-
-					/*first read share container from the buffer; if it is not in the buffer, then read it from the disk. 
-					  besides, store the new share container in the beginning of the cache to overwrite the evicted one*/
-					if (!readShareContainerFromBuffer_(pShareIndexValueHead->shareContainerName, 
-								shareContainerCache[shareContainerCacheIndex[0]].shareContainer)) {
-						/*generate the full share container name*/
-						fullShareContainerName = pShareIndexValueHead->shareContainerName;
-						if (!addPrefixDir_(shareContainerDirName_, fullShareContainerName)) {
-							fprintf(stderr, "Error: fail to add the prefix '%s' to '%s'!\n", 
-									shareContainerDirName_.c_str(), fullShareContainerName.c_str());
-
-							if (!recipeFileIsInBuffer) {
-								fclose(recipeFilePointer);
-							}
-
-							free(recipeFileBuffer);
-							free(shareFileBuffer);
-							free(shareContainerCache);
-							free(shareContainerCacheIndex); 
-
-							delete inodeKeySlice;
-							delete shareKeySlice;
-
-							return 0;	
-						}	
-
-						/*open the container file for reading the share*/
-						if (containerStorerObj_ != NULL) {
-							containerStorerObj_->openOldFile(fullShareContainerName, containerFilePointer);
-						}
-						else {
-							containerFilePointer = fopen(fullShareContainerName.c_str(), "rb");
-						}
-
-						if (containerFilePointer == NULL) {
-							fprintf(stderr, "Error: fail to open the share container file '%s'!\n", 
-									fullShareContainerName.c_str());
-
-							if (!recipeFileIsInBuffer) {
-								fclose(recipeFilePointer);
-							}
-
-							free(recipeFileBuffer);
-							free(shareFileBuffer);
-							free(shareContainerCache);
-							free(shareContainerCacheIndex); 
-
-							delete inodeKeySlice;
-							delete shareKeySlice;
-
-							return 0;	
-						}
-
-						if (fread(shareContainerCache[shareContainerCacheIndex[0]].shareContainer, 
-									1, CONTAINER_BUFFER_SIZE, containerFilePointer) == 0){
-							fprintf(stderr, "Error: fail to read the share container file '%s'!\n", 
-									fullShareContainerName.c_str());
-
-							if (!recipeFileIsInBuffer) {
-								fclose(recipeFilePointer);
-							}
-							fclose(containerFilePointer);
-
-							free(recipeFileBuffer);
-							free(shareFileBuffer);
-							free(shareContainerCache);
-							free(shareContainerCacheIndex); 
-
-							delete inodeKeySlice;
-							delete shareKeySlice;
-
-							return 0;	
-						}
-
-						fclose(containerFilePointer);
-					}
-
-					/*then update the cached share container name*/
-					memcpy(shareContainerCache[shareContainerCacheIndex[0]].shareContainerName, 
-							pShareIndexValueHead->shareContainerName, INTERNAL_FILE_NAME_SIZE);
-				}	
-
-				/*check if shareFileBuffer has enough space for keeping the share info and data*/
-				if (shareFileBufferOffset + shareEntrySize_ + pShareIndexValueHead->shareSize > sentShareFileBufferSize) {
-					/*add the message head before sending the data of the share file buffer*/
-					indicator = htonl(-5);
-					sentDataSize = htonl(shareFileBufferOffset - sentMsgHeadSize);
-					memcpy(shareFileBuffer, &indicator, sizeof(uint32_t));
-					memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
-
-					/*send the data of the share file buffer through the socket with socketFD*/
-					if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset){
-						fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) \
-								through the socket %d --- return %ld!\n", shareFileBufferOffset, socketFD, sentSize);
 
+				/*check if the message has enough space for keeping the share info and data*/
+				if (shareFileBufferOffset + zeroCopySize + shareEntrySize_ + pShareIndexValue->shareSize > 
+						sentShareFileBufferSize) {
+					/*send the data of the share file buffer (and the shares sent from the files) through the socket*/
+					if (!sendShareFileBuffer_(socketFD, shareFileBuffer, shareFileBufferOffset, zeroCopyList)) {
 						if (!recipeFileIsInBuffer) {
 							fclose(recipeFilePointer);
 						}
 
 						free(recipeFileBuffer);
 						free(shareFileBuffer);
-						free(shareContainerCache);
-						free(shareContainerCacheIndex); 
+						closeShareContainer_(containerSource);
+						closeZeroCopyShares_(zeroCopyList);
+						free(containerSource);
 
 						delete inodeKeySlice;
 						delete shareKeySlice;
@@ -2560,20 +4389,44 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 					/*reset shareFileBufferOffset*/
 					shareFileBufferOffset = sentMsgHeadSize;
+					zeroCopySize = 0;
 				}
 
 				/*generate and store the share info into shareFileBuffer*/
 				pShareEntry = (shareEntry_t *) (shareFileBuffer + shareFileBufferOffset);
 				pShareEntry->secretID = pFileRecipeEntry->secretID;
 				pShareEntry->secretSize = pFileRecipeEntry->secretSize;
-				pShareEntry->shareSize = pShareIndexValueHead->shareSize;
+				pShareEntry->shareSize = pShareIndexValue->shareSize;
 				shareFileBufferOffset += shareEntrySize_;
 
-				/*store the share data into shareFileBuffer*/
-				memcpy(shareFileBuffer + shareFileBufferOffset, 
-						shareContainerCache[shareContainerCacheIndex[0]].shareContainer + 
-						pShareIndexValueHead->shareContainerOffset, pShareIndexValueHead->shareSize);
-				shareFileBufferOffset += pShareIndexValueHead->shareSize;
+				/*send a large share from the file of its share container, or read the share data into shareFileBuffer*/
+				if (prepareZeroCopyShare_(pShareIndexValue, containerSource, zeroCopyShare)) {
+					zeroCopyShare.bufferOffset = shareFileBufferOffset;
+					zeroCopyList.push_back(zeroCopyShare);
+					zeroCopySize += pShareIndexValue->shareSize;
+				}
+				else if (!readShare_(pShareIndexValue, containerSource, shareFileBuffer + shareFileBufferOffset)) {
+					fprintf(stderr, "Error: fail to read the share data from the share container %llu!\n", 
+							(unsigned long long) pShareIndexValue->shareContainerID);
+
+					if (!recipeFileIsInBuffer) {
+						fclose(recipeFilePointer);
+					}
+
+					free(recipeFileBuffer);
+					free(shareFileBuffer);
+					closeShareContainer_(containerSource);
+					closeZeroCopyShares_(zeroCopyList);
+					free(containerSource);
+
+					delete inodeKeySlice;
+					delete shareKeySlice;
+
+					return 0;	
+				}
+				else {
+					shareFileBufferOffset += pShareIndexValue->shareSize;
+				}
 			}
 
 			/*if such a share does not exist*/
@@ -2587,8 +4440,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 				delete shareKeySlice;
@@ -2606,8 +4460,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 				delete shareKeySlice;
@@ -2625,8 +4480,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 				delete shareKeySlice;
@@ -2638,25 +4494,17 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 		}	
 
 		if (shareFileBufferOffset > sentMsgHeadSize) {
-			/*add the message head before sending the data of the share file buffer*/
-			indicator = htonl(-5);
-			sentDataSize = htonl(shareFileBufferOffset - sentMsgHeadSize);
-			memcpy(shareFileBuffer, &indicator, sizeof(uint32_t));
-			memcpy(shareFileBuffer + sizeof(uint32_t), &sentDataSize, sizeof(uint32_t));
-
-			/*send the data of the share file buffer through the socket with socketFD*/
-			if ((sentSize = send(socketFD, shareFileBuffer, shareFileBufferOffset, 0)) != shareFileBufferOffset){
-				fprintf(stderr, "Error: fail to send the data of the share file buffer (totally in %d bytes) \
-						through the socket %d --- return %ld!\n", shareFileBufferOffset, socketFD, sentSize);
-
+			/*send the data of the share file buffer (and the shares sent from the files) through the socket*/
+			if (!sendShareFileBuffer_(socketFD, shareFileBuffer, shareFileBufferOffset, zeroCopyList)) {
 				if (!recipeFileIsInBuffer) {
 					fclose(recipeFilePointer);
 				}
 
 				free(recipeFileBuffer);
 				free(shareFileBuffer);
-				free(shareContainerCache);
-				free(shareContainerCacheIndex); 
+				closeShareContainer_(containerSource);
+				closeZeroCopyShares_(zeroCopyList);
+				free(containerSource);
 
 				delete inodeKeySlice;
 
@@ -2670,8 +4518,9 @@ bool DedupCore::restoreShareFile(const int &userID, const std::string &fullFileN
 
 		free(recipeFileBuffer);
 		free(shareFileBuffer);
-		free(shareContainerCache);
-		free(shareContainerCacheIndex); 
+		closeShareContainer_(containerSource);
+		closeZeroCopyShares_(zeroCopyList);
+		free(containerSource);
 	}
 
 	/*if such an inode for fullFileName does not exist*/
@@ -8,8 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <list>
+#include <algorithm>
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
@@ -17,9 +22,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
 #include <openssl/evp.h>
 
+/*for the use of boost unordered_set*/
+#include <boost/unordered_set.hpp>
+/*for the use of boost unordered_map*/
+#include <boost/unordered_map.hpp>
+
 /*for the use of LevelDB*/
 #include "leveldb/db.h"
 /*for the use of Slice*/
@@ -30,6 +41,8 @@
 #include "leveldb/cache.h"
 /*for the use of Bloom filter*/
 #include "leveldb/filter_policy.h"
+/*for the use of MergeOperator*/
+#include "leveldb/merge_operator.h"
 
 /*for the use of BackendStorer*/
 #include "BackendStorer.hh"
@@ -37,6 +50,19 @@
 /*for the use of CryptoPrimitive*/
 #include "CryptoPrimitive.hh"
 
+/*for the use of IndexCache*/
+#include "IndexCache.hh"
+
+/*for the use of the share index engines*/
+#include "ShareIndex.hh"
+#include "FPStore.hh"
+
+/*for the use of ContainerWriter*/
+#include "ContainerWriter.hh"
+
+/*for the use of ExtentCache*/
+#include "ExtentCache.hh"
+
 /*macros for LevelDB option settings*/
 #define MEM_TABLE_SIZE (16<<20)
 #define BLOCK_CACHE_SIZE (32<<20)
@@ -54,6 +80,14 @@
 #define CONTAINER_BUFFER_SIZE (4<<20)
 #define MAX_BUFFER_WAIT_SECS 1800
 
+/*macros for the timing wheel of the buffer flusher thread: the seconds of a tick, and the number of slots 
+  (a lap must be longer than MAX_BUFFER_WAIT_SECS plus two ticks)*/
+#define BUFFER_WHEEL_TICK_SECS 30
+#define NUM_BUFFER_WHEEL_SLOTS 64
+
+/*macro for the file size of a streamed file before its trailer is received*/
+#define FILE_SIZE_UNKNOWN (-1)
+
 /*macro for fingerprint size with the use of SHA-256 CryptoPrimitive instance*/
 #define FP_SIZE 32
 
@@ -61,11 +95,75 @@
 #define KEY_SIZE (FP_SIZE + 1)
 #define MAX_VALUE_SIZE (FP_SIZE + 1)
 
+/*macro for the size of a user reference key (a share index key followed by a user id)*/
+#define USER_REF_KEY_SIZE (KEY_SIZE + 4)
+
+/*macro for the size of an inode version key (a file inode key followed by a version number)*/
+#define INODE_VERSION_KEY_SIZE (KEY_SIZE + 4)
+
+/*macro for the size of a dir child key (a dir inode key followed by the inode fingerprint of a child)*/
+#define DIR_CHILD_KEY_SIZE (KEY_SIZE + FP_SIZE)
+
+/*macro for the max number of dir inodes kept in the dir inode cache (the cache is emptied when full)*/
+#define DIR_INODE_CACHE_SIZE (1<<16)
+
+/*macros for the key and the version of the index format recorded in the database*/
+#define INDEX_FORMAT_KEY "IndexFormat"
+#define INDEX_FORMAT_VERSION 3
+
+/*macros for the key of the limit of the share container ids handed out (recorded in the database), 
+  and the number of ids reserved each time the limit is raised*/
+#define SHARE_CONTAINER_ID_LIMIT_KEY "ShareContainerIDLimit"
+#define SHARE_CONTAINER_ID_RESERVE 1024
+
+/*macros for the name of the share container with an id, the size of a buffer that fits the name of any 64-bit id, 
+  and the limit of the ids handed out (the names of the ids below it have the same length)*/
+#define SHARE_CONTAINER_NAME_FORMAT "%012llu.sc"
+#define SHARE_CONTAINER_NAME_SIZE 24
+#define SHARE_CONTAINER_ID_MAX 1000000000000ULL
+
+/*macros for the postfix of the recipe file name, which tells if the file recipe entries of the file carry 
+  the share locations (the old ones do not)*/
+#define RECIPE_FILE_NAME_POSTFIX ".rl"
+#define LEGACY_RECIPE_FILE_NAME_POSTFIX ".rf"
+
+/*macro for the name of the index cache snapshot in the DB dir*/
+#define INDEX_CACHE_SNAPSHOT_NAME "IndexCacheSnapshot"
+
+/*macro for the name of the fingerprint store dir (under the DB dir)*/
+#define FPSTORE_DIR_NAME "FPStore/"
+
+/*macro for the number of lock stripes guarding index updates (a power of 2)*/
+#define NUM_INDEX_LOCK_STRIPES 256
+
 /*macro for share file buffer size*/
 #define SHARE_FILE_BUFFER_SIZE (4<<20)
 
-/*macro for the number of cached share containers*/
-#define NUM_OF_CACHED_CONTAINERS 4
+/*macros for the restore prefetcher: the number of file recipe entries read ahead at a time (the next ones 
+  are read ahead once half of them are restored), the number of prefetch threads, and the max number of 
+  share containers waiting for them (further prefetches are dropped)*/
+#define RESTORE_PREFETCH_ENTRIES 1024
+#define NUM_PREFETCH_THREADS 4
+#define MAX_PENDING_PREFETCHES 256
+
+/*macros for the hashing threads that verify the fingerprints of the non-duplicate shares in the second-stage 
+  deduplication: the number of threads, and the number of shares verified by a hash task*/
+#define NUM_HASH_THREADS 4
+#define HASH_TASK_SHARES 64
+
+/*macro for the min size of a share that is sent from the file of its share container by sendfile, rather 
+  than copied into the share file buffer (such shares bypass the extent cache)*/
+#define ZERO_COPY_MIN_SHARE_SIZE (16<<10)
+
+/*macros for the offset index of file recipes (the interval is doubled when the checkpoints are full)*/
+#define MIN_OFFSET_INDEX_INTERVAL 256
+#define MAX_OFFSET_CHECKPOINTS 4096
+
+/*macro for the number of recipe entries read at a time when locating a range*/
+#define RANGE_SCAN_ENTRIES 1024
+
+/*macro for the length of a range that ends at the end of file*/
+#define RANGE_TO_END (-1)
 
 using namespace std;
 
@@ -90,8 +188,18 @@ typedef struct {
 	int shareSize;
 } shareMDEntry_t;
 
+/*the trailer structure of the file share metadata, sent after the last share of a file 
+  (fileSize in fileShareMDHead_t is FILE_SIZE_UNKNOWN for a streamed file)*/
+typedef struct {
+	long fileSize;
+	int numOfSecrets;
+} fileShareMDTrailer_t;
+
 /*dir inode value format: [inodeIndexValueHead_t + short name + inodeDirEntry_t ... inodeDirEntry_t]*/
+/*(the children of a dir are added as dir child keys instead, so a new dir inode has no inodeDirEntry_t)*/
 /*file inode value format: [inodeIndexValueHead_t + short name + inodeFileEntry_t ... inodeFileEntry_t]*/
+/*(the i-th version of a file is added as an inode version key with an inodeFileEntry_t, so a new file inode 
+  has no inodeFileEntry_t; an old file inode has its versions from the newest one to the first one)*/
 /*the short name excludes the prefix path*/
 
 /*the head structure of the value of the inode index*/
@@ -113,21 +221,71 @@ typedef struct {
 	int recipeFileOffset;	
 } inodeFileEntry_t;
 
-/*share index value format: [shareIndexValueHead_t + shareUserRefEntry_t ... shareUserRefEntry_t]*/
+/*the entry structure of a new file of a metadata buffer (its inode is added after the file recipes of the buffer)*/
+typedef struct {
+	std::string fullFileName;
+	char inodeFP[FP_SIZE];
+	inodeFileEntry_t inodeFileEntry;
+} newFileEntry_t;
 
-/*the head structure of the value of the share index*/
+/*share index value format: [shareIndexValue_t] (the references of each user are kept under a user reference key)*/
+
+/*the structure of the value of the share index*/
+typedef struct {
+	uint64_t shareContainerID;
+	int shareContainerOffset;
+	int shareSize;
+} shareIndexValue_t;
+
+/*user reference index format: [share index key + user id] -> [int reference count] (updated by merge operands)*/
+
+/*the structure of the share index value of format version 2 (converted by CONVERTINDEX)*/
+typedef struct {
+	char shareContainerName[INTERNAL_FILE_NAME_SIZE];	
+	int shareContainerOffset;
+	int shareSize;
+} v2ShareIndexValue_t;
+
+/*old share index value format: [legacyShareIndexValueHead_t + legacyShareUserRefEntry_t ... ] (converted by CONVERTINDEX)*/
+
+/*the head structure of the old value of the share index*/
 typedef struct {
 	char shareContainerName[INTERNAL_FILE_NAME_SIZE];	
 	int shareContainerOffset;
 	int shareSize;
 	int numOfUsers;
-} shareIndexValueHead_t;
+} legacyShareIndexValueHead_t;
 
-/*the user reference entry structure of the value of the share index*/
+/*the user reference entry structure of the old value of the share index*/
 typedef struct {
 	int userID;
 	int refCnt;
-} shareUserRefEntry_t;
+} legacyShareUserRefEntry_t;
+
+/*the entry structure of a share in a batched index update*/
+typedef struct {
+	char *shareFP;
+	int index;
+	int shareSize;
+	int shareDataBufferOffset;
+	/*the number of shares with the same fingerprint in the batch (set for the first one)*/
+	int numOfRefs;
+	/*if the user owns the share (set for the first one)*/
+	bool ownerStat;
+	/*the share index value, i.e., the location of the share (set for the first one)*/
+	shareIndexValue_t shareIndexValue;
+} shareBatchEntry_t;
+
+/*the hash task structure of a run of non-duplicate shares whose fingerprints are verified by a hashing thread*/
+typedef struct {
+	std::vector<shareBatchEntry_t> *shareList;
+	unsigned char *shareDataBuffer;
+	int startPos;
+	int endPos;
+	/*the number of unfinished tasks of the batch, and the position of the first inconsistent share found (or -1)*/
+	int *numOfPendingTasks;
+	int *inconsistentPos;
+} hashTask_t;
 
 /*file recipe format: [fileRecipeHead_t + fileRecipeEntry_t ... fileRecipeEntry_t]*/
 
@@ -138,13 +296,31 @@ typedef struct {
 	int numOfShares;
 } fileRecipeHead_t;
 
-/*the entry structure of the recipes of a file*/
+/*the entry structure of the recipes of a file (the location of the share is copied from the share index 
+  when the entry is added, so the share can be restored without looking up the share index)*/
 typedef struct {
 	char shareFP[FP_SIZE];	
 	int secretID;
 	int secretSize;
+	shareIndexValue_t shareLocation;
 } fileRecipeEntry_t;
 
+/*the entry structure of the recipes of a file in an old recipe file (a prefix of fileRecipeEntry_t)*/
+typedef struct {
+	char shareFP[FP_SIZE];	
+	int secretID;
+	int secretSize;
+} legacyFileRecipeEntry_t;
+
+/*offset index value format: [offsetIndexValueHead_t + long ... long]*/
+/*the i-th long is the total size of the secrets before the (i * interval)-th file recipe entry*/
+
+/*the head structure of the value of the offset index*/
+typedef struct {
+	int interval;
+	int numOfCheckpoints;
+} offsetIndexValueHead_t;
+
 /*the per-user buffer node structure*/
 typedef struct perUserBufferNode {
 	int userID;
@@ -153,10 +329,25 @@ typedef struct perUserBufferNode {
 	int recipeFileBufferCurrLen;	
 	int lastRecipeHeadPos;	
 	char lastInodeFP[FP_SIZE];
-	char shareContainerName[INTERNAL_FILE_NAME_SIZE];	
+	char currRecipeFileName[INTERNAL_FILE_NAME_SIZE];	
+	int currRecipeFileOffset;
+	int currFileNumOfShares;
+	long currFileSize;
+	int offsetIndexInterval;
+	int numOfOffsetCheckpoints;
+	long offsetCheckpoints[MAX_OFFSET_CHECKPOINTS];
+	uint64_t shareContainerID;
 	unsigned char shareContainerBuffer[CONTAINER_BUFFER_SIZE];
 	int shareContainerBufferCurrLen;		
+	std::vector<std::string> *shareKeyList; /*the share index entries of the new shares in the share container buffer*/
+	std::vector<std::string> *shareValueList;
 	double lastUseTime;
+	int numOfUsers; /*the number of threads using the node (a node in use is never retired)*/
+	bool retireStat; /*if the node is being flushed before it leaves the pool*/
+	pthread_mutex_t nodeLock; /*held by the thread filling, reading or flushing the node, taken only after the node 
+				    is used or retired and never with bufferLock_ held*/
+	int wheelSlot;
+	struct perUserBufferNode *prev; /*the neighbours in the slot of the timing wheel*/
 	struct perUserBufferNode *next;
 } perUserBufferNode_t;
 
@@ -166,8 +357,15 @@ typedef struct perUserBufferNode {
 typedef struct {	
 	long fileSize;
 	int numOfShares;
+	long firstSecretOffset;
 } shareFileHead_t;
 
+/*the range request structure of a range restore, followed by the full file name*/
+typedef struct {
+	long rangeOffset;
+	long rangeLength;
+} fileRangeRequest_t;
+
 /*the entry structure of the restored share file*/
 typedef struct {
 	int secretID;
@@ -175,11 +373,55 @@ typedef struct {
 	int shareSize;
 } shareEntry_t;
 
-/*the share container cache node structure*/
+/*the structure of the share container on disk that a restore reads from (its file is kept open for 
+  the next shares of the container, as the shares of a file are mostly stored together)*/
 typedef struct {
-	char shareContainerName[INTERNAL_FILE_NAME_SIZE];	
-	unsigned char shareContainer[CONTAINER_BUFFER_SIZE];
-} shareContainerCacheNode_t;
+	uint64_t shareContainerID;
+	FILE *containerFilePointer;
+	long containerFileOffset;
+	long shareContainerSize; /*-1 if the share container is stored in its own file*/
+	unsigned char extentBuffer[EXTENT_SIZE];
+} containerSource_t;
+
+/*the structure of a share sent from the file of its share container, at a position of the share file buffer*/
+typedef struct {
+	int bufferOffset;
+	int fileFD; /*a duplicate of the descriptor of the file, closed once the share is sent*/
+	long fileOffset;
+	int shareSize;
+} zeroCopyShare_t;
+
+/*the prefetch task structure of the extents of a share container needed by a restore*/
+typedef struct {
+	uint64_t shareContainerID;
+	std::vector<long> extentIDList;
+} prefetchTask_t;
+
+/*
+ * the merge operator of the user reference index, which adds the reference count of a merge operand to a 
+ * value (or to an older operand); the share index values of the old format may still have merge operands 
+ * of the user reference entries to be added, which are resolved until the values are converted
+ */
+class UserRefMergeOperator : public leveldb::MergeOperator {
+	private:
+		/*
+		 * add the user reference entries of a merge operand to a share index value of the old format
+		 *
+		 * @param existing_value - the value or the older operand, NULL if there is none
+		 * @param value - the merge operand
+		 * @param new_value - the combined value <return>
+		 *
+		 * @return - a boolean value that indicates if the merge op succeeds
+		 */
+		bool mergeLegacyShareRefs_(const leveldb::Slice *existing_value, const leveldb::Slice &value, 
+				std::string *new_value) const;
+
+	public:
+		const char *Name() const;
+
+		bool Merge(const leveldb::Slice &key, const leveldb::Slice *existing_value, const leveldb::Slice &value, 
+				std::string *new_value) const;
+};
 
 class DedupCore{
 	private:	
@@ -192,15 +434,55 @@ class DedupCore{
 		leveldb::Options dbOptions_;
 		leveldb::ReadOptions readOptions_;
 		leveldb::WriteOptions writeOptions_;
-		leveldb::WriteBatch batch_;
+
+		/*the engine that stores the share index*/
+		ShareIndex *shareIndex_;
+
+		/*the merge operator of the user reference index (which always stays in the database)*/
+		UserRefMergeOperator userRefMergeOperator_;
+
+		/*the in-memory cache of the share index, and its snapshot file*/
+		IndexCache *indexCache_;
+		std::string indexCacheFileName_;
+
+		/*the share index entries of the new shares whose share containers are not durable yet (they are 
+		  committed by the container writers together with the locations of the containers)*/
+		boost::unordered_map<std::string, std::string> pendingShareMap_;
 
 		/*variables for cloud storage backend*/
 		BackendStorer *recipeStorerObj_;
 		BackendStorer *containerStorerObj_;
 
+		/*the background writers that append share containers into segment files, one per data directory 
+		  (the first one is shareContainerDirName_), and the next one to take a share container*/
+		std::vector<ContainerWriter *> containerWriters_;
+		int nextContainerWriter_;
+
+		/*the cache of the share container extents read by the restores (shared by all users)*/
+		ExtentCache *extentCache_;
+
+		/*the hashing threads that verify the fingerprints of the non-duplicate shares (shared by all users)*/
+		std::list<hashTask_t> hashTaskList_;
+		bool hashStopStat_;
+		pthread_mutex_t hashLock_;
+		pthread_cond_t hashCond_;
+		pthread_cond_t hashDoneCond_;
+		pthread_t hashThreads_[NUM_HASH_THREADS];
+
+		/*the prefetch threads that read the extents needed by the restores into extentCache_ ahead*/
+		std::list<prefetchTask_t> prefetchTaskList_;
+		bool prefetchStopStat_;
+		pthread_mutex_t prefetchLock_;
+		pthread_cond_t prefetchCond_;
+		pthread_t prefetchThreads_[NUM_PREFETCH_THREADS];
+
 		/*variables for the file share metadata*/
 		int fileShareMDHeadSize_;
 		int shareMDEntrySize_;		
+		int fileShareMDTrailerSize_;
+
+		/*the in-memory cache of the keys of the dir inodes that exist*/
+		boost::unordered_set<std::string> dirInodeCache_;
 
 		/*variables for the inode key-value index*/
 		int inodeIndexValueHeadSize_;
@@ -208,8 +490,10 @@ class DedupCore{
 		int inodeFileEntrySize_;
 
 		/*variables for the share key-value index*/
-		int shareIndexValueHeadSize_;
-		int shareUserRefEntrySize_;
+		int shareIndexValueSize_;
+
+		/*variables for the offset index*/
+		int offsetIndexValueHeadSize_;
 
 		/*variables for file recipes*/
 		std::string recipeFileDirName_;
@@ -217,32 +501,52 @@ class DedupCore{
 		int recipeFileNameValidLen_;
 		int fileRecipeHeadSize_;
 		int fileRecipeEntrySize_;
+		int legacyFileRecipeEntrySize_;
 
 		/*variables for share containers*/
 		std::string shareContainerDirName_;
-		std::string globalShareContainerName_;
-		int shareContainerNameValidLen_;
-
-		/*variables for buffer nodes*/
-		perUserBufferNode_t *headBufferNode_;	
-		perUserBufferNode_t *tailBufferNode_;
+		uint64_t nextShareContainerID_;
+		uint64_t shareContainerIDLimit_;
+
+		/*variables for buffer nodes: the pool indexed by the user id and by the id of the share container being 
+		  filled, and the timing wheel of the flusher thread, where a node waits in the slot of the first tick 
+		  after it may be idle for MAX_BUFFER_WAIT_SECS (a node is not moved when it is used, the flusher moves it 
+		  on when it finds it used since)*/
+		boost::unordered_map<int, perUserBufferNode_t *> bufferNodeMap_;
+		boost::unordered_map<uint64_t, perUserBufferNode_t *> containerBufferNodeMap_;
+		perUserBufferNode_t *bufferWheel_[NUM_BUFFER_WHEEL_SLOTS];
+		long bufferWheelTick_;
 		int perUserBufferNodeSize_;
 
+		/*the flusher thread that flushes the idle buffer nodes into the disk (it waits on bufferLock_)*/
+		bool flusherStopStat_;
+		pthread_cond_t flusherCond_;
+		pthread_t flusherThread_;
+
+		/*the condition signalled when a buffer node is released by a thread or leaves the pool (on bufferLock_)*/
+		pthread_cond_t bufferCond_;
+
 		/*variables for restored share file*/
 		int shareFileHeadSize_;
 		int shareEntrySize_;	
 
-		/*a mutex lock for the database*/
-		pthread_mutex_t DBLock_;
+		/*mutex locks for read-modify-write sequences on index entries, striped by key (lookups take no lock)*/
+		pthread_mutex_t indexLocks_[NUM_INDEX_LOCK_STRIPES];
 
-		/*a mutex lock for the buffer node link*/
+		/*a mutex lock for the buffer node pool*/
 		pthread_mutex_t bufferLock_;
 
+		/*a mutex lock for the pending share index entries*/
+		pthread_mutex_t pendingShareLock_;
+
 		/*a mutex lock for the global recipe file name*/
 		pthread_mutex_t globalRecipeFileNameLock_;
 
-		/*a mutex lock for the global share container name*/
-		pthread_mutex_t globalShareContainerNameLock_;
+		/*a mutex lock for the next share container id*/
+		pthread_mutex_t shareContainerIDLock_;
+
+		/*a mutex lock for the dir inode cache*/
+		pthread_mutex_t dirInodeCacheLock_;
 
 		/*
 		 * format a full file name (including the path) into '/.../.../shortName'
@@ -356,6 +660,69 @@ class DedupCore{
 		 */
 		inline void shareFP2IndexKey_(char *shareFP, char *key);
 
+		/*
+		 * transform a share's fingerprint and a user id to a user reference index key
+		 *
+		 * @param shareFP - the share's fingerprint to be transformed 
+		 * @param userID - the user id 
+		 * @param key - the resulting index key <return>
+		 */
+		inline void shareUserRef2IndexKey_(char *shareFP, const int &userID, char *key);
+
+		/*
+		 * transform the location of a file recipe to an offset index key
+		 *
+		 * @param recipeFileName - the name of the recipe file 
+		 * @param recipeFileOffset - the offset of the file recipe head in the recipe file 
+		 * @param key - the resulting index key <return>
+		 */
+		inline void recipeLocation2IndexKey_(char *recipeFileName, const int &recipeFileOffset, char *key);
+
+		/*
+		 * transform a file inode's fingerprint and a version number to an inode version key
+		 *
+		 * @param inodeFP - the file inode's fingerprint
+		 * @param version - the version number (counted from 0 for the first version)
+		 * @param key - the resulting index key <return>
+		 */
+		inline void inodeVersion2IndexKey_(char *inodeFP, const int &version, char *key);
+
+		/*
+		 * transform the inode fingerprints of a dir and its child to a dir child key
+		 *
+		 * @param dirFP - the dir inode's fingerprint
+		 * @param childFP - the child inode's fingerprint
+		 * @param key - the resulting index key <return>
+		 */
+		inline void dirChild2IndexKey_(char *dirFP, char *childFP, char *key);
+
+		/*
+		 * get the size of the file recipe entries in a recipe file
+		 *
+		 * @param recipeFileName - the name of the recipe file 
+		 *
+		 * @return - the size of fileRecipeEntry_t, or that of legacyFileRecipeEntry_t for an old recipe file
+		 */
+		inline int fileRecipeEntrySizeOf_(const char *recipeFileName);
+
+		/*
+		 * get the index of the lock stripe of an index key
+		 *
+		 * @param key - the index key 
+		 *
+		 * @return - the index of the lock stripe
+		 */
+		inline int indexStripe_(const char *key);
+
+		/*
+		 * get the lock stripe of an index key
+		 *
+		 * @param key - the index key 
+		 *
+		 * @return - the mutex lock guarding read-modify-write sequences on the key
+		 */
+		inline pthread_mutex_t *indexLock_(const char *key);
+
 		/*
 		 * get the current time (in second)
 		 *
@@ -373,61 +740,279 @@ class DedupCore{
 		bool flushBufferNodeIntoDisk_(perUserBufferNode_t *targetBufferNode);
 
 		/*
-		 * find or create a buffer node for a user in the buffer node link
+		 * find or create a buffer node for a user in the buffer node pool, and use it until it is released
 		 *
 		 * @param userID - the user id
 		 * @param targetBufferNode - the resulting buffer node <return>
+		 *
+		 * @return - a boolean value that indicates if the buffer node is found or created
+		 */
+		bool findOrCreateBufferNode_(const int &userID, perUserBufferNode_t *&targetBufferNode);
+
+		/*
+		 * release a buffer node used by findOrCreateBufferNode_()
+		 *
+		 * @param targetBufferNode - the buffer node
+		 */
+		void releaseBufferNode_(perUserBufferNode_t *targetBufferNode);
+
+		/*
+		 * link a buffer node into the slot of the timing wheel where it may expire (the caller holds bufferLock_)
+		 *
+		 * @param targetBufferNode - the buffer node
+		 */
+		void linkBufferNode_(perUserBufferNode_t *targetBufferNode);
+
+		/*
+		 * unlink a buffer node from the timing wheel (the caller holds bufferLock_)
+		 *
+		 * @param targetBufferNode - the buffer node
+		 */
+		void unlinkBufferNode_(perUserBufferNode_t *targetBufferNode);
+
+		/*
+		 * flush a buffer node into the disk, and delete it from the buffer node pool (the caller holds bufferLock_, 
+		 * which is released during the flush, and has unlinked the node from the timing wheel and set its retireStat)
+		 *
+		 * @param targetBufferNode - the buffer node
+		 *
+		 * @return - a boolean value that indicates if the flush op succeeds (the node is deleted anyway)
 		 */
-		void findOrCreateBufferNode_(const int &userID, perUserBufferNode_t *&targetBufferNode);
+		bool retireBufferNode_(perUserBufferNode_t *targetBufferNode);
 
 		/*
-		 * add a file's information into the inode index
+		 * the main procedure of the flusher thread
 		 *
-		 * @param fullFileName - the full name of the file to be added 
+		 * @param param - the DedupCore instance
+		 */
+		static void *flusherHandler_(void *param);
+
+		/*
+		 * add a file's information into the inode index, through the batch of the namespace updates 
+		 * (the caller holds the lock stripe of the file inode key until the batch is written)
+		 *
+		 * @param newFile - the new file to be added 
 		 * @param userID - the user id 
-		 * @param targetBufferNode - the corresponding buffer node 
+		 * @param namespaceBatch - the batch of the inode and dir updates of a metadata buffer <return>
+		 * @param newDirKeySet - the keys of the new dirs added to namespaceBatch <return>
+		 * @param newFileInodeMap - the file inodes added to namespaceBatch <return>
+		 * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
+		 *
+		 * @return - a boolean value that indicates if the add op succeeds
+		 */
+		bool addFileIntoInodeIndex_(const newFileEntry_t &newFile, const int &userID, 
+				leveldb::WriteBatch &namespaceBatch, boost::unordered_set<std::string> &newDirKeySet, 
+				boost::unordered_map<std::string, std::string> &newFileInodeMap, CryptoPrimitive *cryptoObj);
+
+		/*
+		 * add the inodes of the new files of a metadata buffer and their dir updates in one batch, under the
+		 * lock stripes of the file inode keys until the batch is written (so that a file inode is never written
+		 * without its dir child keys), then cache the new dirs
+		 *
+		 * @param newFileList - the new files to be added (cleared once they are added) <return>
+		 * @param userID - the user id
 		 * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
 		 *
 		 * @return - a boolean value that indicates if the add op succeeds
 		 */
-		bool addFileIntoInodeIndex_(const std::string &fullFileName, const int &userID, 
-				perUserBufferNode_t *targetBufferNode, CryptoPrimitive *cryptoObj);
+		bool addNewFilesIntoInodeIndex_(std::vector<newFileEntry_t> &newFileList, const int &userID,
+				CryptoPrimitive *cryptoObj);
+
+		/*
+		 * read the inode file entry of a version of a file
+		 *
+		 * @param inodeFP - the file inode's fingerprint
+		 * @param versionNumber - the version number (0 for the newest version, -1 for the previous one, and so on)
+		 * @param inodeFileEntry - the inode file entry (read only if such a version exists) <return>
+		 * @param numOfVersions - the number of versions of the file <return>
+		 *
+		 * @return - the status of the read op
+		 */
+		leveldb::Status getInodeFileEntry_(char *inodeFP, const int &versionNumber, inodeFileEntry_t &inodeFileEntry, 
+				int &numOfVersions);
+
+		/*
+		 * check if a dir inode is in the dir inode cache
+		 *
+		 * @param dirKey - the key of the dir inode
+		 *
+		 * @return - a boolean value that indicates if the dir inode is cached
+		 */
+		bool findDirInodeInCache_(const std::string &dirKey);
+
+		/*
+		 * add an existing dir inode into the dir inode cache
+		 *
+		 * @param dirKey - the key of the dir inode
+		 */
+		void addDirInodeIntoCache_(const std::string &dirKey);
+
+		/*
+		 * lock the stripes marked in a list in ascending order
+		 *
+		 * @param stripeList - a list that marks the stripes to be locked
+		 */
+		void lockIndexStripes_(bool *stripeList);
+
+		/*
+		 * unlock the stripes marked in a list
+		 *
+		 * @param stripeList - a list that marks the stripes to be unlocked
+		 */
+		void unlockIndexStripes_(bool *stripeList);
+
+		/*
+		 * check that the share index has the current format, and record the format in a new database
+		 *
+		 * @return - a boolean value that indicates if the check op succeeds
+		 */
+		bool checkIndexFormat_();
+
+		/*
+		 * find a key scanned from the share index (for telling if the index is empty)
+		 *
+		 * @param arg - the found status <return>
+		 * @param key - the key
+		 */
+		static void findShareKey_(void *arg, const std::string &key);
+
+		/*
+		 * load the limit of the share container ids handed out from the database
+		 *
+		 * @return - a boolean value that indicates if the load op succeeds
+		 */
+		bool loadShareContainerIDLimit_();
+
+		/*
+		 * hand out a new share container id (raising the recorded limit in the database if necessary)
+		 *
+		 * @param shareContainerID - the share container id <return>
+		 *
+		 * @return - a boolean value that indicates if an id is handed out
+		 */
+		bool newShareContainerID_(uint64_t &shareContainerID);
+
+		/*
+		 * transform a share container id to the full name of the share container
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param shareContainerName - the full share container name <return>
+		 */
+		void shareContainerID2Name_(const uint64_t &shareContainerID, std::string &shareContainerName);
+
+		/*
+		 * load the index cache from its snapshot, or fill its filter with all share keys in the database
+		 *
+		 * @return - a boolean value that indicates if the load op succeeds
+		 */
+		bool loadIndexCache_();
+
+		/*
+		 * add a key scanned from the share index into the filter of the index cache
+		 *
+		 * @param arg - the index cache
+		 * @param key - the key
+		 */
+		static void addCacheKey_(void *arg, const std::string &key);
+
+		/*
+		 * release the pending share index entries committed by a container writer (or dropped by a failed one, 
+		 * so they stay uncommitted, and the shares are stored again when they come next time)
+		 *
+		 * @param arg - the DedupCore instance
+		 * @param keyList - the keys of the entries
+		 * @param commitStat - if the entries are committed
+		 */
+		static void releasePendingShares_(void *arg, const std::vector<std::string> &keyList, bool commitStat);
+
+		/*
+		 * store the recipes handed off to the recipe writer, once the share containers of their entries are durable
+		 *
+		 * @param arg - the DedupCore instance
+		 * @param recipeNode - the node of the recipes
+		 *
+		 * @return - a boolean value that indicates if the store op succeeds
+		 */
+		static bool writeRecipeFile_(void *arg, const containerNode_t *recipeNode);
+
+		/*
+		 * look up the share index values of a list of keys, through the index cache
+		 *
+		 * @param keyList - the index keys
+		 * @param valueList - the values of the keys <return>
+		 * @param statList - the lookup status of the keys <return>
+		 */
+		void getShareBatch_(const std::vector<std::string> &keyList, std::vector<std::string> &valueList, 
+				std::vector<leveldb::Status> &statList);
 
 		/*
-		 * update the index for a share based on intra-user deduplication
+		 * sort a batch of shares by fingerprint and group the shares with the same fingerprint
+		 *
+		 * @param shareList - the shares (sorted by fingerprint on return, with the first share of each group 
+		 *                    recording the size of the group)
+		 * @param keyList - the index key of each group <return>
+		 */
+		void groupShareBatch_(std::vector<shareBatchEntry_t> &shareList, std::vector<std::string> &keyList);
+
+		/*
+		 * look up the locations of a batch of existing shares
+		 *
+		 * @param shareList - the shares (sorted by fingerprint on return, with the first share of each group 
+		 *                    recording the share index value)
 		 *
-		 * @param shareFP - the fingerprint of the share 
+		 * @return - a boolean value that indicates if all shares are found
+		 */
+		bool locateShareBatch_(std::vector<shareBatchEntry_t> &shareList);
+
+		/*
+		 * update the index for a batch of shares based on intra-user deduplication
+		 *
+		 * @param shareList - the shares of a metadata buffer (sorted by fingerprint on return)
 		 * @param userID - the user id 
-		 * @param intraUserDupStat - a boolean value that indicates if the key is a duplicate <return>
+		 * @param intraUserDupStatList - a list that records the intra-user duplicate status of each share <return>
 		 *
 		 * @return - a boolean value that indicates if the update op succeeds
 		 */
-		bool intraUserIndexUpdate_(char *shareFP, const int &userID, bool &intraUserDupStat);
+		bool intraUserIndexUpdate_(std::vector<shareBatchEntry_t> &shareList, const int &userID, 
+				bool *intraUserDupStatList);
 
 		/*
-		 * update the index for a share based on inter-user deduplication
+		 * update the index for a batch of shares based on inter-user deduplication
 		 *
-		 * @param shareFP - the fingerprint of the share 
+		 * @param shareList - the non-duplicate shares of a metadata buffer (sorted by fingerprint on return, 
+		 *                    with the first share of each group recording the share index value)
 		 * @param userID - the user id 
-		 * @param shareSize - the size of the corresponding share 
 		 * @param targetBufferNode - the corresponding buffer node 
 		 * @param shareDataBuffer - the share data buffer
-		 * @param shareDataBufferOffset - the offset of the share data buffer
 		 *
 		 * @return - a boolean value that indicates if the update op succeeds
 		 */
-		bool interUserIndexUpdate_(char *shareFP, const int &userID, const int &shareSize, 
-				perUserBufferNode_t *targetBufferNode, unsigned char *shareDataBuffer, const int &shareDataBufferOffset);
+		bool interUserIndexUpdate_(std::vector<shareBatchEntry_t> &shareList, const int &userID, 
+				perUserBufferNode_t *targetBufferNode, unsigned char *shareDataBuffer);
+
+		/*
+		 * hand off the data of the recipe file buffer to the recipe writer, after the share containers of its entries
+		 *
+		 * @param targetBufferNode - the corresponding buffer node 
+		 * @param recipeFileName - the full recipe file name
+		 * @param recipeFileOffset - the offset of the file recipe head that the entries are appended to 
+		 * (-1 for a new recipe file)
+		 * @param finishStat - if the last file of the recipes is finished
+		 *
+		 * @return - a boolean value that indicates if the hand-off op succeeds
+		 */
+		bool handOffRecipeFile_(perUserBufferNode_t *targetBufferNode, const std::string &recipeFileName, 
+				const int &recipeFileOffset, const bool &finishStat);
 
 		/*
 		 * store the data of the recipe file buffer into a new recipe file
 		 *
 		 * @param targetBufferNode - the corresponding buffer node 
-		 * @param recipeFileName - the recipe file name <return>
+		 * @param finishStat - if the last file of the recipes is finished
 		 *
 		 * @return - a boolean value that indicates if the store op succeeds
 		 */
-		bool storeNewRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName);
+		bool storeNewRecipeFile_(perUserBufferNode_t *targetBufferNode, const bool &finishStat);
 
 		/*
 		 * find an old recipe file for appending the data of the recipe file buffer
@@ -444,24 +1029,74 @@ class DedupCore{
 		 * append the data of the recipe file buffer to an old recipe file
 		 *
 		 * @param targetBufferNode - the corresponding buffer node 
-		 * @param recipeFileName - the recipe file name <return> 
+		 * @param finishStat - if the file is finished
 		 *
 		 * @return - a boolean value that indicates if the append op succeeds
 		 */
-		bool appendOldRecipeFile_(perUserBufferNode_t *targetBufferNode, std::string &recipeFileName);
+		bool appendOldRecipeFile_(perUserBufferNode_t *targetBufferNode, const bool &finishStat);
 
 		/*
-		 * store the data of the share container buffer into a container
+		 * append the file recipe entries of a recipe file buffer to the recipe of the file in an open recipe file, 
+		 * and update its file recipe head there
+		 *
+		 * @param recipeFileBuffer - the data of the recipe file buffer (the head of the file, and its entries)
+		 * @param fp - the recipe file
+		 * @param recipeFileName - the full recipe file name
+		 * @param recipeFileOffset - the offset of the file recipe head in the recipe file
+		 *
+		 * @return - a boolean value that indicates if the append op succeeds
+		 */
+		bool appendRecipeEntries_(const unsigned char *recipeFileBuffer, FILE *fp, const std::string &recipeFileName, 
+				const int &recipeFileOffset);
+
+		/*
+		 * hand off the data of the share container buffer to the container writer, and renew the buffer
 		 *
 		 * @param targetBufferNode - the corresponding buffer node 
-		 * @param shareContainerName - the share container name <return> 
 		 *
 		 * @return - a boolean value that indicates if the store op succeeds
 		 */
-		bool storeShareContainer_(perUserBufferNode_t *targetBufferNode, std::string &shareContainerName);
+		bool storeShareContainer_(perUserBufferNode_t *targetBufferNode);
+
+		/*
+		 * add a file recipe entry to the offset index of the file being received
+		 *
+		 * @param targetBufferNode - the corresponding buffer node 
+		 * @param secretSize - the secret size of the entry
+		 */
+		void addOffsetCheckpoint_(perUserBufferNode_t *targetBufferNode, const int &secretSize);
+
+		/*
+		 * store the offset index of the file being received into the database
+		 *
+		 * @param targetBufferNode - the corresponding buffer node 
+		 *
+		 * @return - a boolean value that indicates if the store op succeeds
+		 */
+		bool storeOffsetIndex_(perUserBufferNode_t *targetBufferNode);
+
+		/*
+		 * locate the file recipe entries that cover a byte range of a file
+		 *
+		 * @param pInodeFileEntry - the inode file entry of the file 
+		 * @param recipeFilePointer - the opened recipe file, or NULL if the recipe file is in recipeFileBuffer
+		 * @param recipeFileBuffer - the buffer that stores the recipe file
+		 * @param recipeEntrySize - the size of the file recipe entries in the recipe file
+		 * @param numOfShares - the total number of shares of the file
+		 * @param rangeOffset - the offset of the range
+		 * @param rangeLength - the length of the range, or RANGE_TO_END
+		 * @param startEntry - the index of the first covering entry <return>
+		 * @param numOfRangeShares - the number of covering entries <return>
+		 * @param firstSecretOffset - the file offset of the first covering secret <return>
+		 *
+		 * @return - a boolean value that indicates if the locate op succeeds
+		 */
+		bool locateRange_(inodeFileEntry_t *pInodeFileEntry, FILE *recipeFilePointer, unsigned char *recipeFileBuffer, 
+				const int &recipeEntrySize, const int &numOfShares, const long &rangeOffset, const long &rangeLength, 
+				int &startEntry, int &numOfRangeShares, long &firstSecretOffset);
 
 		/*
-		 * read the recipe file from the buffer node link
+		 * read the recipe file from the buffer node pool
 		 *
 		 * @param userID - the user id
 		 * @param recipeFileName - the name of the recipe file
@@ -473,15 +1108,174 @@ class DedupCore{
 				unsigned char *recipeFileBuffer);
 
 		/*
-		 * read the share container from the buffer node link
+		 * read a part of a share container from the buffer node pool
+		 *
+		 * @param shareContainerID - the id of the share container
+		 * @param offset - the offset of the part in the share container
+		 * @param size - the size of the part
+		 * @param buffer - the buffer for storing the part <return>
+		 *
+		 * @return - a boolean value that indicates if the share container is in the buffer node pool
+		 */
+		bool readShareContainerFromBuffer_(const uint64_t &shareContainerID, const int &offset, const int &size, 
+				unsigned char *buffer);
+
+		/*
+		 * select the container writer of a new share container (the least queued one, in turn among equals)
+		 *
+		 * @return - the container writer
+		 */
+		ContainerWriter *selectContainerWriter_();
+
+		/*
+		 * read a part of a share container from the queues of the container writers
+		 *
+		 * @param shareContainerID - the id of the share container
+		 * @param offset - the offset of the part in the share container
+		 * @param size - the size of the part
+		 * @param buffer - the buffer for storing the part <return>
+		 *
+		 * @return - a boolean value that indicates if the share container is in a queue
+		 */
+		bool readShareContainerFromWriters_(const uint64_t &shareContainerID, const int &offset, const int &size, 
+				unsigned char *buffer);
+
+		/*
+		 * open the file of a share container on disk (a segment file, or the own file of an old share container)
+		 *
+		 * @param shareContainerID - the id of the share container
+		 * @param source - the share container being read, which is replaced if it is another one <return>
+		 *
+		 * @return - a boolean value that indicates if the open op succeeds
+		 */
+		bool openShareContainer_(const uint64_t &shareContainerID, containerSource_t *source);
+
+		/*
+		 * close the file of the share container being read
+		 *
+		 * @param source - the share container being read
+		 */
+		void closeShareContainer_(containerSource_t *source);
+
+		/*
+		 * verify the fingerprints of a run of non-duplicate shares
+		 *
+		 * @param shareList - the non-duplicate shares
+		 * @param shareDataBuffer - the buffer of the share data
+		 * @param startPos - the position of the first share of the run in shareList
+		 * @param endPos - the position after the last share of the run
+		 * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprints
+		 *
+		 * @return - the position of the first share whose fingerprint is inconsistent, or -1 if there is none
+		 */
+		static int verifyShareRun_(std::vector<shareBatchEntry_t> &shareList, unsigned char *shareDataBuffer, 
+				const int &startPos, const int &endPos, CryptoPrimitive *cryptoObj);
+
+		/*
+		 * verify the fingerprints of the non-duplicate shares of a batch (the runs of shares are hashed by 
+		 * the hashing threads, and the first run by the calling thread)
+		 *
+		 * @param shareList - the non-duplicate shares
+		 * @param shareDataBuffer - the buffer of the share data
+		 * @param cryptoObj - the CryptoPrimitive instance of the calling thread
+		 *
+		 * @return - the position of the first share whose fingerprint is inconsistent found, or -1 if there is none
+		 */
+		int verifyShareBatch_(std::vector<shareBatchEntry_t> &shareList, unsigned char *shareDataBuffer, 
+				CryptoPrimitive *cryptoObj);
+
+		/*
+		 * the main procedure of a hashing thread
+		 *
+		 * @param param - the DedupCore instance
+		 */
+		static void *hashHandler_(void *param);
+
+		/*
+		 * check if a share container is not durable yet (i.e. in the buffer node pool or a writer queue)
+		 *
+		 * @param shareContainerID - the id of the share container
+		 *
+		 * @return - a boolean value that indicates if the share container is not durable yet
+		 */
+		bool shareContainerIsPending_(const uint64_t &shareContainerID);
+
+		/*
+		 * read an extent of a share container on disk into the extent buffer of the source, and cache it
 		 *
-		 * @param shareContainerName - the name of the share container
-		 * @param shareContainerBuffer - the buffer for storing the share container <return>
+		 * @param shareContainerID - the id of the share container
+		 * @param extentID - the extent id
+		 * @param source - the share container on disk being read
+		 * @param readSize - the size of the extent <return>
 		 *
 		 * @return - a boolean value that indicates if the read op succeeds
 		 */
-		bool readShareContainerFromBuffer_(char *shareContainerName, 
-				unsigned char *shareContainerBuffer);
+		bool readExtent_(const uint64_t &shareContainerID, const long &extentID, containerSource_t *source, 
+				int &readSize);
+
+		/*
+		 * read the data of a share (from the extent cache, the buffer node pool, the container writers, or 
+		 * the extents of its share container on disk, which are then cached)
+		 *
+		 * @param pShareIndexValue - the location of the share
+		 * @param source - the share container on disk being read by the restore
+		 * @param shareBuffer - the buffer for storing the share data <return>
+		 *
+		 * @return - a boolean value that indicates if the read op succeeds
+		 */
+		bool readShare_(const shareIndexValue_t *pShareIndexValue, containerSource_t *source, 
+				unsigned char *shareBuffer);
+
+		/*
+		 * prepare to send a share from the file of its share container (only a large share that is durable 
+		 * and not cached is sent so)
+		 *
+		 * @param pShareIndexValue - the location of the share
+		 * @param source - the share container on disk being read by the restore
+		 * @param zeroCopyShare - the share to send from the file <return>
+		 *
+		 * @return - a boolean value that indicates if the share is sent from the file
+		 */
+		bool prepareZeroCopyShare_(const shareIndexValue_t *pShareIndexValue, containerSource_t *source, 
+				zeroCopyShare_t &zeroCopyShare);
+
+		/*
+		 * close the files of the shares to send from the files
+		 *
+		 * @param zeroCopyList - the shares to send from the files <return>
+		 */
+		void closeZeroCopyShares_(std::vector<zeroCopyShare_t> &zeroCopyList);
+
+		/*
+		 * send the share file buffer, with the shares to send from the files at their positions 
+		 * (the files are closed afterwards)
+		 *
+		 * @param socketFD - the socket
+		 * @param shareFileBuffer - the share file buffer, which starts with the space of the message head
+		 * @param shareFileBufferOffset - the size of the data in the share file buffer
+		 * @param zeroCopyList - the shares to send from the files, in order of their positions <return>
+		 *
+		 * @return - a boolean value that indicates if the send op succeeds
+		 */
+		bool sendShareFileBuffer_(int socketFD, unsigned char *shareFileBuffer, const int &shareFileBufferOffset, 
+				std::vector<zeroCopyShare_t> &zeroCopyList);
+
+		/*
+		 * hand off the extents needed by a run of file recipe entries to the prefetch threads, grouped by 
+		 * share container (the cached extents and the share containers that are not durable are skipped)
+		 *
+		 * @param recipeEntryBuffer - the buffer of the file recipe entries
+		 * @param recipeEntrySize - the size of a file recipe entry (the old ones carry no share location)
+		 * @param numOfEntries - the number of the file recipe entries
+		 */
+		void prefetchShares_(unsigned char *recipeEntryBuffer, const int &recipeEntrySize, const int &numOfEntries);
+
+		/*
+		 * the main procedure of a prefetch thread
+		 *
+		 * @param param - the DedupCore instance
+		 */
+		static void *prefetchHandler_(void *param);
 
 	public:
 		/*
@@ -493,13 +1287,20 @@ class DedupCore{
 		 * @param shareContainerDirName - the name of the directory that stores the share containers
 		 * @param recipeStorerObj - the BackendStorer instance that manages recipe files
 		 * @param containerStorerObj - the BackendStorer instance that manages share containers	
+		 * @param indexCacheSize - the memory budget of the share index cache (in bytes)
+		 * @param indexEngine - the engine of the share index (LEVELDB_INDEX_ENGINE or FPSTORE_INDEX_ENGINE)
+		 * @param extraContainerDirNames - the names of further directories (e.g. on other disks) that store the 
+		 * share containers with shareContainerDirName (not under dedupDirName; the list may only grow at a restart)
 		 */
 		DedupCore(const std::string &dedupDirName = "./", 
 				const std::string &dbDirName = "DedupDB/", 
 				const std::string &recipeFileDirName = "RecipeFiles/", 
 				const std::string &shareContainerDirName = "ShareContainers/",
 				BackendStorer *recipeStorerObj = NULL, 
-				BackendStorer *containerStorerObj = NULL);
+				BackendStorer *containerStorerObj = NULL,
+				long indexCacheSize = DEFAULT_INDEX_CACHE_SIZE,
+				int indexEngine = LEVELDB_INDEX_ENGINE,
+				const std::vector<std::string> &extraContainerDirNames = std::vector<std::string>());
 
 		/* 
 		 * destructor of DedupCore 
@@ -537,7 +1338,19 @@ class DedupCore{
 				bool *intraUserDupStatList, unsigned char *shareDataBuffer, CryptoPrimitive *cryptoObj);
 
 		/*
-		 * clean up the buffer node for a user in the buffer node link
+		 * finish a file with its trailer, which commits the final file size and 
+		 * appends the remain of a partial file to a previous recipe file
+		 *
+		 * @param userID - the user id 
+		 * @param trailerBuffer - the buffer that stores the file share metadata trailer
+		 * @param trailerSize - the size of the trailer buffer
+		 *
+		 * @return - a boolean value that indicates if the finish op succeeds
+		 */
+		bool finishFileWithTrailer(const int &userID, unsigned char *trailerBuffer, const int &trailerSize);
+
+		/*
+		 * clean up the buffer node for a user in the buffer node pool
 		 *
 		 * @param userID - the user id
 		 *
@@ -546,25 +1359,36 @@ class DedupCore{
 		bool cleanupUserBufferNode(const int &userID);
 
 		/*
-		 * clean up the buffer nodes for all users in the buffer node link
+		 * clean up the buffer nodes for all users in the buffer node pool
 		 *
 		 * @return - a boolean value that indicates if the clean-up op succeeds
 		 */
 		bool cleanupAllBufferNodes();
 
 		/*
-		 * restore a share file for a user and send it through the socket
+		 * wait for the container writer, checkpoint the share index and save the index cache for the next start of the server
+		 * (the share index is frozen from then on, so that the snapshot stays complete until the server exits)
+		 *
+		 * @return - a boolean value that indicates if the save op succeeds
+		 */
+		bool saveIndexCache();
+
+		/*
+		 * restore a share file (or the shares covering a byte range of it) for a user and send it through the socket
 		 *
 		 * @param userID - the user id
 		 * @param fullFileName - the full name of the original file 
 		 * @param versionNumber - the version number (<=0) of the original file 
 		 * @param socketFD - the file descriptor of the sending socket
 		 * @param cryptoObj - the CryptoPrimitive instance for calculating hash fingerprint
+		 * @param rangeOffset - the offset of the range to restore
+		 * @param rangeLength - the length of the range to restore, or RANGE_TO_END
 		 *
 		 * @return - a boolean value that indicates if the restore op succeeds
 		 */
 		bool restoreShareFile(const int &userID, const std::string &fullFileName, const int &versionNumber, 
-				int socketFD, CryptoPrimitive *cryptoObj);
+				int socketFD, CryptoPrimitive *cryptoObj, const long &rangeOffset = 0, 
+				const long &rangeLength = RANGE_TO_END);
 };
 
 #endif
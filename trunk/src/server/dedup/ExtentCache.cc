@@ -0,0 +1,222 @@
+/*
+ * ExtentCache.cc
+ */
+
+#include "ExtentCache.hh"
+
+using namespace std;
+
+/*
+ * constructor of ExtentCache
+ *
+ * @param memoryBudget - the memory budget (in bytes)
+ */
+ExtentCache::ExtentCache(long memoryBudget) {
+	memoryBudget_ = memoryBudget;
+
+	shardCapacity_ = memoryBudget_ / NUM_EXTENT_CACHE_SHARDS;
+	a1inCapacity_ = shardCapacity_ * EXTENT_CACHE_A1IN_PERCENT / 100;
+	a1outCapacity_ = shardCapacity_ / EXTENT_SIZE * EXTENT_CACHE_A1OUT_PERCENT / 100;
+	if (a1outCapacity_ < 1) {
+		a1outCapacity_ = 1;
+	}
+
+	for (int i = 0; i < NUM_EXTENT_CACHE_SHARDS; i++) {
+		if (pthread_mutex_init(&shards_[i].lock, NULL) != 0) {
+			fprintf(stderr, "Error: fail to initialize the mutex locks of the extent cache shards!\n");
+			exit(1);
+		}
+		shards_[i].a1inUsage = 0;
+		shards_[i].amUsage = 0;
+	}
+
+	numOfHits_ = 0;
+	numOfMisses_ = 0;
+}
+
+/*
+ * destructor of ExtentCache
+ */
+ExtentCache::~ExtentCache() {
+	for (int i = 0; i < NUM_EXTENT_CACHE_SHARDS; i++) {
+		pthread_mutex_destroy(&shards_[i].lock);
+	}
+}
+
+/*
+ * get the shard of an extent
+ *
+ * @param key - the key of the extent
+ *
+ * @return - the shard
+ */
+inline ExtentCache::extentShard_t *ExtentCache::shard_(const extentKey_t &key) {
+	uint64_t hash = (key.first * 0x9E3779B97F4A7C15ULL) ^ (uint64_t) key.second;
+
+	hash ^= hash >> 29;
+
+	return &shards_[hash % NUM_EXTENT_CACHE_SHARDS];
+}
+
+/*
+ * evict extents until a shard fits into its capacity (the caller holds the lock of the shard)
+ *
+ * @param targetShard - the shard
+ */
+void ExtentCache::reclaim_(extentShard_t *targetShard) {
+	while (targetShard->a1inUsage + targetShard->amUsage > shardCapacity_) {
+		/*evict from A1in while it is over its share (or Am is empty), and remember the key in A1out*/
+		if ((targetShard->a1inUsage > a1inCapacity_) || targetShard->amList.empty()) {
+			extentEntry_t &victim = targetShard->a1inList.back();
+
+			targetShard->a1outList.push_front(victim.key);
+			targetShard->a1outMap[victim.key] = targetShard->a1outList.begin();
+			if ((long) targetShard->a1outList.size() > a1outCapacity_) {
+				targetShard->a1outMap.erase(targetShard->a1outList.back());
+				targetShard->a1outList.pop_back();
+			}
+
+			targetShard->a1inUsage -= victim.data.size();
+			targetShard->extentMap.erase(victim.key);
+			targetShard->a1inList.pop_back();
+		}
+		/*or evict the least recently used extent of Am*/
+		else {
+			extentEntry_t &victim = targetShard->amList.back();
+
+			targetShard->amUsage -= victim.data.size();
+			targetShard->extentMap.erase(victim.key);
+			targetShard->amList.pop_back();
+		}
+	}
+}
+
+/*
+ * read a part of a cached extent
+ *
+ * @param shareContainerID - the share container id
+ * @param extentID - the extent id (the offset of the extent in the share container / EXTENT_SIZE)
+ * @param offset - the offset of the part in the extent
+ * @param size - the size of the part
+ * @param buffer - the buffer for storing the part <return>
+ *
+ * @return - a boolean value that indicates if the extent is cached
+ */
+bool ExtentCache::read(const uint64_t &shareContainerID, const long &extentID, const int &offset, const int &size,
+		unsigned char *buffer) {
+	extentKey_t key(shareContainerID, extentID);
+	extentShard_t *targetShard = shard_(key);
+	extentMap_t::iterator it;
+
+	pthread_mutex_lock(&targetShard->lock);
+
+	it = targetShard->extentMap.find(key);
+	if ((it == targetShard->extentMap.end()) || (offset + size > (long) it->second->data.size())) {
+		pthread_mutex_unlock(&targetShard->lock);
+
+		__sync_fetch_and_add(&numOfMisses_, 1);
+
+		return 0;
+	}
+
+	memcpy(buffer, it->second->data.data() + offset, size);
+
+	/*an extent in A1in stays in place (2Q counts the reads of a scan only once)*/
+	if (it->second->frequentStat) {
+		targetShard->amList.splice(targetShard->amList.begin(), targetShard->amList, it->second);
+	}
+
+	pthread_mutex_unlock(&targetShard->lock);
+
+	__sync_fetch_and_add(&numOfHits_, 1);
+
+	return 1;
+}
+
+/*
+ * check if an extent is cached (it does not count as a read)
+ *
+ * @param shareContainerID - the share container id
+ * @param extentID - the extent id
+ *
+ * @return - a boolean value that indicates if the extent is cached
+ */
+bool ExtentCache::contains(const uint64_t &shareContainerID, const long &extentID) {
+	extentKey_t key(shareContainerID, extentID);
+	extentShard_t *targetShard = shard_(key);
+	bool isCached;
+
+	pthread_mutex_lock(&targetShard->lock);
+	isCached = (targetShard->extentMap.find(key) != targetShard->extentMap.end());
+	pthread_mutex_unlock(&targetShard->lock);
+
+	return isCached;
+}
+
+/*
+ * insert an extent that has been read from the disk
+ *
+ * @param shareContainerID - the share container id
+ * @param extentID - the extent id
+ * @param extent - the data of the extent
+ * @param extentSize - the size of the extent (less than EXTENT_SIZE at the end of a share container)
+ */
+void ExtentCache::insert(const uint64_t &shareContainerID, const long &extentID, const unsigned char *extent,
+		const int &extentSize) {
+	extentKey_t key(shareContainerID, extentID);
+	extentShard_t *targetShard = shard_(key);
+	ghostMap_t::iterator ghostIt;
+	extentEntry_t entry;
+
+	pthread_mutex_lock(&targetShard->lock);
+
+	/*another restore may have read the extent meanwhile*/
+	if (targetShard->extentMap.find(key) != targetShard->extentMap.end()) {
+		pthread_mutex_unlock(&targetShard->lock);
+
+		return;
+	}
+
+	entry.key = key;
+
+	/*an extent that is read again after leaving A1in goes to Am, and a new one goes to A1in*/
+	ghostIt = targetShard->a1outMap.find(key);
+	if (ghostIt != targetShard->a1outMap.end()) {
+		targetShard->a1outList.erase(ghostIt->second);
+		targetShard->a1outMap.erase(ghostIt);
+
+		entry.frequentStat = 1;
+		targetShard->amList.push_front(entry);
+		targetShard->amList.front().data.assign((const char *) extent, extentSize);
+		targetShard->extentMap[key] = targetShard->amList.begin();
+		targetShard->amUsage += extentSize;
+	}
+	else {
+		entry.frequentStat = 0;
+		targetShard->a1inList.push_front(entry);
+		targetShard->a1inList.front().data.assign((const char *) extent, extentSize);
+		targetShard->extentMap[key] = targetShard->a1inList.begin();
+		targetShard->a1inUsage += extentSize;
+	}
+
+	reclaim_(targetShard);
+
+	pthread_mutex_unlock(&targetShard->lock);
+}
+
+/*
+ * print the statistics of the cache
+ */
+void ExtentCache::printStat() {
+	long numOfA1inExtents = 0, numOfAmExtents = 0;
+
+	for (int i = 0; i < NUM_EXTENT_CACHE_SHARDS; i++) {
+		pthread_mutex_lock(&shards_[i].lock);
+		numOfA1inExtents += shards_[i].a1inList.size();
+		numOfAmExtents += shards_[i].amList.size();
+		pthread_mutex_unlock(&shards_[i].lock);
+	}
+
+	fprintf(stderr, "Extent cache: %ld extents in A1in, %ld extents in Am, %ld hits, %ld misses\n",
+			numOfA1inExtents, numOfAmExtents, numOfHits_, numOfMisses_);
+}
@@ -0,0 +1,157 @@
+/*
+ * ExtentCache.hh
+ */
+
+#ifndef __EXTENTCACHE_HH__
+#define __EXTENTCACHE_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <utility>
+#include <unistd.h>
+#include <pthread.h>
+
+/*for the use of boost unordered_map*/
+#include <boost/unordered_map.hpp>
+
+/*macro for the default memory budget of the extent cache*/
+#define DEFAULT_EXTENT_CACHE_SIZE (256<<20)
+
+/*macro for the size of an extent (the aligned unit of a share container that is read and cached)*/
+#define EXTENT_SIZE (128<<10)
+
+/*macro for the number of shards of the extent cache*/
+#define NUM_EXTENT_CACHE_SHARDS 16
+
+/*macros for the 2Q queues: the share of the budget for the extents seen once, and the number of the
+  remembered extents evicted from there (in percent of the number of extents that fit into the budget)*/
+#define EXTENT_CACHE_A1IN_PERCENT 25
+#define EXTENT_CACHE_A1OUT_PERCENT 50
+
+using namespace std;
+
+/*
+ * a server-wide cache of the extents of the share containers on disk, with the 2Q replacement policy:
+ * an extent read for the first time enters a FIFO queue (A1in), and is only promoted into the LRU queue
+ * (Am) if it is read again after being evicted from there while its key is still remembered (A1out),
+ * so that a restore scanning cold data does not flush the extents that are read over and over
+ *
+ * note: only the extents of durable share containers are cached, which never change
+ */
+class ExtentCache {
+	private:
+		/*the key of an extent (share container id, extent id)*/
+		typedef std::pair<uint64_t, long> extentKey_t;
+
+		/*the entry structure of a cached extent*/
+		typedef struct {
+			extentKey_t key;
+			std::string data;
+			bool frequentStat; /*true if it is in Am*/
+		} extentEntry_t;
+
+		typedef std::list<extentEntry_t> extentList_t;
+		typedef boost::unordered_map<extentKey_t, extentList_t::iterator> extentMap_t;
+		typedef std::list<extentKey_t> ghostList_t;
+		typedef boost::unordered_map<extentKey_t, ghostList_t::iterator> ghostMap_t;
+
+		/*the shard structure of the extent cache*/
+		typedef struct {
+			pthread_mutex_t lock;
+			extentList_t a1inList;
+			extentList_t amList;
+			extentMap_t extentMap;
+			ghostList_t a1outList;
+			ghostMap_t a1outMap;
+			long a1inUsage;
+			long amUsage;
+		} extentShard_t;
+
+		/*the memory budget of the whole cache*/
+		long memoryBudget_;
+
+		/*the shards, and the capacities of each shard*/
+		extentShard_t shards_[NUM_EXTENT_CACHE_SHARDS];
+		long shardCapacity_;
+		long a1inCapacity_;
+		long a1outCapacity_;
+
+		/*statistics*/
+		long numOfHits_;
+		long numOfMisses_;
+
+		/*
+		 * get the shard of an extent
+		 *
+		 * @param key - the key of the extent
+		 *
+		 * @return - the shard
+		 */
+		inline extentShard_t *shard_(const extentKey_t &key);
+
+		/*
+		 * evict extents until a shard fits into its capacity (the caller holds the lock of the shard)
+		 *
+		 * @param targetShard - the shard
+		 */
+		void reclaim_(extentShard_t *targetShard);
+
+	public:
+		/*
+		 * constructor of ExtentCache
+		 *
+		 * @param memoryBudget - the memory budget (in bytes)
+		 */
+		ExtentCache(long memoryBudget = DEFAULT_EXTENT_CACHE_SIZE);
+
+		/*
+		 * destructor of ExtentCache
+		 */
+		~ExtentCache();
+
+		/*
+		 * read a part of a cached extent
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param extentID - the extent id (the offset of the extent in the share container / EXTENT_SIZE)
+		 * @param offset - the offset of the part in the extent
+		 * @param size - the size of the part
+		 * @param buffer - the buffer for storing the part <return>
+		 *
+		 * @return - a boolean value that indicates if the extent is cached
+		 */
+		bool read(const uint64_t &shareContainerID, const long &extentID, const int &offset, const int &size,
+				unsigned char *buffer);
+
+		/*
+		 * check if an extent is cached (it does not count as a read)
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param extentID - the extent id
+		 *
+		 * @return - a boolean value that indicates if the extent is cached
+		 */
+		bool contains(const uint64_t &shareContainerID, const long &extentID);
+
+		/*
+		 * insert an extent that has been read from the disk
+		 *
+		 * @param shareContainerID - the share container id
+		 * @param extentID - the extent id
+		 * @param extent - the data of the extent
+		 * @param extentSize - the size of the extent (less than EXTENT_SIZE at the end of a share container)
+		 */
+		void insert(const uint64_t &shareContainerID, const long &extentID, const unsigned char *extent,
+				const int &extentSize);
+
+		/*
+		 * print the statistics of the cache
+		 */
+		void printStat();
+};
+
+#endif
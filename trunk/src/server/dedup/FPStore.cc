@@ -0,0 +1,1083 @@
+/*
+ * FPStore.cc
+ */
+
+#include "FPStore.hh"
+
+using namespace std;
+
+/*
+ * write a whole buffer into a file
+ *
+ * @param fd - the file descriptor
+ * @param buffer - the buffer
+ * @param bufferSize - the size of the buffer
+ * @param offset - the offset in the file (-1 for the current offset)
+ *
+ * @return - a boolean value that indicates if the write op succeeds
+ */
+static bool writeAll(int fd, const char *buffer, long bufferSize, long offset) {
+	long doneSize = 0;
+	long ret;
+
+	while (doneSize < bufferSize) {
+		if (offset < 0) {
+			ret = ::write(fd, buffer + doneSize, bufferSize - doneSize);
+		}
+		else {
+			ret = pwrite(fd, buffer + doneSize, bufferSize - doneSize, offset + doneSize);
+		}
+
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return 0;
+		}
+		doneSize += ret;
+	}
+
+	return 1;
+}
+
+/*
+ * read a whole buffer from a file
+ *
+ * @param fd - the file descriptor
+ * @param buffer - the buffer <return>
+ * @param bufferSize - the size of the buffer
+ * @param offset - the offset in the file (-1 for the current offset)
+ *
+ * @return - the number of bytes read (less than bufferSize at the end of the file), or -1 on error
+ */
+static long readAll(int fd, char *buffer, long bufferSize, long offset) {
+	long doneSize = 0;
+	long ret;
+
+	while (doneSize < bufferSize) {
+		if (offset < 0) {
+			ret = read(fd, buffer + doneSize, bufferSize - doneSize);
+		}
+		else {
+			ret = pread(fd, buffer + doneSize, bufferSize - doneSize, offset + doneSize);
+		}
+
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret < 0) {
+			return -1;
+		}
+		if (ret == 0) {
+			break;
+		}
+		doneSize += ret;
+	}
+
+	return doneSize;
+}
+
+/*
+ * constructor of FPStore
+ *
+ * @param dirName - the name of the store directory
+ */
+FPStore::FPStore(const std::string &dirName) {
+	long numOfBatches, numOfOldBatches = 0;
+	int oldLogFD;
+	long i;
+	int p;
+
+	dirName_ = dirName;
+	if (dirName_.empty() || dirName_[dirName_.size() - 1] != '/') {
+		dirName_ += "/";
+	}
+
+	if (mkdir(dirName_.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Error: fail to create the dir '%s'!\n", dirName_.c_str());
+		exit(1);
+	}
+
+	/*open all partitions*/
+	for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+		if (!openPartition_(p)) {
+			fprintf(stderr, "Error: fail to open the partition %d of the fingerprint store '%s'!\n", p, dirName_.c_str());
+			exit(1);
+		}
+	}
+
+	/*initialize the mutex locks logLock_ and checkpointLock_, and the condition syncCond_*/
+	if (pthread_mutex_init(&logLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock logLock_!\n");
+		exit(1);
+	}
+	if (pthread_mutex_init(&checkpointLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the mutex lock checkpointLock_!\n");
+		exit(1);
+	}
+	if (pthread_cond_init(&syncCond_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the condition syncCond_!\n");
+		exit(1);
+	}
+
+	/*recover the writes since the last checkpoint, starting with the log rotated by an unfinished checkpoint*/
+	oldLogStat_ = 0;
+	oldLogFD = open((dirName_ + FPSTORE_OLD_LOG_NAME).c_str(), O_RDONLY);
+	if (oldLogFD != -1) {
+		if (!replayLog_(oldLogFD, numOfOldBatches)) {
+			fprintf(stderr, "Error: fail to replay the old log of the fingerprint store '%s'!\n", dirName_.c_str());
+			exit(1);
+		}
+		close(oldLogFD);
+		oldLogStat_ = 1;
+	}
+	else if (errno != ENOENT) {
+		fprintf(stderr, "Error: fail to open the old log of the fingerprint store '%s'!\n", dirName_.c_str());
+		exit(1);
+	}
+
+	logFD_ = open((dirName_ + FPSTORE_LOG_NAME).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (logFD_ == -1) {
+		fprintf(stderr, "Error: fail to open the log of the fingerprint store '%s'!\n", dirName_.c_str());
+		exit(1);
+	}
+
+	if (!replayLog_(logFD_, numOfBatches)) {
+		fprintf(stderr, "Error: fail to replay the log of the fingerprint store '%s'!\n", dirName_.c_str());
+		exit(1);
+	}
+	numOfBatches += numOfOldBatches;
+
+	/*the log on the disk is durable, and it is rotated by the checkpoint below*/
+	logSize_ = lseek(logFD_, 0, SEEK_END);
+	logEnd_ = logSize_;
+	syncedLogEnd_ = logSize_;
+	syncingStat_ = 0;
+
+	if (numOfBatches > 0) {
+		/*the key counts may be stale after a crash, so they are recounted*/
+		for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+			fpPartition_t *targetPartition = &partitions_[p];
+
+			targetPartition->head->numOfKeys = 0;
+			for (i = 0; i < targetPartition->head->capacity; i++) {
+				if (targetPartition->records[i].valueSize != 0) {
+					targetPartition->head->numOfKeys++;
+				}
+			}
+		}
+		fprintf(stderr, "%ld batches have been recovered from the log of the fingerprint store.\n", numOfBatches);
+	}
+
+	if (!checkpoint()) {
+		fprintf(stderr, "Error: fail to checkpoint the fingerprint store '%s'!\n", dirName_.c_str());
+		exit(1);
+	}
+}
+
+/*
+ * destructor of FPStore
+ */
+FPStore::~FPStore() {
+	int p;
+
+	checkpoint();
+
+	for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+		munmap(partitions_[p].tableMap, partitions_[p].mapSize);
+		close(partitions_[p].tableFD);
+		close(partitions_[p].heapFD);
+		pthread_rwlock_destroy(&partitions_[p].lock);
+	}
+	close(logFD_);
+
+	pthread_cond_destroy(&syncCond_);
+	pthread_mutex_destroy(&checkpointLock_);
+	pthread_mutex_destroy(&logLock_);
+}
+
+/*
+ * hash a key
+ *
+ * @param key - the key
+ *
+ * @return - the 64-bit hash of the key
+ */
+inline uint64_t FPStore::hashKey_(const char *key) {
+	uint64_t hash;
+
+	/*the fingerprint is uniformly distributed, and its first byte selects the partition*/
+	memcpy(&hash, key + FPSTORE_PREFIX_SIZE + 1, sizeof(uint64_t));
+
+	return hash;
+}
+
+/*
+ * calculate the checksum of a log batch
+ *
+ * @param buffer - the body of the batch
+ * @param bufferSize - the size of the body
+ *
+ * @return - the checksum
+ */
+inline uint64_t FPStore::checksum_(const char *buffer, long bufferSize) {
+	uint64_t checksum = 14695981039346656037ULL;
+	long i;
+
+	/*FNV-1a*/
+	for (i = 0; i < bufferSize; i++) {
+		checksum ^= (unsigned char) buffer[i];
+		checksum *= 1099511628211ULL;
+	}
+
+	return checksum;
+}
+
+/*
+ * get the partition of a key
+ *
+ * @param key - the key
+ *
+ * @return - the partition
+ */
+inline FPStore::fpPartition_t *FPStore::partition_(const char *key) {
+	return &partitions_[(unsigned char) key[FPSTORE_PREFIX_SIZE]];
+}
+
+/*
+ * get the name of the table file of a partition
+ *
+ * @param partitionID - the partition id
+ *
+ * @return - the file name
+ */
+std::string FPStore::tableFileName_(int partitionID) {
+	char fileName[32];
+
+	sprintf(fileName, "part%03d.tbl", partitionID);
+
+	return dirName_ + fileName;
+}
+
+/*
+ * get the name of a heap file of a partition
+ *
+ * @param partitionID - the partition id
+ * @param heapGeneration - the generation of the heap file
+ *
+ * @return - the file name
+ */
+std::string FPStore::heapFileName_(int partitionID, long heapGeneration) {
+	char fileName[64];
+
+	sprintf(fileName, "part%03d-%ld.heap", partitionID, heapGeneration);
+
+	return dirName_ + fileName;
+}
+
+/*
+ * open/create a table file and map it into memory
+ *
+ * @param fileName - the name of the table file
+ * @param capacity - the capacity of a new table (ignored for an existing table)
+ * @param truncateStat - a boolean value that indicates if an existing file is dropped
+ * @param fd - the file descriptor <return>
+ * @param tableMap - the mapped table <return>
+ * @param mapSize - the size of the mapped table <return>
+ *
+ * @return - a boolean value that indicates if the open op succeeds
+ */
+bool FPStore::mapTable_(const std::string &fileName, long capacity, bool truncateStat, int &fd,
+		char *&tableMap, long &mapSize) {
+	struct stat fileStat;
+	fpTableHead_t *head;
+	bool newStat;
+
+	fd = open(fileName.c_str(), O_RDWR | O_CREAT | (truncateStat ? O_TRUNC : 0), 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Error: fail to open the table file '%s'!\n", fileName.c_str());
+
+		return 0;
+	}
+
+	if (fstat(fd, &fileStat) != 0) {
+		fprintf(stderr, "Error: fail to stat the table file '%s'!\n", fileName.c_str());
+		close(fd);
+
+		return 0;
+	}
+
+	/*a new table is created as a sparse file*/
+	newStat = (fileStat.st_size == 0);
+	if (newStat) {
+		mapSize = FPSTORE_HEAD_SIZE + capacity * FPSTORE_RECORD_SIZE;
+		if (ftruncate(fd, mapSize) != 0) {
+			fprintf(stderr, "Error: fail to allocate the table file '%s'!\n", fileName.c_str());
+			close(fd);
+
+			return 0;
+		}
+	}
+	else {
+		mapSize = fileStat.st_size;
+	}
+
+	tableMap = (char *) mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (tableMap == MAP_FAILED) {
+		fprintf(stderr, "Error: fail to map the table file '%s'!\n", fileName.c_str());
+		close(fd);
+
+		return 0;
+	}
+
+	head = (fpTableHead_t *) tableMap;
+	if (newStat) {
+		head->magic = FPSTORE_TABLE_MAGIC;
+		head->capacity = capacity;
+		head->numOfKeys = 0;
+		head->heapGeneration = 0;
+		head->heapSize = 0;
+	}
+	else if ((head->magic != FPSTORE_TABLE_MAGIC) || (head->capacity <= 0) ||
+			((head->capacity & (head->capacity - 1)) != 0) ||
+			(mapSize != FPSTORE_HEAD_SIZE + head->capacity * FPSTORE_RECORD_SIZE)) {
+		fprintf(stderr, "Error: the table file '%s' is corrupted!\n", fileName.c_str());
+		munmap(tableMap, mapSize);
+		close(fd);
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * open/create the table and heap files of a partition
+ *
+ * @param partitionID - the partition id
+ *
+ * @return - a boolean value that indicates if the open op succeeds
+ */
+bool FPStore::openPartition_(int partitionID) {
+	fpPartition_t *targetPartition = &partitions_[partitionID];
+	std::string tableFileName = tableFileName_(partitionID);
+
+	if (pthread_rwlock_init(&targetPartition->lock, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the read-write lock of a partition!\n");
+
+		return 0;
+	}
+
+	if (!mapTable_(tableFileName, FPSTORE_INIT_CAPACITY, 0, targetPartition->tableFD,
+				targetPartition->tableMap, targetPartition->mapSize)) {
+		return 0;
+	}
+	targetPartition->head = (fpTableHead_t *) targetPartition->tableMap;
+	targetPartition->records = (fpRecord_t *) (targetPartition->tableMap + FPSTORE_HEAD_SIZE);
+
+	/*drop the files of a grow op interrupted before it took effect*/
+	unlink((tableFileName + ".tmp").c_str());
+	unlink(heapFileName_(partitionID, targetPartition->head->heapGeneration + 1).c_str());
+
+	targetPartition->heapFD = open(heapFileName_(partitionID, targetPartition->head->heapGeneration).c_str(),
+			O_RDWR | O_CREAT, 0644);
+	if (targetPartition->heapFD == -1) {
+		fprintf(stderr, "Error: fail to open the heap file of the partition %d!\n", partitionID);
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * find the slot of a key in a table
+ *
+ * @param head - the head of the table
+ * @param records - the records of the table
+ * @param key - the key
+ * @param slot - the slot of the key, or the free slot for it <return>
+ *
+ * @return - a boolean value that indicates if the key is found
+ */
+bool FPStore::findSlot_(fpTableHead_t *head, fpRecord_t *records, const char *key, long &slot) {
+	long mask = head->capacity - 1;
+
+	/*the load limit keeps a free slot at the end of every probe sequence*/
+	slot = hashKey_(key) & mask;
+	while (records[slot].valueSize != 0) {
+		if (memcmp(records[slot].key, key, FPSTORE_KEY_SIZE) == 0) {
+			return 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return 0;
+}
+
+/*
+ * read the value of a record (the caller holds the lock of the partition)
+ *
+ * @param targetPartition - the partition
+ * @param record - the record
+ * @param value - the value <return>
+ *
+ * @return - a boolean value that indicates if the read op succeeds
+ */
+bool FPStore::readValue_(fpPartition_t *targetPartition, fpRecord_t *record, std::string &value) {
+	uint64_t heapOffset;
+
+	if (record->valueSize <= FPSTORE_INLINE_VALUE_SIZE) {
+		value.assign(record->value, record->valueSize);
+
+		return 1;
+	}
+
+	memcpy(&heapOffset, record->value, sizeof(uint64_t));
+	value.resize(record->valueSize);
+
+	return readAll(targetPartition->heapFD, &value[0], record->valueSize, heapOffset) == (long) record->valueSize;
+}
+
+/*
+ * set the value of a record, appending it to the heap file if it does not fit in the record
+ *
+ * @param heapFD - the heap file
+ * @param head - the head of the table
+ * @param record - the record
+ * @param value - the value
+ * @param valueSize - the size of the value
+ *
+ * @return - a boolean value that indicates if the write op succeeds
+ */
+bool FPStore::writeValue_(int heapFD, fpTableHead_t *head, fpRecord_t *record, const char *value, uint32_t valueSize) {
+	uint64_t heapOffset;
+
+	if (valueSize <= FPSTORE_INLINE_VALUE_SIZE) {
+		memcpy(record->value, value, valueSize);
+	}
+	else {
+		/*the old copy of a replaced value is left in the heap until the table grows*/
+		heapOffset = head->heapSize;
+		if (!writeAll(heapFD, value, valueSize, heapOffset)) {
+			fprintf(stderr, "Error: fail to write a value into the heap file!\n");
+
+			return 0;
+		}
+		memcpy(record->value, &heapOffset, sizeof(uint64_t));
+		head->heapSize += valueSize;
+	}
+
+	/*a new record becomes valid only after its key and value are set*/
+	record->valueSize = valueSize;
+
+	return 1;
+}
+
+/*
+ * double the capacity of the table of a partition (the caller holds the lock of the partition)
+ *
+ * @param partitionID - the partition id
+ *
+ * @return - a boolean value that indicates if the grow op succeeds
+ */
+bool FPStore::growPartition_(int partitionID) {
+	fpPartition_t *targetPartition = &partitions_[partitionID];
+	std::string tableFileName = tableFileName_(partitionID);
+	std::string tmpTableFileName = tableFileName + ".tmp";
+	long oldHeapGeneration = targetPartition->head->heapGeneration;
+	long newHeapGeneration = oldHeapGeneration + 1;
+	int newTableFD, newHeapFD, dirFD;
+	char *newTableMap;
+	long newMapSize;
+	fpTableHead_t *newHead;
+	fpRecord_t *newRecords, *record;
+	std::string value;
+	long i, slot;
+
+	/*1. build the new table and heap files next to the current ones*/
+	if (!mapTable_(tmpTableFileName, targetPartition->head->capacity * 2, 1, newTableFD, newTableMap, newMapSize)) {
+		return 0;
+	}
+	newHead = (fpTableHead_t *) newTableMap;
+	newRecords = (fpRecord_t *) (newTableMap + FPSTORE_HEAD_SIZE);
+	newHead->heapGeneration = newHeapGeneration;
+
+	newHeapFD = open(heapFileName_(partitionID, newHeapGeneration).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (newHeapFD == -1) {
+		fprintf(stderr, "Error: fail to create the heap file of the partition %d!\n", partitionID);
+		munmap(newTableMap, newMapSize);
+		close(newTableFD);
+		unlink(tmpTableFileName.c_str());
+
+		return 0;
+	}
+
+	/*2. rehash all records (which also drops the replaced values in the heap)*/
+	for (i = 0; i < targetPartition->head->capacity; i++) {
+		record = &targetPartition->records[i];
+		if (record->valueSize == 0) {
+			continue;
+		}
+
+		findSlot_(newHead, newRecords, record->key, slot);
+		memcpy(newRecords[slot].key, record->key, FPSTORE_KEY_SIZE);
+
+		if (!readValue_(targetPartition, record, value) ||
+				!writeValue_(newHeapFD, newHead, &newRecords[slot], value.data(), value.size())) {
+			fprintf(stderr, "Error: fail to move a record of the partition %d!\n", partitionID);
+			munmap(newTableMap, newMapSize);
+			close(newTableFD);
+			close(newHeapFD);
+			unlink(tmpTableFileName.c_str());
+			unlink(heapFileName_(partitionID, newHeapGeneration).c_str());
+
+			return 0;
+		}
+		newHead->numOfKeys++;
+	}
+
+	/*3. make the new files durable, then switch to them by renaming the table*/
+	if ((msync(newTableMap, newMapSize, MS_SYNC) != 0) || (fsync(newHeapFD) != 0) ||
+			(rename(tmpTableFileName.c_str(), tableFileName.c_str()) != 0)) {
+		fprintf(stderr, "Error: fail to switch to the new table of the partition %d!\n", partitionID);
+		munmap(newTableMap, newMapSize);
+		close(newTableFD);
+		close(newHeapFD);
+		unlink(tmpTableFileName.c_str());
+		unlink(heapFileName_(partitionID, newHeapGeneration).c_str());
+
+		return 0;
+	}
+
+	dirFD = open(dirName_.c_str(), O_RDONLY);
+	if (dirFD != -1) {
+		fsync(dirFD);
+		close(dirFD);
+	}
+
+	munmap(targetPartition->tableMap, targetPartition->mapSize);
+	close(targetPartition->tableFD);
+	close(targetPartition->heapFD);
+	unlink(heapFileName_(partitionID, oldHeapGeneration).c_str());
+
+	targetPartition->tableFD = newTableFD;
+	targetPartition->heapFD = newHeapFD;
+	targetPartition->tableMap = newTableMap;
+	targetPartition->mapSize = newMapSize;
+	targetPartition->head = newHead;
+	targetPartition->records = newRecords;
+
+	return 1;
+}
+
+/*
+ * make room for the new keys of a write in a partition before the write is logged 
+ * (so that the table is not doubled under the log lock)
+ *
+ * @param partitionID - the partition id
+ * @param numOfNewKeys - the max number of new keys
+ *
+ * @return - a boolean value that indicates if the reserve op succeeds
+ */
+bool FPStore::reservePartition_(int partitionID, long numOfNewKeys) {
+	fpPartition_t *targetPartition = &partitions_[partitionID];
+	bool reserveStat = 1;
+
+	pthread_rwlock_wrlock(&targetPartition->lock);
+
+	while (reserveStat && ((targetPartition->head->numOfKeys + numOfNewKeys) * 100 > 
+				targetPartition->head->capacity * FPSTORE_MAX_LOAD_PERCENT)) {
+		reserveStat = growPartition_(partitionID);
+	}
+
+	pthread_rwlock_unlock(&targetPartition->lock);
+
+	return reserveStat;
+}
+
+/*
+ * insert or replace the value of a key in its partition (the caller holds the log lock)
+ *
+ * @param key - the key
+ * @param value - the value
+ * @param valueSize - the size of the value
+ *
+ * @return - a boolean value that indicates if the put op succeeds
+ */
+bool FPStore::put_(const char *key, const char *value, uint32_t valueSize) {
+	fpPartition_t *targetPartition = partition_(key);
+	bool putStat;
+	long slot;
+
+	pthread_rwlock_wrlock(&targetPartition->lock);
+
+	if (!findSlot_(targetPartition->head, targetPartition->records, key, slot)) {
+		/*the table is doubled before the write is logged, unless concurrent writes (or the log replay) fill it 
+		  beyond the full load*/
+		if ((targetPartition->head->numOfKeys + 1) * 100 > targetPartition->head->capacity * FPSTORE_FULL_LOAD_PERCENT) {
+			if (!growPartition_(targetPartition - partitions_)) {
+				pthread_rwlock_unlock(&targetPartition->lock);
+
+				return 0;
+			}
+			findSlot_(targetPartition->head, targetPartition->records, key, slot);
+		}
+
+		memcpy(targetPartition->records[slot].key, key, FPSTORE_KEY_SIZE);
+		putStat = writeValue_(targetPartition->heapFD, targetPartition->head, &targetPartition->records[slot],
+				value, valueSize);
+		if (putStat) {
+			targetPartition->head->numOfKeys++;
+		}
+	}
+	else {
+		putStat = writeValue_(targetPartition->heapFD, targetPartition->head, &targetPartition->records[slot],
+				value, valueSize);
+	}
+
+	pthread_rwlock_unlock(&targetPartition->lock);
+
+	return putStat;
+}
+
+/*
+ * apply the complete batches in a log to the tables
+ *
+ * @param fd - the log file
+ * @param numOfBatches - the number of applied batches <return>
+ *
+ * @return - a boolean value that indicates if the replay op succeeds
+ */
+bool FPStore::replayLog_(int fd, long &numOfBatches) {
+	fpLogBatchHead_t batchHead;
+	char *body;
+	long bodyOffset, logOffset = 0;
+	uint32_t valueSize;
+	int i;
+
+	numOfBatches = 0;
+
+	/*a torn batch at the end of the log is the last write before a crash, and is dropped*/
+	while (readAll(fd, (char *) &batchHead, sizeof(fpLogBatchHead_t), logOffset) == sizeof(fpLogBatchHead_t)) {
+		if ((batchHead.magic != FPSTORE_LOG_MAGIC) || (batchHead.bodySize <= 0) || (batchHead.numOfPuts <= 0)) {
+			break;
+		}
+
+		body = (char *) malloc(batchHead.bodySize);
+		if (body == NULL) {
+			fprintf(stderr, "Error: fail to allocate memory for a log batch!\n");
+
+			return 0;
+		}
+
+		if ((readAll(fd, body, batchHead.bodySize, logOffset + sizeof(fpLogBatchHead_t)) != batchHead.bodySize) ||
+				(checksum_(body, batchHead.bodySize) != batchHead.checksum)) {
+			free(body);
+			break;
+		}
+
+		bodyOffset = 0;
+		for (i = 0; i < batchHead.numOfPuts; i++) {
+			memcpy(&valueSize, body + bodyOffset, sizeof(uint32_t));
+			bodyOffset += sizeof(uint32_t);
+
+			if (!put_(body + bodyOffset, body + bodyOffset + FPSTORE_KEY_SIZE, valueSize)) {
+				free(body);
+
+				return 0;
+			}
+			bodyOffset += FPSTORE_KEY_SIZE + valueSize;
+		}
+
+		free(body);
+		logOffset += sizeof(fpLogBatchHead_t) + batchHead.bodySize;
+		numOfBatches++;
+	}
+
+	return 1;
+}
+
+/*
+ * make the log durable up to a position, by one fdatasync for all writes appended so far 
+ * (the caller holds the log lock, which is released during the sync)
+ *
+ * @param targetLogEnd - the position
+ *
+ * @return - a boolean value that indicates if the sync op succeeds
+ */
+bool FPStore::syncLog_(long targetLogEnd) {
+	long syncLogEnd;
+	bool syncStat;
+	int fd;
+
+	while (syncedLogEnd_ < targetLogEnd) {
+		/*a sync in progress may not cover the position, so it is checked again after the sync*/
+		if (syncingStat_) {
+			pthread_cond_wait(&syncCond_, &logLock_);
+			continue;
+		}
+
+		/*sync the batches of all writes appended so far, and let the other writes append meanwhile*/
+		syncingStat_ = 1;
+		syncLogEnd = logEnd_;
+		fd = logFD_;
+		pthread_mutex_unlock(&logLock_);
+
+		syncStat = (fdatasync(fd) == 0);
+
+		pthread_mutex_lock(&logLock_);
+		syncingStat_ = 0;
+		if (syncStat && (syncLogEnd > syncedLogEnd_)) {
+			syncedLogEnd_ = syncLogEnd;
+		}
+		pthread_cond_broadcast(&syncCond_);
+
+		if (!syncStat) {
+			fprintf(stderr, "Error: fail to sync the log of the fingerprint store!\n");
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * sync the tables and the heap files, one partition at a time
+ *
+ * @return - a boolean value that indicates if the sync op succeeds
+ */
+bool FPStore::syncPartitions_() {
+	fpPartition_t *targetPartition;
+	bool syncStat;
+	int p;
+
+	/*the read lock keeps the writers and the grow op off the partition during its sync*/
+	for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+		targetPartition = &partitions_[p];
+
+		pthread_rwlock_rdlock(&targetPartition->lock);
+		syncStat = (msync(targetPartition->tableMap, targetPartition->mapSize, MS_SYNC) == 0) && 
+			(fsync(targetPartition->heapFD) == 0);
+		pthread_rwlock_unlock(&targetPartition->lock);
+
+		if (!syncStat) {
+			fprintf(stderr, "Error: fail to sync the partition %d!\n", p);
+
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * sync the tables and the heap files, then drop the log rotated by the checkpoint
+ *
+ * @return - a boolean value that indicates if the release op succeeds
+ */
+bool FPStore::releaseOldLog_() {
+	if (!syncPartitions_()) {
+		return 0;
+	}
+
+	if ((unlink((dirName_ + FPSTORE_OLD_LOG_NAME).c_str()) != 0) && (errno != ENOENT)) {
+		fprintf(stderr, "Error: fail to drop the old log of the fingerprint store!\n");
+
+		return 0;
+	}
+	oldLogStat_ = 0;
+
+	return 1;
+}
+
+/*
+ * move the log aside and start a new one, then sync the tables and drop the old log 
+ * (the caller holds the checkpoint lock; the log lock is only taken for the rotation)
+ *
+ * @param minLogSize - the log size below which the log is not rotated
+ *
+ * @return - a boolean value that indicates if the checkpoint op succeeds
+ */
+bool FPStore::checkpoint_(long minLogSize) {
+	std::string logFileName = dirName_ + FPSTORE_LOG_NAME;
+	std::string oldLogFileName = dirName_ + FPSTORE_OLD_LOG_NAME;
+	int newLogFD, dirFD;
+
+	/*1. finish a checkpoint that failed after its rotation (the old log is never overwritten)*/
+	if (oldLogStat_ && !releaseOldLog_()) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&logLock_);
+
+	/*the log file is not switched under a sync in progress*/
+	while (syncingStat_) {
+		pthread_cond_wait(&syncCond_, &logLock_);
+	}
+
+	if (logSize_ < minLogSize) {
+		pthread_mutex_unlock(&logLock_);
+
+		return 1;
+	}
+
+	/*2. rotate the log (every batch in it has been applied to the tables, as the appends and the applies 
+	  are both under the log lock), and make the rotation durable before new batches go to the new log*/
+	if ((fdatasync(logFD_) != 0) || (rename(logFileName.c_str(), oldLogFileName.c_str()) != 0)) {
+		pthread_mutex_unlock(&logLock_);
+		fprintf(stderr, "Error: fail to rotate the log of the fingerprint store!\n");
+
+		return 0;
+	}
+
+	newLogFD = open(logFileName.c_str(), O_RDWR | O_CREAT | O_APPEND | O_TRUNC, 0644);
+	if (newLogFD == -1) {
+		rename(oldLogFileName.c_str(), logFileName.c_str());
+		pthread_mutex_unlock(&logLock_);
+		fprintf(stderr, "Error: fail to create a new log of the fingerprint store!\n");
+
+		return 0;
+	}
+
+	dirFD = open(dirName_.c_str(), O_RDONLY);
+	if (dirFD != -1) {
+		fsync(dirFD);
+		close(dirFD);
+	}
+
+	close(logFD_);
+	logFD_ = newLogFD;
+	logSize_ = 0;
+	syncedLogEnd_ = logEnd_;
+	oldLogStat_ = 1;
+
+	pthread_mutex_unlock(&logLock_);
+
+	/*3. sync the tables without blocking the writes, then drop the old log*/
+	return releaseOldLog_();
+}
+
+/*
+ * make all written values durable, so that the index opens without recovery
+ *
+ * @return - a boolean value that indicates if the checkpoint op succeeds
+ */
+bool FPStore::checkpoint() {
+	bool checkpointStat;
+
+	pthread_mutex_lock(&checkpointLock_);
+	checkpointStat = checkpoint_(1);
+	pthread_mutex_unlock(&checkpointLock_);
+
+	return checkpointStat;
+}
+
+/*
+ * look up the value of a key
+ *
+ * @param key - the key
+ * @param value - the value <return>
+ *
+ * @return - the status of the lookup (NotFound if the key is not in the index)
+ */
+leveldb::Status FPStore::get(const std::string &key, std::string &value) {
+	fpPartition_t *targetPartition;
+	leveldb::Status getStat;
+	long slot;
+
+	if (key.size() != FPSTORE_KEY_SIZE) {
+		return leveldb::Status::InvalidArgument("invalid key size");
+	}
+
+	targetPartition = partition_(key.data());
+	pthread_rwlock_rdlock(&targetPartition->lock);
+
+	if (!findSlot_(targetPartition->head, targetPartition->records, key.data(), slot)) {
+		getStat = leveldb::Status::NotFound(leveldb::Slice());
+	}
+	else if (!readValue_(targetPartition, &targetPartition->records[slot], value)) {
+		getStat = leveldb::Status::IOError("fail to read the heap file");
+	}
+
+	pthread_rwlock_unlock(&targetPartition->lock);
+
+	return getStat;
+}
+
+/*
+ * look up the values of a list of keys together
+ *
+ * @param keyList - the keys
+ * @param valueList - the values of the keys <return>
+ * @param statList - the lookup status of the keys <return>
+ */
+void FPStore::multiGet(const std::vector<std::string> &keyList, std::vector<std::string> &valueList,
+		std::vector<leveldb::Status> &statList) {
+	int i;
+
+	valueList.resize(keyList.size());
+	statList.resize(keyList.size());
+
+	for (i = 0; i < (int) keyList.size(); i++) {
+		statList[i] = get(keyList[i], valueList[i]);
+	}
+}
+
+/*
+ * insert or replace the values of a list of distinct keys atomically and durably
+ * (the batch is appended to the log in one write, so that it is replayed as a whole or not at all, 
+ * and the log is synced before the write returns)
+ *
+ * @param keyList - the keys
+ * @param valueList - the values of the keys
+ *
+ * @return - the status of the write
+ */
+leveldb::Status FPStore::write(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList) {
+	fpLogBatchHead_t *batchHead;
+	char *buffer, *body;
+	long bodySize = 0, bodyOffset = 0, batchLogEnd;
+	long numOfNewKeys[NUM_FPSTORE_PARTITIONS];
+	uint32_t valueSize;
+	bool checkpointStat;
+	int numOfPuts = keyList.size();
+	int i, p;
+
+	if (numOfPuts == 0) {
+		return leveldb::Status::OK();
+	}
+
+	for (i = 0; i < numOfPuts; i++) {
+		if ((keyList[i].size() != FPSTORE_KEY_SIZE) || valueList[i].empty()) {
+			return leveldb::Status::InvalidArgument("invalid key or value size");
+		}
+		bodySize += sizeof(uint32_t) + FPSTORE_KEY_SIZE + valueList[i].size();
+	}
+
+	/*1. encode the batch*/
+	buffer = (char *) malloc(sizeof(fpLogBatchHead_t) + bodySize);
+	if (buffer == NULL) {
+		return leveldb::Status::IOError("fail to allocate memory for a log batch");
+	}
+	body = buffer + sizeof(fpLogBatchHead_t);
+
+	for (i = 0; i < numOfPuts; i++) {
+		valueSize = valueList[i].size();
+		memcpy(body + bodyOffset, &valueSize, sizeof(uint32_t));
+		bodyOffset += sizeof(uint32_t);
+		memcpy(body + bodyOffset, keyList[i].data(), FPSTORE_KEY_SIZE);
+		bodyOffset += FPSTORE_KEY_SIZE;
+		memcpy(body + bodyOffset, valueList[i].data(), valueSize);
+		bodyOffset += valueSize;
+	}
+
+	batchHead = (fpLogBatchHead_t *) buffer;
+	memset(batchHead, 0, sizeof(fpLogBatchHead_t));
+	batchHead->magic = FPSTORE_LOG_MAGIC;
+	batchHead->numOfPuts = numOfPuts;
+	batchHead->bodySize = bodySize;
+	batchHead->checksum = checksum_(body, bodySize);
+
+	/*2. make room for the keys in their partitions, outside the log lock*/
+	memset(numOfNewKeys, 0, sizeof(numOfNewKeys));
+	for (i = 0; i < numOfPuts; i++) {
+		numOfNewKeys[(unsigned char) keyList[i][FPSTORE_PREFIX_SIZE]]++;
+	}
+	for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+		if ((numOfNewKeys[p] > 0) && !reservePartition_(p, numOfNewKeys[p])) {
+			free(buffer);
+
+			return leveldb::Status::IOError("fail to grow a partition");
+		}
+	}
+
+	pthread_mutex_lock(&logLock_);
+
+	/*3. append the batch to the log*/
+	if (!writeAll(logFD_, buffer, sizeof(fpLogBatchHead_t) + bodySize, -1)) {
+		pthread_mutex_unlock(&logLock_);
+		free(buffer);
+
+		return leveldb::Status::IOError("fail to append to the log");
+	}
+	logSize_ += sizeof(fpLogBatchHead_t) + bodySize;
+	logEnd_ += sizeof(fpLogBatchHead_t) + bodySize;
+	batchLogEnd = logEnd_;
+
+	/*4. apply the batch to the tables in the log order (the log recovers a partially applied batch at the next start)*/
+	bodyOffset = 0;
+	for (i = 0; i < numOfPuts; i++) {
+		valueSize = valueList[i].size();
+		bodyOffset += sizeof(uint32_t);
+
+		if (!put_(body + bodyOffset, body + bodyOffset + FPSTORE_KEY_SIZE, valueSize)) {
+			pthread_mutex_unlock(&logLock_);
+			free(buffer);
+
+			return leveldb::Status::IOError("fail to apply a batch");
+		}
+		bodyOffset += FPSTORE_KEY_SIZE + valueSize;
+	}
+
+	/*5. wait until the batch is durable, together with the batches of the concurrent writes*/
+	if (!syncLog_(batchLogEnd)) {
+		pthread_mutex_unlock(&logLock_);
+		free(buffer);
+
+		return leveldb::Status::IOError("fail to sync the log");
+	}
+	checkpointStat = (logSize_ > FPSTORE_LOG_LIMIT);
+
+	pthread_mutex_unlock(&logLock_);
+	free(buffer);
+
+	/*6. checkpoint the tables once the log is long (unless another write is checkpointing them)*/
+	if (checkpointStat && (pthread_mutex_trylock(&checkpointLock_) == 0)) {
+		checkpointStat = checkpoint_(FPSTORE_LOG_LIMIT);
+		pthread_mutex_unlock(&checkpointLock_);
+
+		if (!checkpointStat) {
+			return leveldb::Status::IOError("fail to checkpoint");
+		}
+	}
+
+	return leveldb::Status::OK();
+}
+
+/*
+ * pass every key in the index to a handler
+ * (the keys of a partition are copied under its lock and handled after it is released, so the 
+ * handler may write to the store)
+ *
+ * @param keyHandler - the handler
+ * @param arg - the argument passed to the handler
+ *
+ * @return - the status of the scan
+ */
+leveldb::Status FPStore::scanKeys(void (*keyHandler)(void *arg, const std::string &key), void *arg) {
+	fpPartition_t *targetPartition;
+	std::vector<std::string> keyList;
+	long i;
+	int p;
+
+	for (p = 0; p < NUM_FPSTORE_PARTITIONS; p++) {
+		targetPartition = &partitions_[p];
+		keyList.clear();
+
+		pthread_rwlock_rdlock(&targetPartition->lock);
+		for (i = 0; i < targetPartition->head->capacity; i++) {
+			if (targetPartition->records[i].valueSize != 0) {
+				keyList.push_back(std::string(targetPartition->records[i].key, FPSTORE_KEY_SIZE));
+			}
+		}
+		pthread_rwlock_unlock(&targetPartition->lock);
+
+		for (i = 0; i < (long) keyList.size(); i++) {
+			keyHandler(arg, keyList[i]);
+		}
+	}
+
+	return leveldb::Status::OK();
+}
@@ -0,0 +1,341 @@
+/*
+ * FPStore.hh
+ */
+
+#ifndef __FPSTORE_HH__
+#define __FPSTORE_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "ShareIndex.hh"
+
+/*macros for the key format (a prefix byte followed by a fingerprint)*/
+#define FPSTORE_KEY_SIZE 33
+#define FPSTORE_PREFIX_SIZE 1
+
+/*macros for the fixed-size records (values longer than the inline space are kept in the heap file)*/
+#define FPSTORE_RECORD_SIZE 128
+#define FPSTORE_INLINE_VALUE_SIZE (FPSTORE_RECORD_SIZE - FPSTORE_KEY_SIZE - 4)
+
+/*macro for the number of partitions (selected by the first byte of the fingerprint)*/
+#define NUM_FPSTORE_PARTITIONS 256
+
+/*macros for the hash table of each partition (the capacity is doubled beyond the max load before a write, 
+  or beyond the full load while the write is applied)*/
+#define FPSTORE_INIT_CAPACITY 1024
+#define FPSTORE_MAX_LOAD_PERCENT 70
+#define FPSTORE_FULL_LOAD_PERCENT 90
+
+/*macro for the size of the table head (a page, so that the records are page-aligned)*/
+#define FPSTORE_HEAD_SIZE 4096
+
+/*macro for the log size that triggers a checkpoint*/
+#define FPSTORE_LOG_LIMIT (256<<20)
+
+/*macros for the magic numbers of the table files and the log batches*/
+#define FPSTORE_TABLE_MAGIC 0x46505354
+#define FPSTORE_LOG_MAGIC 0x4650534c
+
+/*macros for the names of the log file and of the log being checkpointed*/
+#define FPSTORE_LOG_NAME "fpstore.log"
+#define FPSTORE_OLD_LOG_NAME "fpstore.log.old"
+
+using namespace std;
+
+/*
+ * table file format: [fpTableHead_t (padded to FPSTORE_HEAD_SIZE) + fpRecord_t * capacity]
+ * heap file format: [value ...] (referred by the records of the table of the same generation)
+ * log file format: [fpLogBatchHead_t + (value size + key + value) * numOfPuts ...]
+ */
+
+/*the head structure of a table file*/
+typedef struct {
+	int magic;
+	long capacity;
+	long numOfKeys;
+	long heapGeneration;
+	long heapSize;
+} fpTableHead_t;
+
+/*the record structure of a table file*/
+typedef struct {
+	uint32_t valueSize; /*0 for a free slot*/
+	char key[FPSTORE_KEY_SIZE];
+	char value[FPSTORE_INLINE_VALUE_SIZE]; /*the value, or its offset (uint64_t) in the heap file*/
+} fpRecord_t;
+
+/*the head structure of a batch in the log file*/
+typedef struct {
+	int magic;
+	int numOfPuts;
+	long bodySize;
+	uint64_t checksum; /*the hash of the body*/
+} fpLogBatchHead_t;
+
+/*
+ * a persistent fingerprint store, made of hash tables with fixed-size records in memory-mapped files
+ * (open addressing with linear probing), one per fingerprint prefix
+ *
+ * note: every write is appended to a log before it is applied to the tables, and the log is replayed at
+ * startup until the tables are checkpointed; the appends of concurrent writes are made durable by one 
+ * fdatasync (group commit), and a full table is doubled online, blocking only its partition
+ */
+class FPStore : public ShareIndex {
+	private:
+		/*the partition structure*/
+		typedef struct {
+			pthread_rwlock_t lock;
+			int tableFD;
+			int heapFD;
+			char *tableMap;
+			long mapSize;
+			fpTableHead_t *head;
+			fpRecord_t *records;
+		} fpPartition_t;
+
+		/*the name of the store directory*/
+		std::string dirName_;
+
+		/*the partitions*/
+		fpPartition_t partitions_[NUM_FPSTORE_PARTITIONS];
+
+		/*the log file, and its size since the last checkpoint*/
+		int logFD_;
+		long logSize_;
+
+		/*the total size of the appended log batches, and of those that are durable*/
+		long logEnd_;
+		long syncedLogEnd_;
+
+		/*the status of a log sync in progress, and the condition signaled when it finishes*/
+		bool syncingStat_;
+		pthread_cond_t syncCond_;
+
+		/*the mutex lock that serializes the log appends (guarding the log members above)*/
+		pthread_mutex_t logLock_;
+
+		/*the status of a log rotated by a checkpoint that is not finished yet*/
+		bool oldLogStat_;
+
+		/*the mutex lock that serializes the checkpoints*/
+		pthread_mutex_t checkpointLock_;
+
+		/*
+		 * hash a key
+		 *
+		 * @param key - the key
+		 *
+		 * @return - the 64-bit hash of the key
+		 */
+		inline uint64_t hashKey_(const char *key);
+
+		/*
+		 * calculate the checksum of a log batch
+		 *
+		 * @param buffer - the body of the batch
+		 * @param bufferSize - the size of the body
+		 *
+		 * @return - the checksum
+		 */
+		inline uint64_t checksum_(const char *buffer, long bufferSize);
+
+		/*
+		 * get the partition of a key
+		 *
+		 * @param key - the key
+		 *
+		 * @return - the partition
+		 */
+		inline fpPartition_t *partition_(const char *key);
+
+		/*
+		 * get the name of the table file of a partition
+		 *
+		 * @param partitionID - the partition id
+		 *
+		 * @return - the file name
+		 */
+		std::string tableFileName_(int partitionID);
+
+		/*
+		 * get the name of a heap file of a partition
+		 *
+		 * @param partitionID - the partition id
+		 * @param heapGeneration - the generation of the heap file
+		 *
+		 * @return - the file name
+		 */
+		std::string heapFileName_(int partitionID, long heapGeneration);
+
+		/*
+		 * open/create a table file and map it into memory
+		 *
+		 * @param fileName - the name of the table file
+		 * @param capacity - the capacity of a new table (ignored for an existing table)
+		 * @param truncateStat - a boolean value that indicates if an existing file is dropped
+		 * @param fd - the file descriptor <return>
+		 * @param tableMap - the mapped table <return>
+		 * @param mapSize - the size of the mapped table <return>
+		 *
+		 * @return - a boolean value that indicates if the open op succeeds
+		 */
+		bool mapTable_(const std::string &fileName, long capacity, bool truncateStat, int &fd, char *&tableMap, long &mapSize);
+
+		/*
+		 * open/create the table and heap files of a partition
+		 *
+		 * @param partitionID - the partition id
+		 *
+		 * @return - a boolean value that indicates if the open op succeeds
+		 */
+		bool openPartition_(int partitionID);
+
+		/*
+		 * find the slot of a key in a table
+		 *
+		 * @param head - the head of the table
+		 * @param records - the records of the table
+		 * @param key - the key
+		 * @param slot - the slot of the key, or the free slot for it <return>
+		 *
+		 * @return - a boolean value that indicates if the key is found
+		 */
+		bool findSlot_(fpTableHead_t *head, fpRecord_t *records, const char *key, long &slot);
+
+		/*
+		 * read the value of a record (the caller holds the lock of the partition)
+		 *
+		 * @param targetPartition - the partition
+		 * @param record - the record
+		 * @param value - the value <return>
+		 *
+		 * @return - a boolean value that indicates if the read op succeeds
+		 */
+		bool readValue_(fpPartition_t *targetPartition, fpRecord_t *record, std::string &value);
+
+		/*
+		 * set the value of a record, appending it to the heap file if it does not fit in the record
+		 *
+		 * @param heapFD - the heap file
+		 * @param head - the head of the table
+		 * @param record - the record
+		 * @param value - the value
+		 * @param valueSize - the size of the value
+		 *
+		 * @return - a boolean value that indicates if the write op succeeds
+		 */
+		bool writeValue_(int heapFD, fpTableHead_t *head, fpRecord_t *record, const char *value, uint32_t valueSize);
+
+		/*
+		 * double the capacity of the table of a partition (the caller holds the lock of the partition)
+		 *
+		 * @param partitionID - the partition id
+		 *
+		 * @return - a boolean value that indicates if the grow op succeeds
+		 */
+		bool growPartition_(int partitionID);
+
+		/*
+		 * make room for the new keys of a write in a partition before the write is logged 
+		 * (so that the table is not doubled under the log lock)
+		 *
+		 * @param partitionID - the partition id
+		 * @param numOfNewKeys - the max number of new keys
+		 *
+		 * @return - a boolean value that indicates if the reserve op succeeds
+		 */
+		bool reservePartition_(int partitionID, long numOfNewKeys);
+
+		/*
+		 * insert or replace the value of a key in its partition (the caller holds the log lock)
+		 *
+		 * @param key - the key
+		 * @param value - the value
+		 * @param valueSize - the size of the value
+		 *
+		 * @return - a boolean value that indicates if the put op succeeds
+		 */
+		bool put_(const char *key, const char *value, uint32_t valueSize);
+
+		/*
+		 * apply the complete batches in a log to the tables
+		 *
+		 * @param fd - the log file
+		 * @param numOfBatches - the number of applied batches <return>
+		 *
+		 * @return - a boolean value that indicates if the replay op succeeds
+		 */
+		bool replayLog_(int fd, long &numOfBatches);
+
+		/*
+		 * make the log durable up to a position, by one fdatasync for all writes appended so far 
+		 * (the caller holds the log lock, which is released during the sync)
+		 *
+		 * @param targetLogEnd - the position
+		 *
+		 * @return - a boolean value that indicates if the sync op succeeds
+		 */
+		bool syncLog_(long targetLogEnd);
+
+		/*
+		 * sync the tables and the heap files, one partition at a time
+		 *
+		 * @return - a boolean value that indicates if the sync op succeeds
+		 */
+		bool syncPartitions_();
+
+		/*
+		 * sync the tables and the heap files, then drop the log rotated by the checkpoint
+		 *
+		 * @return - a boolean value that indicates if the release op succeeds
+		 */
+		bool releaseOldLog_();
+
+		/*
+		 * move the log aside and start a new one, then sync the tables and drop the old log 
+		 * (the caller holds the checkpoint lock; the log lock is only taken for the rotation)
+		 *
+		 * @param minLogSize - the log size below which the log is not rotated
+		 *
+		 * @return - a boolean value that indicates if the checkpoint op succeeds
+		 */
+		bool checkpoint_(long minLogSize);
+
+	public:
+		/*
+		 * constructor of FPStore
+		 *
+		 * @param dirName - the name of the store directory
+		 */
+		FPStore(const std::string &dirName);
+
+		/*
+		 * destructor of FPStore
+		 */
+		~FPStore();
+
+		leveldb::Status get(const std::string &key, std::string &value);
+
+		void multiGet(const std::vector<std::string> &keyList, std::vector<std::string> &valueList,
+				std::vector<leveldb::Status> &statList);
+
+		leveldb::Status write(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList);
+
+		leveldb::Status scanKeys(void (*keyHandler)(void *arg, const std::string &key), void *arg);
+
+		bool checkpoint();
+};
+
+#endif
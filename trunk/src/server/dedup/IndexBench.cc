@@ -0,0 +1,272 @@
+/*
+ * IndexBench.cc
+ *
+ * compare the share index engines on the share index workload: loading new shares, and looking up
+ * existing and new shares, all in batches like DedupCore does (the user references are kept in the
+ * database whatever the engine)
+ *
+ * usage: ./INDEXBENCH ([numOfKeys] ([engine] ([dirName])))
+ *        [engine] is "leveldb", "fpstore" or "all" (default)
+ */
+
+#include "DedupCore.hh"
+
+using namespace std;
+
+/*macro for the default number of keys loaded into each engine*/
+#define DEFAULT_BENCH_KEYS 100000000L
+
+/*macro for the number of keys of a batch (about the distinct shares of a metadata buffer)*/
+#define BENCH_BATCH_SIZE 1024
+
+/*macro for the number of keys of each lookup phase*/
+#define BENCH_OPS 1000000L
+
+/*
+ * get the current time
+ *
+ * @return - the current time in seconds
+ */
+static double now() {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * generate the index key of the i-th share (a random-looking fingerprint, like a real one)
+ *
+ * @param i - the share number
+ * @param key - the key <return>
+ */
+static void genKey(uint64_t i, std::string &key) {
+	uint64_t x = i;
+	int j;
+
+	key.resize(KEY_SIZE);
+	key[0] = '1';
+
+	/*splitmix64*/
+	for (j = 0; j < FP_SIZE / 8; j++) {
+		uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+		memcpy(&key[1 + j * 8], &z, 8);
+	}
+}
+
+/*
+ * generate the share index value of a new share
+ *
+ * @param i - the share number
+ * @param value - the value <return>
+ */
+static void genValue(uint64_t i, std::string &value) {
+	shareIndexValue_t shareIndexValue;
+
+	memset(&shareIndexValue, 0, sizeof(shareIndexValue_t));
+	shareIndexValue.shareContainerID = i >> 10;
+	shareIndexValue.shareContainerOffset = (i & 1023) * 4096;
+	shareIndexValue.shareSize = 4096;
+
+	value.assign((char *) &shareIndexValue, sizeof(shareIndexValue_t));
+}
+
+/*
+ * print the result of a phase
+ *
+ * @param engineName - the name of the engine
+ * @param phaseName - the name of the phase
+ * @param numOfOps - the number of keys handled in the phase
+ * @param seconds - the duration of the phase
+ */
+static void report(const char *engineName, const char *phaseName, long numOfOps, double seconds) {
+	printf("%-8s %-12s %12ld keys %10.2f s %12.0f keys/s\n", engineName, phaseName, numOfOps, seconds,
+			numOfOps / seconds);
+	fflush(stdout);
+}
+
+/*
+ * open an engine on a directory
+ *
+ * @param engineName - the name of the engine
+ * @param dirName - the directory
+ * @param db - the database of the LevelDB engine <return>
+ * @param dbOptions - the options of the database <return>
+ *
+ * @return - the engine
+ */
+static ShareIndex *openEngine(const std::string &engineName, const std::string &dirName, leveldb::DB *&db,
+		leveldb::Options &dbOptions) {
+	db = NULL;
+
+	if (engineName == "fpstore") {
+		return new FPStore(dirName);
+	}
+
+	/*the same options as DedupCore*/
+	dbOptions.create_if_missing = true;
+	dbOptions.write_buffer_size = MEM_TABLE_SIZE;
+	dbOptions.block_cache = leveldb::NewLRUCache(BLOCK_CACHE_SIZE);
+	dbOptions.filter_policy = leveldb::NewBloomFilterPolicy(BLOOM_FILTER_KEY_BITS);
+	leveldb::Status openStat = leveldb::DB::Open(dbOptions, dirName, &db);
+	if (openStat.ok() == false) {
+		fprintf(stderr, "Error: fail to open/create the database '%s'!\n", dirName.c_str());
+		fprintf(stderr, "Status: %s \n", openStat.ToString().c_str());
+		exit(1);
+	}
+
+	return new LevelDBShareIndex(db, '1');
+}
+
+/*
+ * close an engine
+ *
+ * @param shareIndex - the engine
+ * @param db - the database of the LevelDB engine
+ * @param dbOptions - the options of the database
+ */
+static void closeEngine(ShareIndex *shareIndex, leveldb::DB *db, leveldb::Options &dbOptions) {
+	delete shareIndex;
+
+	if (db != NULL) {
+		delete db;
+		delete dbOptions.block_cache;
+		delete dbOptions.filter_policy;
+	}
+}
+
+/*
+ * run all phases on an engine
+ *
+ * @param engineName - the name of the engine
+ * @param dirName - the directory of the engine (removed beforehand)
+ * @param numOfKeys - the number of keys to load
+ */
+static void runBench(const std::string &engineName, const std::string &dirName, long numOfKeys) {
+	std::vector<std::string> keyList(BENCH_BATCH_SIZE), valueList(BENCH_BATCH_SIZE);
+	std::vector<leveldb::Status> statList;
+	leveldb::Options dbOptions;
+	leveldb::DB *db;
+	ShareIndex *shareIndex;
+	unsigned int seed = 12345;
+	long i, j, numOfFound;
+	double startTime;
+
+	std::string command = "rm -rf '" + dirName + "'";
+	if (system(command.c_str()) != 0) {
+		fprintf(stderr, "Error: fail to remove '%s'!\n", dirName.c_str());
+		exit(1);
+	}
+
+	shareIndex = openEngine(engineName, dirName, db, dbOptions);
+
+	/*1. load new shares (every share is looked up before it is added, as in the second stage)*/
+	startTime = now();
+	for (i = 0; i < numOfKeys; i += BENCH_BATCH_SIZE) {
+		keyList.resize(std::min((long) BENCH_BATCH_SIZE, numOfKeys - i));
+		valueList.resize(keyList.size());
+		for (j = 0; j < (long) keyList.size(); j++) {
+			genKey(i + j, keyList[j]);
+		}
+
+		shareIndex->multiGet(keyList, valueList, statList);
+		for (j = 0; j < (long) keyList.size(); j++) {
+			genValue(i + j, valueList[j]);
+		}
+
+		leveldb::Status writeStat = shareIndex->write(keyList, valueList);
+		if (writeStat.ok() == false) {
+			fprintf(stderr, "Error: fail to perform batched writes!\n");
+			fprintf(stderr, "Status: %s \n", writeStat.ToString().c_str());
+			exit(1);
+		}
+
+		if ((i / BENCH_BATCH_SIZE) % 10000 == 9999) {
+			report(engineName.c_str(), "load...", i + keyList.size(), now() - startTime);
+		}
+	}
+	report(engineName.c_str(), "load", numOfKeys, now() - startTime);
+
+	/*2. look up random existing shares*/
+	keyList.resize(BENCH_BATCH_SIZE);
+	numOfFound = 0;
+	startTime = now();
+	for (i = 0; i < BENCH_OPS; i += BENCH_BATCH_SIZE) {
+		for (j = 0; j < BENCH_BATCH_SIZE; j++) {
+			genKey(rand_r(&seed) % numOfKeys, keyList[j]);
+		}
+
+		shareIndex->multiGet(keyList, valueList, statList);
+		for (j = 0; j < BENCH_BATCH_SIZE; j++) {
+			numOfFound += statList[j].ok();
+		}
+	}
+	report(engineName.c_str(), "hit lookup", i, now() - startTime);
+	if (numOfFound != i) {
+		fprintf(stderr, "Error: %ld of %ld existing keys are not found!\n", i - numOfFound, i);
+		exit(1);
+	}
+
+	/*3. look up new shares*/
+	numOfFound = 0;
+	startTime = now();
+	for (i = 0; i < BENCH_OPS; i += BENCH_BATCH_SIZE) {
+		for (j = 0; j < BENCH_BATCH_SIZE; j++) {
+			genKey(numOfKeys + i + j, keyList[j]);
+		}
+
+		shareIndex->multiGet(keyList, valueList, statList);
+		for (j = 0; j < BENCH_BATCH_SIZE; j++) {
+			numOfFound += statList[j].ok();
+		}
+	}
+	report(engineName.c_str(), "miss lookup", i, now() - startTime);
+	if (numOfFound != 0) {
+		fprintf(stderr, "Error: %ld new keys are found!\n", numOfFound);
+		exit(1);
+	}
+
+	/*4. close and reopen*/
+	startTime = now();
+	closeEngine(shareIndex, db, dbOptions);
+	shareIndex = openEngine(engineName, dirName, db, dbOptions);
+	report(engineName.c_str(), "reopen", numOfKeys, now() - startTime);
+
+	closeEngine(shareIndex, db, dbOptions);
+
+	command = "du -sh '" + dirName + "'";
+	if (system(command.c_str()) != 0) {
+		fprintf(stderr, "Error: fail to measure '%s'!\n", dirName.c_str());
+	}
+}
+
+int main(int argv, char** argc) {
+	long numOfKeys = argv > 1 ? atol(argc[1]) : DEFAULT_BENCH_KEYS;
+	std::string engineName = argv > 2 ? argc[2] : "all";
+	std::string dirName = argv > 3 ? argc[3] : "./IndexBench";
+
+	if (numOfKeys <= 0) {
+		fprintf(stderr, "usage: ./INDEXBENCH ([numOfKeys] ([engine] ([dirName])))\n");
+
+		exit(1);
+	}
+
+	if (mkdir(dirName.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Error: fail to create the dir '%s'!\n", dirName.c_str());
+
+		exit(1);
+	}
+
+	if (engineName == "leveldb" || engineName == "all") {
+		runBench("leveldb", dirName + "/leveldb", numOfKeys);
+	}
+	if (engineName == "fpstore" || engineName == "all") {
+		runBench("fpstore", dirName + "/fpstore", numOfKeys);
+	}
+
+	return 0;
+}
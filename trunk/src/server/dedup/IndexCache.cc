@@ -0,0 +1,503 @@
+/*
+ * IndexCache.cc
+ */
+
+#include "IndexCache.hh"
+
+using namespace std;
+
+/*
+ * constructor of IndexCache
+ *
+ * @param memoryBudget - the memory budget (in bytes), half for the filter and half for the hot entries
+ */
+IndexCache::IndexCache(long memoryBudget) {
+	long bucketSize = CUCKOO_SLOTS_PER_BUCKET * sizeof(uint16_t);
+
+	memoryBudget_ = memoryBudget;
+
+	/*use the largest power-of-2 number of buckets that fits into half of the budget*/
+	numOfBuckets_ = 1;
+	while (numOfBuckets_ * 2 * bucketSize <= memoryBudget_ / 2) {
+		numOfBuckets_ *= 2;
+	}
+	filterTags_ = (uint16_t *) malloc(numOfBuckets_ * bucketSize);
+	if (filterTags_ == NULL) {
+		fprintf(stderr, "Error: fail to allocate the memory for the index cache filter!\n");
+		exit(1);
+	}
+	memset(filterTags_, 0, numOfBuckets_ * bucketSize);
+	numOfKeys_ = 0;
+	filterValidStat_ = 1;
+
+	if (pthread_rwlock_init(&filterLock_, NULL) != 0) {
+		fprintf(stderr, "Error: fail to initialize the read-write lock filterLock_!\n");
+		exit(1);
+	}
+
+	/*the rest of the budget is shared by the shards of the hot entry table*/
+	shardCapacity_ = (memoryBudget_ - numOfBuckets_ * bucketSize) / NUM_INDEX_CACHE_SHARDS;
+	for (int i = 0; i < NUM_INDEX_CACHE_SHARDS; i++) {
+		if (pthread_mutex_init(&shards_[i].lock, NULL) != 0) {
+			fprintf(stderr, "Error: fail to initialize the mutex locks of the index cache shards!\n");
+			exit(1);
+		}
+		shards_[i].usage = 0;
+	}
+
+	numOfFilterMisses_ = 0;
+	numOfHits_ = 0;
+}
+
+/*
+ * destructor of IndexCache
+ */
+IndexCache::~IndexCache() {
+	free(filterTags_);
+	pthread_rwlock_destroy(&filterLock_);
+
+	for (int i = 0; i < NUM_INDEX_CACHE_SHARDS; i++) {
+		pthread_mutex_destroy(&shards_[i].lock);
+	}
+}
+
+/*
+ * hash a key (FNV-1a)
+ *
+ * @param key - the key
+ *
+ * @return - the 64-bit hash of the key
+ */
+inline uint64_t IndexCache::hashKey_(const std::string &key) {
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < key.size(); i++) {
+		hash ^= (unsigned char) key[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * get the tag and the two candidate buckets of a key in the filter
+ *
+ * @param key - the key
+ * @param tag - the tag <return>
+ * @param bucket1 - the first bucket <return>
+ * @param bucket2 - the second bucket <return>
+ */
+inline void IndexCache::filterPosition_(const std::string &key, uint16_t &tag, long &bucket1, long &bucket2) {
+	uint64_t hash = hashKey_(key);
+
+	/*tag 0 marks an empty slot*/
+	tag = (uint16_t) (hash >> 32);
+	if (tag == 0) {
+		tag = 1;
+	}
+	bucket1 = (long) (hash & (numOfBuckets_ - 1));
+	bucket2 = altBucket_(bucket1, tag);
+}
+
+/*
+ * get the alternative bucket of a tag
+ *
+ * @param bucket - the current bucket of the tag
+ * @param tag - the tag
+ *
+ * @return - the other bucket of the tag
+ */
+inline long IndexCache::altBucket_(const long &bucket, const uint16_t &tag) {
+	/*partial-key cuckoo hashing: the two buckets can be found from each other with the tag alone*/
+	return (bucket ^ (long) ((uint32_t) tag * 0x5bd1e995)) & (numOfBuckets_ - 1);
+}
+
+/*
+ * put a tag into a free slot of a bucket
+ *
+ * @param bucket - the bucket
+ * @param tag - the tag
+ *
+ * @return - a boolean value that indicates if the bucket has a free slot
+ */
+inline bool IndexCache::putTag_(const long &bucket, const uint16_t &tag) {
+	uint16_t *slots = filterTags_ + bucket * CUCKOO_SLOTS_PER_BUCKET;
+
+	for (int i = 0; i < CUCKOO_SLOTS_PER_BUCKET; i++) {
+		if (slots[i] == 0) {
+			slots[i] = tag;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * check if a bucket holds a tag
+ *
+ * @param bucket - the bucket
+ * @param tag - the tag
+ *
+ * @return - a boolean value that indicates if the tag is found
+ */
+inline bool IndexCache::hasTag_(const long &bucket, const uint16_t &tag) {
+	uint16_t *slots = filterTags_ + bucket * CUCKOO_SLOTS_PER_BUCKET;
+
+	for (int i = 0; i < CUCKOO_SLOTS_PER_BUCKET; i++) {
+		if (slots[i] == tag) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * get the shard of a key in the hot entry table
+ *
+ * @param key - the key
+ *
+ * @return - the shard
+ */
+inline IndexCache::hotShard_t *IndexCache::shard_(const std::string &key) {
+	return &shards_[hashKey_(key) % NUM_INDEX_CACHE_SHARDS];
+}
+
+/*
+ * insert or replace an entry in a shard, and evict the least recently used entries over the capacity
+ * (the caller holds the lock of the shard)
+ *
+ * @param targetShard - the shard
+ * @param key - the key
+ * @param value - the value
+ */
+void IndexCache::putEntry_(hotShard_t *targetShard, const std::string &key, const std::string &value) {
+	hotMap_t::iterator it = targetShard->hotMap.find(key);
+
+	if (it != targetShard->hotMap.end()) {
+		/*replace the value and move the entry to the front*/
+		targetShard->usage += (long) value.size() - (long) it->second->value.size();
+		it->second->value = value;
+		targetShard->lruList.splice(targetShard->lruList.begin(), targetShard->lruList, it->second);
+	}
+	else {
+		hotEntry_t entry;
+
+		entry.key = key;
+		entry.value = value;
+		targetShard->lruList.push_front(entry);
+		targetShard->hotMap[key] = targetShard->lruList.begin();
+		/*count the key twice, as the table holds a copy besides the entry*/
+		targetShard->usage += 2 * key.size() + value.size() + sizeof(hotEntry_t);
+	}
+
+	/*evict the least recently used entries*/
+	while ((targetShard->usage > shardCapacity_) && (targetShard->lruList.size() > 1)) {
+		hotEntry_t &victim = targetShard->lruList.back();
+
+		targetShard->usage -= 2 * victim.key.size() + victim.value.size() + sizeof(hotEntry_t);
+		targetShard->hotMap.erase(victim.key);
+		targetShard->lruList.pop_back();
+	}
+}
+
+/*
+ * check if a key may be in the index
+ *
+ * @param key - the key
+ *
+ * @return - a boolean value that is false only if the key is definitely not in the index
+ */
+bool IndexCache::mayContain(const std::string &key) {
+	uint16_t tag;
+	long bucket1, bucket2;
+	bool mayContainStat;
+
+	filterPosition_(key, tag, bucket1, bucket2);
+
+	pthread_rwlock_rdlock(&filterLock_);
+	mayContainStat = (!filterValidStat_) || hasTag_(bucket1, tag) || hasTag_(bucket2, tag);
+	pthread_rwlock_unlock(&filterLock_);
+
+	if (!mayContainStat) {
+		__sync_fetch_and_add(&numOfFilterMisses_, 1);
+	}
+
+	return mayContainStat;
+}
+
+/*
+ * add a new key into the filter
+ *
+ * @param key - the key
+ */
+void IndexCache::addKey(const std::string &key) {
+	uint16_t tag, victimTag;
+	long bucket1, bucket2, bucket;
+	uint16_t *slots;
+	int i;
+
+	filterPosition_(key, tag, bucket1, bucket2);
+
+	pthread_rwlock_wrlock(&filterLock_);
+
+	if (!filterValidStat_) {
+		pthread_rwlock_unlock(&filterLock_);
+
+		return;
+	}
+
+	if (putTag_(bucket1, tag) || putTag_(bucket2, tag)) {
+		numOfKeys_++;
+		pthread_rwlock_unlock(&filterLock_);
+
+		return;
+	}
+
+	/*both buckets are full, so kick the tags around until one of them finds a free slot*/
+	bucket = (tag & 1) ? bucket1 : bucket2;
+	for (i = 0; i < CUCKOO_MAX_KICKS; i++) {
+		slots = filterTags_ + bucket * CUCKOO_SLOTS_PER_BUCKET;
+		victimTag = slots[i % CUCKOO_SLOTS_PER_BUCKET];
+		slots[i % CUCKOO_SLOTS_PER_BUCKET] = tag;
+		tag = victimTag;
+
+		bucket = altBucket_(bucket, tag);
+		if (putTag_(bucket, tag)) {
+			numOfKeys_++;
+			pthread_rwlock_unlock(&filterLock_);
+
+			return;
+		}
+	}
+
+	/*a tag is dropped, so the filter can no longer answer definite misses*/
+	filterValidStat_ = 0;
+	fprintf(stderr, "Warning: the index cache filter is full after %ld keys, and it is disabled!\n", numOfKeys_);
+
+	pthread_rwlock_unlock(&filterLock_);
+}
+
+/*
+ * look up the value of a hot key
+ *
+ * @param key - the key
+ * @param value - the value <return>
+ *
+ * @return - a boolean value that indicates if the key is cached
+ */
+bool IndexCache::lookup(const std::string &key, std::string &value) {
+	hotShard_t *targetShard = shard_(key);
+	hotMap_t::iterator it;
+
+	pthread_mutex_lock(&targetShard->lock);
+
+	it = targetShard->hotMap.find(key);
+	if (it == targetShard->hotMap.end()) {
+		pthread_mutex_unlock(&targetShard->lock);
+
+		return 0;
+	}
+
+	value = it->second->value;
+	targetShard->lruList.splice(targetShard->lruList.begin(), targetShard->lruList, it->second);
+
+	pthread_mutex_unlock(&targetShard->lock);
+
+	__sync_fetch_and_add(&numOfHits_, 1);
+
+	return 1;
+}
+
+/*
+ * insert or replace the value of a key in the hot entry table
+ *
+ * @param key - the key
+ * @param value - the value
+ */
+void IndexCache::update(const std::string &key, const std::string &value) {
+	hotShard_t *targetShard = shard_(key);
+
+	pthread_mutex_lock(&targetShard->lock);
+	putEntry_(targetShard, key, value);
+	pthread_mutex_unlock(&targetShard->lock);
+}
+
+/*
+ * save the whole cache into a snapshot file
+ *
+ * @param snapshotFileName - the name of the snapshot file
+ *
+ * @return - a boolean value that indicates if the save op succeeds
+ */
+bool IndexCache::saveSnapshot(const std::string &snapshotFileName) {
+	std::string tmpFileName = snapshotFileName + ".tmp";
+	indexCacheSnapshotHead_t snapshotHead;
+	lruList_t::reverse_iterator it;
+	int size, i;
+	bool saveStat = 1;
+	FILE *fp;
+
+	fp = fopen(tmpFileName.c_str(), "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "Error: fail to open the snapshot file '%s'!\n", tmpFileName.c_str());
+
+		return 0;
+	}
+
+	/*freeze the whole cache while it is written*/
+	pthread_rwlock_rdlock(&filterLock_);
+	for (i = 0; i < NUM_INDEX_CACHE_SHARDS; i++) {
+		pthread_mutex_lock(&shards_[i].lock);
+	}
+
+	memset(&snapshotHead, 0, sizeof(indexCacheSnapshotHead_t));
+	snapshotHead.magic = INDEX_CACHE_SNAPSHOT_MAGIC;
+	snapshotHead.memoryBudget = memoryBudget_;
+	snapshotHead.numOfBuckets = numOfBuckets_;
+	snapshotHead.numOfKeys = numOfKeys_;
+	snapshotHead.filterValidStat = filterValidStat_;
+	snapshotHead.numOfEntries = 0;
+	for (i = 0; i < NUM_INDEX_CACHE_SHARDS; i++) {
+		snapshotHead.numOfEntries += shards_[i].lruList.size();
+	}
+
+	if (fwrite(&snapshotHead, sizeof(indexCacheSnapshotHead_t), 1, fp) != 1) {
+		saveStat = 0;
+	}
+	if (saveStat && (fwrite(filterTags_, numOfBuckets_ * CUCKOO_SLOTS_PER_BUCKET * sizeof(uint16_t), 1, fp) != 1)) {
+		saveStat = 0;
+	}
+
+	/*write the entries from the least recently used, so that loading them keeps their order*/
+	for (i = 0; (i < NUM_INDEX_CACHE_SHARDS) && saveStat; i++) {
+		for (it = shards_[i].lruList.rbegin(); (it != shards_[i].lruList.rend()) && saveStat; it++) {
+			size = it->key.size();
+			if ((fwrite(&size, sizeof(int), 1, fp) != 1) || (fwrite(it->key.data(), size, 1, fp) != 1)) {
+				saveStat = 0;
+			}
+			size = it->value.size();
+			if ((fwrite(&size, sizeof(int), 1, fp) != 1) || (fwrite(it->value.data(), size, 1, fp) != 1)) {
+				saveStat = 0;
+			}
+		}
+	}
+
+	for (i = NUM_INDEX_CACHE_SHARDS - 1; i >= 0; i--) {
+		pthread_mutex_unlock(&shards_[i].lock);
+	}
+	pthread_rwlock_unlock(&filterLock_);
+
+	if (fclose(fp) != 0) {
+		saveStat = 0;
+	}
+
+	if (!saveStat || (rename(tmpFileName.c_str(), snapshotFileName.c_str()) != 0)) {
+		fprintf(stderr, "Error: fail to write the snapshot file '%s'!\n", snapshotFileName.c_str());
+		unlink(tmpFileName.c_str());
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * load the cache from a snapshot file saved with the same memory budget
+ *
+ * @param snapshotFileName - the name of the snapshot file
+ *
+ * @return - a boolean value that indicates if the load op succeeds (the cache is left empty otherwise)
+ */
+bool IndexCache::loadSnapshot(const std::string &snapshotFileName) {
+	indexCacheSnapshotHead_t snapshotHead;
+	std::string key, value;
+	int size;
+	long i;
+	bool loadStat = 1;
+	FILE *fp;
+
+	fp = fopen(snapshotFileName.c_str(), "rb");
+	if (fp == NULL) {
+		return 0;
+	}
+
+	if ((fread(&snapshotHead, sizeof(indexCacheSnapshotHead_t), 1, fp) != 1) ||
+			(snapshotHead.magic != INDEX_CACHE_SNAPSHOT_MAGIC) ||
+			(snapshotHead.memoryBudget != memoryBudget_) || (snapshotHead.numOfBuckets != numOfBuckets_)) {
+		fclose(fp);
+
+		return 0;
+	}
+
+	pthread_rwlock_wrlock(&filterLock_);
+
+	if (fread(filterTags_, numOfBuckets_ * CUCKOO_SLOTS_PER_BUCKET * sizeof(uint16_t), 1, fp) != 1) {
+		loadStat = 0;
+	}
+	numOfKeys_ = snapshotHead.numOfKeys;
+	filterValidStat_ = snapshotHead.filterValidStat;
+
+	for (i = 0; (i < snapshotHead.numOfEntries) && loadStat; i++) {
+		if ((fread(&size, sizeof(int), 1, fp) != 1) || (size < 0)) {
+			loadStat = 0;
+			break;
+		}
+		key.resize(size);
+		if ((size > 0) && (fread(&key[0], size, 1, fp) != 1)) {
+			loadStat = 0;
+			break;
+		}
+		if ((fread(&size, sizeof(int), 1, fp) != 1) || (size < 0)) {
+			loadStat = 0;
+			break;
+		}
+		value.resize(size);
+		if ((size > 0) && (fread(&value[0], size, 1, fp) != 1)) {
+			loadStat = 0;
+			break;
+		}
+
+		update(key, value);
+	}
+
+	/*a partial snapshot is useless, as the filter must hold all keys*/
+	if (!loadStat) {
+		memset(filterTags_, 0, numOfBuckets_ * CUCKOO_SLOTS_PER_BUCKET * sizeof(uint16_t));
+		numOfKeys_ = 0;
+		filterValidStat_ = 1;
+
+		for (int j = 0; j < NUM_INDEX_CACHE_SHARDS; j++) {
+			pthread_mutex_lock(&shards_[j].lock);
+			shards_[j].lruList.clear();
+			shards_[j].hotMap.clear();
+			shards_[j].usage = 0;
+			pthread_mutex_unlock(&shards_[j].lock);
+		}
+	}
+
+	pthread_rwlock_unlock(&filterLock_);
+
+	fclose(fp);
+
+	return loadStat;
+}
+
+/*
+ * print the statistics of the cache
+ */
+void IndexCache::printStat() {
+	long numOfEntries = 0;
+
+	for (int i = 0; i < NUM_INDEX_CACHE_SHARDS; i++) {
+		pthread_mutex_lock(&shards_[i].lock);
+		numOfEntries += shards_[i].lruList.size();
+		pthread_mutex_unlock(&shards_[i].lock);
+	}
+
+	pthread_rwlock_rdlock(&filterLock_);
+	fprintf(stderr, "Index cache: %ld keys in the filter (%s), %ld hot entries, %ld filter misses, %ld hits\n",
+			numOfKeys_, filterValidStat_ ? "valid" : "disabled", numOfEntries, numOfFilterMisses_, numOfHits_);
+	pthread_rwlock_unlock(&filterLock_);
+}
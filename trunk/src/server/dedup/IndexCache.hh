@@ -0,0 +1,235 @@
+/*
+ * IndexCache.hh
+ */
+
+#ifndef __INDEXCACHE_HH__
+#define __INDEXCACHE_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <unistd.h>
+#include <pthread.h>
+
+/*for the use of boost unordered_map*/
+#include <boost/unordered_map.hpp>
+
+/*macro for the default memory budget of the index cache*/
+#define DEFAULT_INDEX_CACHE_SIZE (64<<20)
+
+/*macro for the number of shards of the hot entry table*/
+#define NUM_INDEX_CACHE_SHARDS 64
+
+/*macros for the cuckoo filter (each slot holds a 16-bit tag)*/
+#define CUCKOO_SLOTS_PER_BUCKET 4
+#define CUCKOO_MAX_KICKS 500
+
+/*macro for the magic number of an index cache snapshot*/
+#define INDEX_CACHE_SNAPSHOT_MAGIC 0x43444943
+
+using namespace std;
+
+/*snapshot format: [indexCacheSnapshotHead_t + filter tags + (key size + key + value size + value) ...]*/
+
+/*the head structure of an index cache snapshot*/
+typedef struct {
+	int magic;
+	long memoryBudget;
+	long numOfBuckets;
+	long numOfKeys;
+	bool filterValidStat;
+	long numOfEntries;
+} indexCacheSnapshotHead_t;
+
+/*
+ * an in-memory cache of the share index, made of a cuckoo filter over all share keys
+ * (which answers definite misses) and a sharded LRU table of the values of hot share keys
+ *
+ * note: the caller must keep the filter complete (adding every new key before it can be looked up
+ * under the same lock), and keep the table consistent with the database (only inserting a value
+ * read or written under the lock of its key)
+ */
+class IndexCache {
+	private:
+		/*the entry structure of the hot entry table*/
+		typedef struct {
+			std::string key;
+			std::string value;
+		} hotEntry_t;
+
+		typedef std::list<hotEntry_t> lruList_t;
+		typedef boost::unordered_map<std::string, lruList_t::iterator> hotMap_t;
+
+		/*the shard structure of the hot entry table*/
+		typedef struct {
+			pthread_mutex_t lock;
+			lruList_t lruList;
+			hotMap_t hotMap;
+			long usage;
+		} hotShard_t;
+
+		/*the memory budget of the whole cache*/
+		long memoryBudget_;
+
+		/*the cuckoo filter (numOfBuckets_ is a power of 2)*/
+		uint16_t *filterTags_;
+		long numOfBuckets_;
+		long numOfKeys_;
+
+		/*a boolean value that indicates if the filter holds all keys (false after it overflows)*/
+		bool filterValidStat_;
+
+		/*the read-write lock of the filter*/
+		pthread_rwlock_t filterLock_;
+
+		/*the hot entry table*/
+		hotShard_t shards_[NUM_INDEX_CACHE_SHARDS];
+		long shardCapacity_;
+
+		/*statistics*/
+		long numOfFilterMisses_;
+		long numOfHits_;
+
+		/*
+		 * hash a key
+		 *
+		 * @param key - the key
+		 *
+		 * @return - the 64-bit hash of the key
+		 */
+		inline uint64_t hashKey_(const std::string &key);
+
+		/*
+		 * get the tag and the two candidate buckets of a key in the filter
+		 *
+		 * @param key - the key
+		 * @param tag - the tag <return>
+		 * @param bucket1 - the first bucket <return>
+		 * @param bucket2 - the second bucket <return>
+		 */
+		inline void filterPosition_(const std::string &key, uint16_t &tag, long &bucket1, long &bucket2);
+
+		/*
+		 * get the alternative bucket of a tag
+		 *
+		 * @param bucket - the current bucket of the tag
+		 * @param tag - the tag
+		 *
+		 * @return - the other bucket of the tag
+		 */
+		inline long altBucket_(const long &bucket, const uint16_t &tag);
+
+		/*
+		 * put a tag into a free slot of a bucket
+		 *
+		 * @param bucket - the bucket
+		 * @param tag - the tag
+		 *
+		 * @return - a boolean value that indicates if the bucket has a free slot
+		 */
+		inline bool putTag_(const long &bucket, const uint16_t &tag);
+
+		/*
+		 * check if a bucket holds a tag
+		 *
+		 * @param bucket - the bucket
+		 * @param tag - the tag
+		 *
+		 * @return - a boolean value that indicates if the tag is found
+		 */
+		inline bool hasTag_(const long &bucket, const uint16_t &tag);
+
+		/*
+		 * get the shard of a key in the hot entry table
+		 *
+		 * @param key - the key
+		 *
+		 * @return - the shard
+		 */
+		inline hotShard_t *shard_(const std::string &key);
+
+		/*
+		 * insert or replace an entry in a shard, and evict the least recently used entries over the capacity
+		 * (the caller holds the lock of the shard)
+		 *
+		 * @param targetShard - the shard
+		 * @param key - the key
+		 * @param value - the value
+		 */
+		void putEntry_(hotShard_t *targetShard, const std::string &key, const std::string &value);
+
+	public:
+		/*
+		 * constructor of IndexCache
+		 *
+		 * @param memoryBudget - the memory budget (in bytes), half for the filter and half for the hot entries
+		 */
+		IndexCache(long memoryBudget = DEFAULT_INDEX_CACHE_SIZE);
+
+		/*
+		 * destructor of IndexCache
+		 */
+		~IndexCache();
+
+		/*
+		 * check if a key may be in the index
+		 *
+		 * @param key - the key
+		 *
+		 * @return - a boolean value that is false only if the key is definitely not in the index
+		 */
+		bool mayContain(const std::string &key);
+
+		/*
+		 * add a new key into the filter
+		 *
+		 * @param key - the key
+		 */
+		void addKey(const std::string &key);
+
+		/*
+		 * look up the value of a hot key
+		 *
+		 * @param key - the key
+		 * @param value - the value <return>
+		 *
+		 * @return - a boolean value that indicates if the key is cached
+		 */
+		bool lookup(const std::string &key, std::string &value);
+
+		/*
+		 * insert or replace the value of a key in the hot entry table
+		 *
+		 * @param key - the key
+		 * @param value - the value
+		 */
+		void update(const std::string &key, const std::string &value);
+
+		/*
+		 * save the whole cache into a snapshot file
+		 *
+		 * @param snapshotFileName - the name of the snapshot file
+		 *
+		 * @return - a boolean value that indicates if the save op succeeds
+		 */
+		bool saveSnapshot(const std::string &snapshotFileName);
+
+		/*
+		 * load the cache from a snapshot file saved with the same memory budget
+		 *
+		 * @param snapshotFileName - the name of the snapshot file
+		 *
+		 * @return - a boolean value that indicates if the load op succeeds (the cache is left empty otherwise)
+		 */
+		bool loadSnapshot(const std::string &snapshotFileName);
+
+		/*
+		 * print the statistics of the cache
+		 */
+		void printStat();
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * ShareIndex.cc
+ */
+
+#include "ShareIndex.hh"
+
+using namespace std;
+
+/*
+ * constructor of LevelDBShareIndex
+ *
+ * @param db - the database
+ * @param keyPrefix - the prefix byte of the share keys
+ */
+LevelDBShareIndex::LevelDBShareIndex(leveldb::DB *db, char keyPrefix) {
+	db_ = db;
+	keyPrefix_ = keyPrefix;
+}
+
+/*
+ * look up the value of a key
+ *
+ * @param key - the key
+ * @param value - the value <return>
+ *
+ * @return - the status of the lookup (NotFound if the key is not in the index)
+ */
+leveldb::Status LevelDBShareIndex::get(const std::string &key, std::string &value) {
+	return db_->Get(readOptions_, key, &value);
+}
+
+/*
+ * look up the values of a list of keys together
+ *
+ * @param keyList - the keys
+ * @param valueList - the values of the keys <return>
+ * @param statList - the lookup status of the keys <return>
+ */
+void LevelDBShareIndex::multiGet(const std::vector<std::string> &keyList, std::vector<std::string> &valueList,
+		std::vector<leveldb::Status> &statList) {
+	std::vector<leveldb::Slice> keySliceList;
+	int i;
+
+	for (i = 0; i < (int) keyList.size(); i++) {
+		keySliceList.push_back(leveldb::Slice(keyList[i]));
+	}
+
+	statList = db_->MultiGet(readOptions_, keySliceList, &valueList);
+}
+
+/*
+ * insert or replace the values of a list of distinct keys atomically
+ *
+ * @param keyList - the keys
+ * @param valueList - the values of the keys
+ *
+ * @return - the status of the write
+ */
+leveldb::Status LevelDBShareIndex::write(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList) {
+	leveldb::WriteBatch batch;
+	int i;
+
+	for (i = 0; i < (int) keyList.size(); i++) {
+		batch.Put(keyList[i], valueList[i]);
+	}
+
+	return db_->Write(writeOptions_, &batch);
+}
+
+/*
+ * add the writes of a list of distinct keys to a write batch of the database
+ *
+ * @param keyList - the keys
+ * @param valueList - the values of the keys
+ * @param batch - the write batch
+ *
+ * @return - a boolean value that indicates if the writes are added to the batch
+ */
+bool LevelDBShareIndex::addToBatch(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList,
+		leveldb::WriteBatch &batch) {
+	int i;
+
+	for (i = 0; i < (int) keyList.size(); i++) {
+		batch.Put(keyList[i], valueList[i]);
+	}
+
+	return 1;
+}
+
+/*
+ * pass every key in the index to a handler
+ *
+ * @param keyHandler - the handler
+ * @param arg - the argument passed to the handler
+ *
+ * @return - the status of the scan
+ */
+leveldb::Status LevelDBShareIndex::scanKeys(void (*keyHandler)(void *arg, const std::string &key), void *arg) {
+	leveldb::Iterator *it = db_->NewIterator(readOptions_);
+
+	for (it->Seek(leveldb::Slice(&keyPrefix_, 1)); it->Valid() && (it->key()[0] == keyPrefix_); it->Next()) {
+		keyHandler(arg, it->key().ToString());
+	}
+
+	leveldb::Status scanStat = it->status();
+	delete it;
+
+	return scanStat;
+}
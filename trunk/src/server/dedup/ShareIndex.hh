@@ -0,0 +1,137 @@
+/*
+ * ShareIndex.hh
+ */
+
+#ifndef __SHAREINDEX_HH__
+#define __SHAREINDEX_HH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*for the use of LevelDB*/
+#include "leveldb/db.h"
+/*for the use of Slice*/
+#include "leveldb/slice.h"
+/*for the use of Status*/
+#include "leveldb/status.h"
+/*for the use of WriteBatch*/
+#include "leveldb/write_batch.h"
+
+/*macros for the share index engines*/
+#define LEVELDB_INDEX_ENGINE 0
+#define FPSTORE_INDEX_ENGINE 1
+
+using namespace std;
+
+/*
+ * the interface of the engine that stores the share index (the keys of all shares have the same size
+ * and the same prefix byte), with the status of each op reported as a LevelDB status
+ */
+class ShareIndex {
+	public:
+		/*
+		 * destructor of ShareIndex
+		 */
+		virtual ~ShareIndex() {}
+
+		/*
+		 * look up the value of a key
+		 *
+		 * @param key - the key
+		 * @param value - the value <return>
+		 *
+		 * @return - the status of the lookup (NotFound if the key is not in the index)
+		 */
+		virtual leveldb::Status get(const std::string &key, std::string &value) = 0;
+
+		/*
+		 * look up the values of a list of keys together
+		 *
+		 * @param keyList - the keys
+		 * @param valueList - the values of the keys <return>
+		 * @param statList - the lookup status of the keys <return>
+		 */
+		virtual void multiGet(const std::vector<std::string> &keyList, std::vector<std::string> &valueList,
+				std::vector<leveldb::Status> &statList) = 0;
+
+		/*
+		 * insert or replace the values of a list of distinct keys atomically
+		 *
+		 * @param keyList - the keys
+		 * @param valueList - the values of the keys
+		 *
+		 * @return - the status of the write
+		 */
+		virtual leveldb::Status write(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList) = 0;
+
+		/*
+		 * add the writes of a list of distinct keys to a write batch of the database shared with the 
+		 * other indices, if the engine keeps the share index in it (otherwise they are written by write())
+		 *
+		 * @param keyList - the keys
+		 * @param valueList - the values of the keys
+		 * @param batch - the write batch
+		 *
+		 * @return - a boolean value that indicates if the writes are added to the batch
+		 */
+		virtual bool addToBatch(const std::vector<std::string> & /*keyList*/,
+				const std::vector<std::string> & /*valueList*/, leveldb::WriteBatch & /*batch*/) { return 0; }
+
+		/*
+		 * pass every key in the index to a handler (the handler may write to the index, and 
+		 * the values it writes for the scanned keys do not add keys to the scan)
+		 *
+		 * @param keyHandler - the handler
+		 * @param arg - the argument passed to the handler
+		 *
+		 * @return - the status of the scan
+		 */
+		virtual leveldb::Status scanKeys(void (*keyHandler)(void *arg, const std::string &key), void *arg) = 0;
+
+		/*
+		 * make all written values durable, so that the index opens without recovery
+		 *
+		 * @return - a boolean value that indicates if the checkpoint op succeeds
+		 */
+		virtual bool checkpoint() { return 1; }
+};
+
+/*
+ * the share index engine on a LevelDB database shared with the other indices
+ */
+class LevelDBShareIndex : public ShareIndex {
+	private:
+		/*the database (not owned)*/
+		leveldb::DB *db_;
+		leveldb::ReadOptions readOptions_;
+		leveldb::WriteOptions writeOptions_;
+
+		/*the prefix byte of the share keys*/
+		char keyPrefix_;
+
+	public:
+		/*
+		 * constructor of LevelDBShareIndex
+		 *
+		 * @param db - the database
+		 * @param keyPrefix - the prefix byte of the share keys
+		 */
+		LevelDBShareIndex(leveldb::DB *db, char keyPrefix);
+
+		leveldb::Status get(const std::string &key, std::string &value);
+
+		void multiGet(const std::vector<std::string> &keyList, std::vector<std::string> &valueList,
+				std::vector<leveldb::Status> &statList);
+
+		leveldb::Status write(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList);
+
+		bool addToBatch(const std::vector<std::string> &keyList, const std::vector<std::string> &valueList,
+				leveldb::WriteBatch &batch);
+
+		leveldb::Status scanKeys(void (*keyHandler)(void *arg, const std::string &key), void *arg);
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -852,6 +853,61 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
 
+// Combine the merge operand at *input with the older entries of its user
+// key, and leave *input at the first entry that was not used.  The
+// combination is stored in *key (with the given sequence) and *value: a
+// value if it reaches a value, a deletion or the base level of the key,
+// else a merge operand to be resolved against the older levels.
+Status DBImpl::MergeCompactionEntries(CompactionState* compact,
+                                      Iterator* input,
+                                      SequenceNumber sequence,
+                                      std::string* key,
+                                      std::string* value) {
+  ParsedInternalKey ikey;
+  ParseInternalKey(input->key(), &ikey);  // Already checked by the caller
+  const std::string user_key = ikey.user_key.ToString();
+  MergeContext merge(options_.merge_operator);
+  ValueType type = kTypeMerge;
+  bool corrupt = false;
+  Status s;
+  if (!merge.AddOperand(user_key, input->value(), &s)) {
+    return s;
+  }
+  for (input->Next(); input->Valid(); input->Next()) {
+    if (!ParseInternalKey(input->key(), &ikey)) {
+      // Leave the error key (and what lies under it) as it is
+      corrupt = true;
+      break;
+    }
+    if (user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      if (!merge.AddOperand(user_key, input->value(), &s)) {
+        return s;
+      }
+    } else {
+      Slice base = input->value();
+      s = merge.Finish(user_key, ikey.type == kTypeValue ? &base : NULL,
+                       value);
+      type = kTypeValue;
+      input->Next();
+      break;
+    }
+  }
+  if (merge.pending()) {
+    if (!corrupt && compact->compaction->IsBaseLevelForKey(user_key)) {
+      s = merge.Finish(user_key, NULL, value);
+      type = kTypeValue;
+    } else {
+      merge.Release(value);
+    }
+  }
+  key->clear();
+  AppendInternalKey(key, ParsedInternalKey(user_key, sequence, type));
+  return s;
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
@@ -879,6 +935,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
+  std::string merged_key, merged_value;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
@@ -904,7 +961,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     // Handle key/value, add to state, etc.
+    Slice value = input->value();
     bool drop = false;
+    bool merged = false;    // input is already past the entries used
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -934,9 +993,27 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (ikey.type == kTypeMerge &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options_.merge_operator != NULL) {
+        // No snapshot sees the older entries of this user key on their
+        // own, so they are combined with this operand into one entry.
+        const SequenceNumber sequence = ikey.sequence;
+        status = MergeCompactionEntries(compact, input, sequence,
+                                        &merged_key, &merged_value);
+        if (!status.ok()) {
+          break;
+        }
+        key = merged_key;
+        value = merged_value;
+        merged = true;
+        ikey.sequence = sequence;
       }
 
-      last_sequence_for_key = ikey.sequence;
+      // An operand left as it is does not hide the older entries
+      if (ikey.type != kTypeMerge || merged) {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -960,7 +1037,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         compact->current_output()->smallest.DecodeFrom(key);
       }
       compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->builder->Add(key, value);
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
@@ -972,7 +1049,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
     }
 
-    input->Next();
+    if (!merged) {
+      input->Next();
+    }
   }
 
   if (status.ok() && shutting_down_.Acquire_Load()) {
@@ -1100,13 +1179,15 @@ Status DBImpl::Get(const ReadOptions& options,
   {
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
+    // The merge operands met on the way are carried down to older data.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    MergeContext merge(options_.merge_operator);
+    if (mem->Get(lkey, value, &s, &merge)) {
       // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+    } else if (imm != NULL && imm->Get(lkey, value, &s, &merge)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, &merge);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1121,12 +1202,88 @@ Status DBImpl::Get(const ReadOptions& options,
   return s;
 }
 
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const int n = keys.size();
+  std::vector<Status> statuses(n);
+  values->resize(n);
+  if (n == 0) {
+    return statuses;
+  }
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != NULL) {
+    snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != NULL) imm->Ref();
+  current->Ref();
+
+  bool have_stat_update = false;
+  Version::GetStats stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<MergeContext*> merges(n);
+    std::vector<const LookupKey*> file_keys;
+    std::vector<std::string*> file_values;
+    std::vector<Status*> file_statuses;
+    std::vector<MergeContext*> file_merges;
+    for (int i = 0; i < n; i++) {
+      // First look in the memtable, then in the immutable memtable (if any).
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      merges[i] = new MergeContext(options_.merge_operator);
+      if (mem->Get(*lkeys[i], &(*values)[i], &statuses[i], merges[i])) {
+        // Done
+      } else if (imm != NULL && imm->Get(*lkeys[i], &(*values)[i],
+                                         &statuses[i], merges[i])) {
+        // Done
+      } else {
+        file_keys.push_back(lkeys[i]);
+        file_values.push_back(&(*values)[i]);
+        file_statuses.push_back(&statuses[i]);
+        file_merges.push_back(merges[i]);
+      }
+    }
+    // Then look up the rest together in the current version
+    if (!file_keys.empty()) {
+      current->MultiGet(options, file_keys.size(), &file_keys[0],
+                        &file_values[0], &file_statuses[0], &stats,
+                        &file_merges[0]);
+      have_stat_update = true;
+    }
+    for (int i = 0; i < n; i++) {
+      delete lkeys[i];
+      delete merges[i];
+    }
+    mutex_.Lock();
+  }
+
+  if (have_stat_update && current->UpdateStats(stats)) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != NULL) imm->Unref();
+  current->Unref();
+  return statuses;
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
   return NewDBIterator(
-      this, user_comparator(), iter,
+      this, user_comparator(), options_.merge_operator, iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
@@ -1440,6 +1597,24 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses[i] = Get(options, keys[i], &(*values)[i]);
+  }
+  return statuses;
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
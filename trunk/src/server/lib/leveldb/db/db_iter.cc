@@ -7,8 +7,10 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -40,7 +42,8 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), or
+  //     past the entries that were merged into them (see merged_)
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -48,14 +51,16 @@ class DBIter: public Iterator {
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_op,
+         Iterator* iter, SequenceNumber s, uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_op),
         iter_(iter),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
@@ -65,11 +70,13 @@ class DBIter: public Iterator {
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ?
+        iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -88,6 +95,8 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  bool MergeForward(const ParsedInternalKey& ikey);
+  bool MergeBackward(const ParsedInternalKey& ikey, bool has_base);
   bool ParseKey(ParsedInternalKey* key);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
@@ -110,6 +119,7 @@ class DBIter: public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
 
@@ -118,6 +128,7 @@ class DBIter: public Iterator {
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;   // Forward, and saved_key_/saved_value_ hold a merged entry
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -162,6 +173,16 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is already past the merged entries, and saved_key_ already
+    // contains the key to skip past.
+    merged_ = false;
+    ClearSavedValue();
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -194,6 +215,16 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            // Leaves iter_ past the entries of the key that were merged
+            valid_ = MergeForward(ikey);
+            return;
+          }
+          break;
       }
     }
     iter_->Next();
@@ -202,10 +233,68 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Combine the merge operand at iter_ (whose key is "ikey") with the
+// older entries of its user key, store the result in saved_key_ and
+// saved_value_, and leave iter_ at the first entry that was not used.
+// Returns false (and sets status_) if the entries cannot be merged.
+bool DBIter::MergeForward(const ParsedInternalKey& ikey) {
+  MergeContext merge(merge_operator_);
+  SaveKey(ikey.user_key, &saved_key_);
+  ClearSavedValue();
+  if (!merge.AddOperand(saved_key_, iter_->value(), &status_)) {
+    saved_key_.clear();
+    return false;
+  }
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey older;
+    if (!ParseKey(&older)) {
+      saved_key_.clear();
+      return false;
+    }
+    if (user_comparator_->Compare(older.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (older.type == kTypeMerge) {
+      if (!merge.AddOperand(saved_key_, iter_->value(), &status_)) {
+        saved_key_.clear();
+        return false;
+      }
+    } else {
+      // A value or a deletion ends the entries of the key that are merged
+      Slice base = iter_->value();
+      status_ = merge.Finish(saved_key_,
+                             older.type == kTypeValue ? &base : NULL,
+                             &saved_value_);
+      iter_->Next();
+      break;
+    }
+  }
+  if (merge.pending()) {
+    status_ = merge.Finish(saved_key_, NULL, &saved_value_);
+  }
+  if (!status_.ok()) {
+    saved_key_.clear();
+    ClearSavedValue();
+    return false;
+  }
+  merged_ = true;
+  return true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
+    if (merged_) {
+      // iter_ is past the current entry.  Move it back to the newest
+      // entry of saved_key_, then use the code below.
+      merged_ = false;
+      std::string target;
+      AppendInternalKey(&target, ParsedInternalKey(saved_key_,
+                                                   kMaxSequenceNumber,
+                                                   kValueTypeForSeek));
+      iter_->Seek(target);
+    }
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
     assert(iter_->Valid());  // Otherwise valid_ would have been false
@@ -242,6 +331,20 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
+        if (ikey.type == kTypeMerge) {
+          // Combine the operand with the older entries of the key met so
+          // far (none if the last one was a deletion or another key)
+          if (!MergeBackward(ikey, value_type != kTypeDeletion)) {
+            valid_ = false;
+            saved_key_.clear();
+            ClearSavedValue();
+            direction_ = kForward;
+            return;
+          }
+          value_type = kTypeMerge;
+          iter_->Prev();
+          continue;
+        }
         value_type = ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
@@ -271,7 +374,30 @@ void DBIter::FindPrevUserEntry() {
   }
 }
 
+// Combine the merge operand at iter_ (whose key is "ikey") into
+// saved_value_, which holds the combination of the older entries of the
+// key if "has_base" is true.  Returns false (and sets status_) if they
+// cannot be merged.
+bool DBIter::MergeBackward(const ParsedInternalKey& ikey, bool has_base) {
+  if (merge_operator_ == NULL) {
+    status_ = Status::NotSupported(
+        "merge operand without a merge operator for ", ikey.user_key);
+    return false;
+  }
+  std::string combined;
+  Slice base(saved_value_);
+  if (!merge_operator_->Merge(ikey.user_key, has_base ? &base : NULL,
+                              iter_->value(), &combined)) {
+    status_ = Status::Corruption("failed to merge value for ", ikey.user_key);
+    return false;
+  }
+  SaveKey(ikey.user_key, &saved_key_);
+  saved_value_.swap(combined);
+  return true;
+}
+
 void DBIter::Seek(const Slice& target) {
+  merged_ = false;
   direction_ = kForward;
   ClearSavedValue();
   saved_key_.clear();
@@ -286,6 +412,7 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  merged_ = false;
   direction_ = kForward;
   ClearSavedValue();
   iter_->SeekToFirst();
@@ -297,6 +424,7 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  merged_ = false;
   direction_ = kReverse;
   ClearSavedValue();
   iter_->SeekToLast();
@@ -308,10 +436,12 @@ void DBIter::SeekToLast() {
 Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
     uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+  return new DBIter(db, user_key_comparator, merge_operator, internal_iter,
+                    sequence, seed);
 }
 
 }  // namespace leveldb
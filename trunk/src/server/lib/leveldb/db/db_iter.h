@@ -12,13 +12,16 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are combined with
+// "*merge_operator" (which may be NULL if the DB holds none).
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
     uint32_t seed);
@@ -10,6 +10,7 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/table.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -306,6 +307,29 @@ class DBTest {
     return result;
   }
 
+  // Return the results of looking up "keys" together, formatted like
+  // the results of Get() separated by commas.
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> s = db_->MultiGet(options, key_slices, &values);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      if (s[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!s[i].ok()) {
+        result += s[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -362,6 +386,9 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
           }
         }
         iter->Next();
@@ -657,6 +684,223 @@ TEST(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    std::vector<std::string> keys;
+    ASSERT_EQ("", MultiGet(keys));
+
+    // Spread the keys over level-0, a non-level-0 level and the memtable
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("x", "vx"));
+    ASSERT_OK(Put("d", "vd1"));
+    Compact("a", "z");
+    ASSERT_OK(Put("d", "vd2"));
+    ASSERT_OK(Put("f", "vf"));
+    ASSERT_OK(Delete("x"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("m", "vm"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("m", "vm2"));
+    ASSERT_OK(Delete("a"));
+
+    // Unsorted, repeated and missing keys
+    keys.push_back("x");
+    keys.push_back("m");
+    keys.push_back("d");
+    keys.push_back("b");
+    keys.push_back("f");
+    keys.push_back("d");
+    keys.push_back("a");
+    ASSERT_EQ("NOT_FOUND,vm2,vd2,NOT_FOUND,vf,vd2,NOT_FOUND", MultiGet(keys));
+    ASSERT_EQ("NOT_FOUND,vm,vd2,NOT_FOUND,vf,vd2,va",
+              MultiGet(keys, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+namespace {
+// Adds decimal numbers, so that merges are easy to check.
+class AddOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const { return "leveldb.test.AddOperator"; }
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& value, std::string* new_value) const {
+    long long sum = atoll(value.ToString().c_str());
+    if (existing_value != NULL) {
+      sum += atoll(existing_value->ToString().c_str());
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", sum);
+    new_value->assign(buf);
+    return true;
+  }
+};
+}
+
+TEST(DBTest, MergeGet) {
+  AddOperator add;
+  Options options = CurrentOptions();
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_OK(Put("b", "10"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "5"));
+  ASSERT_OK(Put("c", "10"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "7"));
+  ASSERT_EQ("3", Get("a"));
+  ASSERT_EQ("15", Get("b"));
+  ASSERT_EQ("7", Get("c"));
+
+  // Operands split between the memtable and a table
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "4"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+  ASSERT_EQ("7", Get("a"));
+  ASSERT_EQ("16", Get("b"));
+  ASSERT_EQ("7", Get("c"));
+  ASSERT_EQ("(a->7)(b->16)(c->7)", Contents());
+
+  // Operands split between levels, then resolved by a full compaction
+  Compact("a", "z");
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "100"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("116", Get("b"));
+  Compact("a", "z");
+  ASSERT_EQ("[ 7 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ 116 ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ 7 ]", AllEntriesFor("c"));
+
+  Reopen(&options);
+  ASSERT_EQ("(a->7)(b->116)(c->7)", Contents());
+}
+
+TEST(DBTest, MergeSnapshot) {
+  AddOperator add;
+  Options options = CurrentOptions();
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+  ASSERT_EQ("6", Get("a"));
+  ASSERT_EQ("3", Get("a", snapshot));
+
+  // The entries under the snapshot are combined, the newer one is kept
+  Compact("a", "z");
+  ASSERT_EQ("[ MERGE(3), 3 ]", AllEntriesFor("a"));
+  ASSERT_EQ("6", Get("a"));
+  ASSERT_EQ("3", Get("a", snapshot));
+
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "4"));
+  Compact("a", "z");
+  ASSERT_EQ("[ 10 ]", AllEntriesFor("a"));
+}
+
+TEST(DBTest, MergeOperandsAboveBaseLevel) {
+  AddOperator add;
+  Options options = CurrentOptions();
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  // Push a value to level-2, then compact operands from level-0 to level-1
+  ASSERT_OK(Put("a", "100"));
+  ASSERT_OK(Put("z", "0"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_OK(Put("z", "0"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+  ASSERT_OK(Put("z", "0"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+
+  // The operands are combined, but stay an operand of the older value
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("[ MERGE(6), 100 ]", AllEntriesFor("a"));
+  ASSERT_EQ("106", Get("a"));
+  ASSERT_EQ("(a->106)(z->0)", Contents());
+}
+
+TEST(DBTest, MergeMultiGet) {
+  AddOperator add;
+  Options options = CurrentOptions();
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "10"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "20"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "30"));
+  std::vector<std::string> keys;
+  keys.push_back("c");
+  keys.push_back("a");
+  keys.push_back("d");
+  keys.push_back("b");
+  ASSERT_EQ("30,11,NOT_FOUND,22", MultiGet(keys));
+}
+
+TEST(DBTest, MergeIterator) {
+  AddOperator add;
+  Options options = CurrentOptions();
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "3"));
+  ASSERT_OK(Put("c", "4"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "5"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->5");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->4");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->5");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->1");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->5");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->1");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "d->5");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->4");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->5");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->4");
+  iter->Seek("d");
+  ASSERT_EQ(IterStatus(iter), "d->5");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->4");
+  delete iter;
+}
+
+TEST(DBTest, MergeWithoutOperator) {
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_TRUE(Get("a").find("Not implemented") != std::string::npos);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+}
+
 TEST(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -986,6 +1230,40 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, MultiGetMatchesGet) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Build many files over several levels, with deletions and overwrites
+  Random rnd(301);
+  for (int i = 0; i < 3000; i++) {
+    const int k = rnd.Uniform(2000);
+    if (rnd.OneIn(5)) {
+      ASSERT_OK(Delete(Key(k)));
+    } else {
+      ASSERT_OK(Put(Key(k), RandomString(&rnd, 100 + rnd.Uniform(400))));
+    }
+    if (i == 2000) {
+      dbfull()->TEST_CompactRange(0, NULL, NULL);
+    }
+  }
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  for (int round = 0; round < 20; round++) {
+    std::vector<std::string> keys;
+    std::string expected;
+    const int n = 1 + rnd.Uniform(500);
+    for (int i = 0; i < n; i++) {
+      // Include keys that were never written
+      keys.push_back(Key(rnd.Uniform(2200)));
+      if (i > 0) expected += ",";
+      expected += Get(keys[i]);
+    }
+    ASSERT_EQ(expected, MultiGet(keys));
+  }
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -4,6 +4,7 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -105,11 +106,12 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   table_.Insert(buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (; iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -124,19 +126,32 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue:
+        if (merge->pending()) {
+          *s = merge->Finish(key.user_key(), &v, value);
+        } else {
           value->assign(v.data(), v.size());
-          return true;
         }
-        case kTypeDeletion:
+        return true;
+      case kTypeDeletion:
+        if (merge->pending()) {
+          *s = merge->Finish(key.user_key(), NULL, value);
+        } else {
           *s = Status::NotFound(Slice());
+        }
+        return true;
+      case kTypeMerge:
+        if (!merge->AddOperand(key.user_key(), v, s)) {
           return true;
-      }
+        }
+        break;      // Keep looking for older entries of the key
     }
   }
   return false;
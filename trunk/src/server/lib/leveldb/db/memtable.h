@@ -14,6 +14,7 @@
 namespace leveldb {
 
 class InternalKeyComparator;
+class MergeContext;
 class Mutex;
 class MemTableIterator;
 
@@ -60,8 +61,12 @@ class MemTable {
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
+  // Merge operands for key are added to *merge until a value or a deletion
+  // resolves them (then the merged value is stored in *value and the
+  // merge status in *status, and true is returned).
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
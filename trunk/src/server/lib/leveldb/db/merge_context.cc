@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_context.h"
+
+#include <assert.h>
+
+namespace leveldb {
+
+bool MergeContext::AddOperand(const Slice& user_key, const Slice& operand,
+                              Status* s) {
+  if (merge_operator_ == NULL) {
+    *s = Status::NotSupported("merge operand without a merge operator for ",
+                              user_key);
+    return false;
+  }
+  if (!pending_) {
+    operand_.assign(operand.data(), operand.size());
+    pending_ = true;
+    return true;
+  }
+  std::string combined;
+  if (!merge_operator_->Merge(user_key, &operand, operand_, &combined)) {
+    *s = Status::Corruption("failed to merge operands for ", user_key);
+    return false;
+  }
+  operand_.swap(combined);
+  return true;
+}
+
+Status MergeContext::Finish(const Slice& user_key, const Slice* base,
+                            std::string* value) {
+  assert(pending_);
+  pending_ = false;
+  value->clear();
+  if (!merge_operator_->Merge(user_key, base, operand_, value)) {
+    return Status::Corruption("failed to merge value for ", user_key);
+  }
+  return Status::OK();
+}
+
+void MergeContext::Release(std::string* operand) {
+  assert(pending_);
+  pending_ = false;
+  operand->swap(operand_);
+  operand_.clear();
+}
+
+}  // namespace leveldb
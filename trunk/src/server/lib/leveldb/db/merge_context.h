@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+#define STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+
+#include <string>
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// MergeContext folds the merge operands of one user key, met from the
+// newest to the oldest while a lookup walks down the memtables and the
+// tables, until it reaches a value, a deletion or the end of the data.
+// As the merge operator is associative, the operands are combined as
+// they come, so that only one partial result is kept.
+class MergeContext {
+ public:
+  explicit MergeContext(const MergeOperator* merge_operator)
+      : merge_operator_(merge_operator),
+        pending_(false) {
+  }
+
+  // Returns true iff operands have been added but not resolved yet.
+  bool pending() const { return pending_; }
+
+  // Add an operand older than all the operands added so far.  Returns
+  // false and stores the error in *s if it cannot be combined.
+  bool AddOperand(const Slice& user_key, const Slice& operand, Status* s);
+
+  // Combine the operands with "base" (the value under them, or NULL if
+  // there is none), store the result in *value and return the status.
+  Status Finish(const Slice& user_key, const Slice* base, std::string* value);
+
+  // Store the combination of the operands in *operand, to be resolved
+  // later against older data, and clear them.
+  void Release(std::string* operand);
+
+ private:
+  const MergeOperator* merge_operator_;
+  bool pending_;
+  std::string operand_;   // The combination of the operands added so far
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
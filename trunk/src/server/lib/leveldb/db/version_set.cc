@@ -10,6 +10,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -262,27 +263,54 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMergeFailed,
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  MergeContext* merge;
+  Status merge_status;
 };
 }
-static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
+// Returns true if the entries after "ikey" are wanted too, that is if
+// "ikey" is a merge operand of the key.
+static bool SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   Saver* s = reinterpret_cast<Saver*>(arg);
   ParsedInternalKey parsed_key;
   if (!ParseInternalKey(ikey, &parsed_key)) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      switch (parsed_key.type) {
+        case kTypeValue:
+          if (s->merge->pending()) {
+            s->merge_status = s->merge->Finish(s->user_key, &v, s->value);
+            s->state = s->merge_status.ok() ? kFound : kMergeFailed;
+          } else {
+            s->value->assign(v.data(), v.size());
+            s->state = kFound;
+          }
+          break;
+        case kTypeDeletion:
+          if (s->merge->pending()) {
+            s->merge_status = s->merge->Finish(s->user_key, NULL, s->value);
+            s->state = s->merge_status.ok() ? kFound : kMergeFailed;
+          } else {
+            s->state = kDeleted;
+          }
+          break;
+        case kTypeMerge:
+          if (!s->merge->AddOperand(s->user_key, v, &s->merge_status)) {
+            s->state = kMergeFailed;
+            break;
+          }
+          return true;    // Keep searching for older entries of the key
       }
     }
   }
+  return false;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -337,7 +365,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    MergeContext* merge) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -410,6 +439,7 @@ Status Version::Get(const ReadOptions& options,
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.merge = merge;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
       if (!s.ok()) {
@@ -426,13 +456,213 @@ Status Version::Get(const ReadOptions& options,
         case kCorrupt:
           s = Status::Corruption("corrupted key for ", user_key);
           return s;
+        case kMergeFailed:
+          return saver.merge_status;
       }
     }
   }
 
+  if (merge->pending()) {
+    // The operands apply to a key that has no value
+    return merge->Finish(user_key, NULL, value);
+  }
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+namespace {
+// Orders the keys of a MultiGet by user key
+struct LookupKeyOrder {
+  const Comparator* ucmp;
+  const LookupKey* const* keys;
+
+  bool operator()(int a, int b) const {
+    return ucmp->Compare(keys[a]->user_key(), keys[b]->user_key()) < 0;
+  }
+};
+
+// State of the keys of a MultiGet
+struct MultiGetState {
+  const ReadOptions* options;
+  const LookupKey* const* keys;
+  Status* const* statuses;
+  Version::GetStats* stats;
+  std::vector<Saver> savers;
+  std::vector<char> done;
+  std::vector<FileMetaData*> first_file;
+  std::vector<int> first_file_level;
+
+  // Scratch space of ProbeFile()
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+};
+}
+
+// Probe "f" for the keys whose indexes are in "batch", and mark the keys
+// that are resolved by it as done.
+static void ProbeFile(TableCache* table_cache, MultiGetState* state,
+                      FileMetaData* f, int level,
+                      const std::vector<int>& batch) {
+  if (batch.empty()) return;
+
+  state->ikeys.clear();
+  state->args.clear();
+  for (size_t i = 0; i < batch.size(); i++) {
+    const int k = batch[i];
+    if (state->first_file[k] == NULL) {
+      state->first_file[k] = f;
+      state->first_file_level[k] = level;
+    } else if (state->stats->seek_file == NULL) {
+      // We have had more than one seek for this read.  Charge the 1st file.
+      state->stats->seek_file = state->first_file[k];
+      state->stats->seek_file_level = state->first_file_level[k];
+    }
+    state->ikeys.push_back(state->keys[k]->internal_key());
+    state->args.push_back(&state->savers[k]);
+  }
+
+  Status s = table_cache->MultiGet(*state->options, f->number, f->file_size,
+                                   batch.size(), &state->ikeys[0],
+                                   &state->args[0], SaveValue);
+  for (size_t i = 0; i < batch.size(); i++) {
+    const int k = batch[i];
+    if (!s.ok()) {
+      *state->statuses[k] = s;
+      state->done[k] = true;
+      continue;
+    }
+    switch (state->savers[k].state) {
+      case kNotFound:
+        break;      // Keep searching in other files
+      case kFound:
+        *state->statuses[k] = Status::OK();
+        state->done[k] = true;
+        break;
+      case kDeleted:
+        *state->statuses[k] = Status::NotFound(Slice());
+        state->done[k] = true;
+        break;
+      case kCorrupt:
+        *state->statuses[k] = Status::Corruption("corrupted key for ",
+                                                 state->savers[k].user_key);
+        state->done[k] = true;
+        break;
+      case kMergeFailed:
+        *state->statuses[k] = state->savers[k].merge_status;
+        state->done[k] = true;
+        break;
+    }
+  }
+}
+
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys,
+                       std::string* const* vals, Status* const* statuses,
+                       GetStats* stats, MergeContext* const* merges) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  stats->seek_file = NULL;
+  stats->seek_file_level = -1;
+
+  MultiGetState state;
+  state.options = &options;
+  state.keys = keys;
+  state.statuses = statuses;
+  state.stats = stats;
+  state.savers.resize(n);
+  state.done.resize(n, false);
+  state.first_file.resize(n, NULL);
+  state.first_file_level.resize(n, -1);
+
+  // Keys still to be searched, in increasing key order
+  std::vector<int> pending(n);
+  for (int i = 0; i < n; i++) {
+    pending[i] = i;
+    state.savers[i].state = kNotFound;
+    state.savers[i].ucmp = ucmp;
+    state.savers[i].user_key = keys[i]->user_key();
+    state.savers[i].value = vals[i];
+    state.savers[i].merge = merges[i];
+    *statuses[i] = Status::NotFound(Slice());
+  }
+  LookupKeyOrder order;
+  order.ucmp = ucmp;
+  order.keys = keys;
+  std::sort(pending.begin(), pending.end(), order);
+
+  // As in Get(), entries never hop across levels, so a key found in a
+  // smaller level is not searched in later levels.
+  std::vector<FileMetaData*> tmp;
+  std::vector<int> batch;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Probe them in order from
+      // newest to oldest, each for the pending keys it overlaps.
+      tmp = files_[0];
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (uint32_t i = 0; i < tmp.size(); i++) {
+        FileMetaData* f = tmp[i];
+        batch.clear();
+        for (size_t p = 0; p < pending.size(); p++) {
+          const int k = pending[p];
+          if (!state.done[k] &&
+              ucmp->Compare(keys[k]->user_key(), f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(keys[k]->user_key(), f->largest.user_key()) <= 0) {
+            batch.push_back(k);
+          }
+        }
+        ProbeFile(vset_->table_cache_, &state, f, 0, batch);
+      }
+    } else {
+      // Files do not overlap, so the sorted keys that fall in a file are
+      // consecutive.
+      size_t p = 0;
+      while (p < pending.size()) {
+        // Binary search to find earliest index whose largest key >= ikey.
+        uint32_t index = FindFile(vset_->icmp_, files_[level],
+                                  keys[pending[p]]->internal_key());
+        if (index >= num_files) {
+          // This key and all the keys after it are past the last file
+          break;
+        }
+        FileMetaData* f = files_[level][index];
+        batch.clear();
+        while (p < pending.size() &&
+               vset_->icmp_.Compare(keys[pending[p]]->internal_key(),
+                                    f->largest.Encode()) <= 0) {
+          const int k = pending[p];
+          if (ucmp->Compare(keys[k]->user_key(), f->smallest.user_key()) >= 0) {
+            batch.push_back(k);
+          }
+          // Otherwise all of "f" is past any data for the key
+          p++;
+        }
+        ProbeFile(vset_->table_cache_, &state, f, level, batch);
+      }
+    }
+
+    // Drop the keys resolved in this level
+    size_t remaining = 0;
+    for (size_t p = 0; p < pending.size(); p++) {
+      if (!state.done[pending[p]]) {
+        pending[remaining++] = pending[p];
+      }
+    }
+    pending.resize(remaining);
+  }
+
+  // The operands of the keys left apply to keys that have no value
+  for (size_t p = 0; p < pending.size(); p++) {
+    const int k = pending[p];
+    if (merges[k]->pending()) {
+      *statuses[k] = merges[k]->Finish(keys[k]->user_key(), NULL, vals[k]);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != NULL) {
@@ -30,6 +30,7 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -64,14 +65,25 @@ class Version {
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  Fills *stats.  The merge
+  // operands found are folded into *merge, which may already hold the
+  // newer operands of the key.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, MergeContext* merge);
+
+  // Lookup the values for n keys, as if by calling Get() for each of
+  // them.  Sets (*statuses)[i] and, if found, (*vals)[i] for keys[i].
+  // The keys that fall in the same file are probed together, in key
+  // order.  Fills *stats.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* vals, Status* const* statuses,
+                GetStats* stats, MergeContext* const* merges);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator combines the operands written by WriteBatch::Merge()
+// with the value of a key.  Merges are blind writes: the operands are
+// stored as they are and combined when the key is read, and when the
+// entries of the key meet during a compaction.
+//
+// The operation must be associative:
+//    Merge(Merge(a, b), c) == Merge(a, Merge(b, c))
+// because the operands may be combined with each other before they are
+// combined with the value they apply to.  Combining with a missing value
+// (existing_value == NULL) must give the same result as combining with
+// the value that the key would have if the operand were its first write.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the merge operator.
+  virtual const char* Name() const = 0;
+
+  // Combine "value" (the newer operand) into "existing_value" (the older
+  // value or operand of "key", or NULL if there is none), and store the
+  // result in *new_value.
+  //
+  // Returns false if the operands cannot be combined, which is reported
+  // as a corruption.
+  virtual bool Merge(const Slice& key,
+                     const Slice* existing_value,
+                     const Slice& value,
+                     std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -14,6 +14,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -135,6 +136,16 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL, use the specified operator to combine the operands
+  // written by WriteBatch::Merge() with the values of their keys.
+  //
+  // REQUIRES: a DB that contains merge operands must be opened with the
+  // same operator.  Reading a merged key without an operator fails with
+  // a NotSupported status.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -63,13 +63,22 @@ class Table {
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key), and then with the entries after it for as long as
+  // (*handle_result) returns true (e.g. while it collects merge operands).
+  // May not make such a call if filter policy says that key is not present.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
-      void (*handle_result)(void* arg, const Slice& k, const Slice& v));
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
+
+  // Like InternalGet() for each of the n keys, which must be sorted in
+  // increasing order.  The index block is walked once, and consecutive
+  // keys that fall in the same data block share a single read of it.
+  Status InternalMultiGet(
+      const ReadOptions&, int n, const Slice* keys,
+      void* const* args,
+      bool (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
 
   void ReadMeta(const Footer& footer);
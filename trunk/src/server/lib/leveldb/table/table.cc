@@ -213,9 +213,46 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+// Pass the entries after the one at "block_iter" to (*saver) for as long
+// as it asks for more.  The entries of a key may run past the end of the
+// block, and then the rest are read through a table iterator.
+static Status PassFollowingEntries(const Table* table,
+                                   const ReadOptions& options,
+                                   Iterator* block_iter, void* arg,
+                                   bool (*saver)(void*, const Slice&,
+                                                 const Slice&)) {
+  std::string last_key;
+  bool more = true;
+  while (more) {
+    last_key.assign(block_iter->key().data(), block_iter->key().size());
+    block_iter->Next();
+    if (!block_iter->Valid()) {
+      break;
+    }
+    more = (*saver)(arg, block_iter->key(), block_iter->value());
+  }
+  Status s = block_iter->status();
+  if (!more || !s.ok()) {
+    return s;
+  }
+
+  Iterator* iter = table->NewIterator(options);
+  iter->Seek(last_key);
+  if (iter->Valid()) {
+    iter->Next();     // Internal keys are unique, so the seek found last_key
+  }
+  while (more && iter->Valid()) {
+    more = (*saver)(arg, iter->key(), iter->value());
+    iter->Next();
+  }
+  s = iter->status();
+  delete iter;
+  return s;
+}
+
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          bool (*saver)(void*, const Slice&, const Slice&)) {
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
@@ -230,13 +267,68 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*saver)(arg, block_iter->key(), block_iter->value());
+      if (block_iter->Valid() &&
+          (*saver)(arg, block_iter->key(), block_iter->value())) {
+        s = PassFollowingEntries(this, options, block_iter, arg, saver);
       }
-      s = block_iter->status();
+      if (s.ok()) {
+        s = block_iter->status();
+      }
+      delete block_iter;
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               bool (*saver)(void*, const Slice&,
+                                             const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  Iterator* iiter = rep_->index_block->NewIterator(cmp);
+  Iterator* block_iter = NULL;
+  std::string block_handle;  // Encoded handle of the block in block_iter
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    // Keys are sorted, so the index entry found for the previous key is
+    // still the right one unless k is past the end of its block.
+    if (i == 0 || !iiter->Valid() || cmp->Compare(k, iiter->key()) > 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      // k and all the keys after it are past the last block
+      break;
+    }
+    Slice handle_value = iiter->value();
+    FilterBlockReader* filter = rep_->filter;
+    BlockHandle handle;
+    if (filter != NULL &&
+        handle.DecodeFrom(&handle_value).ok() &&
+        !filter->KeyMayMatch(handle.offset(), k)) {
+      // Not found
+      continue;
+    }
+    if (block_iter == NULL || iiter->value() != Slice(block_handle)) {
       delete block_iter;
+      block_iter = BlockReader(this, options, iiter->value());
+      block_handle.assign(iiter->value().data(), iiter->value().size());
+    }
+    block_iter->Seek(k);
+    if (block_iter->Valid() &&
+        (*saver)(args[i], block_iter->key(), block_iter->value())) {
+      // The next key seeks block_iter again, so it can be moved on here
+      s = PassFollowingEntries(this, options, block_iter, args[i], saver);
+    }
+    if (s.ok()) {
+      s = block_iter->status();
     }
   }
+  delete block_iter;
   if (s.ok()) {
     s = iiter->status();
   }
@@ -1,3 +1,5 @@
+#include <signal.h>
+
 #include "server.hh"
 #include "DedupCore.hh"
 #include "CryptoPrimitive.hh"
@@ -8,6 +10,23 @@ DedupCore* dedupObj;
 
 Server* server;
 
+/* signals that shut the server down */
+sigset_t shutdownSignals;
+
+/*
+ * wait for a shutdown signal, then stop the server (main goes on with the shutdown once the server returns)
+ */
+void* shutdownHandler(void* /*param*/){
+	int sig;
+
+	sigwait(&shutdownSignals, &sig);
+	fprintf(stderr, "\nShutting down on signal %d\n", sig);
+
+	server->stop();
+
+	return NULL;
+}
+
 int main(int argv, char** argc){
 
 	/* enable openssl locks */
@@ -17,19 +36,56 @@ int main(int argv, char** argc){
 		exit(1); 
 	}
 
+	/* a client may close its connection in the middle of a restore, report it as a send error instead */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* block shutdown signals in all threads, they are taken by the shutdown thread */
+	sigemptyset(&shutdownSignals);
+	sigaddset(&shutdownSignals, SIGINT);
+	sigaddset(&shutdownSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &shutdownSignals, NULL);
+
+	/* further share container dirs (e.g. one per disk), separated by ':' */
+	std::vector<std::string> extraContainerDirNames;
+	if (argv > 5) {
+		std::string dirList = argc[5];
+		size_t prePos = 0, currPos;
+
+		while ((currPos = dirList.find(':', prePos)) != std::string::npos) {
+			if (currPos > prePos) {
+				extraContainerDirNames.push_back(dirList.substr(prePos, currPos - prePos));
+			}
+			prePos = currPos + 1;
+		}
+		if (prePos < dirList.size()) {
+			extraContainerDirNames.push_back(dirList.substr(prePos));
+		}
+	}
+
 	/* initialize objects */
 	BackendStorer* recipeStorerObj = NULL;
 	BackendStorer* containerStorerObj = NULL;
-	dedupObj = new DedupCore("./","meta/DedupDB","meta/RecipeFiles","meta/ShareContainers",recipeStorerObj, containerStorerObj);
+	dedupObj = new DedupCore("./","meta/DedupDB","meta/RecipeFiles","meta/ShareContainers",recipeStorerObj, containerStorerObj,
+			argv > 3 ? atol(argc[3]) << 20 : DEFAULT_INDEX_CACHE_SIZE,
+			(argv > 4 && strcmp(argc[4], "fpstore") == 0) ? FPSTORE_INDEX_ENGINE : LEVELDB_INDEX_ENGINE,
+			extraContainerDirNames);
 
 	/* initialize server object */
-	server = new Server(atoi(argc[1]), dedupObj);
+	server = new Server(atoi(argc[1]), dedupObj, argv > 2 ? atoi(argc[2]) : DEFAULT_LISTEN_BACKLOG);
+
+	/* a shutdown signal received meanwhile stays pending until the shutdown thread waits for it */
+	pthread_t shutdownThread;
+	pthread_create(&shutdownThread, NULL, shutdownHandler, NULL);
 
-	/* run server service */
+	/* run server service, until it is stopped and the workers have processed the queued messages */
 	server->runReceive();
 
+	/* flush the buffered recipes and share containers, then wait for the container writers, 
+	 * checkpoint the share index and save the index cache */
+	bool shutdownStat = dedupObj->cleanupAllBufferNodes() && dedupObj->saveIndexCache();
+
 	/* openssl lock cleanup */
 	CryptoPrimitive::opensslLockCleanup();
 
-	return 0;
+	return shutdownStat ? 0 : 1;
 }